@@ -68,9 +68,10 @@ int main(int argc, char ** argv){
   CXI_Dataset_Reference * dataset_ref  = cxi_create_dataset(det->handle, dataset, CXI_Data_Type);
   if(!dataset_ref) return -1;
   
-  int data_buffer[10] = {1,2,3,4,5,6,7,8,9,10};
-  /* Write data to dataset. Specify the datatype of the data in memory. */
-  if(cxi_write_dataset(dataset, data_buffer, H5T_NATIVE_INT)) return -1;
+  short data_buffer[10] = {1,2,3,4,5,6,7,8,9,10};
+  /* Write data to dataset. Specify the datatype of the data in memory.
+     Using the file datatype in memory skips the type conversion. */
+  if(cxi_write_dataset(dataset, data_buffer, H5T_NATIVE_SHORT)) return -1;
   /* Note that you can only create the link after cxi_create_dataset */
   cxi_create_data_link(entry,dataset);
 
@@ -92,9 +93,9 @@ int main(int argc, char ** argv){
   dataset_ref  = cxi_create_dataset(det->handle, dataset, CXI_Data_Type);
   if(!dataset_ref) return -1;
   
-  int data2_buffer[10] = {11,12,13,14,15,16,17,18,19,20};
+  short data2_buffer[10] = {11,12,13,14,15,16,17,18,19,20};
   /* Write data to dataset. Specify the datatype of the data in memory. */
-  if(cxi_write_dataset(dataset, data2_buffer, H5T_NATIVE_INT)) return -1;
+  if(cxi_write_dataset(dataset, data2_buffer, H5T_NATIVE_SHORT)) return -1;
   cxi_create_data_link(entry,dataset);
 
   return 0;
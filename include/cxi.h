@@ -66,6 +66,7 @@
 #pragma once 
 
 #include <hdf5.h>
+#include <stdint.h>
 
 #ifdef __cplusplus 
 extern "C"{
@@ -100,6 +101,21 @@ extern "C"{
     CXI_Reciprocal_Coordinates_Type     
   }CXI_Dataset_Type;
 
+  /*! \name Mask bits
+   *  Meaning of the bits of a pixel \p mask.
+   *  \see CXI_Image::mask
+   *  \{
+   */
+#define CXI_PIXEL_IS_VALID       0x00000001
+#define CXI_PIXEL_IS_SATURATED   0x00000002
+#define CXI_PIXEL_IS_HOT         0x00000004
+#define CXI_PIXEL_IS_DEAD        0x00000008
+#define CXI_PIXEL_IS_SHADOWED    0x00000010
+#define CXI_PIXEL_IS_PARASITIC   0x00000020
+#define CXI_PIXEL_HAS_SIGNAL     0x00000040
+#define CXI_PIXEL_INSIDE_SUPPORT 0x00000200
+  /*! \} */
+
   /*! Possible spaces for an image. 
    */
   typedef enum{
@@ -141,6 +157,68 @@ extern "C"{
   }CXI_Image_Dimensionality;
 
 
+  /*! Memory owned by an open CXI_File. Opaque.
+   *
+   * Everything opened through the references of a file, structs, strings
+   * and HDF5 handles, is allocated from the file's arena and released with
+   * it by cxi_close_file(). References record the arena in their last field,
+   * \p arena, which is set by the library; references built by hand must be
+   * zero initialized, so that what they open is allocated individually, or
+   * get the arena of the file they belong to. The field is kept last so that
+   * the others keep their offsets.
+   */
+  typedef struct CXI_Arena CXI_Arena;
+
+  /*! I/O counters of a dataset, a file or the whole process, see cxi_get_stats().
+   *
+   * Times are wall clock nanoseconds. HDF5 converts and decompresses inside
+   * its read and write calls, so \p convert_ns and \p decompress_ns are the
+   * time spent in calls that had to convert or go through filters, not the
+   * conversion or decompression alone. Chunk cache hits are estimated from
+   * the chunks touched by consecutive reads and writes of a dataset.
+   *
+   * The counters of a file only gather the datasets opened from it with
+   * cxi_open_dataset() and the frames of streams. Datasets created by
+   * cxi_create_dataset(), cxi_merge_datasets(), cxi_subset_dataset(),
+   * cxi_create_pixel_major_dataset() and the like belong to the caller and
+   * may outlive the file, so they only count for themselves and toward the
+   * totals of the process.
+   */
+  typedef struct{
+    /*! The number of HDF5 open, read and write calls. */
+    uint64_t hdf5_calls;
+    /*! The number of dataset reads. */
+    uint64_t reads;
+    /*! The number of dataset writes. */
+    uint64_t writes;
+    /*! The number of bytes read, in memory type. */
+    uint64_t bytes_read;
+    /*! The number of bytes written, in memory type. */
+    uint64_t bytes_written;
+    /*! The time spent reading. */
+    uint64_t read_ns;
+    /*! The time spent writing. */
+    uint64_t write_ns;
+    /*! The time spent in reads and writes where the memory type differs from the file type. */
+    uint64_t convert_ns;
+    /*! The time spent in reads and writes of filtered, e.g. compressed, datasets. */
+    uint64_t decompress_ns;
+    /*! The number of chunks touched that had just been touched by the previous access. */
+    uint64_t chunk_cache_hits;
+    /*! The number of other chunks touched. */
+    uint64_t chunk_cache_misses;
+    /*! The number of cxi_open_* calls that succeeded. */
+    uint64_t opens;
+    /*! The time spent in those calls. */
+    uint64_t open_ns;
+    /*! The number of reads and writes where the memory type differs from the file type. */
+    uint64_t conversions;
+    /*! The number of chunks copied as stored, without going through the HDF5 filter
+     *  and conversion pipeline: by cxi_merge_datasets(), and by reads and writes
+     *  of whole unfiltered chunks in the file type. */
+    uint64_t raw_chunk_copies;
+  }CXI_Stats;
+
   /*! Defines the dimensions and data type of a dataset.
    */
   typedef struct CXI_Dataset{
@@ -153,6 +231,27 @@ extern "C"{
     int dimension_count;
     /*! The HDF5 data type of the element of the dataset, or 0 if not set. */
     hid_t data_type;    
+    /*! The I/O counters of this dataset. */
+    CXI_Stats stats;
+    /*! The I/O counters of the file the dataset was opened from, or NULL. */
+    CXI_Stats * file_stats;
+    /*! The number of slices in each chunk, or 0 if the dataset is not chunked. */
+    hsize_t chunk_slices;
+    /*! Is 1 if the dataset goes through filters such as compression. */
+    int filtered;
+    /*! One plus the last chunk accessed, or 0. */
+    hsize_t last_chunk;
+    /*! Is 1 if chunks hold whole slices and are not filtered, so that reads and
+     *  writes in the file type can copy them raw. */
+    int raw_chunks;
+    /*! The transfer property list used for reads and writes, see cxi_set_conversion_buffer(). */
+    hid_t transfer_plist;
+    /*! The buffer set by cxi_set_conversion_buffer(), or NULL. */
+    void * conversion_buffer;
+    /*! Is 1 once a conversion warning was printed for this dataset. */
+    int conversion_warned;
+    /*! Owns the dataset if it was opened from a file, NULL otherwise. */
+    CXI_Arena * arena;
   }CXI_Dataset;
 
   /*! A reference to an open \p CXI_Dataset
@@ -166,6 +265,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Dataset to which this reference corresponds to. */
     CXI_Dataset * dataset;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Dataset_Reference;
 
 
@@ -188,6 +289,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Process to which this reference corresponds to. */
     CXI_Process * process;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Process_Reference;
   
   /*! Describes a beamline attenuator used during data collection.
@@ -232,6 +335,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Attenuator to which this reference corresponds to. */
     CXI_Attenuator * attenuator;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Attenuator_Reference;
 
 
@@ -268,6 +373,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Geometry to which this reference corresponds to. */
     CXI_Geometry * geometry;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Geometry_Reference;
 
   /*! Holds information about one of the detectors used during the experiment.
@@ -361,6 +468,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Detector to which this reference corresponds to. */
     CXI_Detector * detector;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Detector_Reference;
 
   /*! Describes the light source being used. */
@@ -399,6 +508,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Source to which this reference corresponds to. */
     CXI_Source * source;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Source_Reference;
 
   /*! Monochromator used in the instrument. */
@@ -429,6 +540,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Monochromator to which this reference corresponds to. */
     CXI_Monochromator * monochromator;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Monochromator_Reference;
   
   /*! Template of instrument descriptions comprising various beamline components.
@@ -483,6 +596,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Instrument to which this reference corresponds to. */
     CXI_Instrument * instrument;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Instrument_Reference;
 
   /*! This class is a general placeholder for the most important information 
@@ -511,6 +626,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Data to which this reference corresponds to. */
     CXI_Data * data;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Data_Reference;
 
   /*! This class should be used to store processed image data. 
@@ -616,6 +733,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Image to which this reference corresponds to */
     CXI_Image * image;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Image_Reference;
   
   /*! Holds basic information about the kind of sample used, its geometry and properties.
@@ -679,6 +798,8 @@ extern "C"{
     char * group_name;
     /*! The \p CXI_Sample to which this reference corresponds to */
     CXI_Sample * sample;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Sample_Reference;
 
   /*! Describes the properties of a CXI Entry.
@@ -756,6 +877,8 @@ extern "C"{
     char * group_name;
     /*! The CXI_Entry to which this reference corresponds to. */
     CXI_Entry * entry;
+    /*! Owning arena, see CXI_Arena. */
+    CXI_Arena * arena;
   }CXI_Entry_Reference;
 
 
@@ -780,6 +903,10 @@ extern "C"{
      * A negative value indicates the value was not set/read.
      */
     int cxi_version;
+    /*! Owns every object opened from this file, see cxi_close_file(). */
+    CXI_Arena * arena;
+    /*! The I/O counters of everything opened from this file. */
+    CXI_Stats stats;
   }CXI_File;
 
 
@@ -800,6 +927,11 @@ extern "C"{
   CXI_File * cxi_open_file(const char * filename, const char * mode);
 
   /*! Close an open CXI file. 
+   *
+   * Everything opened from the file, down to the datasets and the strings
+   * read from it, is released at once and must not be used afterwards.
+   * Objects created by the caller and the references returned by the
+   * cxi_create functions are not affected.
    *
    * \param file The file to close.
    * \return Zero if successful ora negative number in case of error.
@@ -838,6 +970,14 @@ extern "C"{
    */
   CXI_Detector * cxi_open_detector(CXI_Detector_Reference * detector);
  
+  /*! Open a CXI Geometry
+   *
+   * \param geometry A reference to the geometry to be opened.
+   *
+   * \return The opened \p CXI_Geometry or NULL is case of error.
+   */
+  CXI_Geometry * cxi_open_geometry(CXI_Geometry_Reference * geometry);
+
   /*! Open a CXI Attenuator 
    *
    * \param attenuator A reference to the attenuator to be opened.
@@ -853,6 +993,13 @@ extern "C"{
    * \return The opened \p CXI_Monochromator or NULL is case of error.
    */
   CXI_Monochromator * cxi_open_monochromator(CXI_Monochromator_Reference * monochromator);
+  /*! Open a CXI Image
+   *
+   * \param image A reference to the image to be opened.
+   *
+   * \return The opened \p CXI_Image or NULL is case of error.
+   */
+  CXI_Image * cxi_open_image(CXI_Image_Reference * image);
   /*! Open a CXI Sample
    *
    * \param sample A reference to the sample to be opened.
@@ -904,6 +1051,51 @@ extern "C"{
    */
   int cxi_read_dataset_slice(CXI_Dataset * dataset, unsigned int slice, void * data, hid_t data_type);
 
+  /*! Read a range of consecutive slices from an open a CXI Dataset
+   *
+   * \param dataset The dataset to read.
+   * \param first The index of the first slice to read.
+   * \param n The number of slices to read.
+   * \param data The buffer where the read data will be written. It must have space for \p n times cxi_dataset_slice_length() elements.
+   * \param data_type The HDF5 data type to be written on the output buffer. Must be convertible from the data type of the dataset.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_read_dataset_slices(CXI_Dataset * dataset, hsize_t first, hsize_t n, void * data, hid_t data_type);
+
+  /*! Called by cxi_dataset_foreach_block() for each block of slices.
+   *
+   * \param data The slices one after the other, valid until the callback returns.
+   * \param first The index of the first slice of the block.
+   * \param n The number of slices in the block.
+   * \param mem_type The type of \p data, the native type of the dataset.
+   * \param user The pointer given to cxi_dataset_foreach_block().
+   *
+   * \return 0 to go on, anything else to stop.
+   */
+  typedef int (*CXI_Block_Callback)(const void * data, hsize_t first, hsize_t n, hid_t mem_type, void * user);
+
+  /*! Hand a dataset of any size to a callback one block of slices at a time.
+   *
+   * Blocks are made of whole chunks when they fit the budget, so each chunk is decoded once, and only
+   * two of them are in memory at any time: the next block is read by another
+   * thread while the callback works on the current one. Blocks are handed
+   * out in order. With an HDF5 that is not thread-safe blocks are read in
+   * turn with the callback instead.
+   *
+   * \param dataset The dataset to read, which must not be used elsewhere during the call,
+   *        its statistics included.
+   * \param block_frames The number of slices per block, rounded down to whole chunks
+   *        or to an even part of a larger chunk, or 0 for blocks of about 16 MB.
+   * \param callback The function called for each block.
+   * \param user Passed to \p callback.
+   *
+   * \return 0 once every block was handed out, what the callback returned if it
+   *         stopped early, or -1 in case of error.
+   */
+  int cxi_dataset_foreach_block(CXI_Dataset * dataset, hsize_t block_frames, CXI_Block_Callback callback,
+				void * user);
+
 /*! \} // reading
  */
 
@@ -945,6 +1137,14 @@ extern "C"{
    * \return A reference to the \p image created or NULL in case of error.
    */
   CXI_Detector_Reference * cxi_create_detector(hid_t loc, CXI_Detector * detector);
+  /*! Create a geometry group and its children.
+   * 
+   * \param loc An HDF5 identifier specifying the location where the dataset will be created.
+   * \param geometry A filled structure which determines the properties of the created geometry.
+   *
+   * \return A reference to the \p geometry created or NULL in case of error.
+   */
+  CXI_Geometry_Reference * cxi_create_geometry(hid_t loc, CXI_Geometry * geometry);
   /*! Create a instrument group and its children.
    * 
    * \param loc An HDF5 identifier specifying the location where the dataset will be created.
@@ -1115,6 +1315,1516 @@ extern "C"{
 /*! \} // utility
  */
 
+/*! \addtogroup reduction Frame Reductions
+ *  \{
+ */
+
+  /*! The quantities accumulated by cxi_reduce_dataset().
+   */
+  typedef enum{
+    /*! The mean of each pixel over all frames */
+    CXI_Reduction_Mean,
+    /*! The sample variance of each pixel over all frames */
+    CXI_Reduction_Variance,
+    /*! The square root of the variance, suitable for a \p data_error dataset */
+    CXI_Reduction_Standard_Deviation,
+    /*! The sum of each pixel over all frames, e.g. a powder pattern */
+    CXI_Reduction_Sum,
+    /*! The maximum of each pixel over all frames */
+    CXI_Reduction_Max
+  }CXI_Reduction_Quantity;
+
+  /*! Per pixel statistics of a stack of frames.
+   *  All arrays have \p frame_length elements, in the same order as a slice of the reduced dataset.
+   */
+  typedef struct CXI_Reduction{
+    /*! The number of frames that were reduced. */
+    hsize_t frame_count;
+    /*! The number of elements in each frame. */
+    hsize_t frame_length;
+    /*! The dimensions of a frame, that is the dimensions of the dataset without the slowest changing one. */
+    hsize_t * dimensions;
+    /*! The number of dimensions of a frame. */
+    int dimension_count;
+    /*! The mean of each pixel. */
+    double * mean;
+    /*! The sample variance of each pixel. */
+    double * variance;
+    /*! The sum of each pixel. */
+    double * sum;
+    /*! The maximum of each pixel. */
+    double * max;
+  }CXI_Reduction;
+
+  /*! Calculate the per pixel mean, variance, sum and maximum of a stack of frames.
+   *
+   * The dataset is read in batches of whole frames, so only one batch is held
+   * in memory at a time, and each batch is reduced in parallel.
+   * Frames run along the slowest changing dimension of the dataset.
+   *
+   * \param dataset The dataset to reduce.
+   * \param batch_frames The number of frames to read at a time, or 0 to pick
+   * a number of whole chunks that fits in 64 MB.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return The reduction, to be freed with cxi_free_reduction(), or NULL in case of error.
+   */
+  CXI_Reduction * cxi_reduce_dataset(CXI_Dataset * dataset, hsize_t batch_frames, int nthreads);
+
+  /*! Free a reduction returned by cxi_reduce_dataset().
+   *
+   * \param reduction The reduction to free.
+   */
+  void cxi_free_reduction(CXI_Reduction * reduction);
+
+  /*! Write one of the quantities of a reduction to a new dataset.
+   *
+   * \param loc An HDF5 identifier specifying the location where the dataset will be created.
+   * \param reduction The reduction to write.
+   * \param quantity Which quantity to write.
+   * \param type The type of dataset created, for example \p CXI_Data_Type for a
+   * mean image or \p CXI_Data_Error_Type for the standard deviation.
+   *
+   * \return A reference to the dataset created or NULL in case of error.
+   */
+  CXI_Dataset_Reference * cxi_create_reduction_dataset(hid_t loc, CXI_Reduction * reduction,
+						     CXI_Reduction_Quantity quantity,
+						     CXI_Dataset_Type type);
+
+/*! \} // reduction
+ */
+
+/*! \addtogroup dark Dark Calibration
+ *  \{
+ */
+
+  /*! Options for cxi_calibrate_dark(). Zeroed fields take their default value.
+   */
+  typedef struct CXI_Dark_Options{
+    /*! The number of frames to read at a time. By default whole chunks fitting in 64 MB. */
+    hsize_t batch_frames;
+    /*! The number of threads to use. By default all the available cores. */
+    int nthreads;
+    /*! A pixel is hot if its mean is more than this many robust standard deviations
+      above the median of all pixel means. The robust standard deviation is never
+      taken below the noise of a single pixel mean. Defaults to 6. */
+    double hot_threshold;
+    /*! A pixel is noisy if its sigma is more than this many robust standard deviations
+      above the median of all pixel sigmas. Noisy pixels are flagged as hot. Defaults to 6. */
+    double noisy_threshold;
+    /*! A pixel is dead if its sigma is less or equal to this value. Defaults to 0,
+      which only flags pixels that never change. */
+    double dead_sigma;
+    /*! The number of histogram bins per pixel used to estimate the median, rounded up
+      to an even number. Defaults to 64. */
+    int median_bins;
+  }CXI_Dark_Options;
+
+  /*! Per pixel statistics of a dark run.
+   *  All arrays have \p frame_length elements, in the same order as a frame of the dark run.
+   */
+  typedef struct CXI_Dark_Calibration{
+    /*! The number of dark frames used. */
+    hsize_t frame_count;
+    /*! The number of elements in each frame. */
+    hsize_t frame_length;
+    /*! The dimensions of a frame. */
+    hsize_t * dimensions;
+    /*! The number of dimensions of a frame. */
+    int dimension_count;
+    /*! The mean of each pixel. */
+    double * mean;
+    /*! The standard deviation of each pixel. */
+    double * sigma;
+    /*! An estimate of the median of each pixel, accurate to a fraction of a histogram bin. */
+    double * median;
+    /*! \p CXI_PIXEL_IS_HOT or \p CXI_PIXEL_IS_DEAD for the flagged pixels, 0 otherwise. */
+    uint32_t * mask;
+    /*! The number of pixels flagged as hot because of their mean. */
+    hsize_t hot_count;
+    /*! The number of pixels flagged as hot because of their noise. */
+    hsize_t noisy_count;
+    /*! The number of pixels flagged as dead. */
+    hsize_t dead_count;
+  }CXI_Dark_Calibration;
+
+  /*! Calculate a dark calibration from a stack of dark frames.
+   *
+   * The frames are streamed in batches, so memory use only depends on the
+   * frame size. The median is estimated from a small per pixel histogram
+   * centred on the statistics of the first batch, and widened by merging
+   * bins when later batches drift out of its range.
+   *
+   * \param darks The stack of dark frames.
+   * \param options The calibration options, or NULL to use the defaults.
+   *
+   * \return The calibration, to be freed with cxi_free_dark_calibration(), or NULL in case of error.
+   */
+  CXI_Dark_Calibration * cxi_calibrate_dark(CXI_Dataset * darks, CXI_Dark_Options * options);
+
+  /*! Free a calibration returned by cxi_calibrate_dark().
+   *
+   * \param cal The calibration to free.
+   */
+  void cxi_free_dark_calibration(CXI_Dark_Calibration * cal);
+
+  /*! Write the mean of a dark calibration as \p data_dark and its flags as \p mask
+   *  of a detector, and set the corresponding references of \p detector.
+   *
+   * \param detector The detector to write to.
+   * \param cal The calibration to write.
+   *
+   * \return Zero if succesful or non-zero if it encountered an error.
+   */
+  int cxi_write_dark_calibration(CXI_Detector * detector, CXI_Dark_Calibration * cal);
+
+/*! \} // dark
+ */
+
+/*! \addtogroup assembly Detector Assembly
+ *  \{
+ */
+
+  /*! The placement of one panel of a segmented detector.
+   *  The center of the pixel (s,f) of the panel is at
+   *  \p corner_position + (s+0.5) * \p basis_vectors[0] + (f+0.5) * \p basis_vectors[1].
+   */
+  typedef struct CXI_Panel{
+    /*! The x, y and z coordinates of the corner of the first pixel. */
+    double corner_position[3];
+    /*! The step between consecutive pixels along the slow and the fast dimension. */
+    double basis_vectors[2][3];
+    /*! The number of pixels along the slow and the fast dimension. */
+    hsize_t dimensions[2];
+  }CXI_Panel;
+
+  /*! A run of consecutive output pixels copied from evenly spaced input pixels. */
+  typedef struct CXI_Assembler_Run{
+    /*! Index of the first output pixel. */
+    int64_t output;
+    /*! Index of the first input pixel, or -1 if the run is not covered by any panel. */
+    int64_t input;
+    /*! Number of pixels in the run. */
+    int64_t length;
+    /*! Distance between consecutive input pixels. */
+    int64_t stride;
+  }CXI_Assembler_Run;
+
+  /*! Precomputed mapping from the stacked panels of a detector to a 2D image.
+   */
+  typedef struct CXI_Assembler{
+    /*! The number of rows and columns of the assembled image. */
+    hsize_t dimensions[2];
+    /*! The size of the pixels of the assembled image. */
+    double pixel_size;
+    /*! The number of pixels of all the panels together. */
+    hsize_t input_length;
+    /*! For each input pixel, the index of the output pixel it is assembled into. */
+    int64_t * pixel_to_output;
+    /*! The runs used by the assembly kernels. */
+    CXI_Assembler_Run * runs;
+    /*! The number of runs. */
+    hsize_t run_count;
+    /*! The value given to output pixels not covered by any panel. Defaults to 0. */
+    float fill_value;
+  }CXI_Assembler;
+
+  /*! Describe a panel using the geometry of a detector.
+   *
+   * The basis vectors and corner position of the detector are used when set.
+   * Otherwise the orientation and translation of its geometry group are used,
+   * with the first row of the orientation along the fast dimension.
+   *
+   * \param detector An open detector.
+   * \param slow_dim The number of pixels along the slow dimension of the panel.
+   * \param fast_dim The number of pixels along the fast dimension of the panel.
+   * \param panel The panel to fill in.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_panel_from_detector(CXI_Detector * detector, hsize_t slow_dim, hsize_t fast_dim,
+			      CXI_Panel * panel);
+
+  /*! Precompute the assembly of a segmented detector.
+   *
+   * The input of the assembler is a frame with all the panels stacked in order,
+   * each one with its slow dimension before its fast one.
+   *
+   * \param panels The panels of the detector.
+   * \param panel_count The number of panels.
+   * \param pixel_size The pixel size of the output, or 0 to use the smallest panel pixel.
+   *
+   * \return The assembler, to be freed with cxi_free_assembler(), or NULL in case of error.
+   */
+  CXI_Assembler * cxi_create_assembler(CXI_Panel * panels, int panel_count, double pixel_size);
+
+  /*! Free an assembler returned by cxi_create_assembler().
+   *
+   * \param assembler The assembler to free.
+   */
+  void cxi_free_assembler(CXI_Assembler * assembler);
+
+  /*! Assemble a frame.
+   *
+   * \param assembler The assembler to use.
+   * \param input The stacked panels, with \p input_length elements.
+   * \param output The assembled image, with \p dimensions[0] * \p dimensions[1] elements.
+   * \param nthreads The number of threads to split the frame between, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_assemble_frame(CXI_Assembler * assembler, const float * input, float * output,
+			 int nthreads);
+
+  /*! Assemble several frames.
+   *
+   * When there are at least as many frames as threads each thread assembles
+   * whole frames, otherwise the threads split each frame.
+   *
+   * \param assembler The assembler to use.
+   * \param input \p n consecutive stacked frames.
+   * \param n The number of frames.
+   * \param output \p n consecutive assembled images.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_assemble_frames(CXI_Assembler * assembler, const float * input, hsize_t n,
+			  float * output, int nthreads);
+
+/*! \} // assembly
+ */
+
+/*! \addtogroup fftshift FFT Shifts
+ *  \{
+ */
+
+  /*! The quadrant layout requested when reading an image.
+   *  \see CXI_Image::is_fft_shifted
+   */
+  typedef enum{
+    /*! Return the image as stored in the file */
+    CXI_FFT_As_Stored = 0,
+    /*! Return the image with the zero frequency at the first element */
+    CXI_FFT_Shifted,
+    /*! Return the image with the zero frequency at the center */
+    CXI_FFT_Unshifted
+  }CXI_FFT_Shift_State;
+
+  /*! Swap the halves of an array along all its dimensions, in place,
+   *  moving the zero frequency component to the center.
+   *
+   * Works for any number of dimensions and for odd sizes, where it matches
+   * numpy.fft.fftshift. Each thread uses as scratch about 256 bytes of the
+   * faster dimensions across the whole length of the axis being shifted. If
+   * it cannot be allocated the array is left partly shifted and an error returned.
+   *
+   * \param data The array to shift.
+   * \param ndims The number of dimensions of the array.
+   * \param dims The dimensions of the array, slowest changing first.
+   * \param element_size The size in bytes of each element, e.g. 8 for single precision complex.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_fftshift(void * data, int ndims, const hsize_t * dims, size_t element_size, int nthreads);
+
+  /*! The inverse of cxi_fftshift(). The two only differ for odd sizes.
+   *
+   * \param data The array to shift.
+   * \param ndims The number of dimensions of the array.
+   * \param dims The dimensions of the array, slowest changing first.
+   * \param element_size The size in bytes of each element.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_ifftshift(void * data, int ndims, const hsize_t * dims, size_t element_size, int nthreads);
+
+  /*! Read the data of an image in the requested quadrant layout.
+   *
+   * The image is shifted in place after reading when \p is_fft_shifted
+   * differs from the requested state. If the dataset has more dimensions than
+   * the image dimensionality the slower ones are taken to index a stack of images.
+   *
+   * \param image An open image with \p data set.
+   * \param data The buffer where the read data will be written.
+   * \param data_type The HDF5 data type to be written on the output buffer.
+   * \param state The requested layout.
+   * \param nthreads The number of threads to use for the shift, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_read_image_data(CXI_Image * image, void * data, hid_t data_type,
+			  CXI_FFT_Shift_State state, int nthreads);
+
+/*! \} // fftshift
+ */
+
+/*! \addtogroup pyramid Preview Pyramids
+ *  \{
+ */
+
+  /*! The maximum number of levels of a preview pyramid. */
+#define CXI_PYRAMID_MAX_LEVELS 3
+
+  /*! A set of binned copies of a dataset, used for previews.
+   *
+   * Level l is stored as a single precision dataset named
+   * "<name>_bin<2^(l+1)>" next to the original one, e.g. data_bin2,
+   * data_bin4 and data_bin8. Every pixel of a level is the mean of the
+   * 2x2 pixels under it in the level above, edges with an odd size
+   * average only the pixels that exist.
+   */
+  typedef struct{
+    /*! The datasets of each level, finest first. */
+    CXI_Dataset * levels[CXI_PYRAMID_MAX_LEVELS];
+    /*! References to the datasets of each level. */
+    CXI_Dataset_Reference * references[CXI_PYRAMID_MAX_LEVELS];
+    /*! The number of levels. */
+    int level_count;
+    /*! 1 if the original dataset is a stack of frames, 0 for a single image. */
+    int stacked;
+    /*! The number of rows of the original images. */
+    hsize_t rows;
+    /*! The number of columns of the original images. */
+    hsize_t cols;
+  }CXI_Pyramid;
+
+  /*! Create the datasets of a preview pyramid for a 2D image or a 3D stack of frames.
+   *
+   * Use cxi_write_pyramid_slices() to fill them as the frames are written,
+   * or cxi_build_pyramid() to do it all from data already in the file.
+   *
+   * \param data A reference to the original dataset, as returned by cxi_create_dataset().
+   * \param levels The number of levels, between 1 and \p CXI_PYRAMID_MAX_LEVELS.
+   *
+   * \return The new pyramid or NULL in case of error.
+   */
+  CXI_Pyramid * cxi_create_pyramid(CXI_Dataset_Reference * data, int levels);
+
+  /*! Bin frames and write them to all the levels of a pyramid.
+   *
+   * \param pyramid The pyramid.
+   * \param first The index of the first frame, 0 for a single image.
+   * \param n The number of frames, 1 for a single image.
+   * \param frames The full resolution frames.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_write_pyramid_slices(CXI_Pyramid * pyramid, hsize_t first, hsize_t n,
+			       const float * frames, int nthreads);
+
+  /*! Close the datasets of a pyramid and free it. */
+  void cxi_close_pyramid(CXI_Pyramid * pyramid);
+
+  /*! Build the preview pyramid of a dataset already in the file.
+   *
+   * The dataset is read in batches of frames so memory use stays bounded.
+   *
+   * \param data A reference to the original dataset.
+   * \param levels The number of levels, between 1 and \p CXI_PYRAMID_MAX_LEVELS.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_build_pyramid(CXI_Dataset_Reference * data, int levels, int nthreads);
+
+  /*! Open the coarsest level of a dataset that still fills a viewport.
+   *
+   * Falls back to the original dataset when there is no pyramid or when
+   * no level is large enough. Close the result with cxi_close_pyramid_level().
+   *
+   * \param data A reference to the original dataset.
+   * \param rows The height of the viewport in pixels.
+   * \param cols The width of the viewport in pixels.
+   * \param binning If not NULL receives the binning of the chosen level, 1 for the original.
+   *
+   * \return The open dataset or NULL in case of error.
+   */
+  CXI_Dataset * cxi_open_pyramid_level(CXI_Dataset_Reference * data, hsize_t rows, hsize_t cols,
+				       int * binning);
+
+  /*! Close a dataset returned by cxi_open_pyramid_level(). */
+  void cxi_close_pyramid_level(CXI_Dataset * dataset);
+
+/*! \} // pyramid
+ */
+
+/*! \addtogroup sparse Sparse Frames
+ *  \{
+ */
+
+  /*! A stack of frames stored as lists of pixels.
+   *
+   * Suited for photon sparse data where only a small fraction of the pixels
+   * of each frame is above threshold. The frames live in a group containing
+   * the ragged arrays "pixel_index", the linear index of each stored pixel in
+   * its frame, and "pixel_value", its value, plus "frame_offsets", where the
+   * pixels of frame i are those in [frame_offsets[i],frame_offsets[i+1]), and
+   * "frame_dimensions", the rows and columns of the dense frames.
+   */
+  typedef struct{
+    /*! The HDF5 identifier of the group. */
+    hid_t handle;
+    /*! The HDF5 identifier of the frame_offsets dataset. */
+    hid_t offsets;
+    /*! The HDF5 identifier of the pixel_index dataset. */
+    hid_t indices;
+    /*! The HDF5 identifier of the pixel_value dataset. */
+    hid_t values;
+    /*! The rows and columns of each frame. */
+    hsize_t frame_dimensions[2];
+    /*! The number of frames. */
+    hsize_t frame_count;
+    /*! A copy of the frame_offsets dataset, with \p frame_count+1 entries. */
+    hsize_t * frame_offsets;
+    /*! The allocated size of \p frame_offsets. */
+    hsize_t offsets_capacity;
+  }CXI_Sparse_Frames;
+
+  /*! Create an empty group of sparse frames.
+   *
+   * \param loc The HDF5 location where the group is created, e.g. the handle of a CXI_Data.
+   * \param name The name of the group, e.g. "data_sparse".
+   * \param rows The number of rows of each frame.
+   * \param cols The number of columns of each frame.
+   *
+   * \return The new sparse frames or NULL in case of error.
+   */
+  CXI_Sparse_Frames * cxi_create_sparse_frames(hid_t loc, const char * name,
+					       hsize_t rows, hsize_t cols);
+
+  /*! Append a dense frame, keeping only the pixels above \p threshold.
+   *
+   * \param s The sparse frames.
+   * \param frame The dense frame.
+   * \param threshold Pixels less than or equal to this are not stored.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_append_sparse_frame(CXI_Sparse_Frames * s, const float * frame, float threshold);
+
+  /*! Append a frame given directly as a list of pixels.
+   *
+   * \param s The sparse frames.
+   * \param index The linear index of each pixel in the frame.
+   * \param value The value of each pixel.
+   * \param n The number of pixels, possibly 0.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_append_sparse_pixels(CXI_Sparse_Frames * s, const uint32_t * index,
+			       const float * value, hsize_t n);
+
+  /*! Open an existing group of sparse frames.
+   *
+   * \param loc The HDF5 location of the group.
+   * \param name The name of the group.
+   *
+   * \return The sparse frames or NULL in case of error.
+   */
+  CXI_Sparse_Frames * cxi_open_sparse_frames(hid_t loc, const char * name);
+
+  /*! Read consecutive frames as dense arrays.
+   *
+   * \param s The sparse frames.
+   * \param first The first frame to read.
+   * \param n The number of frames to read.
+   * \param dense The output buffer, with room for \p n frames.
+   * \param fill The value of the pixels that are not stored.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_read_sparse_frames(CXI_Sparse_Frames * s, hsize_t first, hsize_t n,
+			     float * dense, float fill);
+
+  /*! Read a single frame as a dense array.
+   *  \see cxi_read_sparse_frames()
+   */
+  int cxi_read_sparse_frame(CXI_Sparse_Frames * s, hsize_t frame, float * dense, float fill);
+
+  /*! Close the sparse frames and free them. */
+  void cxi_close_sparse_frames(CXI_Sparse_Frames * s);
+
+/*! \} // sparse
+ */
+
+/*! \addtogroup photon Photon Counts
+ *  \{
+ */
+
+  /*! How fractional photon counts are rounded. */
+  typedef enum{
+    /*! Round to the nearest integer */
+    CXI_Round_Nearest = 0,
+    /*! Round down */
+    CXI_Round_Floor,
+    /*! Round up */
+    CXI_Round_Ceil
+  }CXI_Photon_Rounding;
+
+  /*! Options for converting detector counts (ADU) to photon counts. */
+  typedef struct{
+    /*! The detector counts produced by one photon, e.g. from cxi_adu_per_photon(). Must be positive. */
+    double adu_per_photon;
+    /*! Pixels with fewer photons than this are set to 0 before rounding. The default, 0, zeroes negative values. */
+    double threshold;
+    /*! The rounding applied to the photon counts. */
+    CXI_Photon_Rounding rounding;
+    /*! The integer type stored in the file, or 0 to use the narrowest type that fits the data. */
+    hid_t data_type;
+    /*! The deflate compression level, from 1 to 9, or 0 for no compression. */
+    int deflate_level;
+  }CXI_Photon_Options;
+
+  /*! The detector counts per photon, \p counts_per_joule times the photon energy.
+   *
+   * \return The counts per photon or 0 if either value is not set.
+   */
+  double cxi_adu_per_photon(CXI_Detector * detector, CXI_Source * source);
+
+  /*! Convert detector counts to integer photon counts.
+   *
+   * \param adu The detector counts.
+   * \param n The number of values.
+   * \param opt The conversion options.
+   * \param counts The output photon counts. Values beyond 32 bits, infinities
+   *        included, saturate and NaN gives 0.
+   * \param min If not NULL receives the smallest count.
+   * \param max If not NULL receives the largest count.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_quantize_photons(const float * adu, hsize_t n, const CXI_Photon_Options * opt,
+			   int32_t * counts, int64_t * min, int64_t * max);
+
+  /*! The narrowest native integer type that holds all values in [min,max]. */
+  hid_t cxi_photon_count_type(int64_t min, int64_t max);
+
+  /*! Create a dataset of photon counts from detector counts.
+   *
+   * The conversion is recorded in the "adu_per_photon" and "photon_threshold"
+   * attributes of the dataset, see cxi_read_scaled_dataset().
+   *
+   * \param loc The HDF5 location of the dataset.
+   * \param dataset The dimensions of the dataset. \p data_type is set to the type chosen.
+   * \param type The type of dataset to create.
+   * \param adu All the detector counts, or NULL to create an empty dataset to be filled
+   *        with cxi_write_photon_slices(), in which case \p opt->data_type must be set.
+   * \param opt The conversion options.
+   *
+   * \return A reference to the new dataset or NULL in case of error.
+   */
+  CXI_Dataset_Reference * cxi_create_photon_dataset(hid_t loc, CXI_Dataset * dataset,
+						    CXI_Dataset_Type type, const float * adu,
+						    const CXI_Photon_Options * opt);
+
+  /*! Convert frames to photon counts and write them to a photon count dataset.
+   *
+   * Counts that do not fit in the type of the dataset are clipped.
+   *
+   * \param dataset A dataset created with cxi_create_photon_dataset().
+   * \param first The first frame to write.
+   * \param n The number of frames.
+   * \param adu The detector counts of the frames.
+   * \param opt The conversion options.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_write_photon_slices(CXI_Dataset * dataset, hsize_t first, hsize_t n,
+			      const float * adu, const CXI_Photon_Options * opt);
+
+  /*! The factor that converts a dataset back to detector counts, 1 for ordinary datasets. */
+  double cxi_dataset_scale(CXI_Dataset * dataset);
+
+  /*! Read a dataset multiplied by cxi_dataset_scale().
+   *
+   * \param dataset The dataset to read.
+   * \param data The output buffer.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_read_scaled_dataset(CXI_Dataset * dataset, float * data);
+
+/*! \} // photon
+ */
+
+/*! \addtogroup catalogue File Catalogue
+ *  \{
+ */
+
+  /*! The numeric columns of a catalogue. Missing values are stored as NaN,
+   *  which never matches a query. Physical quantities are in SI units.
+   */
+  typedef enum{
+    /*! The number of the entry in the file, starting at 1 */
+    CXI_Catalogue_Entry = 0,
+    /*! The number of the instrument in the entry, starting at 1 */
+    CXI_Catalogue_Instrument,
+    /*! The number of the detector in the instrument, starting at 1 */
+    CXI_Catalogue_Detector,
+    /*! The detector distance, in m */
+    CXI_Catalogue_Distance,
+    /*! The detector pixel size along x, in m */
+    CXI_Catalogue_X_Pixel_Size,
+    /*! The detector pixel size along y, in m */
+    CXI_Catalogue_Y_Pixel_Size,
+    /*! The photon energy of the first source of the instrument, in J */
+    CXI_Catalogue_Photon_Energy,
+    /*! The pulse energy of the first source of the instrument, in J */
+    CXI_Catalogue_Pulse_Energy,
+    /*! The number of frames of the detector data, or of the first data group of the entry */
+    CXI_Catalogue_Frames,
+    /*! The number of rows of each frame */
+    CXI_Catalogue_Rows,
+    /*! The number of columns of each frame */
+    CXI_Catalogue_Columns,
+    /*! The number of columns, not a column itself */
+    CXI_Catalogue_Column_Count
+  }CXI_Catalogue_Column;
+
+  /*! An index of the metadata of many CXI files.
+   *
+   * There is one row per detector of every instrument of every entry, or
+   * one per entry if the entry has no detectors. The columns are kept in
+   * memory as plain arrays so that queries are simple scans. On disk the
+   * catalogue is an HDF5 file with one compressed dataset per column.
+   */
+  typedef struct{
+    /*! The number of files in the catalogue. */
+    hsize_t file_count;
+    /*! The path of each file. */
+    char ** paths;
+    /*! The modification time of each file, in seconds since the epoch. */
+    double * mtimes;
+    /*! The size of each file in bytes. */
+    hsize_t * sizes;
+    /*! The number of rows. */
+    hsize_t row_count;
+    /*! The file each row belongs to. */
+    uint32_t * row_file;
+    /*! The numeric columns, each with \p row_count values. */
+    double * columns[CXI_Catalogue_Column_Count];
+    /*! The title of the entry of each row, or NULL. */
+    char ** titles;
+    /*! The name of the first sample of the entry of each row, or NULL. */
+    char ** samples;
+    /*! Owns the strings. */
+    CXI_Arena * arena;
+  }CXI_Catalogue;
+
+  /*! A condition on a catalogue column, \p min <= value <= \p max. */
+  typedef struct{
+    CXI_Catalogue_Column column;
+    double min;
+    double max;
+  }CXI_Catalogue_Range;
+
+  /*! Load a catalogue from disk.
+   *
+   * \param filename The catalogue file. If it does not exist an empty catalogue is returned.
+   *
+   * \return The catalogue or NULL in case of error.
+   */
+  CXI_Catalogue * cxi_open_catalogue(const char * filename);
+
+  /*! Bring a catalogue up to date with the files under some directories.
+   *
+   * Directories are searched recursively for files ending in ".cxi", following
+   * symbolic links except those leading back to a directory being searched. Only
+   * files that are new or whose modification time or size changed are read, in
+   * parallel if HDF5 is thread-safe. Files of the catalogue under \p roots that
+   * no longer exist are dropped, files elsewhere are kept.
+   *
+   * \param catalogue The catalogue.
+   * \param roots The directories or files to index.
+   * \param root_count The number of entries in \p roots.
+   * \param nthreads The number of threads to use, or 0 to use all the available cores.
+   *
+   * \return The number of files read, or a negative number in case of error.
+   */
+  int cxi_update_catalogue(CXI_Catalogue * catalogue, const char ** roots, int root_count, int nthreads);
+
+  /*! Write a catalogue to disk, replacing the file atomically.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_save_catalogue(CXI_Catalogue * catalogue, const char * filename);
+
+  /*! Find the rows that satisfy all the given ranges.
+   *
+   * \param catalogue The catalogue.
+   * \param ranges The conditions.
+   * \param range_count The number of conditions, 0 matches every row.
+   * \param rows If not NULL receives the matching rows, it must have room for \p row_count entries.
+   *
+   * \return The number of matching rows.
+   */
+  hsize_t cxi_query_catalogue(CXI_Catalogue * catalogue, const CXI_Catalogue_Range * ranges,
+			      int range_count, hsize_t * rows);
+
+  /*! The name of a catalogue column, e.g. "distance", or NULL. */
+  const char * cxi_catalogue_column_name(CXI_Catalogue_Column column);
+
+  /*! Free a catalogue. */
+  void cxi_close_catalogue(CXI_Catalogue * catalogue);
+
+/*! \} // catalogue
+ */
+
+/*! \addtogroup stats I/O Statistics
+ *  \{
+ */
+
+  /*! Get the I/O counters of a dataset, a file or the whole process.
+   *
+   * Counters are always collected, with a few relaxed atomic additions and
+   * clock reads per call, and can be read while other threads do I/O.
+   *
+   * \param file If not NULL and \p dataset is NULL, get the counters of this file,
+   *        which leave out the datasets created in it, see CXI_Stats.
+   * \param dataset If not NULL, get the counters of this dataset.
+   * \param stats Receives the counters. If both \p file and \p dataset are NULL
+   *        these are the totals of the process.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_get_stats(CXI_File * file, CXI_Dataset * dataset, CXI_Stats * stats);
+
+  /*! Zero the counters selected as in cxi_get_stats(). */
+  void cxi_reset_stats(CXI_File * file, CXI_Dataset * dataset);
+
+/*! \} // stats
+ */
+
+/*! \addtogroup conversion Type Conversion
+ *  \{
+ */
+
+  /*! Give the conversions of a dataset a reusable buffer.
+   *
+   * Reads and writes where the memory type differs from \p data_type go
+   * through a conversion buffer, by default allocated by HDF5 on every call
+   * and 1 MB in size, so that large transfers are converted in many pieces.
+   * When the types match, reads and writes of whole unfiltered chunks
+   * copy them raw and need no buffer.
+   *
+   * \param dataset The dataset.
+   * \param bytes The size of the buffer. A size of a typical transfer avoids
+   *        splitting it. 0 frees the buffer and goes back to the default.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_set_conversion_buffer(CXI_Dataset * dataset, size_t bytes);
+
+  /*! Print a warning the first time each dataset is read or written with a
+   *  memory type different from its file type. Off by default, also turned
+   *  on by setting the environment variable \p CXI_WARN_CONVERSIONS.
+   *  Conversions are always counted in CXI_Stats::conversions.
+   */
+  void cxi_set_conversion_warnings(int enable);
+
+/*! \} // conversion
+ */
+
+/*! \addtogroup trace Tracing
+ *  \{
+ */
+
+  /*! Start recording a timeline of libcxi calls.
+   *
+   * Every cxi_open_*, cxi_read_*, cxi_write_* and cxi_create_* call records a
+   * begin and an end event, with the thread that made it, into a buffer of
+   * that thread. Recording takes no locks. Setting the environment variable
+   * \p CXI_TRACE to a file name starts tracing when the library is loaded
+   * and writes the trace when the program exits.
+   *
+   * \param filename The file cxi_stop_trace() writes to, in the Chrome trace
+   *        event format understood by chrome://tracing and Perfetto.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_start_trace(const char * filename);
+
+  /*! Stop recording and write the events recorded since the last call.
+   *
+   * \return Zero if successful or a negative number if tracing was not on or the file could not be written.
+   */
+  int cxi_stop_trace(void);
+
+/*! \} // trace
+ */
+
+/*! \addtogroup pool Frame Buffers
+ *  \{
+ */
+
+  /*! Buffers for whole frames of one dataset, handed out and taken back
+   *  without locks. Opaque.
+   */
+  typedef struct CXI_Frame_Pool CXI_Frame_Pool;
+
+  /*! Alignment options of cxi_create_frame_pool(), can be or'ed. */
+  typedef enum{
+    /*! Buffers start on a 64 byte boundary. */
+    CXI_Pool_Cache_Line = 0,
+    /*! Buffers start on a page boundary, as O_DIRECT needs. */
+    CXI_Pool_Page_Aligned = 1,
+    /*! Buffers start on a 2 MB boundary and ask the kernel for transparent huge pages. */
+    CXI_Pool_Huge_Pages = 2
+  }CXI_Pool_Flags;
+
+  /*! Create a pool of frame buffers for a dataset.
+   *
+   * Buffers are allocated the first time they are needed and recycled
+   * afterwards, so reading or writing slices through them stops allocating
+   * once the pool is warm. Any number of threads can get and put buffers
+   * at the same time.
+   *
+   * \param dataset The dataset the frames come from.
+   * \param mem_type The type of the elements in memory.
+   * \param frames The number of frames each buffer holds.
+   * \param max_buffers The number of buffers kept for reuse. Buffers asked for
+   *        beyond that are allocated and freed on every use.
+   * \param flags A combination of CXI_Pool_Flags.
+   *
+   * \return The pool, to be freed with cxi_free_frame_pool(), or NULL in case of error.
+   */
+  CXI_Frame_Pool * cxi_create_frame_pool(CXI_Dataset * dataset, hid_t mem_type, hsize_t frames,
+					 int max_buffers, int flags);
+
+  /*! The size in bytes of the buffers of a pool, enough for \p frames frames. */
+  size_t cxi_frame_pool_buffer_size(CXI_Frame_Pool * pool);
+
+  /*! Take a buffer from a pool.
+   *
+   * \return A buffer of cxi_frame_pool_buffer_size() bytes, with undefined
+   * contents, or NULL if out of memory.
+   */
+  void * cxi_frame_pool_get(CXI_Frame_Pool * pool);
+
+  /*! Give back a buffer returned by cxi_frame_pool_get() on the same pool. */
+  void cxi_frame_pool_put(CXI_Frame_Pool * pool, void * buffer);
+
+  /*! Free a pool and all its buffers, which must all have been given back.
+   *
+   * \param pool The pool to free.
+   */
+  void cxi_free_frame_pool(CXI_Frame_Pool * pool);
+
+/*! \} // pool
+ */
+
+/*! \addtogroup events Frame Events
+ *  \{
+ */
+
+  /*! A column of per-frame values, see cxi_create_frame_table(). */
+  typedef struct{
+    /*! The name of the column, e.g. "pulse_energy". */
+    const char * name;
+    /*! The HDF5 type of the values, in memory and in the file. */
+    hid_t type;
+  }CXI_Column;
+
+  /*! Values recorded for every frame of a stack, such as pulse energies,
+   *  timestamps or pulse IDs, stored as columns.
+   *
+   * The table is a group, usually placed next to the frames in a CXI_Data,
+   * holding one growing one dimensional dataset per column, with as many
+   * values as there are frames. Values are gathered in memory and each
+   * column written with one call per batch of \p batch_frames rows, which is
+   * also the chunk size of the columns. A column is read back whole with a
+   * single call to cxi_read_frame_column().
+   */
+  typedef struct{
+    /*! The HDF5 identifier of the group. */
+    hid_t handle;
+    /*! The number of columns. */
+    int column_count;
+    /*! The name of each column. */
+    char ** names;
+    /*! The HDF5 type of each column in the file. */
+    hid_t * types;
+    /*! The HDF5 identifier of the dataset of each column. */
+    hid_t * datasets;
+    /*! The number of rows, including the ones not written yet. */
+    hsize_t frame_count;
+    /*! The number of rows already in the file. */
+    hsize_t written;
+    /*! The number of rows gathered before each column is written. */
+    hsize_t batch_frames;
+    /*! The rows not written yet, one buffer per column. */
+    void ** pending;
+    /*! The number of rows in \p pending. */
+    hsize_t pending_frames;
+  }CXI_Frame_Table;
+
+  /*! Create an empty table of per-frame values.
+   *
+   * \param loc The HDF5 location where the group is created, e.g. the handle of a CXI_Data.
+   * \param name The name of the group, e.g. "events".
+   * \param columns The columns, kept in this order.
+   * \param count The number of columns.
+   * \param batch_frames The number of rows written at once, 0 for 4096.
+   *
+   * \return The new table, to be closed with cxi_close_frame_table(), or NULL in case of error.
+   */
+  CXI_Frame_Table * cxi_create_frame_table(hid_t loc, const char * name, const CXI_Column * columns,
+					   int count, hsize_t batch_frames);
+
+  /*! Open an existing table of per-frame values, e.g. to read its columns or add rows.
+   *
+   * \param loc The HDF5 location of the group.
+   * \param name The name of the group.
+   *
+   * \return The table or NULL in case of error.
+   */
+  CXI_Frame_Table * cxi_open_frame_table(hid_t loc, const char * name);
+
+  /*! The index of the column with the given name, or -1 if there is none. */
+  int cxi_frame_table_column(CXI_Frame_Table * table, const char * name);
+
+  /*! Add the values of n frames.
+   *
+   * \param table The table.
+   * \param n The number of frames.
+   * \param values One array of \p n values per column, in the type of the
+   *        column. A NULL array stores zeros.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_append_frame_values(CXI_Frame_Table * table, hsize_t n, const void * const * values);
+
+  /*! Write the rows gathered so far.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_flush_frame_table(CXI_Frame_Table * table);
+
+  /*! Read all the values of a column.
+   *
+   * \param table The table.
+   * \param column The index of the column.
+   * \param values The output, with room for \p frame_count values.
+   * \param mem_type The HDF5 type of \p values, converted to if different from the column's.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_read_frame_column(CXI_Frame_Table * table, int column, void * values, hid_t mem_type);
+
+  /*! Write the rows gathered so far, close the table and free it.
+   *
+   * \return Zero if successful or a negative number if some rows could not be written.
+   */
+  int cxi_close_frame_table(CXI_Frame_Table * table);
+
+/*! \} // events
+ */
+
+/*! \addtogroup stream Frame Streams
+ *  \{
+ */
+
+  /*! How cxi_create_frame_stream() lays out and splits its files. */
+  typedef struct{
+    /*! The number of frames per chunk. 0 picks as many as fit in about 4 MB. */
+    hsize_t chunk_frames;
+    /*! The deflate level, applied after shuffle, or 0 to store chunks as they are. */
+    int deflate_level;
+    /*! Start a new file once the current one holds this many frames, or 0 for no limit. */
+    hsize_t max_file_frames;
+    /*! Start a new file before the current one grows past this many bytes, or 0 for no limit.
+     *  Frames count at their uncompressed size. Files always get at least one chunk. */
+    hsize_t max_file_bytes;
+    /*! If not 0 also keep a master file "<prefix>.cxi" whose entry_1/data_1/data is a
+     *  virtual dataset stacking the data of every finished file, next to external links
+     *  to each of them named part_0001, part_0002... and parts/0, parts/1... Finishing a
+     *  file only adds its links, which the virtual dataset follows, so readers opening
+     *  the master see one continuous stack of all the frames written so far but those
+     *  of the file still being written. Readers that keep it open should reopen it to
+     *  see the files finished since.
+     *
+     *  The master is written without HDF5's file locks, so that readers holding it
+     *  open do not stop the stream. If it still cannot be updated a warning is printed
+     *  and it catches up when the next file is finished; only failing to update it when
+     *  the stream is closed is an error. Then a shorter last file, or files of uneven
+     *  lengths, get the virtual dataset listing every file instead. */
+    int master;
+    /*! Per-frame values kept in a table "events" next to the frames of every file,
+     *  see cxi_append_frames_with_values(), or NULL. Must stay valid while the stream is open. */
+    const CXI_Column * columns;
+    /*! The number of \p columns. */
+    int column_count;
+    /*! The name of one of \p columns, e.g. "pulse_id", whose index is stored in
+     *  every file as it is finished, see cxi_build_frame_index(), or NULL. */
+    const char * index_column;
+  }CXI_Stream_Options;
+
+  /*! A stack of frames appended to a sequence of CXI files.
+   *
+   * The files are named "<prefix>_0001.cxi", "<prefix>_0002.cxi"... and each
+   * holds the frames it received in entry_1/data_1/data, a dataset chunked
+   * along the frames that grows as they arrive. Frames are gathered in
+   * whole chunks, which are written straight to the file without going
+   * through HDF5's type conversion when they are not compressed.
+   */
+  typedef struct{
+    /*! The options the stream was created with, with \p chunk_frames filled in. */
+    CXI_Stream_Options options;
+    /*! The file names without the counter and extension. */
+    char * prefix;
+    /*! The number of dimensions of a frame. */
+    int frame_rank;
+    /*! The dimensions of a frame. */
+    hsize_t frame_dimensions[H5S_MAX_RANK-1];
+    /*! The datatype of the frames in the files. */
+    hid_t data_type;
+    /*! The size of a frame in the files, in bytes. */
+    size_t frame_bytes;
+    /*! The file being written. */
+    CXI_File * file;
+    /*! The frames of the file being written. */
+    CXI_Dataset * dataset;
+    /*! The name of the file being written. */
+    char * filename;
+    /*! The number of files started, the current one included. */
+    int file_count;
+    /*! The number of frames in the current file, buffered ones included. */
+    hsize_t file_frames;
+    /*! The size of the current file, with its frames written so far uncompressed. */
+    hsize_t file_bytes;
+    /*! The number of frames appended to the stream. */
+    hsize_t frame_count;
+    /*! Frames waiting to complete a chunk. */
+    void * pending;
+    /*! The number of frames in \p pending. */
+    hsize_t pending_frames;
+    /*! The pool \p pending comes from. */
+    CXI_Frame_Pool * pool;
+    /*! The name of the master file, or NULL. */
+    char * master_filename;
+    /*! The number of frames of each finished file. */
+    hsize_t * part_frames;
+    /*! The number of finished files. */
+    int part_count;
+    /*! The number of finished files linked from the master. */
+    int master_parts;
+    /*! The frames of each file in the pattern the virtual dataset of the master follows,
+     *  or 0 if it lists the files or does not exist yet. */
+    hsize_t master_block;
+    /*! The per-frame values of the file being written, or NULL without columns. */
+    CXI_Frame_Table * table;
+  }CXI_Frame_Stream;
+
+  /*! Start a stream of frames and create its first file.
+   *
+   * \param prefix The file names without the counter and extension.
+   * \param frame_rank The number of dimensions of a frame.
+   * \param frame_dimensions The dimensions of a frame.
+   * \param data_type The datatype of the frames in the files.
+   * \param options How to lay out and split the files, or NULL for a single file of 4 MB chunks.
+   *
+   * \return The stream, to be closed with cxi_close_frame_stream(), or NULL in case of error.
+   */
+  CXI_Frame_Stream * cxi_create_frame_stream(const char * prefix, int frame_rank,
+					     const hsize_t * frame_dimensions, hid_t data_type,
+					     const CXI_Stream_Options * options);
+
+  /*! Append frames to a stream, starting new files as needed.
+   *
+   * Frames in the file datatype are copied chunk by chunk, other types are
+   * converted by HDF5 and written as they come.
+   *
+   * \param stream The stream.
+   * \param frames The frames, one after the other.
+   * \param n The number of frames.
+   * \param mem_type The datatype of \p frames.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_append_frames(CXI_Frame_Stream * stream, const void * frames, hsize_t n, hid_t mem_type);
+
+  /*! Append frames together with their per-frame values.
+   *
+   * The values go to the table of the file receiving each frame, so every
+   * file holds as many rows as frames once it is finished. Frames appended
+   * with cxi_append_frames() get zeros in every column.
+   *
+   * \param stream The stream, created with \p columns in its options.
+   * \param frames The frames, one after the other.
+   * \param n The number of frames.
+   * \param mem_type The datatype of \p frames.
+   * \param values One array of \p n values per column, in the type of the column.
+   *
+   * \return Zero if successful or a negative number in case of error.
+   */
+  int cxi_append_frames_with_values(CXI_Frame_Stream * stream, const void * frames, hsize_t n,
+				    hid_t mem_type, const void * const * values);
+
+  /*! Write the buffered frames and close the current file.
+   *
+   * \param stream The stream, which is freed.
+   *
+   * \return Zero if successful or a negative number if some frames could not be written.
+   */
+  int cxi_close_frame_stream(CXI_Frame_Stream * stream);
+
+/*! \} // stream
+ */
+
+/*! \addtogroup merge Merging and Subsetting
+ *  \{
+ */
+
+  /*! Stack the frames of several datasets, e.g. the runs of an experiment, into a new dataset.
+   *
+   * The new dataset has the data type, chunk shape and filters of the first
+   * source and, when chunked, can grow along the frames. Chunks of sources
+   * laid out and compressed the same way are copied as stored, without
+   * being decompressed, whenever they fall on a chunk of the new dataset;
+   * only the frames of chunks shared by two sources are decoded and encoded
+   * again. Sources laid out differently are converted frame by frame. The
+   * chunks copied as stored are counted in CXI_Stats::raw_chunk_copies.
+   * Attributes of the first source are copied too.
+   *
+   * \param loc The HDF5 location of the new dataset, e.g. the handle of a CXI_Data.
+   * \param name The name of the new dataset, e.g. "data".
+   * \param sources The datasets, whose frames all have the same dimensions.
+   * \param count The number of sources.
+   * \param merged Filled in with the new dataset. The caller closes its \p handle
+   *        and \p data_type and frees its \p dimensions.
+   *
+   * \return A reference to the new dataset or NULL in case of error.
+   */
+  CXI_Dataset_Reference * cxi_merge_datasets(hid_t loc, const char * name, CXI_Dataset ** sources,
+					     int count, CXI_Dataset * merged);
+
+  /*! Copy some frames of a dataset, e.g. the hits of a run, to a new dataset.
+   *
+   * Frames are copied like in cxi_merge_datasets(): runs of consecutive
+   * frames that fill whole chunks, starting at the same position within a
+   * chunk in both datasets, are copied as stored.
+   *
+   * \param loc The HDF5 location of the new dataset.
+   * \param name The name of the new dataset.
+   * \param source The dataset to copy from.
+   * \param frames The indices of the frames to copy, in the order they are wanted.
+   * \param n The number of frames.
+   * \param subset Filled in with the new dataset, as in cxi_merge_datasets().
+   *
+   * \return A reference to the new dataset or NULL in case of error.
+   */
+  CXI_Dataset_Reference * cxi_subset_dataset(hid_t loc, const char * name, CXI_Dataset * source,
+					     const hsize_t * frames, hsize_t n, CXI_Dataset * subset);
+
+/*! \} // merge
+ */
+
+/*! \addtogroup query Frame Queries
+ *  \{
+ */
+
+  /*! The comparisons of a query condition. */
+  typedef enum{
+    CXI_Less,
+    CXI_Less_Equal,
+    CXI_Greater,
+    CXI_Greater_Equal,
+    CXI_Equal,
+    CXI_Not_Equal,
+    /*! Between the value and the upper bound, both included */
+    CXI_Between
+  }CXI_Compare;
+
+  /*! A selection of frames such as the ones matched by a query. */
+  typedef struct{
+    /*! The number of frames selected from */
+    hsize_t frame_count;
+    /*! Bit f % 64 of word f / 64 is set for each selected frame f */
+    uint64_t * bitmap;
+    /*! The number of selected frames */
+    hsize_t selected_count;
+    /*! The indices of the selected frames, in increasing order */
+    hsize_t * frames;
+  }CXI_Selection;
+
+  /*! A conjunction and disjunction of conditions on per-frame values. */
+  typedef struct CXI_Query CXI_Query;
+
+  /*! Start a query on the per-frame values below an HDF5 location.
+   *
+   * \param loc The location the column names of the conditions are relative to,
+   *        e.g. the handle of a CXI_Entry or of a CXI_Frame_Table.
+   *
+   * \return The query, to be freed with cxi_free_query(), or NULL in case of error.
+   */
+  CXI_Query * cxi_create_query(hid_t loc);
+
+  /*! Add a condition to the current term of a query.
+   *
+   * The conditions of a term must all hold for a frame to match it.
+   *
+   * \param query The query.
+   * \param column The path of a one dimensional dataset with a value per frame,
+   *        e.g. "data_1/events/pulse_energy". Values are compared as doubles.
+   * \param op The comparison.
+   * \param value The value compared with, or the lower bound of CXI_Between.
+   * \param upper The upper bound of CXI_Between, ignored otherwise.
+   *
+   * \return 0 on success, -1 otherwise.
+   */
+  int cxi_query_where(CXI_Query * query, const char * column, CXI_Compare op, double value, double upper);
+
+  /*! Start a new term of a query. Frames matching any term match the query. */
+  int cxi_query_or(CXI_Query * query);
+
+  /*! Find the frames matching a query.
+   *
+   * The columns are read a block of frames at a time, each once whatever
+   * the number of conditions on it, and compared two values at a time with
+   * SSE2 where available, building the bitmap of the selection directly.
+   *
+   * \return The matching frames, to be freed with cxi_free_selection(), or NULL
+   *         in case of error, e.g. when the columns differ in length.
+   */
+  CXI_Selection * cxi_run_query(CXI_Query * query);
+
+  void cxi_free_query(CXI_Query * query);
+  void cxi_free_selection(CXI_Selection * selection);
+
+  /*! Read some of the selected frames of a dataset in a single call.
+   *
+   * The selected frames can also be copied to a new dataset with
+   * cxi_subset_dataset(), passing \p frames and \p selected_count.
+   *
+   * \param dataset The dataset with the frames.
+   * \param selection The selection, e.g. from cxi_run_query().
+   * \param first The first selected frame to read, counted within the selection.
+   * \param n The number of selected frames to read.
+   * \param data Filled in with the n frames one after the other.
+   * \param mem_type The type of \p data.
+   *
+   * \return 0 on success, -1 otherwise.
+   */
+  int cxi_read_selected_frames(CXI_Dataset * dataset, const CXI_Selection * selection, hsize_t first,
+			       hsize_t n, void * data, hid_t mem_type);
+
+/*! \} // query
+ */
+
+/*! \addtogroup index Frame Indices
+ *  \{
+ */
+
+  /*! The frames of each ID of a per-frame column, such as pulse IDs or timestamps. */
+  typedef struct{
+    /*! The number of frames indexed */
+    hsize_t frame_count;
+    /*! The IDs of all the frames in increasing order */
+    uint64_t * ids;
+    /*! The frame of each of \p ids, or NULL when the IDs were already in frame order */
+    uint64_t * frames;
+  }CXI_Frame_Index;
+
+  /*! Build the index of a column and store it in the file.
+   *
+   * The index of "a/b" is kept in the group "a/frame_index/b", replacing any
+   * previous one. IDs already in increasing frame order, as pulse IDs usually
+   * are, need no more than the column itself, and only the number of frames
+   * indexed is stored. Rows of a CXI_Frame_Table must be flushed first.
+   *
+   * \param loc The location the column is relative to, e.g. the handle of a CXI_Frame_Table.
+   * \param column The path of a one dimensional dataset of integer IDs, e.g. "pulse_id".
+   *
+   * \return 0 on success, -1 otherwise.
+   */
+  int cxi_build_frame_index(hid_t loc, const char * column);
+
+  /*! Open the index of a column, building it when missing or stale.
+   *
+   * An index built for fewer frames than the column now holds is built again.
+   * Indices built here are stored unless the file is open read only.
+   *
+   * \param loc The location the column is relative to.
+   * \param column The path of the column.
+   *
+   * \return The index, to be closed with cxi_close_frame_index(), or NULL in case of error.
+   */
+  CXI_Frame_Index * cxi_open_frame_index(hid_t loc, const char * column);
+
+  /*! Find the frames of many IDs at once.
+   *
+   * IDs given in increasing order are found by galloping on from the previous
+   * one, others each by a search of the whole index. Large batches are split
+   * between threads.
+   *
+   * \param index The index.
+   * \param ids The IDs to look up.
+   * \param n The number of IDs.
+   * \param frames Filled in with the first frame of each ID, or -1 for IDs not found.
+   * \param interpolate If not 0 guess the position of IDs from their value, which for
+   *        evenly spaced IDs takes a few steps instead of log2(frame_count). Searches
+   *        fall back on bisection whenever guesses stop paying off.
+   *
+   * \return 0 on success, -1 otherwise.
+   */
+  int cxi_lookup_frames(const CXI_Frame_Index * index, const uint64_t * ids, hsize_t n, int64_t * frames,
+			int interpolate);
+
+  void cxi_close_frame_index(CXI_Frame_Index * index);
+
+/*! \} // index
+ */
+
+/*! \addtogroup sampler Shuffled Batches
+ *  \{
+ */
+
+  /*! How cxi_create_batch_sampler() shuffles and prepares its batches. */
+  typedef struct{
+    /*! The number of frames per batch. */
+    hsize_t batch_frames;
+    /*! The number of chunks read into memory together, whose frames are shuffled
+     *  among themselves. More chunks shuffle better and take more memory; as many
+     *  as the dataset holds shuffle it completely. 0 picks 8. */
+    int window_chunks;
+    /*! The number of batches prepared in advance. 0 picks 2. */
+    int prefetch_batches;
+    /*! The seed of the shuffles. Epochs are shuffled differently but the same way for the same seed. */
+    uint64_t seed;
+    /*! The CXI_Pool_Flags of the batch buffers, e.g. CXI_Pool_Page_Aligned. */
+    int pool_flags;
+    /*! If not 0 leave out the last batch of an epoch when it has fewer than \p batch_frames frames. */
+    int drop_last;
+  }CXI_Sampler_Options;
+
+  /*! A batch of frames handed out by cxi_next_batch(). */
+  typedef struct{
+    /*! The frames one after the other, in the memory type of the sampler */
+    void * data;
+    /*! The index in the dataset of each frame */
+    const hsize_t * frames;
+    /*! The number of frames in the batch */
+    hsize_t frame_count;
+    /*! The epoch the batch belongs to, counting from 0 */
+    uint64_t epoch;
+  }CXI_Batch;
+
+  /*! Reads a dataset in shuffled batches of frames. Opaque. */
+  typedef struct CXI_Batch_Sampler CXI_Batch_Sampler;
+
+  /*! Start reading shuffled batches of the frames of a dataset, e.g. to train on them.
+   *
+   * Each epoch visits the chunks of the dataset in a random order, a window
+   * of them at a time, and hands out the frames of a window in a random
+   * order. Every chunk is read and decompressed once per epoch, in a single
+   * read, so no more is read than the dataset holds however the frames are
+   * shuffled. A background thread reads and assembles the next batches while
+   * the current ones are used. With an HDF5 that is not thread-safe it only
+   * reads while cxi_next_batch() waits, so that the caller can use HDF5 in
+   * between. Batch buffers come from a CXI_Frame_Pool and
+   * are reused, so they can be pinned once, e.g. for transfers to a GPU.
+   *
+   * \param dataset The dataset, which must stay open and must not be used elsewhere,
+   *        its statistics included, until the sampler is freed.
+   * \param mem_type The type of the frames in the batches.
+   * \param options How to shuffle.
+   *
+   * \return The sampler, to be freed with cxi_free_batch_sampler(), or NULL in case of error.
+   */
+  CXI_Batch_Sampler * cxi_create_batch_sampler(CXI_Dataset * dataset, hid_t mem_type,
+					       const CXI_Sampler_Options * options);
+
+  /*! Take the next batch, waiting for it if need be.
+   *
+   * The batch must be given back with cxi_release_batch() once used; no more
+   * than two batches should be held at a time.
+   *
+   * \param sampler The sampler.
+   * \param batch Filled in with the batch.
+   *
+   * \return 1 for a batch, 0 at the end of an epoch, after which the next call starts
+   *         the next epoch, or -1 in case of error.
+   */
+  int cxi_next_batch(CXI_Batch_Sampler * sampler, CXI_Batch * batch);
+
+  /*! Give back a batch from cxi_next_batch() for its buffer to be filled again. */
+  void cxi_release_batch(CXI_Batch_Sampler * sampler, CXI_Batch * batch);
+
+  /*! Stop the background thread and free a sampler, whose batches must all have been released. */
+  void cxi_free_batch_sampler(CXI_Batch_Sampler * sampler);
+
+/*! \} // sampler
+ */
+
+/*! \addtogroup transpose Pixel Series
+ *  \{
+ */
+
+  /*! Called by cxi_foreach_pixel_series() for each block of pixels.
+   *
+   * \param series The series of the pixels one after the other, frame f of pixel
+   *        first_pixel+p being series[p*frames+f]. Valid until the callback returns.
+   * \param first_pixel The index of the first pixel within a frame.
+   * \param pixels The number of pixels in the block, whole rows of them.
+   * \param frames The number of frames of each series.
+   * \param mem_type The type of \p series, the native type of the dataset.
+   * \param user The pointer given to cxi_foreach_pixel_series().
+   *
+   * \return 0 to go on, anything else to stop.
+   */
+  typedef int (*CXI_Series_Callback)(const void * series, hsize_t first_pixel, hsize_t pixels, hsize_t frames,
+				     hid_t mem_type, void * user);
+
+  /*! Hand the time series of every pixel of a stack of frames to a callback.
+   *
+   * As many rows of pixels as fit in \p max_bytes are gathered at a time
+   * from blocks of whole chunks, see cxi_dataset_foreach_block(), and
+   * transposed in cache sized tiles. Each group of rows takes a pass over
+   * the dataset, so when the series of a few rows already fill the memory
+   * it is cheaper to write a pixel-major copy with
+   * cxi_create_pixel_major_dataset() first.
+   *
+   * \param dataset The stack of frames.
+   * \param max_bytes The memory the series may take, or 0 for 256 MB. At least a row of
+   *        pixels is always gathered.
+   * \param callback The function called for each block of pixels.
+   * \param user Passed to \p callback.
+   *
+   * \return 0 once every pixel was handed out, what the callback returned if it
+   *         stopped early, or -1 in case of error.
+   */
+  int cxi_foreach_pixel_series(CXI_Dataset * dataset, size_t max_bytes, CXI_Series_Callback callback, void * user);
+
+  /*! Write a stack of frames pixel-major, the frames becoming the fastest dimension.
+   *
+   * A stack of dimensions (frames, rows, columns) gives a dataset of
+   * dimensions (rows, columns, frames), whose slices are the series of a row
+   * of pixels and can be read with cxi_read_dataset_slices() or
+   * cxi_dataset_foreach_block(). The stack is read once, a block of whole
+   * chunks at a time, and each block written transposed. Chunks of the new
+   * dataset span the frames of a block, or an even part of them, so that each
+   * is written once, with as many pixels as keep them about 1 MB, and are
+   * compressed like those of the stack. Memory use does not depend on the
+   * number of frames.
+   *
+   * \param loc The HDF5 location of the new dataset.
+   * \param name The name of the new dataset.
+   * \param source The stack of frames, with at least two dimensions.
+   * \param transposed Filled in with the new dataset. The caller closes its \p handle
+   *        and \p data_type and frees its \p dimensions.
+   *
+   * \return A reference to the new dataset or NULL in case of error.
+   */
+  CXI_Dataset_Reference * cxi_create_pixel_major_dataset(hid_t loc, const char * name, CXI_Dataset * source,
+							 CXI_Dataset * transposed);
+
+/*! \} // transpose
+ */
+
 
 #ifdef __cplusplus 
 } /* extern "C" */
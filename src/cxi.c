@@ -2,22 +2,14 @@
 #include <string.h>
 #include <ctype.h>
 #include "cxi.h"
+#include "cxi_private.h"
 #include <stdarg.h>
 
 
-#if defined CXI_DEBUG 
-#define  cxi_debug(...) _cxi_debug(__FILE__,__LINE__,__VA_ARGS__)
-#else  
-#define  cxi_debug(...) 
-#endif 
-
-#define  cxi_warning(...) _cxi_warning(__FILE__,__LINE__,__VA_ARGS__)
-
-
 
 static int CXI_VERSION = 130;
 
-static void _cxi_debug(char * file, int line, char *format, ...){
+void _cxi_debug(char * file, int line, char *format, ...){
   va_list ap;
   va_start(ap,format);
   fprintf(stderr, "libcxi debug: ");
@@ -26,7 +18,7 @@ static void _cxi_debug(char * file, int line, char *format, ...){
   va_end(ap);
 }
 
-static void _cxi_warning(char * file, int line, char *format, ...){
+void _cxi_warning(char * file, int line, char *format, ...){
   va_list ap;
   va_start(ap,format);
   fprintf(stderr, "libcxi warning: ");
@@ -35,16 +27,6 @@ static void _cxi_warning(char * file, int line, char *format, ...){
   va_end(ap);
 }
 
-static void cxi_close_data(CXI_Data_Reference * ref);
-static void cxi_close_entry(CXI_Entry_Reference * ref);
-static void cxi_close_instrument(CXI_Instrument_Reference * ref);
-static void cxi_close_source(CXI_Source_Reference * ref);
-static void cxi_close_detector(CXI_Detector_Reference * ref);
-static void cxi_close_attenuator(CXI_Attenuator_Reference * ref);
-static void cxi_close_monochromator(CXI_Monochromator_Reference * ref);
-static void cxi_close_image(CXI_Image_Reference * ref);
-static void cxi_close_sample(CXI_Sample_Reference * ref);
-static void cxi_close_dataset(CXI_Dataset_Reference * data);
 
 static int follows_iso8601(char * date){
   /* We'll only support dates with 4 digit years */
@@ -139,6 +121,7 @@ static int array_total_size(hid_t dataset){
    hid_t s = H5Dget_space(dataset);
    int ndims = H5Sget_simple_extent_ndims(s);
    if(ndims == 0){
+     H5Sclose(s);
      return -1;
    }
    hsize_t * dims = malloc(sizeof(hsize_t)*ndims);
@@ -148,15 +131,17 @@ static int array_total_size(hid_t dataset){
    for(int i = 0;i<ndims;i++){
      size *= dims[i];
    }
+   free(dims);
    return size;
 }
 
-static int try_read_string(hid_t loc, char * name, char ** dest){
+static int try_read_string(CXI_Arena * arena, hid_t loc, char * name, char ** dest){
   if(H5Lexists(loc,name,H5P_DEFAULT)){
     hid_t ds = H5Dopen(loc,name,H5P_DEFAULT);
     hid_t t = H5Dget_type(ds);
     if(H5Tget_class(t) == H5T_STRING){
-      *dest = malloc(sizeof(char)*H5Tget_size(t));
+      /* Fixed length strings are not necessarily NUL terminated */
+      *dest = cxi_arena_calloc(arena, sizeof(char), H5Tget_size(t)+1);
       H5Dread(ds,t,H5S_ALL,H5S_ALL,H5P_DEFAULT,*dest);
     }
     H5Tclose(t);
@@ -225,6 +210,18 @@ static int try_read_int(hid_t loc, char * name, int * dest){
   return 0;
 }
 
+static int try_write_int(hid_t loc, char * name, int value){
+  hid_t space = H5Screate(H5S_SCALAR);
+  if(space < 0) return space;
+  hid_t ds = H5Dcreate(loc,name,H5T_NATIVE_INT,space,H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+  if(ds < 0) return ds;
+  herr_t status = H5Sclose(space);
+  if(status < 0) return status;    
+  status = H5Dwrite(ds,H5T_NATIVE_INT,H5S_ALL,H5S_ALL,H5P_DEFAULT,&value);
+  if(status < 0) return status;    
+  return H5Dclose(ds);
+}
+
 static int try_read_float_array(hid_t loc, char * name, double * dest, int size){
   if(H5Lexists(loc,name,H5P_DEFAULT)){
     hid_t ds = H5Dopen(loc,name,H5P_DEFAULT);
@@ -277,75 +274,77 @@ static int try_write_float_3D_array(hid_t loc, char * name, double * values, int
 
 
 CXI_Data * cxi_open_data(CXI_Data_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening data");
-  char buffer[1024];
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
-  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  CXI_Data * data = cxi_arena_calloc(ref->arena, sizeof(CXI_Data), 1);
   if(!data){
     return NULL;
   }
 
-  data->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  data->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(data->handle < 0){
-    free(data);
+    cxi_arena_release(ref->arena, data);
     return NULL;
   }
   ref->data = data;  
   if(H5Lexists(data->handle,"data",H5P_DEFAULT)){
-    data->data = calloc(sizeof(CXI_Dataset_Reference),1);
+    data->data = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     data->data->parent_handle = data->handle;
-    data->data->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(data->data->group_name,"data");          
+    data->data->group_name = cxi_arena_strdup(ref->arena, "data");
+    data->data->arena = ref->arena;
   }
 
   if(H5Lexists(data->handle,"errors",H5P_DEFAULT)){
-    data->errors = calloc(sizeof(CXI_Dataset_Reference),1);
+    data->errors = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     data->errors->parent_handle = data->handle;
-    data->errors->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(data->errors->group_name,"errors");          
+    data->errors->group_name = cxi_arena_strdup(ref->arena, "errors");
+    data->errors->arena = ref->arena;
   }
+  cxi_stats_open(ref->arena, begin);
   return data;
 }
 
-static void cxi_close_data(CXI_Data_Reference * ref){
-  cxi_debug("closing data");
-  CXI_Data * data = ref->data;
-  if(data){
-    cxi_close_dataset(data->data);
-    H5Gclose(data->handle);
-    free(data);
-  }
-  free(ref);
-}
 
 
 CXI_File * cxi_open_file(const char * filename, const char * mode){
+  CXI_TRACE();
   cxi_debug("opening file");
-  CXI_File * file = malloc(sizeof(CXI_File));
+  uint64_t begin = cxi_stats_now();
+  /* The file and everything opened from it live in the same arena */
+  CXI_Arena * arena = cxi_arena_new();
+  if(!arena){
+    return NULL;
+  }
+  CXI_File * file = cxi_arena_calloc(arena, sizeof(CXI_File), 1);
   if(!file){
+    cxi_arena_free(arena);
     return NULL;
   }
+  file->arena = arena;
+  cxi_arena_set_stats(arena, &file->stats);
   if(strcmp(mode,"r") == 0){
     file->handle = H5Fopen(filename, H5F_ACC_RDONLY,H5P_DEFAULT);
     if(file->handle < 0){
-      free(file);
+      cxi_arena_free(arena);
       return NULL;
     }
-    file->filename = malloc(sizeof(char)*(strlen(filename)+1));
-    strcpy(file->filename,filename);
+    cxi_stats_call(&file->stats);
+    file->filename = cxi_arena_strdup(arena, filename);
     /* Read existing entries */
     int n = find_max_suffix(file->handle, "entry");
     file->entry_count = n;
-    file->entries = calloc(sizeof(CXI_Entry_Reference *),n);
+    file->entries = cxi_arena_calloc(arena, sizeof(CXI_Entry_Reference *), n);
     char buffer[1024];
     for(int i = 0;i<n;i++){
-      file->entries[i] = calloc(sizeof(CXI_Entry_Reference),1);
+      file->entries[i] = cxi_arena_calloc(arena, sizeof(CXI_Entry_Reference), 1);
       sprintf(buffer,"entry_%d",i+1);
       file->entries[i]->parent_handle = file->handle;
-      file->entries[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-      strcpy(file->entries[i]->group_name,buffer);      
+      file->entries[i]->group_name = cxi_arena_strdup(arena, buffer);
+      file->entries[i]->arena = arena;
     }
     /* Read the CXI verion */
     file->cxi_version = -1;
@@ -355,11 +354,15 @@ CXI_File * cxi_open_file(const char * filename, const char * mode){
     }else if(file->cxi_version >= CXI_VERSION){
       /* Warning: CXI version of the file is higher than from libcxi */
     }
+    cxi_stats_open(arena, begin);
     return file;    
   }else if(strcmp(mode,"w") == 0){
     file->handle = H5Fcreate(filename,H5F_ACC_TRUNC,H5P_DEFAULT,H5P_DEFAULT);
-    file->filename = malloc(sizeof(char)*(strlen(filename)+1));
-    strcpy(file->filename,filename);
+    if(file->handle < 0){
+      cxi_arena_free(arena);
+      return NULL;
+    }
+    file->filename = cxi_arena_strdup(arena, filename);
     hsize_t dims[1] = {1};
     hid_t dataspace = H5Screate_simple(1, dims, dims);
     hid_t dataset = H5Dcreate(file->handle, "cxi_version", H5T_NATIVE_INT, dataspace, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
@@ -368,36 +371,41 @@ CXI_File * cxi_open_file(const char * filename, const char * mode){
     H5Sclose(dataspace);
     return file;
   }else{
-    free(file);
+    cxi_arena_free(arena);
     return NULL;
   }    
 }
 
 int cxi_close_file(CXI_File * file){
   cxi_debug("closing file");
-  for(int i = 0;i<file->entry_count;i++){
-    cxi_close_entry(file->entries[i]);
+  if(!file){
+    return -1;
+  }
+  hid_t handle = file->handle;
+  /* Closes every handle opened through the file and frees all the
+     objects at once, including file itself */
+  cxi_arena_free(file->arena);
+  if(H5Fclose(handle) < 0){
+    return -1;
   }
-  H5Fclose(file->handle);
-  free(file->entries);
-  free(file->filename);
-  free(file);
   return 0;
 }
 
 CXI_Entry * cxi_open_entry(CXI_Entry_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening entry");
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
-  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  CXI_Entry * entry = cxi_arena_calloc(ref->arena, sizeof(CXI_Entry), 1);
   if(!entry){
     return NULL;
   }
 
-  entry->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  entry->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(entry->handle < 0){
-    free(entry);
+    cxi_arena_release(ref->arena, entry);
     return NULL;
   }
   ref->entry = entry;
@@ -407,116 +415,83 @@ CXI_Entry * cxi_open_entry(CXI_Entry_Reference * ref){
   /* Search for Data groups */
   n = find_max_suffix(entry->handle, "data");
   entry->data_count = n;
-  entry->data = calloc(sizeof(CXI_Data_Reference *),n);
+  entry->data = cxi_arena_calloc(ref->arena, sizeof(CXI_Data_Reference *), n);
   for(int i = 0;i<n;i++){
-    entry->data[i] = calloc(sizeof(CXI_Data_Reference),1);
+    entry->data[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Data_Reference), 1);
     sprintf(buffer,"data_%d",i+1);
     entry->data[i]->parent_handle = entry->handle;
-    entry->data[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(entry->data[i]->group_name,buffer);      
+    entry->data[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    entry->data[i]->arena = ref->arena;
   }
 
 
   /* Search for Image groups */
   n = find_max_suffix(entry->handle, "image");
   entry->image_count = n;
-  entry->images = calloc(sizeof(CXI_Image_Reference *),n);
+  entry->images = cxi_arena_calloc(ref->arena, sizeof(CXI_Image_Reference *), n);
   for(int i = 0;i<n;i++){
-    entry->images[i] = calloc(sizeof(CXI_Image_Reference),1);
+    entry->images[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Image_Reference), 1);
     sprintf(buffer,"image_%d",i+1);
     entry->images[i]->parent_handle = entry->handle;
-    entry->images[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(entry->images[i]->group_name,buffer);      
+    entry->images[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    entry->images[i]->arena = ref->arena;
   }
 
   /* Search for Instrument groups */
   n = find_max_suffix(entry->handle, "instrument");
   entry->instrument_count = n;
-  entry->instruments = calloc(sizeof(CXI_Instrument_Reference *),n);
+  entry->instruments = cxi_arena_calloc(ref->arena, sizeof(CXI_Instrument_Reference *), n);
   for(int i = 0;i<n;i++){
-    entry->instruments[i] = calloc(sizeof(CXI_Instrument_Reference),1);
+    entry->instruments[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Instrument_Reference), 1);
     sprintf(buffer,"instrument_%d",i+1);
     entry->instruments[i]->parent_handle = entry->handle;
-    entry->instruments[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(entry->instruments[i]->group_name,buffer);      
+    entry->instruments[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    entry->instruments[i]->arena = ref->arena;
   }
 
   /* Search for Sample groups */
   n = find_max_suffix(entry->handle, "sample");
   entry->sample_count = n;
-  entry->samples = calloc(sizeof(CXI_Sample_Reference *),n);
+  entry->samples = cxi_arena_calloc(ref->arena, sizeof(CXI_Sample_Reference *), n);
   for(int i = 0;i<n;i++){
-    entry->samples[i] = calloc(sizeof(CXI_Sample_Reference),1);
+    entry->samples[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Sample_Reference), 1);
     sprintf(buffer,"sample_%d",i+1);
     entry->samples[i]->parent_handle = entry->handle;
-    entry->samples[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(entry->samples[i]->group_name,buffer);      
-  }
-
-  /* Search for Instrument groups */
-  n = find_max_suffix(entry->handle, "instrument");
-  entry->instrument_count = n;
-  entry->instruments = calloc(sizeof(CXI_Instrument_Reference *),n);
-  for(int i = 0;i<n;i++){
-    entry->instruments[i] = calloc(sizeof(CXI_Instrument_Reference),1);
-    sprintf(buffer,"instrument_%d",i+1);
-    entry->instruments[i]->parent_handle = entry->handle;
-    entry->instruments[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(entry->instruments[i]->group_name,buffer);      
+    entry->samples[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    entry->samples[i]->arena = ref->arena;
   }
 
   /* Now lets try to fill in whatever we can */
-  try_read_string(entry->handle, "end_time",&entry->end_time);
-  try_read_string(entry->handle, "experiment_identifier",&entry->experiment_identifier);
-  try_read_string(entry->handle, "experiment_description",&entry->experiment_description);
-  try_read_string(entry->handle, "program_name",&entry->program_name);
-  try_read_string(entry->handle, "start_time",&entry->start_time);
-  try_read_string(entry->handle, "title",&entry->title);
+  try_read_string(ref->arena, entry->handle, "end_time",&entry->end_time);
+  try_read_string(ref->arena, entry->handle, "experiment_identifier",&entry->experiment_identifier);
+  try_read_string(ref->arena, entry->handle, "experiment_description",&entry->experiment_description);
+  try_read_string(ref->arena, entry->handle, "program_name",&entry->program_name);
+  try_read_string(ref->arena, entry->handle, "start_time",&entry->start_time);
+  try_read_string(ref->arena, entry->handle, "title",&entry->title);
+  cxi_stats_open(ref->arena, begin);
   return entry;
 }
 
 
-static void cxi_close_entry(CXI_Entry_Reference * ref){
-  cxi_debug("closing entry");
-  CXI_Entry * entry = ref->entry;
-  for(int i = 0;i<entry->data_count;i++){
-    cxi_close_data(entry->data[i]);
-  }
-  free(entry->data);
-  for(int i = 0;i<entry->image_count;i++){
-    cxi_close_image(entry->images[i]);
-  }
-  free(entry->images);
-  for(int i = 0;i<entry->instrument_count;i++){
-    cxi_close_instrument(entry->instruments[i]);
-  }
-  free(entry->instruments);
-  for(int i = 0;i<entry->sample_count;i++){
-    cxi_close_sample(entry->samples[i]);
-  }
-  free(entry->samples);
-  H5Gclose(entry->handle);
-  free(entry);
-  free(ref->group_name);
-  free(ref);  
-}
 
 
 
 CXI_Instrument * cxi_open_instrument(CXI_Instrument_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening instrument");
+  uint64_t begin = cxi_stats_now();
   char buffer[1024];
   if(!ref){
     return NULL;
   }
-  CXI_Instrument * instrument = calloc(sizeof(CXI_Instrument),1);
+  CXI_Instrument * instrument = cxi_arena_calloc(ref->arena, sizeof(CXI_Instrument), 1);
   if(!instrument){
     return NULL;
   }
 
-  instrument->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  instrument->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(instrument->handle < 0){
-    free(instrument);
+    cxi_arena_release(ref->arena, instrument);
     return NULL;
   }
   ref->instrument = instrument;
@@ -524,137 +499,106 @@ CXI_Instrument * cxi_open_instrument(CXI_Instrument_Reference * ref){
   /* Search for Attenuator groups */
   n = find_max_suffix(instrument->handle, "attenuator");
   instrument->attenuator_count = n;
-  instrument->attenuators = calloc(sizeof(CXI_Attenuator *),n);
+  instrument->attenuators = cxi_arena_calloc(ref->arena, sizeof(CXI_Attenuator_Reference *), n);
   for(int i = 0;i<n;i++){
-    instrument->attenuators[i] = calloc(sizeof(CXI_Attenuator),1);
+    instrument->attenuators[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Attenuator_Reference), 1);
     sprintf(buffer,"attenuator_%d",i+1);
     instrument->attenuators[i]->parent_handle = instrument->handle;
-    instrument->attenuators[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(instrument->attenuators[i]->group_name,buffer);      
+    instrument->attenuators[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    instrument->attenuators[i]->arena = ref->arena;
   }
 
   /* Search for Detector groups */
   n = find_max_suffix(instrument->handle, "detector");
   instrument->detector_count = n;
-  instrument->detectors = calloc(sizeof(CXI_Detector_Reference *),n);
+  instrument->detectors = cxi_arena_calloc(ref->arena, sizeof(CXI_Detector_Reference *), n);
   for(int i = 0;i<n;i++){
-    instrument->detectors[i] = calloc(sizeof(CXI_Detector_Reference),1);
+    instrument->detectors[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Detector_Reference), 1);
     sprintf(buffer,"detector_%d",i+1);
     instrument->detectors[i]->parent_handle = instrument->handle;
-    instrument->detectors[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(instrument->detectors[i]->group_name,buffer);      
+    instrument->detectors[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    instrument->detectors[i]->arena = ref->arena;
   }
 
 
   /* Search for Monochromator groups */
   n = find_max_suffix(instrument->handle, "monochromator");
   instrument->monochromator_count = n;
-  instrument->monochromators = calloc(sizeof(CXI_Monochromator *),n);
+  instrument->monochromators = cxi_arena_calloc(ref->arena, sizeof(CXI_Monochromator_Reference *), n);
   for(int i = 0;i<n;i++){
-    instrument->monochromators[i] = calloc(sizeof(CXI_Monochromator),1);
+    instrument->monochromators[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Monochromator_Reference), 1);
     sprintf(buffer,"monochromator_%d",i+1);
     instrument->monochromators[i]->parent_handle = instrument->handle;
-    instrument->monochromators[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(instrument->monochromators[i]->group_name,buffer);      
+    instrument->monochromators[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    instrument->monochromators[i]->arena = ref->arena;
   }
 
   /* Search for Source groups */
   n = find_max_suffix(instrument->handle, "source");
   instrument->source_count = n;
-  instrument->sources = calloc(sizeof(CXI_Source *),n);
+  instrument->sources = cxi_arena_calloc(ref->arena, sizeof(CXI_Source_Reference *), n);
   for(int i = 0;i<n;i++){
-    instrument->sources[i] = calloc(sizeof(CXI_Source),1);
+    instrument->sources[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Source_Reference), 1);
     sprintf(buffer,"source_%d",i+1);
     instrument->sources[i]->parent_handle = instrument->handle;
-    instrument->sources[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(instrument->sources[i]->group_name,buffer);      
+    instrument->sources[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    instrument->sources[i]->arena = ref->arena;
   }
 
 
   /* Now lets try to fill in whatever we can */
-  try_read_string(instrument->handle, "name",&instrument->name);
+  try_read_string(ref->arena, instrument->handle, "name",&instrument->name);
+  cxi_stats_open(ref->arena, begin);
   return instrument;
 }
 
-static void cxi_close_instrument(CXI_Instrument_Reference * ref){
-  cxi_debug("closing instrument");
-  CXI_Instrument * instrument = ref->instrument;
-  if(instrument){
-    for(int i = 0;i<instrument->detector_count;i++){
-      cxi_close_detector(instrument->detectors[i]);
-    }
-    free(instrument->detectors);
-    for(int i = 0;i<instrument->attenuator_count;i++){
-      cxi_close_attenuator(instrument->attenuators[i]);
-    }
-    free(instrument->attenuators);
-    for(int i = 0;i<instrument->monochromator_count;i++){
-      cxi_close_monochromator(instrument->monochromators[i]);
-    }
-    free(instrument->monochromators);
-    for(int i = 0;i<instrument->source_count;i++){
-      cxi_close_source(instrument->sources[i]);
-    }
-    free(instrument->sources);
-
-    H5Gclose(instrument->handle);
-    free(instrument);
-  }
-  free(ref->group_name);
-  free(ref);  
-}
 
 
 CXI_Source * cxi_open_source(CXI_Source_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening source");
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
-  CXI_Source * source = calloc(sizeof(CXI_Source),1);
+  CXI_Source * source = cxi_arena_calloc(ref->arena, sizeof(CXI_Source), 1);
   if(!source){
     return NULL;
   }
-  source->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  source->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(source->handle < 0){
+    cxi_arena_release(ref->arena, source);
     return NULL;
   }
   ref->source = source;
 
-  try_read_string(source->handle, "name",&source->name);
+  try_read_string(ref->arena, source->handle, "name",&source->name);
   source->energy_valid = try_read_float(source->handle, "energy",&source->energy);
   source->pulse_energy_valid = try_read_float(source->handle, "pulse_energy",&source->pulse_energy);
   source->pulse_width_valid = try_read_float(source->handle, "pulse_width",&source->pulse_width);
 
+  cxi_stats_open(ref->arena, begin);
   return source;
 }
 
-static void cxi_close_source(CXI_Source_Reference * ref){
-  cxi_debug("closing source");
-  CXI_Source * source = ref->source;
-  if(source){
-    free(source->name);
-    H5Gclose(source->handle);
-    free(source);
-  }
-  free(ref->group_name);
-  free(ref);
-}
 
 
 CXI_Detector * cxi_open_detector(CXI_Detector_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening detector");
+  uint64_t begin = cxi_stats_now();
   char buffer[1024];
   if(!ref){
     return NULL;
   }
-  CXI_Detector * detector = calloc(sizeof(CXI_Detector),1);
+  CXI_Detector * detector = cxi_arena_calloc(ref->arena, sizeof(CXI_Detector), 1);
   if(!detector){
     return NULL;
   }
 
-  detector->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  detector->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(detector->handle < 0){
-    free(detector);
+    cxi_arena_release(ref->arena, detector);
     return NULL;
   }
   ref->detector = detector;
@@ -666,11 +610,11 @@ CXI_Detector * cxi_open_detector(CXI_Detector_Reference * ref){
     cxi_warning("Opened detector with multiple geometries");
   }
   for(int i = 0;i<n;i++){
-    detector->geometry = calloc(sizeof(CXI_Geometry_Reference),1);
+    detector->geometry = cxi_arena_calloc(ref->arena, sizeof(CXI_Geometry_Reference), 1);
     sprintf(buffer,"geometry_%d",i+1);
     detector->geometry->parent_handle = detector->handle;
-    detector->geometry->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(detector->geometry->group_name,buffer);      
+    detector->geometry->group_name = cxi_arena_strdup(ref->arena, buffer);
+    detector->geometry->arena = ref->arena;
   }
 
 
@@ -682,7 +626,7 @@ CXI_Detector * cxi_open_detector(CXI_Detector_Reference * ref){
 						    &detector->counts_per_joule);
   detector->data_sum_valid = try_read_float(detector->handle, "data_sum",
 					    &detector->data_sum);
-  try_read_string(detector->handle, "description",&detector->description);
+  try_read_string(ref->arena, detector->handle, "description",&detector->description);
   detector->distance_valid = try_read_float(detector->handle, 
 					    "distance",&detector->distance);
   detector->x_pixel_size_valid = try_read_float(detector->handle,
@@ -713,113 +657,122 @@ CXI_Detector * cxi_open_detector(CXI_Detector_Reference * ref){
   }
 
   if(H5Lexists(detector->handle,"data",H5P_DEFAULT)){
-    detector->data = calloc(sizeof(CXI_Dataset_Reference),1);
+    detector->data = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     detector->data->parent_handle = detector->handle;
-    detector->data->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(detector->data->group_name,"data");          
+    detector->data->group_name = cxi_arena_strdup(ref->arena, "data");
+    detector->data->arena = ref->arena;
   }
   if(H5Lexists(detector->handle,"data_dark",H5P_DEFAULT)){
-    detector->data_dark = calloc(sizeof(CXI_Dataset_Reference),1);
+    detector->data_dark = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     detector->data_dark->parent_handle = detector->handle;
-    detector->data_dark->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(detector->data_dark->group_name,"data_dark");          
+    detector->data_dark->group_name = cxi_arena_strdup(ref->arena, "data_dark");
+    detector->data_dark->arena = ref->arena;
   }
 
   if(H5Lexists(detector->handle,"data_white",H5P_DEFAULT)){
-    detector->data_white = calloc(sizeof(CXI_Dataset_Reference),1);
+    detector->data_white = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     detector->data_white->parent_handle = detector->handle;
-    detector->data_white->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(detector->data_white->group_name,"data_white");          
+    detector->data_white->group_name = cxi_arena_strdup(ref->arena, "data_white");
+    detector->data_white->arena = ref->arena;
   }
 
   if(H5Lexists(detector->handle,"data_error",H5P_DEFAULT)){
-    detector->data_error = calloc(sizeof(CXI_Dataset_Reference),1);
+    detector->data_error = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     detector->data_error->parent_handle = detector->handle;
-    detector->data_error->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(detector->data_error->group_name,"data_error");          
+    detector->data_error->group_name = cxi_arena_strdup(ref->arena, "data_error");
+    detector->data_error->arena = ref->arena;
   }
 
 
   if(H5Lexists(detector->handle,"mask",H5P_DEFAULT)){
-    detector->mask = calloc(sizeof(CXI_Dataset_Reference),1);
+    detector->mask = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     detector->mask->parent_handle = detector->handle;
-    detector->mask->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(detector->mask->group_name,"mask");      
-    
+    detector->mask->group_name = cxi_arena_strdup(ref->arena, "mask");
+    detector->mask->arena = ref->arena;
   }
 
+  cxi_stats_open(ref->arena, begin);
   return detector;
 }
 
-static void cxi_close_detector(CXI_Detector_Reference * ref){
-  cxi_debug("closing detector");
-  CXI_Detector * detector = ref->detector;
-  if(detector){
-    cxi_close_dataset(detector->data);
-    cxi_close_dataset(detector->data_white);
-    cxi_close_dataset(detector->data_dark);
-    cxi_close_dataset(detector->data_error);
-    cxi_close_dataset(detector->mask);
-    H5Gclose(detector->handle);
-    free(detector);
-  }
-  free(ref->group_name);
-  free(ref);
+
+CXI_Geometry * cxi_open_geometry(CXI_Geometry_Reference * ref){
+  CXI_TRACE();
+  cxi_debug("opening geometry");
+  uint64_t begin = cxi_stats_now();
+  if(!ref){
+    return NULL;
+  }
+  CXI_Geometry * geometry = cxi_arena_calloc(ref->arena, sizeof(CXI_Geometry), 1);
+  if(!geometry){
+    return NULL;
+  }
+
+  geometry->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
+  if(geometry->handle < 0){
+    cxi_arena_release(ref->arena, geometry);
+    return NULL;
+  }
+  ref->geometry = geometry;
+  geometry->orientation_valid = try_read_float_array(geometry->handle, "orientation",
+						     (double *)geometry->orientation,6);
+  geometry->translation_valid = try_read_float_array(geometry->handle, "translation",
+						     geometry->translation,3);
+  cxi_stats_open(ref->arena, begin);
+  return geometry;
 }
 
+
 CXI_Dataset * cxi_open_dataset(CXI_Dataset_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening dataset");
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
 
 
   cxi_debug("opening dataset");
-  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  CXI_Dataset * dataset = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset), 1);
   if(!dataset){
     return NULL;
   }
-  dataset->handle = H5Dopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  dataset->handle = cxi_arena_track(ref->arena, H5Dopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
+  if(dataset->handle < 0){
+    cxi_arena_release(ref->arena, dataset);
+    return NULL;
+  }
 
   hid_t s = H5Dget_space(dataset->handle);
   dataset->dimension_count = H5Sget_simple_extent_ndims(s);
-  dataset->dimensions = calloc(sizeof(hsize_t),dataset->dimension_count);
+  dataset->dimensions = cxi_arena_calloc(ref->arena, sizeof(hsize_t), dataset->dimension_count);
   H5Sget_simple_extent_dims(s,dataset->dimensions,NULL);     
-  dataset->data_type = H5Dget_type(dataset->handle);
+  H5Sclose(s);
+  dataset->data_type = cxi_arena_track(ref->arena, H5Dget_type(dataset->handle));
+  dataset->arena = ref->arena;
+  cxi_dataset_init_io(dataset, cxi_arena_stats(ref->arena));
   ref->dataset = dataset;
+  cxi_stats_open(ref->arena, begin);
   return dataset;
 }
 
-static void cxi_close_dataset(CXI_Dataset_Reference * ref){
-  if(!ref){
-    return;
-  }
-  cxi_debug("closing dataset");
-  CXI_Dataset * dataset = ref->dataset;
-  if(dataset){
-    H5Dclose(dataset->handle);
-    H5Tclose(dataset->data_type);
-    free(dataset->dimensions);
-    free(dataset);
-  }
-  free(ref->group_name);
-  free(ref);
-}
 
 
 CXI_Attenuator * cxi_open_attenuator(CXI_Attenuator_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening attenuator");
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
-  CXI_Attenuator * attenuator = calloc(sizeof(CXI_Attenuator),1);
+  CXI_Attenuator * attenuator = cxi_arena_calloc(ref->arena, sizeof(CXI_Attenuator), 1);
   if(!attenuator){
     return NULL;
   }
 
-  attenuator->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  attenuator->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(attenuator->handle < 0){
-    free(attenuator);
+    cxi_arena_release(ref->arena, attenuator);
     return NULL;
   }
   ref->attenuator = attenuator;  
@@ -827,175 +780,156 @@ CXI_Attenuator * cxi_open_attenuator(CXI_Attenuator_Reference * ref){
   attenuator->thickness_valid = try_read_float(attenuator->handle, "thickness",&attenuator->thickness);
   attenuator->attenuator_transmission_valid = try_read_float(attenuator->handle, "attenuator_transmission",
 							     &attenuator->attenuator_transmission);
-  try_read_string(attenuator->handle, "type",&attenuator->type);
+  try_read_string(ref->arena, attenuator->handle, "type",&attenuator->type);
 
 
+  cxi_stats_open(ref->arena, begin);
   return attenuator;
 }
 
-static void cxi_close_attenuator(CXI_Attenuator_Reference * ref){
-  cxi_debug("closing attenuator");
-  CXI_Attenuator * attenuator = ref->attenuator;
-  if(attenuator){
-    H5Gclose(attenuator->handle);
-    free(attenuator->type);
-    free(attenuator);
-  }
-  free(ref->group_name);
-  free(ref);
-}
 
 
 CXI_Monochromator * cxi_open_monochromator(CXI_Monochromator_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening monochromator");
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
-  CXI_Monochromator * monochromator = calloc(sizeof(CXI_Monochromator),1);
+  CXI_Monochromator * monochromator = cxi_arena_calloc(ref->arena, sizeof(CXI_Monochromator), 1);
   if(!monochromator){
     return NULL;
   }
 
-  monochromator->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  monochromator->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(monochromator->handle < 0){
-    free(monochromator);
+    cxi_arena_release(ref->arena, monochromator);
     return NULL;
   }
   ref->monochromator = monochromator;  
   monochromator->energy_valid = try_read_float(monochromator->handle, "energy",&monochromator->energy);
   monochromator->energy_error = try_read_float(monochromator->handle, "energy_error",&monochromator->energy_error);
+  cxi_stats_open(ref->arena, begin);
   return monochromator;
 }
 
-static void cxi_close_monochromator(CXI_Monochromator_Reference * ref){
-  cxi_debug("closing monochromator");
-  CXI_Monochromator * monochromator = ref->monochromator;
-  if(monochromator){
-    H5Gclose(monochromator->handle);
-    free(monochromator);
-  }
-  free(ref->group_name);
-  free(ref);
-}
 
 
 CXI_Image * cxi_open_image(CXI_Image_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening image");
+  uint64_t begin = cxi_stats_now();
   char buffer[1024];
   if(!ref){
     return NULL;
   }
-  CXI_Image * image = calloc(sizeof(CXI_Image),1);
+  CXI_Image * image = cxi_arena_calloc(ref->arena, sizeof(CXI_Image), 1);
   if(!image){
     return NULL;
   }
 
-  image->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  image->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(image->handle < 0){
-    free(image);
+    cxi_arena_release(ref->arena, image);
     return NULL;
   }
 
   /* Search for Detector groups */
   int n = find_max_suffix(image->handle, "detector");
   image->detector_count = n;
-  image->detectors = calloc(sizeof(CXI_Detector_Reference *),n);
+  image->detectors = cxi_arena_calloc(ref->arena, sizeof(CXI_Detector_Reference *), n);
   for(int i = 0;i<n;i++){
-    image->detectors[i] = calloc(sizeof(CXI_Detector_Reference),1);
+    image->detectors[i] = cxi_arena_calloc(ref->arena, sizeof(CXI_Detector_Reference), 1);
     sprintf(buffer,"detector_%d",i+1);
     image->detectors[i]->parent_handle = image->handle;
-    image->detectors[i]->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(image->detectors[i]->group_name,buffer);      
+    image->detectors[i]->group_name = cxi_arena_strdup(ref->arena, buffer);
+    image->detectors[i]->arena = ref->arena;
   }
 
   ref->image = image;  
   if(H5Lexists(image->handle,"data",H5P_DEFAULT)){
-    image->data = calloc(sizeof(CXI_Dataset_Reference),1);
+    image->data = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     image->data->parent_handle = image->handle;
-    image->data->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(image->data->group_name,"data");          
+    image->data->group_name = cxi_arena_strdup(ref->arena, "data");
+    image->data->arena = ref->arena;
   }
 
   if(H5Lexists(image->handle,"data_error",H5P_DEFAULT)){
-    image->data_error = calloc(sizeof(CXI_Dataset_Reference),1);
+    image->data_error = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     image->data_error->parent_handle = image->handle;
-    image->data_error->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(image->data_error->group_name,"data_error");          
+    image->data_error->group_name = cxi_arena_strdup(ref->arena, "data_error");
+    image->data_error->arena = ref->arena;
   }
 
 
   if(H5Lexists(image->handle,"mask",H5P_DEFAULT)){
-    image->mask = calloc(sizeof(CXI_Dataset_Reference),1);
+    image->mask = cxi_arena_calloc(ref->arena, sizeof(CXI_Dataset_Reference), 1);
     image->mask->parent_handle = image->handle;
-    image->mask->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
-    strcpy(image->mask->group_name,"mask");      
-    
+    image->mask->group_name = cxi_arena_strdup(ref->arena, "mask");
+    image->mask->arena = ref->arena;
   }
 
-  //  try_read_string(image->handle, "data_space",&image->data_space);
-  //  try_read_string(image->handle, "data_type",&image->data_type);
+  //  try_read_string(ref->arena, image->handle, "data_space",&image->data_space);
+  //  try_read_string(ref->arena, image->handle, "data_type",&image->data_type);
   image->dimensionality_valid = try_read_int(image->handle, "dimensionality",&image->dimensionality);
   image->image_center_valid = try_read_float_array(image->handle, "image_center",image->image_center,3);
+  image->is_fft_shifted_valid = try_read_int(image->handle, "is_fft_shifted",&image->is_fft_shifted);
 
+  cxi_stats_open(ref->arena, begin);
   return image;
 }
 
-static void cxi_close_image(CXI_Image_Reference * ref){
-  cxi_debug("closing image");
-  CXI_Image * image = ref->image;
-  if(image){
-    H5Gclose(image->handle);
-    free(image);
-  }
-  free(ref->group_name);
-  free(ref);
-}
 
 
 CXI_Sample * cxi_open_sample(CXI_Sample_Reference * ref){
+  CXI_TRACE();
   cxi_debug("opening sample");
+  uint64_t begin = cxi_stats_now();
   if(!ref){
     return NULL;
   }
-  CXI_Sample * sample = calloc(sizeof(CXI_Sample),1);
+  CXI_Sample * sample = cxi_arena_calloc(ref->arena, sizeof(CXI_Sample), 1);
   if(!sample){
     return NULL;
   }
 
-  sample->handle = H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT);
+  sample->handle = cxi_arena_track(ref->arena, H5Gopen(ref->parent_handle,ref->group_name,H5P_DEFAULT));
   if(sample->handle < 0){
-    free(sample);
+    cxi_arena_release(ref->arena, sample);
     return NULL;
   }
   ref->sample = sample;  
+  try_read_string(ref->arena, sample->handle, "name",&sample->name);
+  try_read_string(ref->arena, sample->handle, "description",&sample->description);
+  try_read_string(ref->arena, sample->handle, "unit_cell_group",&sample->unit_cell_group);
+  cxi_stats_open(ref->arena, begin);
   return sample;
 }
 
-static void cxi_close_sample(CXI_Sample_Reference * ref){
-  cxi_debug("closing sample");
-  CXI_Sample * sample = ref->sample;
-  if(sample){
-    H5Gclose(sample->handle);
-    free(sample);
-  }
-  free(ref->group_name);
-  free(ref);
-}
 
 
 
 int cxi_read_dataset(CXI_Dataset * dataset, void * data, hid_t datatype){
+  CXI_TRACE();
   if(!dataset){
     return -1;
   }
   if(!data){
     return -1;
   }
-  H5Dread(dataset->handle,datatype,H5S_ALL,H5S_ALL,H5P_DEFAULT,data);      
-  return 0;
+  uint64_t begin = cxi_stats_now();
+  hsize_t n = dataset->dimension_count ? dataset->dimensions[0] : 1;
+  int converts = cxi_dataset_converts(dataset, datatype);
+  herr_t status = 0;
+  if(converts || cxi_read_raw_chunks(dataset, 0, n, data)){
+    status = H5Dread(dataset->handle,datatype,H5S_ALL,H5S_ALL,dataset->transfer_plist,data);
+  }
+  cxi_stats_io(dataset, 0, datatype, converts, 0, n, begin);
+  return status < 0 ? -1 : 0;
 }
 
 int cxi_read_dataset_slice(CXI_Dataset * dataset, unsigned int slice, void * data, hid_t datatype){
+  CXI_TRACE();
   if(!dataset){
     return -1;
   }
@@ -1005,15 +939,20 @@ int cxi_read_dataset_slice(CXI_Dataset * dataset, unsigned int slice, void * dat
   if(slice >= dataset->dimensions[0]){
     return -1;
   }
+  uint64_t begin = cxi_stats_now();
+  int converts = cxi_dataset_converts(dataset, datatype);
+  if(!converts && cxi_read_raw_chunks(dataset, slice, 1, data) == 0){
+    cxi_stats_io(dataset, 0, datatype, converts, slice, 1, begin);
+    return 0;
+  }
 
   hid_t s = H5Dget_space(dataset->handle);
   if(s < 0){
     return -1;
   }
-  hsize_t *start;
-  start = malloc(sizeof(hsize_t)*dataset->dimension_count);
-  hsize_t *count;
-  count = malloc(sizeof(hsize_t)*dataset->dimension_count);
+  /* No allocation, HDF5 datasets have at most H5S_MAX_RANK dimensions */
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
   for(int i =0;i<dataset->dimension_count;i++){
     start[i] = 0;
     count[i] = dataset->dimensions[i];
@@ -1024,16 +963,107 @@ int cxi_read_dataset_slice(CXI_Dataset * dataset, unsigned int slice, void * dat
   hid_t memspace = H5Screate_simple (dataset->dimension_count, count, NULL);
   
   H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
-  H5Dread(dataset->handle,datatype,memspace,s,H5P_DEFAULT,data);      
+  herr_t status = H5Dread(dataset->handle,datatype,memspace,s,dataset->transfer_plist,data);
+  cxi_stats_io(dataset, 0, datatype, converts, slice, 1, begin);
+  H5Sclose(memspace);
   H5Sclose(s);
-  free(start);
-  free(count);
 
+  return status < 0 ? -1 : 0;
+}
+
+int cxi_read_dataset_slices(CXI_Dataset * dataset, hsize_t first, hsize_t n, void * data, hid_t datatype){
+  CXI_TRACE();
+  if(!dataset){
+    return -1;
+  }
+  if(!data){
+    return -1;
+  }
+  if(dataset->dimension_count <= 0 || n == 0 || first+n > dataset->dimensions[0]){
+    return -1;
+  }
+  uint64_t begin = cxi_stats_now();
+  int converts = cxi_dataset_converts(dataset, datatype);
+  if(!converts && cxi_read_raw_chunks(dataset, first, n, data) == 0){
+    cxi_stats_io(dataset, 0, datatype, converts, first, n, begin);
+    return 0;
+  }
+
+  hid_t s = H5Dget_space(dataset->handle);
+  if(s < 0){
+    return -1;
+  }
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
+  for(int i =0;i<dataset->dimension_count;i++){
+    start[i] = 0;
+    count[i] = dataset->dimensions[i];
+  }
+
+  start[0] = first;
+  count[0] = n;
+  hid_t memspace = H5Screate_simple (dataset->dimension_count, count, NULL);
+
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  herr_t status = H5Dread(dataset->handle,datatype,memspace,s,dataset->transfer_plist,data);
+  cxi_stats_io(dataset, 0, datatype, converts, first, n, begin);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  if(status < 0){
+    return -1;
+  }
   return 0;
 }
 
+hsize_t cxi_dataset_chunk_slices(CXI_Dataset * dataset){
+  if(!dataset || dataset->handle < 0 || dataset->dimension_count <= 0){
+    return 0;
+  }
+  hid_t plist = H5Dget_create_plist(dataset->handle);
+  if(plist < 0){
+    return 0;
+  }
+  hsize_t ret = 0;
+  if(H5Pget_layout(plist) == H5D_CHUNKED){
+    hsize_t * chunk = malloc(sizeof(hsize_t)*dataset->dimension_count);
+    if(H5Pget_chunk(plist, dataset->dimension_count, chunk) == dataset->dimension_count){
+      ret = chunk[0];
+    }
+    free(chunk);
+  }
+  H5Pclose(plist);
+  return ret;
+}
+
+hsize_t cxi_batch_slices(CXI_Dataset * dataset, size_t elem_size, size_t max_bytes){
+  if(!dataset || dataset->dimension_count <= 0 || dataset->dimensions[0] == 0){
+    return 0;
+  }
+  size_t slice_bytes = cxi_dataset_slice_length(dataset)*elem_size;
+  hsize_t n = 1;
+  if(slice_bytes && max_bytes > slice_bytes){
+    n = max_bytes/slice_bytes;
+  }
+  /* The whole dataset if it fits, it ends with whatever is left of its last chunk */
+  if(n >= dataset->dimensions[0]){
+    return dataset->dimensions[0];
+  }
+  /* Prefer whole chunks so that each chunk is only decoded once, and split a
+     chunk over budget evenly so that batches never straddle two chunks */
+  hsize_t chunk = cxi_dataset_chunk_slices(dataset);
+  if(chunk > 0 && n >= chunk){
+    n -= n % chunk;
+  }else if(chunk > 0){
+    while(chunk % n){
+      n--;
+    }
+  }
+  return n;
+}
+
 
 CXI_Entry_Reference * cxi_create_entry(hid_t loc, CXI_Entry * entry){
+  CXI_TRACE();
   if(loc < 0 || !entry){
     return NULL;
   }
@@ -1122,6 +1152,7 @@ CXI_Entry_Reference * cxi_create_entry(hid_t loc, CXI_Entry * entry){
 }
 
 CXI_Data_Reference * cxi_create_data(hid_t loc, CXI_Data * data){
+  CXI_TRACE();
   if(loc < 0 || !data){
     return NULL;
   }
@@ -1142,6 +1173,7 @@ CXI_Data_Reference * cxi_create_data(hid_t loc, CXI_Data * data){
 
 }
 CXI_Image_Reference * cxi_create_image(hid_t loc, CXI_Image * image){
+  CXI_TRACE();
   if(loc < 0 || !image){
     return NULL;
   }
@@ -1158,10 +1190,17 @@ CXI_Image_Reference * cxi_create_image(hid_t loc, CXI_Image * image){
   ref->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
   ref->image = image;
   strcpy(ref->group_name,buffer);
+  if(image->dimensionality_valid){
+    try_write_int(handle,"dimensionality",image->dimensionality);
+  }
+  if(image->is_fft_shifted_valid){
+    try_write_int(handle,"is_fft_shifted",image->is_fft_shifted);
+  }
   return ref;
 
 }
 CXI_Instrument_Reference * cxi_create_instrument(hid_t loc, CXI_Instrument * instrument){
+  CXI_TRACE();
   if(loc < 0 || !instrument){
     return NULL;
   }
@@ -1182,6 +1221,7 @@ CXI_Instrument_Reference * cxi_create_instrument(hid_t loc, CXI_Instrument * ins
 
 }
 CXI_Sample_Reference * cxi_create_sample(hid_t loc, CXI_Sample * sample){
+  CXI_TRACE();
   if(loc < 0 || !sample){
     return NULL;
   }
@@ -1234,6 +1274,7 @@ CXI_Sample_Reference * cxi_create_sample(hid_t loc, CXI_Sample * sample){
 }
 
 CXI_Monochromator_Reference * cxi_create_monochromator(hid_t loc, CXI_Monochromator * monochromator){
+  CXI_TRACE();
   if(loc < 0 || !monochromator){
     return NULL;
   }
@@ -1256,6 +1297,7 @@ CXI_Monochromator_Reference * cxi_create_monochromator(hid_t loc, CXI_Monochroma
 
 
 CXI_Attenuator_Reference * cxi_create_attenuator(hid_t loc, CXI_Attenuator * attenuator){
+  CXI_TRACE();
   if(loc < 0 || !attenuator){
     return NULL;
   }
@@ -1276,6 +1318,7 @@ CXI_Attenuator_Reference * cxi_create_attenuator(hid_t loc, CXI_Attenuator * att
 }
 
 CXI_Source_Reference * cxi_create_source(hid_t loc, CXI_Source * source){
+  CXI_TRACE();
   if(loc < 0 || !source){
     return NULL;
   }
@@ -1306,6 +1349,7 @@ CXI_Source_Reference * cxi_create_source(hid_t loc, CXI_Source * source){
 }
 
 CXI_Detector_Reference * cxi_create_detector(hid_t loc, CXI_Detector * detector){
+  CXI_TRACE();
   if(loc < 0 || !detector){
     return NULL;
   }
@@ -1350,6 +1394,7 @@ CXI_Detector_Reference * cxi_create_detector(hid_t loc, CXI_Detector * detector)
 }
 
 CXI_Geometry_Reference * cxi_create_geometry(hid_t loc, CXI_Geometry * geometry){
+  CXI_TRACE();
   if(loc < 0 || !geometry){
     return NULL;
   }
@@ -1366,10 +1411,17 @@ CXI_Geometry_Reference * cxi_create_geometry(hid_t loc, CXI_Geometry * geometry)
   ref->group_name = malloc(sizeof(char)*(strlen(buffer)+1));
   ref->geometry = geometry;
   strcpy(ref->group_name,buffer);
+  if(geometry->orientation_valid){
+    try_write_float_2D_array(handle,"orientation",(double *)geometry->orientation,2,3);
+  }
+  if(geometry->translation_valid){
+    try_write_float_1D_array(handle,"translation",geometry->translation,3);
+  }
   return ref;
 }
 
 CXI_Process_Reference * cxi_create_process(hid_t loc, CXI_Process * process){
+  CXI_TRACE();
   if(loc < 0 || !process){
     return NULL;
   }
@@ -1389,7 +1441,7 @@ CXI_Process_Reference * cxi_create_process(hid_t loc, CXI_Process * process){
   return ref;
 }
 
-static char * dataset_type_to_name(CXI_Dataset_Type type){  
+char * cxi_dataset_type_name(CXI_Dataset_Type type){  
   static char * table[] = {
     "data",
     "data_dark",
@@ -1403,21 +1455,22 @@ static char * dataset_type_to_name(CXI_Dataset_Type type){
   
 }
 
-CXI_Dataset_Reference * cxi_create_dataset(hid_t loc, CXI_Dataset * dataset, 
-					   CXI_Dataset_Type type){
-  if(loc < 0 || !dataset){
+CXI_Dataset_Reference * cxi_create_named_dataset(hid_t loc, const char * name, CXI_Dataset * dataset,
+						 hid_t create_plist){
+  if(loc < 0 || !dataset || !name){
     return NULL;
   }
-  char * name = dataset_type_to_name(type);
   hid_t dataspace = H5Screate_simple(dataset->dimension_count,
 				     dataset->dimensions, NULL );
   hid_t handle = H5Dcreate(loc,name, dataset->data_type, dataspace,  
-			   H5P_DEFAULT,H5P_DEFAULT,H5P_DEFAULT);
+			   H5P_DEFAULT,create_plist,H5P_DEFAULT);
+  H5Sclose(dataspace);
   if(handle < 0){
     return NULL;
   }
   CXI_Dataset_Reference * ref = calloc(sizeof(CXI_Dataset_Reference),1);
   dataset->handle = handle;
+  cxi_dataset_init_io(dataset, NULL);
   ref->parent_handle = loc;
   ref->group_name = malloc(sizeof(char)*(strlen(name)+1));
   ref->dataset = dataset;
@@ -1425,7 +1478,17 @@ CXI_Dataset_Reference * cxi_create_dataset(hid_t loc, CXI_Dataset * dataset,
   return ref;
 }
 
+CXI_Dataset_Reference * cxi_create_dataset(hid_t loc, CXI_Dataset * dataset, 
+					   CXI_Dataset_Type type){
+  CXI_TRACE();
+  if(loc < 0 || !dataset){
+    return NULL;
+  }
+  return cxi_create_named_dataset(loc, cxi_dataset_type_name(type), dataset, H5P_DEFAULT);
+}
+
 int cxi_write_dataset(CXI_Dataset * dataset, void * data, hid_t datatype){
+  CXI_TRACE();
   if(!dataset){
     return -1;
   }
@@ -1435,11 +1498,19 @@ int cxi_write_dataset(CXI_Dataset * dataset, void * data, hid_t datatype){
   if(dataset->handle < 0){
     return -1;
   }
-  H5Dwrite(dataset->handle,datatype,H5S_ALL,H5S_ALL,H5P_DEFAULT,data);      
+  uint64_t begin = cxi_stats_now();
+  hsize_t n = dataset->dimension_count ? dataset->dimensions[0] : 1;
+  int converts = cxi_dataset_converts(dataset, datatype);
+  if((converts || cxi_write_raw_chunks(dataset, 0, n, data)) &&
+     H5Dwrite(dataset->handle,datatype,H5S_ALL,H5S_ALL,dataset->transfer_plist,data) < 0){
+    return -1;
+  }
+  cxi_stats_io(dataset, 1, datatype, converts, 0, n, begin);
   return 0;
 }
 
 int cxi_write_dataset_slice(CXI_Dataset * dataset,unsigned int slice, void * data, hid_t datatype){
+  CXI_TRACE();
   if(!dataset){
     return -1;
   }
@@ -1452,15 +1523,19 @@ int cxi_write_dataset_slice(CXI_Dataset * dataset,unsigned int slice, void * dat
   if(dataset->handle < 0){
     return -1;
   }
+  uint64_t begin = cxi_stats_now();
+  int converts = cxi_dataset_converts(dataset, datatype);
+  if(!converts && cxi_write_raw_chunks(dataset, slice, 1, data) == 0){
+    cxi_stats_io(dataset, 1, datatype, converts, slice, 1, begin);
+    return 0;
+  }
 
   hid_t s = H5Dget_space(dataset->handle);
   if(s < 0){
     return -1;
   }
-  hsize_t *start;
-  start = malloc(sizeof(hsize_t)*dataset->dimension_count);
-  hsize_t *count;
-  count = malloc(sizeof(hsize_t)*dataset->dimension_count);
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
   for(int i =0;i<dataset->dimension_count;i++){
     start[i] = 0;
     count[i] = dataset->dimensions[i];
@@ -1471,11 +1546,13 @@ int cxi_write_dataset_slice(CXI_Dataset * dataset,unsigned int slice, void * dat
   hid_t memspace = H5Screate_simple (dataset->dimension_count, count, NULL);
   
   H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
-  H5Dwrite(dataset->handle,datatype,memspace,s,H5P_DEFAULT,data);      
+  herr_t status = H5Dwrite(dataset->handle,datatype,memspace,s,dataset->transfer_plist,data);
+  H5Sclose(memspace);
   H5Sclose(s);
-  free(start);
-  free(count);
-
+  if(status < 0){
+    return -1;
+  }
+  cxi_stats_io(dataset, 1, datatype, converts, slice, 1, begin);
   return 0;
 }
 
@@ -1506,10 +1583,16 @@ hsize_t cxi_dataset_slice_length(CXI_Dataset * dataset){
   if(dataset->dimension_count <= 0){
     return 0;
   }
-  return cxi_dataset_length(dataset)/dataset->dimensions[0];
+  /* Not the length over the first dimension, which may still be 0 */
+  hsize_t ret = 1;
+  for(int i = 1;i<dataset->dimension_count;i++){
+    ret *= dataset->dimensions[i];
+  }
+  return ret;
 }
 
 CXI_Data_Reference * cxi_create_data_link(CXI_Entry * entry, CXI_Dataset * data){
+  CXI_TRACE();
   if(!entry || ! data){
     return NULL;
   }
@@ -0,0 +1,148 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi_private.h"
+
+/* Most allocations are a few dozen bytes, a block holds hundreds of them */
+#define CXI_ARENA_BLOCK_SIZE (16*1024)
+#define CXI_ARENA_ALIGNMENT 16
+
+typedef struct Arena_Block{
+  struct Arena_Block * prev;
+  /* Keeps the memory after the header aligned */
+  union{
+    size_t size;
+    long double align;
+  }u;
+}Arena_Block;
+
+struct CXI_Arena{
+  Arena_Block * blocks;
+  char * next;
+  size_t left;
+  hid_t * handles;
+  size_t handle_count;
+  size_t handle_capacity;
+  CXI_Stats * stats;
+};
+
+CXI_Arena * cxi_arena_new(void){
+  return calloc(sizeof(CXI_Arena),1);
+}
+
+static void * arena_alloc(CXI_Arena * arena, size_t size){
+  size = (size+CXI_ARENA_ALIGNMENT-1) & ~(size_t)(CXI_ARENA_ALIGNMENT-1);
+  if(size > arena->left){
+    size_t block = size > CXI_ARENA_BLOCK_SIZE/4 ? size : CXI_ARENA_BLOCK_SIZE;
+    Arena_Block * b = malloc(sizeof(Arena_Block)+block);
+    if(!b){
+      return NULL;
+    }
+    b->u.size = block;
+    if(block == size && arena->blocks){
+      /* Oversized requests get their own block behind the current one,
+	 so the space left in the current block is not wasted */
+      b->prev = arena->blocks->prev;
+      arena->blocks->prev = b;
+      return b+1;
+    }
+    b->prev = arena->blocks;
+    arena->blocks = b;
+    arena->next = (char *)(b+1);
+    arena->left = block;
+  }
+  void * p = arena->next;
+  arena->next += size;
+  arena->left -= size;
+  return p;
+}
+
+void * cxi_arena_calloc(CXI_Arena * arena, size_t size, size_t n){
+  if(!arena){
+    return calloc(size,n);
+  }
+  if(n && size > ((size_t)-1)/n){
+    return NULL;
+  }
+  void * p = arena_alloc(arena, size*n);
+  if(p){
+    memset(p, 0, size*n);
+  }
+  return p;
+}
+
+char * cxi_arena_strdup(CXI_Arena * arena, const char * s){
+  size_t len = strlen(s)+1;
+  char * p = arena ? arena_alloc(arena, len) : malloc(len);
+  if(p){
+    memcpy(p, s, len);
+  }
+  return p;
+}
+
+void cxi_arena_release(CXI_Arena * arena, void * p){
+  if(!arena){
+    free(p);
+  }
+}
+
+hid_t cxi_arena_track(CXI_Arena * arena, hid_t id){
+  if(!arena || id < 0){
+    return id;
+  }
+  cxi_stats_call(arena->stats);
+  if(arena->handle_count == arena->handle_capacity){
+    size_t capacity = arena->handle_capacity ? 2*arena->handle_capacity : 64;
+    hid_t * handles = realloc(arena->handles, sizeof(hid_t)*capacity);
+    if(!handles){
+      cxi_warning("Could not track HDF5 handle, it will not be closed");
+      return id;
+    }
+    arena->handles = handles;
+    arena->handle_capacity = capacity;
+  }
+  arena->handles[arena->handle_count++] = id;
+  return id;
+}
+
+int cxi_arena_close(CXI_Arena * arena, hid_t id){
+  if(arena){
+    for(size_t i = arena->handle_count;i>0;i--){
+      if(arena->handles[i-1] == id){
+	memmove(arena->handles+i-1, arena->handles+i, sizeof(hid_t)*(arena->handle_count-i));
+	arena->handle_count--;
+	break;
+      }
+    }
+  }
+  return H5Idec_ref(id) < 0 ? -1 : 0;
+}
+
+CXI_Stats * cxi_arena_stats(CXI_Arena * arena){
+  return arena ? arena->stats : NULL;
+}
+
+void cxi_arena_set_stats(CXI_Arena * arena, CXI_Stats * stats){
+  if(arena){
+    arena->stats = stats;
+  }
+}
+
+void cxi_arena_free(CXI_Arena * arena){
+  if(!arena){
+    return;
+  }
+  /* Children were opened after their parents, close them first. The arena
+     owns these references: checking H5Iis_valid() instead could release an
+     identifier that was closed elsewhere and then reused. */
+  for(size_t i = arena->handle_count;i>0;i--){
+    H5Idec_ref(arena->handles[i-1]);
+  }
+  free(arena->handles);
+  Arena_Block * b = arena->blocks;
+  while(b){
+    Arena_Block * prev = b->prev;
+    free(b);
+    b = prev;
+  }
+  free(arena);
+}
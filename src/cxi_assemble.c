@@ -0,0 +1,269 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+int cxi_panel_from_detector(CXI_Detector * detector, hsize_t slow_dim, hsize_t fast_dim,
+			    CXI_Panel * panel){
+  if(!detector || !panel || slow_dim == 0 || fast_dim == 0){
+    return -1;
+  }
+  memset(panel, 0, sizeof(CXI_Panel));
+  panel->dimensions[0] = slow_dim;
+  panel->dimensions[1] = fast_dim;
+  CXI_Geometry * geometry = NULL;
+  if(detector->geometry){
+    geometry = detector->geometry->geometry;
+    if(!geometry){
+      geometry = cxi_open_geometry(detector->geometry);
+    }
+  }
+  if(!detector->basis_vectors_valid && geometry && geometry->orientation_valid){
+    /* The first row of the orientation is the local x axis, along the
+       fast dimension, and the second the local y axis, along the slow one. */
+    for(int i = 0;i<3;i++){
+      panel->basis_vectors[0][i] = geometry->orientation[1][i]*detector->y_pixel_size;
+      panel->basis_vectors[1][i] = geometry->orientation[0][i]*detector->x_pixel_size;
+    }
+  }else{
+    /* cxi_open_detector() fills in default basis vectors if needed */
+    memcpy(panel->basis_vectors, detector->basis_vectors, sizeof(panel->basis_vectors));
+  }
+  if(detector->corner_position_valid){
+    memcpy(panel->corner_position, detector->corner_position, sizeof(panel->corner_position));
+  }else if(geometry && geometry->translation_valid){
+    memcpy(panel->corner_position, geometry->translation, sizeof(panel->corner_position));
+  }
+  return 0;
+}
+
+/* Appends a run to the assembler, growing the array as needed */
+static int push_run(CXI_Assembler * a, hsize_t * capacity, int64_t output, int64_t input,
+		    int64_t length, int64_t stride){
+  if(a->run_count == *capacity){
+    *capacity = *capacity ? 2*(*capacity) : 64;
+    CXI_Assembler_Run * runs = realloc(a->runs, sizeof(CXI_Assembler_Run)*(*capacity));
+    if(!runs){
+      return -1;
+    }
+    a->runs = runs;
+  }
+  CXI_Assembler_Run * r = &a->runs[a->run_count++];
+  r->output = output;
+  r->input = input;
+  r->length = length;
+  r->stride = stride;
+  return 0;
+}
+
+/* Compresses the output to input map into runs of output pixels whose
+ * inputs are evenly spaced. Panels are usually placed in whole rows or
+ * columns, so an image ends up as a few runs per output row and the
+ * kernels spend their time in memcpy or in simple strided loops.
+ */
+static int build_runs(CXI_Assembler * a, const int64_t * output_to_pixel){
+  hsize_t capacity = 0;
+  hsize_t row = a->dimensions[1];
+  for(hsize_t y = 0;y<a->dimensions[0];y++){
+    const int64_t * map = output_to_pixel + y*row;
+    hsize_t x = 0;
+    while(x < row){
+      hsize_t start = x;
+      int64_t stride = 0;
+      if(map[x] < 0){
+	while(x < row && map[x] < 0){
+	  x++;
+	}
+      }else{
+	x++;
+	if(x < row && map[x] >= 0){
+	  stride = map[x]-map[x-1];
+	  while(x < row && map[x] >= 0 && map[x]-map[x-1] == stride){
+	    x++;
+	  }
+	}
+      }
+      if(push_run(a, &capacity, y*row+start, map[start], x-start, stride)){
+	return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+CXI_Assembler * cxi_create_assembler(CXI_Panel * panels, int panel_count, double pixel_size){
+  CXI_TRACE();
+  if(!panels || panel_count <= 0){
+    return NULL;
+  }
+  CXI_Assembler * a = calloc(sizeof(CXI_Assembler),1);
+  if(!a){
+    return NULL;
+  }
+  for(int p = 0;p<panel_count;p++){
+    a->input_length += panels[p].dimensions[0]*panels[p].dimensions[1];
+  }
+  if(pixel_size <= 0){
+    /* Use the smallest pixel of all panels so no pixel is lost */
+    pixel_size = DBL_MAX;
+    for(int p = 0;p<panel_count;p++){
+      for(int b = 0;b<2;b++){
+	double len = sqrt(panels[p].basis_vectors[b][0]*panels[p].basis_vectors[b][0]+
+			  panels[p].basis_vectors[b][1]*panels[p].basis_vectors[b][1]);
+	if(len > 0 && len < pixel_size){
+	  pixel_size = len;
+	}
+      }
+    }
+    if(pixel_size == DBL_MAX){
+      free(a);
+      return NULL;
+    }
+  }
+  a->pixel_size = pixel_size;
+
+  /* Project the center of every pixel on the detector plane, the
+     same way the detector basis vectors do, so that x and y decrease
+     along the columns and rows of the output. */
+  double * xs = malloc(sizeof(double)*a->input_length);
+  double * ys = malloc(sizeof(double)*a->input_length);
+  a->pixel_to_output = malloc(sizeof(int64_t)*a->input_length);
+  if(!xs || !ys || !a->pixel_to_output){
+    free(xs);
+    free(ys);
+    cxi_free_assembler(a);
+    return NULL;
+  }
+  double xmax = -DBL_MAX, xmin = DBL_MAX, ymax = -DBL_MAX, ymin = DBL_MAX;
+  hsize_t i = 0;
+  for(int p = 0;p<panel_count;p++){
+    CXI_Panel * panel = &panels[p];
+    for(hsize_t s = 0;s<panel->dimensions[0];s++){
+      for(hsize_t f = 0;f<panel->dimensions[1];f++){
+	xs[i] = panel->corner_position[0] + (s+0.5)*panel->basis_vectors[0][0] +
+	  (f+0.5)*panel->basis_vectors[1][0];
+	ys[i] = panel->corner_position[1] + (s+0.5)*panel->basis_vectors[0][1] +
+	  (f+0.5)*panel->basis_vectors[1][1];
+	xmax = xs[i] > xmax ? xs[i] : xmax;
+	xmin = xs[i] < xmin ? xs[i] : xmin;
+	ymax = ys[i] > ymax ? ys[i] : ymax;
+	ymin = ys[i] < ymin ? ys[i] : ymin;
+	i++;
+      }
+    }
+  }
+  a->dimensions[0] = (hsize_t)floor((ymax-ymin)/pixel_size+0.5)+1;
+  a->dimensions[1] = (hsize_t)floor((xmax-xmin)/pixel_size+0.5)+1;
+  hsize_t nout = a->dimensions[0]*a->dimensions[1];
+  int64_t * output_to_pixel = malloc(sizeof(int64_t)*nout);
+  if(!output_to_pixel){
+    free(xs);
+    free(ys);
+    cxi_free_assembler(a);
+    return NULL;
+  }
+  for(hsize_t o = 0;o<nout;o++){
+    output_to_pixel[o] = -1;
+  }
+  for(i = 0;i<a->input_length;i++){
+    int64_t row = (int64_t)floor((ymax-ys[i])/pixel_size+0.5);
+    int64_t col = (int64_t)floor((xmax-xs[i])/pixel_size+0.5);
+    a->pixel_to_output[i] = row*a->dimensions[1]+col;
+    /* Where panels overlap the last one wins */
+    output_to_pixel[a->pixel_to_output[i]] = i;
+  }
+  free(xs);
+  free(ys);
+  int ret = build_runs(a, output_to_pixel);
+  free(output_to_pixel);
+  if(ret){
+    cxi_free_assembler(a);
+    return NULL;
+  }
+  cxi_debug("assembler maps %llu pixels to %llux%llu in %llu runs",
+	    (unsigned long long)a->input_length, (unsigned long long)a->dimensions[0],
+	    (unsigned long long)a->dimensions[1], (unsigned long long)a->run_count);
+  return a;
+}
+
+void cxi_free_assembler(CXI_Assembler * assembler){
+  if(!assembler){
+    return;
+  }
+  free(assembler->pixel_to_output);
+  free(assembler->runs);
+  free(assembler);
+}
+
+static void assemble_runs(const CXI_Assembler * a, hsize_t begin, hsize_t end,
+			  const float * input, float * output){
+  for(hsize_t r = begin;r<end;r++){
+    const CXI_Assembler_Run * run = &a->runs[r];
+    float * out = output + run->output;
+    if(run->input < 0){
+      for(int64_t k = 0;k<run->length;k++){
+	out[k] = a->fill_value;
+      }
+    }else if(run->stride == 1 || run->length == 1){
+      memcpy(out, input + run->input, sizeof(float)*run->length);
+    }else{
+      const float * in = input + run->input;
+      int64_t stride = run->stride;
+      for(int64_t k = 0;k<run->length;k++){
+	out[k] = in[k*stride];
+      }
+    }
+  }
+}
+
+typedef struct{
+  const CXI_Assembler * a;
+  const float * input;
+  float * output;
+}Assemble_Job;
+
+static void assemble_run_range(hsize_t begin, hsize_t end, void * arg){
+  Assemble_Job * job = arg;
+  assemble_runs(job->a, begin, end, job->input, job->output);
+}
+
+static void assemble_frame_range(hsize_t begin, hsize_t end, void * arg){
+  Assemble_Job * job = arg;
+  hsize_t nout = job->a->dimensions[0]*job->a->dimensions[1];
+  for(hsize_t f = begin;f<end;f++){
+    assemble_runs(job->a, 0, job->a->run_count, job->input + f*job->a->input_length,
+		  job->output + f*nout);
+  }
+}
+
+int cxi_assemble_frames(CXI_Assembler * assembler, const float * input, hsize_t n,
+			float * output, int nthreads){
+  if(!assembler || !input || !output){
+    return -1;
+  }
+  Assemble_Job job;
+  job.a = assembler;
+  job.input = input;
+  job.output = output;
+  if(nthreads <= 0){
+    nthreads = cxi_default_thread_count();
+  }
+  if(n >= (hsize_t)nthreads){
+    /* Enough frames to keep every thread busy with whole frames */
+    cxi_parallel_for(nthreads, n, assemble_frame_range, &job);
+  }else{
+    for(hsize_t f = 0;f<n;f++){
+      job.input = input + f*assembler->input_length;
+      job.output = output + f*assembler->dimensions[0]*assembler->dimensions[1];
+      cxi_parallel_for(nthreads, assembler->run_count, assemble_run_range, &job);
+    }
+  }
+  return 0;
+}
+
+int cxi_assemble_frame(CXI_Assembler * assembler, const float * input, float * output,
+		       int nthreads){
+  return cxi_assemble_frames(assembler, input, 1, output, nthreads);
+}
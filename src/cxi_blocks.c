@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+#define CXI_BLOCK_BYTES (16*1024*1024)
+
+/* Two buffers, one read into while the callback has the other */
+typedef struct{
+  CXI_Dataset * dataset;
+  hid_t mem_type;
+  hsize_t block_frames;
+  hsize_t block_count;
+  void * buffers[2];
+  int full[2];
+  int status[2];
+  int stop;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+}Block_Reader;
+
+static hsize_t block_length(Block_Reader * r, hsize_t block){
+  hsize_t first = block*r->block_frames;
+  hsize_t n = r->dataset->dimensions[0]-first;
+  return n < r->block_frames ? n : r->block_frames;
+}
+
+static void * read_blocks(void * arg){
+  Block_Reader * r = arg;
+  for(hsize_t b = 0;b<r->block_count;b++){
+    int slot = b % 2;
+    pthread_mutex_lock(&r->lock);
+    while(r->full[slot] && !r->stop){
+      pthread_cond_wait(&r->changed, &r->lock);
+    }
+    int stop = r->stop;
+    pthread_mutex_unlock(&r->lock);
+    if(stop){
+      break;
+    }
+    int status = cxi_read_dataset_slices(r->dataset, b*r->block_frames, block_length(r, b),
+					 r->buffers[slot], r->mem_type);
+    pthread_mutex_lock(&r->lock);
+    r->full[slot] = 1;
+    r->status[slot] = status;
+    pthread_cond_broadcast(&r->changed);
+    pthread_mutex_unlock(&r->lock);
+    if(status){
+      break;
+    }
+  }
+  return NULL;
+}
+
+int cxi_dataset_foreach_block(CXI_Dataset * dataset, hsize_t block_frames, CXI_Block_Callback callback,
+			      void * user){
+  CXI_TRACE();
+  if(!dataset || !callback || dataset->dimension_count <= 0){
+    return -1;
+  }
+  if(dataset->dimensions[0] == 0){
+    return 0;
+  }
+  Block_Reader r;
+  memset(&r, 0, sizeof(r));
+  r.dataset = dataset;
+  r.mem_type = H5Tget_native_type(dataset->data_type, H5T_DIR_ASCEND);
+  if(r.mem_type < 0){
+    return -1;
+  }
+  size_t slice_bytes = cxi_dataset_slice_length(dataset)*H5Tget_size(r.mem_type);
+  size_t max_bytes = block_frames ? block_frames*slice_bytes : CXI_BLOCK_BYTES;
+  r.block_frames = cxi_batch_slices(dataset, H5Tget_size(r.mem_type), max_bytes);
+  r.block_count = (dataset->dimensions[0]+r.block_frames-1)/r.block_frames;
+  r.buffers[0] = malloc(slice_bytes*r.block_frames);
+  r.buffers[1] = r.block_count > 1 ? malloc(slice_bytes*r.block_frames) : NULL;
+  if(!r.buffers[0] || (r.block_count > 1 && !r.buffers[1])){
+    free(r.buffers[0]);
+    free(r.buffers[1]);
+    H5Tclose(r.mem_type);
+    return -1;
+  }
+  pthread_mutex_init(&r.lock, NULL);
+  pthread_cond_init(&r.changed, NULL);
+  /* HDF5 built without thread safety must not be called while the callback may call it */
+  pthread_t thread;
+  int threaded = cxi_hdf5_threadsafe() && pthread_create(&thread, NULL, read_blocks, &r) == 0;
+  int ret = 0;
+  for(hsize_t b = 0;!ret && b<r.block_count;b++){
+    int slot = b % 2;
+    /* Without a thread, blocks are read in turn with the callback */
+    if(!threaded){
+      r.full[slot] = 1;
+      r.status[slot] = cxi_read_dataset_slices(dataset, b*r.block_frames, block_length(&r, b),
+					       r.buffers[slot], r.mem_type);
+    }
+    pthread_mutex_lock(&r.lock);
+    while(!r.full[slot]){
+      pthread_cond_wait(&r.changed, &r.lock);
+    }
+    pthread_mutex_unlock(&r.lock);
+    if(r.status[slot]){
+      ret = -1;
+      break;
+    }
+    ret = callback(r.buffers[slot], b*r.block_frames, block_length(&r, b), r.mem_type, user);
+    pthread_mutex_lock(&r.lock);
+    r.full[slot] = 0;
+    pthread_cond_broadcast(&r.changed);
+    pthread_mutex_unlock(&r.lock);
+  }
+  if(threaded){
+    pthread_mutex_lock(&r.lock);
+    r.stop = 1;
+    pthread_cond_broadcast(&r.changed);
+    pthread_mutex_unlock(&r.lock);
+    pthread_join(thread, NULL);
+  }
+  pthread_mutex_destroy(&r.lock);
+  pthread_cond_destroy(&r.changed);
+  free(r.buffers[0]);
+  free(r.buffers[1]);
+  H5Tclose(r.mem_type);
+  return ret;
+}
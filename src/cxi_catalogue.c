@@ -0,0 +1,765 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+#define CXI_CATALOGUE_VERSION 1
+#define CXI_CATALOGUE_CHUNK 65536
+
+static const char * column_names[CXI_Catalogue_Column_Count] = {
+  "entry",
+  "instrument",
+  "detector",
+  "distance",
+  "x_pixel_size",
+  "y_pixel_size",
+  "photon_energy",
+  "pulse_energy",
+  "frames",
+  "rows",
+  "columns"
+};
+
+const char * cxi_catalogue_column_name(CXI_Catalogue_Column column){
+  if(column < 0 || column >= CXI_Catalogue_Column_Count){
+    return NULL;
+  }
+  return column_names[column];
+}
+
+/* A row read from a file, before it makes it into the catalogue */
+typedef struct{
+  double v[CXI_Catalogue_Column_Count];
+  char * title;
+  char * sample;
+}Scan_Row;
+
+/* A file found while crawling */
+typedef struct{
+  char * path;
+  double mtime;
+  hsize_t size;
+  /* The index of the file in the old catalogue, or -1 */
+  int64_t old;
+  int changed;
+  int failed;
+  Scan_Row * rows;
+  hsize_t row_count;
+  hsize_t row_capacity;
+}Found_File;
+
+typedef struct{
+  Found_File * files;
+  hsize_t count;
+  hsize_t capacity;
+}Found_List;
+
+static char * heap_strdup(const char * s){
+  if(!s || !s[0]){
+    return NULL;
+  }
+  return cxi_arena_strdup(NULL, s);
+}
+
+static Scan_Row * push_row(Found_File * f, const char * title, const char * sample){
+  if(f->row_count == f->row_capacity){
+    hsize_t capacity = f->row_capacity ? 2*f->row_capacity : 4;
+    Scan_Row * rows = realloc(f->rows, sizeof(Scan_Row)*capacity);
+    if(!rows){
+      return NULL;
+    }
+    f->rows = rows;
+    f->row_capacity = capacity;
+  }
+  Scan_Row * r = &f->rows[f->row_count++];
+  for(int c = 0;c<CXI_Catalogue_Column_Count;c++){
+    r->v[c] = NAN;
+  }
+  r->title = heap_strdup(title);
+  r->sample = heap_strdup(sample);
+  return r;
+}
+
+/* Frames, rows and columns of a dataset, leading dimensions count as frames */
+static void dataset_shape(CXI_Dataset_Reference * ref, double * shape){
+  CXI_Dataset * dataset = ref->dataset ? ref->dataset : cxi_open_dataset(ref);
+  if(!dataset || dataset->dimension_count <= 0){
+    return;
+  }
+  int n = dataset->dimension_count;
+  double frames = 1;
+  for(int i = 0;i<n-2;i++){
+    frames *= dataset->dimensions[i];
+  }
+  shape[0] = frames;
+  shape[1] = n >= 2 ? dataset->dimensions[n-2] : 1;
+  shape[2] = dataset->dimensions[n-1];
+}
+
+static void set_shape(Scan_Row * r, const double * shape){
+  r->v[CXI_Catalogue_Frames] = shape[0];
+  r->v[CXI_Catalogue_Rows] = shape[1];
+  r->v[CXI_Catalogue_Columns] = shape[2];
+}
+
+static void set_source(Scan_Row * r, CXI_Source * source){
+  if(!source){
+    return;
+  }
+  if(source->energy_valid){
+    r->v[CXI_Catalogue_Photon_Energy] = source->energy;
+  }
+  if(source->pulse_energy_valid){
+    r->v[CXI_Catalogue_Pulse_Energy] = source->pulse_energy;
+  }
+}
+
+static void scan_file(Found_File * f){
+  CXI_File * file = cxi_open_file(f->path,"r");
+  if(!file){
+    f->failed = 1;
+    return;
+  }
+  for(int e = 0;e<file->entry_count;e++){
+    CXI_Entry * entry = cxi_open_entry(file->entries[e]);
+    if(!entry){
+      continue;
+    }
+    const char * sample = NULL;
+    if(entry->sample_count){
+      CXI_Sample * s = cxi_open_sample(entry->samples[0]);
+      sample = s ? s->name : NULL;
+    }
+    double entry_shape[3] = {NAN,NAN,NAN};
+    if(entry->data_count){
+      CXI_Data * data = cxi_open_data(entry->data[0]);
+      if(data && data->data){
+	dataset_shape(data->data, entry_shape);
+      }
+    }
+    hsize_t first = f->row_count;
+    for(int i = 0;i<entry->instrument_count;i++){
+      CXI_Instrument * instrument = cxi_open_instrument(entry->instruments[i]);
+      if(!instrument){
+	continue;
+      }
+      CXI_Source * source = instrument->source_count ? cxi_open_source(instrument->sources[0]) : NULL;
+      hsize_t instrument_first = f->row_count;
+      for(int d = 0;d<instrument->detector_count;d++){
+	CXI_Detector * detector = cxi_open_detector(instrument->detectors[d]);
+	if(!detector){
+	  continue;
+	}
+	Scan_Row * r = push_row(f, entry->title, sample);
+	if(!r){
+	  break;
+	}
+	r->v[CXI_Catalogue_Entry] = e+1;
+	r->v[CXI_Catalogue_Instrument] = i+1;
+	r->v[CXI_Catalogue_Detector] = d+1;
+	if(detector->distance_valid){
+	  r->v[CXI_Catalogue_Distance] = detector->distance;
+	}
+	if(detector->x_pixel_size_valid){
+	  r->v[CXI_Catalogue_X_Pixel_Size] = detector->x_pixel_size;
+	}
+	if(detector->y_pixel_size_valid){
+	  r->v[CXI_Catalogue_Y_Pixel_Size] = detector->y_pixel_size;
+	}
+	set_source(r, source);
+	double shape[3] = {NAN,NAN,NAN};
+	if(detector->data){
+	  dataset_shape(detector->data, shape);
+	}
+	set_shape(r, isnan(shape[0]) ? entry_shape : shape);
+      }
+      if(f->row_count == instrument_first){
+	Scan_Row * r = push_row(f, entry->title, sample);
+	if(r){
+	  r->v[CXI_Catalogue_Entry] = e+1;
+	  r->v[CXI_Catalogue_Instrument] = i+1;
+	  set_source(r, source);
+	  set_shape(r, entry_shape);
+	}
+      }
+    }
+    if(f->row_count == first){
+      Scan_Row * r = push_row(f, entry->title, sample);
+      if(r){
+	r->v[CXI_Catalogue_Entry] = e+1;
+	set_shape(r, entry_shape);
+      }
+    }
+  }
+  cxi_close_file(file);
+}
+
+static void scan_range(hsize_t begin, hsize_t end, void * arg){
+  Found_File ** files = arg;
+  for(hsize_t i = begin;i<end;i++){
+    scan_file(files[i]);
+  }
+}
+
+static int ends_with(const char * s, const char * suffix){
+  size_t n = strlen(s);
+  size_t m = strlen(suffix);
+  return n >= m && strcmp(s+n-m, suffix) == 0;
+}
+
+static int add_found(Found_List * list, const char * path, const struct stat * st){
+  if(list->count == list->capacity){
+    hsize_t capacity = list->capacity ? 2*list->capacity : 64;
+    Found_File * files = realloc(list->files, sizeof(Found_File)*capacity);
+    if(!files){
+      return -1;
+    }
+    list->files = files;
+    list->capacity = capacity;
+  }
+  Found_File * f = &list->files[list->count++];
+  memset(f, 0, sizeof(Found_File));
+  f->path = cxi_arena_strdup(NULL, path);
+  f->mtime = st->st_mtim.tv_sec + 1e-9*st->st_mtim.tv_nsec;
+  f->size = st->st_size;
+  f->old = -1;
+  return f->path ? 0 : -1;
+}
+
+/* The directories being crawled, from the innermost one up */
+typedef struct Crawled_Dir{
+  dev_t dev;
+  ino_t ino;
+  const struct Crawled_Dir * parent;
+}Crawled_Dir;
+
+static int crawl(Found_List * list, const char * path, int top, const Crawled_Dir * parent){
+  struct stat st;
+  if(stat(path, &st)){
+    return top ? -1 : 0;
+  }
+  if(S_ISREG(st.st_mode)){
+    /* Files named explicitly are indexed whatever their extension */
+    if(top || ends_with(path, ".cxi")){
+      return add_found(list, path, &st);
+    }
+    return 0;
+  }
+  if(!S_ISDIR(st.st_mode)){
+    return 0;
+  }
+  /* Symbolic links are followed, but not back into a directory being crawled */
+  for(const Crawled_Dir * c = parent;c;c = c->parent){
+    if(c->dev == st.st_dev && c->ino == st.st_ino){
+      return 0;
+    }
+  }
+  Crawled_Dir self = {st.st_dev, st.st_ino, parent};
+  DIR * dir = opendir(path);
+  if(!dir){
+    return top ? -1 : 0;
+  }
+  struct dirent * d;
+  int ret = 0;
+  while(!ret && (d = readdir(dir))){
+    if(strcmp(d->d_name,".") == 0 || strcmp(d->d_name,"..") == 0){
+      continue;
+    }
+    char * child = malloc(strlen(path)+strlen(d->d_name)+2);
+    if(!child){
+      ret = -1;
+      break;
+    }
+    sprintf(child,"%s/%s",path,d->d_name);
+    ret = crawl(list, child, 0, &self);
+    free(child);
+  }
+  closedir(dir);
+  return ret;
+}
+
+typedef struct{
+  const char * path;
+  hsize_t index;
+}Path_Index;
+
+static int compare_paths(const void * a, const void * b){
+  return strcmp(((const Path_Index *)a)->path, ((const Path_Index *)b)->path);
+}
+
+static int under_root(const char * path, const char * root){
+  size_t n = strlen(root);
+  while(n > 1 && root[n-1] == '/'){
+    n--;
+  }
+  return strncmp(path, root, n) == 0 && (path[n] == 0 || path[n] == '/');
+}
+
+static CXI_Catalogue * empty_catalogue(void){
+  CXI_Catalogue * c = calloc(sizeof(CXI_Catalogue),1);
+  if(!c){
+    return NULL;
+  }
+  c->arena = cxi_arena_new();
+  if(!c->arena){
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+/* Frees the arrays of a catalogue but not the catalogue itself */
+static void free_contents(CXI_Catalogue * c){
+  free(c->paths);
+  free(c->mtimes);
+  free(c->sizes);
+  free(c->row_file);
+  for(int k = 0;k<CXI_Catalogue_Column_Count;k++){
+    free(c->columns[k]);
+  }
+  free(c->titles);
+  free(c->samples);
+  cxi_arena_free(c->arena);
+}
+
+static int allocate_contents(CXI_Catalogue * c, hsize_t files, hsize_t rows){
+  hsize_t nf = files ? files : 1;
+  hsize_t nr = rows ? rows : 1;
+  c->paths = calloc(sizeof(char *),nf);
+  c->mtimes = calloc(sizeof(double),nf);
+  c->sizes = calloc(sizeof(hsize_t),nf);
+  c->row_file = calloc(sizeof(uint32_t),nr);
+  c->titles = calloc(sizeof(char *),nr);
+  c->samples = calloc(sizeof(char *),nr);
+  int ok = c->paths && c->mtimes && c->sizes && c->row_file && c->titles && c->samples;
+  for(int k = 0;k<CXI_Catalogue_Column_Count;k++){
+    c->columns[k] = calloc(sizeof(double),nr);
+    ok = ok && c->columns[k];
+  }
+  return ok ? 0 : -1;
+}
+
+static char * arena_string(CXI_Arena * arena, const char * s){
+  return s ? cxi_arena_strdup(arena, s) : NULL;
+}
+
+int cxi_update_catalogue(CXI_Catalogue * catalogue, const char ** roots, int root_count, int nthreads){
+  if(!catalogue || (root_count && !roots)){
+    return -1;
+  }
+  Found_List found;
+  memset(&found, 0, sizeof(found));
+  for(int r = 0;r<root_count;r++){
+    if(crawl(&found, roots[r], 1, NULL)){
+      cxi_warning("Could not index %s", roots[r]);
+    }
+  }
+
+  /* Match the files found with the ones we already know */
+  Path_Index * known = malloc(sizeof(Path_Index)*(catalogue->file_count+1));
+  if(!known){
+    return -1;
+  }
+  for(hsize_t i = 0;i<catalogue->file_count;i++){
+    known[i].path = catalogue->paths[i];
+    known[i].index = i;
+  }
+  qsort(known, catalogue->file_count, sizeof(Path_Index), compare_paths);
+  Found_File ** changed = malloc(sizeof(Found_File *)*(found.count+1));
+  hsize_t changed_count = 0;
+  /* 0 for files to drop, 1 for the ones to keep */
+  char * keep = calloc(1,catalogue->file_count+1);
+  if(!changed || !keep){
+    free(known);
+    free(changed);
+    free(keep);
+    return -1;
+  }
+  for(hsize_t i = 0;i<catalogue->file_count;i++){
+    int indexed = 0;
+    for(int r = 0;r<root_count && !indexed;r++){
+      indexed = under_root(catalogue->paths[i], roots[r]);
+    }
+    keep[i] = !indexed;
+  }
+  for(hsize_t i = 0;i<found.count;i++){
+    Found_File * f = &found.files[i];
+    Path_Index key = {f->path, 0};
+    Path_Index * k = bsearch(&key, known, catalogue->file_count, sizeof(Path_Index), compare_paths);
+    if(k){
+      f->old = k->index;
+    }
+    if(k && catalogue->mtimes[k->index] == f->mtime && catalogue->sizes[k->index] == f->size){
+      keep[k->index] = 1;
+    }else{
+      if(k){
+	keep[k->index] = 0;
+      }
+      f->changed = 1;
+      changed[changed_count++] = f;
+    }
+  }
+  free(known);
+
+  /* Files are read with HDF5, only in parallel if it allows it */
+  cxi_parallel_for(cxi_hdf5_threadsafe() ? nthreads : 1, changed_count, scan_range, changed);
+
+  /* Rows of a file are always contiguous, find where they start */
+  hsize_t * first_row = calloc(sizeof(hsize_t),catalogue->file_count+1);
+  hsize_t * row_count = calloc(sizeof(hsize_t),catalogue->file_count+1);
+  CXI_Catalogue next;
+  memset(&next, 0, sizeof(next));
+  next.arena = cxi_arena_new();
+  int ret = first_row && row_count && next.arena ? 0 : -1;
+  if(!ret){
+    for(hsize_t r = catalogue->row_count;r>0;r--){
+      first_row[catalogue->row_file[r-1]] = r-1;
+      row_count[catalogue->row_file[r-1]]++;
+    }
+    for(hsize_t i = 0;i<catalogue->file_count;i++){
+      if(keep[i]){
+	next.file_count++;
+	next.row_count += row_count[i];
+      }
+    }
+    for(hsize_t i = 0;i<changed_count;i++){
+      if(!changed[i]->failed){
+	next.file_count++;
+	next.row_count += changed[i]->row_count;
+      }
+    }
+    ret = allocate_contents(&next, next.file_count, next.row_count);
+  }
+  if(!ret){
+    hsize_t nf = 0;
+    hsize_t nr = 0;
+    for(hsize_t i = 0;i<catalogue->file_count;i++){
+      if(!keep[i]){
+	continue;
+      }
+      next.paths[nf] = cxi_arena_strdup(next.arena, catalogue->paths[i]);
+      next.mtimes[nf] = catalogue->mtimes[i];
+      next.sizes[nf] = catalogue->sizes[i];
+      for(hsize_t r = first_row[i];r<first_row[i]+row_count[i];r++,nr++){
+	next.row_file[nr] = nf;
+	for(int k = 0;k<CXI_Catalogue_Column_Count;k++){
+	  next.columns[k][nr] = catalogue->columns[k][r];
+	}
+	next.titles[nr] = arena_string(next.arena, catalogue->titles[r]);
+	next.samples[nr] = arena_string(next.arena, catalogue->samples[r]);
+      }
+      nf++;
+    }
+    for(hsize_t i = 0;i<changed_count;i++){
+      Found_File * f = changed[i];
+      if(f->failed){
+	cxi_warning("Could not read %s", f->path);
+	continue;
+      }
+      next.paths[nf] = cxi_arena_strdup(next.arena, f->path);
+      next.mtimes[nf] = f->mtime;
+      next.sizes[nf] = f->size;
+      for(hsize_t r = 0;r<f->row_count;r++,nr++){
+	next.row_file[nr] = nf;
+	for(int k = 0;k<CXI_Catalogue_Column_Count;k++){
+	  next.columns[k][nr] = f->rows[r].v[k];
+	}
+	next.titles[nr] = arena_string(next.arena, f->rows[r].title);
+	next.samples[nr] = arena_string(next.arena, f->rows[r].sample);
+      }
+      nf++;
+    }
+    free_contents(catalogue);
+    *catalogue = next;
+  }else{
+    free_contents(&next);
+  }
+  for(hsize_t i = 0;i<found.count;i++){
+    for(hsize_t r = 0;r<found.files[i].row_count;r++){
+      free(found.files[i].rows[r].title);
+      free(found.files[i].rows[r].sample);
+    }
+    free(found.files[i].rows);
+    free(found.files[i].path);
+  }
+  free(found.files);
+  free(first_row);
+  free(row_count);
+  free(changed);
+  free(keep);
+  return ret ? ret : (int)changed_count;
+}
+
+hsize_t cxi_query_catalogue(CXI_Catalogue * catalogue, const CXI_Catalogue_Range * ranges,
+			    int range_count, hsize_t * rows){
+  if(!catalogue){
+    return 0;
+  }
+  hsize_t n = 0;
+  for(hsize_t r = 0;r<catalogue->row_count;r++){
+    int match = 1;
+    for(int i = 0;i<range_count && match;i++){
+      if(ranges[i].column < 0 || ranges[i].column >= CXI_Catalogue_Column_Count){
+	return 0;
+      }
+      double v = catalogue->columns[ranges[i].column][r];
+      /* NaN fails both comparisons */
+      match = v >= ranges[i].min && v <= ranges[i].max;
+    }
+    if(match){
+      if(rows){
+	rows[n] = r;
+      }
+      n++;
+    }
+  }
+  return n;
+}
+
+/* On disk every column is a dataset, compressed when it is not empty */
+static int write_column(hid_t loc, const char * name, hid_t type, hsize_t n, const void * data){
+  hsize_t dims[1] = {n};
+  hid_t space = H5Screate_simple(1, dims, NULL);
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  if(n > 0){
+    hsize_t chunk[1] = {n < CXI_CATALOGUE_CHUNK ? n : CXI_CATALOGUE_CHUNK};
+    H5Pset_chunk(plist, 1, chunk);
+    H5Pset_shuffle(plist);
+    H5Pset_deflate(plist, 4);
+  }
+  hid_t ds = H5Dcreate(loc, name, type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Pclose(plist);
+  H5Sclose(space);
+  if(ds < 0){
+    return -1;
+  }
+  herr_t status = n ? H5Dwrite(ds, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) : 0;
+  H5Dclose(ds);
+  return status < 0 ? -1 : 0;
+}
+
+/* Strings are stored back to back, string i spans [offsets[i],offsets[i+1]) */
+static int write_strings(hid_t loc, const char * name, char ** strings, hsize_t n){
+  hsize_t * offsets = malloc(sizeof(hsize_t)*(n+1));
+  if(!offsets){
+    return -1;
+  }
+  offsets[0] = 0;
+  for(hsize_t i = 0;i<n;i++){
+    offsets[i+1] = offsets[i] + (strings[i] ? strlen(strings[i]) : 0);
+  }
+  char * chars = malloc(offsets[n]+1);
+  if(!chars){
+    free(offsets);
+    return -1;
+  }
+  for(hsize_t i = 0;i<n;i++){
+    if(strings[i]){
+      memcpy(chars+offsets[i], strings[i], offsets[i+1]-offsets[i]);
+    }
+  }
+  char buffer[1024];
+  sprintf(buffer,"%s_offsets",name);
+  int ret = write_column(loc, buffer, H5T_NATIVE_HSIZE, n+1, offsets);
+  sprintf(buffer,"%s_chars",name);
+  ret = ret ? ret : write_column(loc, buffer, H5T_NATIVE_CHAR, offsets[n], chars);
+  free(chars);
+  free(offsets);
+  return ret;
+}
+
+int cxi_save_catalogue(CXI_Catalogue * catalogue, const char * filename){
+  if(!catalogue || !filename){
+    return -1;
+  }
+  char * tmp = malloc(strlen(filename)+5);
+  if(!tmp){
+    return -1;
+  }
+  sprintf(tmp,"%s.tmp",filename);
+  hid_t file = H5Fcreate(tmp, H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+  if(file < 0){
+    free(tmp);
+    return -1;
+  }
+  int version = CXI_CATALOGUE_VERSION;
+  int ret = write_column(file, "catalogue_version", H5T_NATIVE_INT, 1, &version);
+  hid_t files = H5Gcreate(file, "files", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  hid_t rows = H5Gcreate(file, "rows", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  hsize_t nf = catalogue->file_count;
+  hsize_t nr = catalogue->row_count;
+  ret = ret || files < 0 || rows < 0 ||
+    write_strings(files, "path", catalogue->paths, nf) ||
+    write_column(files, "mtime", H5T_NATIVE_DOUBLE, nf, catalogue->mtimes) ||
+    write_column(files, "size", H5T_NATIVE_HSIZE, nf, catalogue->sizes) ||
+    write_column(rows, "file", H5T_NATIVE_UINT32, nr, catalogue->row_file) ||
+    write_strings(rows, "title", catalogue->titles, nr) ||
+    write_strings(rows, "sample", catalogue->samples, nr);
+  for(int k = 0;k<CXI_Catalogue_Column_Count && !ret;k++){
+    ret = write_column(rows, column_names[k], H5T_NATIVE_DOUBLE, nr, catalogue->columns[k]);
+  }
+  if(files >= 0){
+    H5Gclose(files);
+  }
+  if(rows >= 0){
+    H5Gclose(rows);
+  }
+  if(H5Fclose(file) < 0){
+    ret = -1;
+  }
+  /* Readers only ever see a complete catalogue */
+  if(!ret && rename(tmp, filename)){
+    ret = -1;
+  }
+  if(ret){
+    remove(tmp);
+  }
+  free(tmp);
+  return ret ? -1 : 0;
+}
+
+static int read_column(hid_t loc, const char * name, hid_t type, hsize_t n, void * data){
+  hid_t ds = H5Dopen(loc, name, H5P_DEFAULT);
+  if(ds < 0){
+    return -1;
+  }
+  hid_t space = H5Dget_space(ds);
+  hsize_t dims[1] = {0};
+  int ok = H5Sget_simple_extent_ndims(space) == 1;
+  H5Sget_simple_extent_dims(space, dims, NULL);
+  H5Sclose(space);
+  ok = ok && dims[0] == n;
+  if(ok && n){
+    ok = H5Dread(ds, type, H5S_ALL, H5S_ALL, H5P_DEFAULT, data) >= 0;
+  }
+  H5Dclose(ds);
+  return ok ? 0 : -1;
+}
+
+static hsize_t column_length(hid_t loc, const char * name){
+  hid_t ds = H5Dopen(loc, name, H5P_DEFAULT);
+  if(ds < 0){
+    return 0;
+  }
+  hid_t space = H5Dget_space(ds);
+  hsize_t dims[1] = {0};
+  if(H5Sget_simple_extent_ndims(space) == 1){
+    H5Sget_simple_extent_dims(space, dims, NULL);
+  }
+  H5Sclose(space);
+  H5Dclose(ds);
+  return dims[0];
+}
+
+static int read_strings(hid_t loc, const char * name, char ** strings, hsize_t n, CXI_Arena * arena){
+  char buffer[1024];
+  hsize_t * offsets = malloc(sizeof(hsize_t)*(n+1));
+  if(!offsets){
+    return -1;
+  }
+  sprintf(buffer,"%s_offsets",name);
+  if(read_column(loc, buffer, H5T_NATIVE_HSIZE, n+1, offsets)){
+    free(offsets);
+    return -1;
+  }
+  char * chars = malloc(offsets[n]+1);
+  sprintf(buffer,"%s_chars",name);
+  if(!chars || read_column(loc, buffer, H5T_NATIVE_CHAR, offsets[n], chars)){
+    free(offsets);
+    free(chars);
+    return -1;
+  }
+  int ret = 0;
+  for(hsize_t i = 0;i<n;i++){
+    hsize_t len = offsets[i+1]-offsets[i];
+    if(len == 0 || offsets[i+1] > offsets[n]){
+      continue;
+    }
+    strings[i] = cxi_arena_calloc(arena, 1, len+1);
+    if(!strings[i]){
+      ret = -1;
+      break;
+    }
+    memcpy(strings[i], chars+offsets[i], len);
+  }
+  free(offsets);
+  free(chars);
+  return ret;
+}
+
+CXI_Catalogue * cxi_open_catalogue(const char * filename){
+  CXI_TRACE();
+  if(!filename){
+    return NULL;
+  }
+  CXI_Catalogue * c = empty_catalogue();
+  if(!c){
+    return NULL;
+  }
+  struct stat st;
+  if(stat(filename, &st)){
+    /* A new catalogue */
+    if(allocate_contents(c, 0, 0)){
+      cxi_close_catalogue(c);
+      return NULL;
+    }
+    return c;
+  }
+  hid_t file = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if(file < 0){
+    cxi_close_catalogue(c);
+    return NULL;
+  }
+  int version = 0;
+  int ret = read_column(file, "catalogue_version", H5T_NATIVE_INT, 1, &version);
+  if(!ret && version != CXI_CATALOGUE_VERSION){
+    cxi_warning("Unsupported catalogue version %d", version);
+    ret = -1;
+  }
+  hid_t files = ret ? -1 : H5Gopen(file, "files", H5P_DEFAULT);
+  hid_t rows = ret ? -1 : H5Gopen(file, "rows", H5P_DEFAULT);
+  if(files < 0 || rows < 0){
+    ret = -1;
+  }
+  if(!ret){
+    c->file_count = column_length(files, "mtime");
+    c->row_count = column_length(rows, "file");
+    ret = allocate_contents(c, c->file_count, c->row_count) ||
+      read_strings(files, "path", c->paths, c->file_count, c->arena) ||
+      read_column(files, "mtime", H5T_NATIVE_DOUBLE, c->file_count, c->mtimes) ||
+      read_column(files, "size", H5T_NATIVE_HSIZE, c->file_count, c->sizes) ||
+      read_column(rows, "file", H5T_NATIVE_UINT32, c->row_count, c->row_file) ||
+      read_strings(rows, "title", c->titles, c->row_count, c->arena) ||
+      read_strings(rows, "sample", c->samples, c->row_count, c->arena);
+  }
+  for(int k = 0;k<CXI_Catalogue_Column_Count && !ret;k++){
+    ret = read_column(rows, column_names[k], H5T_NATIVE_DOUBLE, c->row_count, c->columns[k]);
+  }
+  for(hsize_t r = 0;r<c->row_count && !ret;r++){
+    ret = c->row_file[r] >= c->file_count;
+  }
+  if(files >= 0){
+    H5Gclose(files);
+  }
+  if(rows >= 0){
+    H5Gclose(rows);
+  }
+  H5Fclose(file);
+  if(ret){
+    cxi_close_catalogue(c);
+    return NULL;
+  }
+  return c;
+}
+
+void cxi_close_catalogue(CXI_Catalogue * catalogue){
+  if(!catalogue){
+    return;
+  }
+  free_contents(catalogue);
+  free(catalogue);
+}
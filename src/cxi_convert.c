@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi_private.h"
+
+static int warn_conversions = 0;
+
+void cxi_set_conversion_warnings(int enable){
+  __atomic_store_n(&warn_conversions, enable ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+__attribute__((constructor)) static void conversion_warnings_from_environment(void){
+  const char * v = getenv("CXI_WARN_CONVERSIONS");
+  if(v && v[0] && strcmp(v,"0")){
+    cxi_set_conversion_warnings(1);
+  }
+}
+
+int cxi_dataset_converts(CXI_Dataset * dataset, hid_t mem_type){
+  if(dataset->data_type <= 0 || H5Tequal(mem_type, dataset->data_type) > 0){
+    return 0;
+  }
+  if(__atomic_load_n(&warn_conversions, __ATOMIC_RELAXED) &&
+     !__atomic_exchange_n(&dataset->conversion_warned, 1, __ATOMIC_RELAXED)){
+    cxi_warning("Converting dataset elements of %d bytes to or from memory elements of %d bytes, "
+		"use the file type in memory to avoid it",
+		(int)H5Tget_size(dataset->data_type), (int)H5Tget_size(mem_type));
+  }
+  return 1;
+}
+
+/* Everything but the first dimension, in bytes */
+static size_t slice_bytes(CXI_Dataset * dataset){
+  size_t bytes = H5Tget_size(dataset->data_type);
+  for(int i = 1;i<dataset->dimension_count;i++){
+    bytes *= dataset->dimensions[i];
+  }
+  return bytes;
+}
+
+static int raw_range(CXI_Dataset * dataset, hsize_t first, hsize_t n){
+  hsize_t cs = dataset->chunk_slices;
+  return dataset->raw_chunks && cs && n && first % cs == 0 && n % cs == 0 &&
+    first+n <= dataset->dimensions[0] && dataset->dimension_count <= H5S_MAX_RANK;
+}
+
+int cxi_read_raw_chunks(CXI_Dataset * dataset, hsize_t first, hsize_t n, void * data){
+  if(!raw_range(dataset, first, n)){
+    return -1;
+  }
+  hsize_t cs = dataset->chunk_slices;
+  size_t chunk_bytes = cs*slice_bytes(dataset);
+  hsize_t offset[H5S_MAX_RANK];
+  memset(offset, 0, sizeof(offset));
+  /* Chunks never written read as the fill value, which only H5Dread() knows.
+     Asking about them is an error HDF5 would print. */
+  int allocated = 1;
+  H5E_BEGIN_TRY{
+    for(hsize_t c = first;allocated && c<first+n;c += cs){
+      offset[0] = c;
+      hsize_t size = 0;
+      allocated = H5Dget_chunk_storage_size(dataset->handle, offset, &size) >= 0 && size == chunk_bytes;
+    }
+  }H5E_END_TRY;
+  if(!allocated){
+    return -1;
+  }
+  for(hsize_t c = first;c<first+n;c += cs){
+    offset[0] = c;
+    uint32_t filters = 0;
+    if(H5Dread_chunk(dataset->handle, H5P_DEFAULT, offset, &filters,
+		     (char *)data+(c-first)/cs*chunk_bytes) < 0){
+      /* The caller reads everything again */
+      return -1;
+    }
+  }
+  cxi_stats_raw_copy(dataset, n/cs);
+  return 0;
+}
+
+int cxi_write_raw_chunks(CXI_Dataset * dataset, hsize_t first, hsize_t n, const void * data){
+  if(!raw_range(dataset, first, n)){
+    return -1;
+  }
+  hsize_t cs = dataset->chunk_slices;
+  size_t chunk_bytes = cs*slice_bytes(dataset);
+  hsize_t offset[H5S_MAX_RANK];
+  memset(offset, 0, sizeof(offset));
+  for(hsize_t c = first;c<first+n;c += cs){
+    offset[0] = c;
+    if(H5Dwrite_chunk(dataset->handle, H5P_DEFAULT, 0, offset, chunk_bytes,
+		      (const char *)data+(c-first)/cs*chunk_bytes) < 0){
+      /* Rewriting all of them is harmless */
+      return -1;
+    }
+  }
+  cxi_stats_raw_copy(dataset, n/cs);
+  return 0;
+}
+
+int cxi_set_conversion_buffer(CXI_Dataset * dataset, size_t bytes){
+  if(!dataset){
+    return -1;
+  }
+  if(dataset->transfer_plist > 0 && dataset->transfer_plist != H5P_DEFAULT){
+    cxi_arena_close(dataset->arena, dataset->transfer_plist);
+  }
+  dataset->transfer_plist = H5P_DEFAULT;
+  cxi_arena_release(dataset->arena, dataset->conversion_buffer);
+  dataset->conversion_buffer = NULL;
+  if(bytes == 0){
+    return 0;
+  }
+  /* HDF5 needs room for at least one element of either type */
+  if(bytes < 64){
+    bytes = 64;
+  }
+  dataset->conversion_buffer = cxi_arena_calloc(dataset->arena, 1, bytes);
+  if(!dataset->conversion_buffer){
+    return -1;
+  }
+  hid_t plist = H5Pcreate(H5P_DATASET_XFER);
+  if(plist < 0 || H5Pset_buffer(plist, bytes, dataset->conversion_buffer, NULL) < 0){
+    if(plist >= 0){
+      H5Pclose(plist);
+    }
+    cxi_arena_release(dataset->arena, dataset->conversion_buffer);
+    dataset->conversion_buffer = NULL;
+    return -1;
+  }
+  /* Closed with the file if the dataset belongs to one */
+  dataset->transfer_plist = cxi_arena_track(dataset->arena, plist);
+  return 0;
+}
@@ -0,0 +1,363 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+#define CXI_DARK_BATCH_BYTES (64*1024*1024)
+#define CXI_DARK_DEFAULT_BINS 64
+#define CXI_DARK_DEFAULT_THRESHOLD 6.0
+/* Half width of the median histogram, in sigmas of the frames seen so far */
+#define CXI_DARK_HISTOGRAM_SIGMAS 8.0
+/* Widening a histogram more often than this means its values are not finite */
+#define CXI_DARK_MAX_WIDENINGS 64
+/* The smallest robust spread, relative to the median, for data without any noise */
+#define CXI_DARK_MIN_SPREAD 1e-6
+
+typedef struct{
+  CXI_Reduction * r;
+  double * batch;
+  hsize_t batch_frames;
+  int bins;
+  /* Each pixel owns bins+2 counters, the first and the last ones
+     count the values below and above the histogram range. */
+  uint16_t * counts;
+  float * lower;
+  float * inv_width;
+}Dark_Batch;
+
+/* Halving all the counters of a pixel keeps its distribution and
+   therefore its median, while making room for more frames. */
+static void halve_histogram(uint16_t * c, int slots){
+  for(int k = 0;k<slots;k++){
+    c[k] >>= 1;
+  }
+}
+
+/* The range a pixel's histogram should cover given the n frames seen so far */
+static void wanted_range(Dark_Batch * b, hsize_t i, hsize_t n, double * lo, double * hi){
+  CXI_Reduction * r = b->r;
+  double sigma = n > 1 ? sqrt(r->variance[i]/(n-1)) : 0;
+  double half = CXI_DARK_HISTOGRAM_SIGMAS*sigma;
+  if(half < 1){
+    half = 1;
+  }
+  *lo = r->mean[i]-half;
+  *hi = r->mean[i]+half;
+}
+
+static void seed_histogram(Dark_Batch * b, hsize_t begin, hsize_t end, hsize_t nb){
+  for(hsize_t i = begin;i<end;i++){
+    double lo, hi;
+    wanted_range(b, i, nb, &lo, &hi);
+    b->lower[i] = lo;
+    b->inv_width[i] = b->bins/(hi-lo);
+  }
+}
+
+/* Doubles the range of a pixel's histogram, merging pairs of bins, until it
+   covers the frames seen so far. Later batches may drift away from the first
+   one. Values that already fell outside the range stay in the outer counters. */
+static void widen_histogram(Dark_Batch * b, hsize_t i, hsize_t n){
+  double lo, hi;
+  wanted_range(b, i, n, &lo, &hi);
+  uint16_t * c = b->counts + i*(b->bins+2);
+  int half = b->bins/2;
+  for(int w = 0;w<CXI_DARK_MAX_WIDENINGS;w++){
+    double range = b->bins/b->inv_width[i];
+    if(hi <= b->lower[i]+range && lo >= b->lower[i]){
+      return;
+    }
+    /* Make sure merged bins can't overflow */
+    for(int k = 1;k<=b->bins;k++){
+      if(c[k] >= UINT16_MAX/2){
+	halve_histogram(c, b->bins+2);
+	break;
+      }
+    }
+    if(hi > b->lower[i]+range){
+      for(int k = 0;k<half;k++){
+	c[1+k] = c[1+2*k]+c[2+2*k];
+      }
+      memset(c+1+half, 0, sizeof(uint16_t)*half);
+    }else if(lo < b->lower[i]){
+      for(int k = half-1;k>=0;k--){
+	c[1+half+k] = c[1+2*k]+c[2+2*k];
+      }
+      memset(c+1, 0, sizeof(uint16_t)*half);
+      b->lower[i] -= range;
+    }
+    b->inv_width[i] /= 2;
+  }
+}
+
+static void dark_pixels(hsize_t begin, hsize_t end, void * arg){
+  Dark_Batch * b = arg;
+  CXI_Reduction * r = b->r;
+  hsize_t nb = b->batch_frames;
+  hsize_t len = r->frame_length;
+  int slots = b->bins+2;
+  cxi_reduction_accumulate(r, b->batch, nb, begin, end);
+  if(r->frame_count == 0){
+    /* The range of the histogram comes from the first batch */
+    seed_histogram(b, begin, end, nb);
+  }else{
+    for(hsize_t i = begin;i<end;i++){
+      widen_histogram(b, i, r->frame_count+nb);
+    }
+  }
+  enum {block = 256};
+  for(hsize_t p0 = begin; p0 < end; p0 += block){
+    hsize_t pn = end-p0 < block ? end-p0 : block;
+    for(hsize_t f = 0;f<nb;f++){
+      const double * frame = b->batch + f*len;
+      for(hsize_t i = p0;i<p0+pn;i++){
+	double x = (frame[i]-b->lower[i])*b->inv_width[i];
+	int k;
+	if(x < 0){
+	  k = 0;
+	}else if(x >= b->bins){
+	  k = b->bins+1;
+	}else{
+	  k = (int)x+1;
+	}
+	uint16_t * c = b->counts + i*slots;
+	if(++c[k] == UINT16_MAX){
+	  halve_histogram(c, slots);
+	}
+      }
+    }
+  }
+}
+
+static double histogram_median(const uint16_t * c, int bins, float lower, float inv_width){
+  double total = 0;
+  for(int k = 0;k<bins+2;k++){
+    total += c[k];
+  }
+  double target = total/2;
+  double cum = c[0];
+  if(cum >= target){
+    return lower;
+  }
+  for(int k = 1;k<=bins;k++){
+    if(c[k] && cum + c[k] >= target){
+      return lower + (k-1 + (target-cum)/c[k])/inv_width;
+    }
+    cum += c[k];
+  }
+  return lower + bins/inv_width;
+}
+
+static int compare_doubles(const void * a, const void * b){
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Median and median absolute deviation over all pixels */
+static int robust_spread(const double * v, hsize_t n, double * median, double * mad){
+  double * tmp = malloc(sizeof(double)*n);
+  if(!tmp){
+    return -1;
+  }
+  memcpy(tmp, v, sizeof(double)*n);
+  qsort(tmp, n, sizeof(double), compare_doubles);
+  *median = tmp[n/2];
+  for(hsize_t i = 0;i<n;i++){
+    tmp[i] = fabs(v[i]-*median);
+  }
+  qsort(tmp, n, sizeof(double), compare_doubles);
+  *mad = tmp[n/2];
+  free(tmp);
+  return 0;
+}
+
+/* Scales the MAD so it estimates a standard deviation, but never below
+   error_floor, nor below a tiny fraction of the median. Otherwise a MAD of 0,
+   e.g. with quantized data, puts the limit at the median and flags half of
+   the pixels. */
+static double robust_sigma(double median, double mad, double error_floor){
+  double s = 1.4826*mad;
+  if(s < error_floor){
+    s = error_floor;
+  }
+  double eps = CXI_DARK_MIN_SPREAD*(fabs(median) > 1 ? fabs(median) : 1);
+  return s > eps ? s : eps;
+}
+
+static int flag_pixels(CXI_Dark_Calibration * cal, double hot_threshold,
+		       double noisy_threshold, double dead_sigma){
+  double mean_median, mean_mad, sigma_median, sigma_mad;
+  if(robust_spread(cal->mean, cal->frame_length, &mean_median, &mean_mad) ||
+     robust_spread(cal->sigma, cal->frame_length, &sigma_median, &sigma_mad)){
+    return -1;
+  }
+  /* Means and sigmas of identical pixels still differ by their statistical errors */
+  double n = cal->frame_count;
+  double hot_limit = mean_median + hot_threshold*robust_sigma(mean_median, mean_mad, sigma_median/sqrt(n));
+  double noisy_limit = sigma_median + noisy_threshold*
+    robust_sigma(sigma_median, sigma_mad, n > 1 ? sigma_median/sqrt(2*(n-1)) : 0);
+  for(hsize_t i = 0;i<cal->frame_length;i++){
+    if(cal->sigma[i] <= dead_sigma){
+      cal->mask[i] |= CXI_PIXEL_IS_DEAD;
+      cal->dead_count++;
+    }else if(cal->mean[i] > hot_limit){
+      cal->mask[i] |= CXI_PIXEL_IS_HOT;
+      cal->hot_count++;
+    }else if(cal->sigma[i] > noisy_limit){
+      cal->mask[i] |= CXI_PIXEL_IS_HOT;
+      cal->noisy_count++;
+    }
+  }
+  return 0;
+}
+
+CXI_Dark_Calibration * cxi_calibrate_dark(CXI_Dataset * darks, CXI_Dark_Options * options){
+  CXI_Dark_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  if(options){
+    opt = *options;
+  }
+  if(opt.median_bins <= 0){
+    opt.median_bins = CXI_DARK_DEFAULT_BINS;
+  }
+  /* Widening merges pairs of bins */
+  opt.median_bins += opt.median_bins % 2;
+  if(opt.hot_threshold <= 0){
+    opt.hot_threshold = CXI_DARK_DEFAULT_THRESHOLD;
+  }
+  if(opt.noisy_threshold <= 0){
+    opt.noisy_threshold = CXI_DARK_DEFAULT_THRESHOLD;
+  }
+  CXI_Reduction * r = cxi_reduction_new(darks);
+  if(!r){
+    return NULL;
+  }
+  hsize_t frames = darks->dimensions[0];
+  hsize_t batch_frames = opt.batch_frames;
+  if(batch_frames == 0){
+    batch_frames = cxi_batch_slices(darks, sizeof(double), CXI_DARK_BATCH_BYTES);
+  }
+  if(batch_frames > frames){
+    batch_frames = frames;
+  }
+  Dark_Batch b;
+  b.r = r;
+  b.bins = opt.median_bins;
+  b.batch = malloc(sizeof(double)*r->frame_length*batch_frames);
+  b.counts = calloc(sizeof(uint16_t),r->frame_length*(b.bins+2));
+  b.lower = malloc(sizeof(float)*r->frame_length);
+  b.inv_width = malloc(sizeof(float)*r->frame_length);
+  CXI_Dark_Calibration * cal = calloc(sizeof(CXI_Dark_Calibration),1);
+  if(!b.batch || !b.counts || !b.lower || !b.inv_width || !cal){
+    goto error;
+  }
+  for(hsize_t first = 0; first < frames; first += batch_frames){
+    b.batch_frames = frames-first < batch_frames ? frames-first : batch_frames;
+    if(cxi_read_dataset_slices(darks, first, b.batch_frames, b.batch, H5T_NATIVE_DOUBLE)){
+      goto error;
+    }
+    cxi_parallel_for(opt.nthreads, r->frame_length, dark_pixels, &b);
+    r->frame_count += b.batch_frames;
+  }
+  cxi_reduction_finish(r);
+
+  cal->frame_count = r->frame_count;
+  cal->frame_length = r->frame_length;
+  cal->dimension_count = r->dimension_count;
+  /* Take over the arrays we want to keep from the reduction */
+  cal->dimensions = r->dimensions;
+  cal->mean = r->mean;
+  cal->sigma = r->variance;
+  r->dimensions = NULL;
+  r->mean = NULL;
+  r->variance = NULL;
+  cal->median = malloc(sizeof(double)*cal->frame_length);
+  cal->mask = calloc(sizeof(uint32_t),cal->frame_length);
+  if(!cal->median || !cal->mask){
+    goto error;
+  }
+  for(hsize_t i = 0;i<cal->frame_length;i++){
+    cal->sigma[i] = sqrt(cal->sigma[i]);
+    cal->median[i] = histogram_median(b.counts + i*(b.bins+2), b.bins,
+				      b.lower[i], b.inv_width[i]);
+  }
+  if(flag_pixels(cal, opt.hot_threshold, opt.noisy_threshold, opt.dead_sigma)){
+    goto error;
+  }
+  cxi_debug("dark calibration flagged %llu hot, %llu noisy and %llu dead pixels",
+	    (unsigned long long)cal->hot_count, (unsigned long long)cal->noisy_count,
+	    (unsigned long long)cal->dead_count);
+  cxi_free_reduction(r);
+  free(b.batch);
+  free(b.counts);
+  free(b.lower);
+  free(b.inv_width);
+  return cal;
+
+ error:
+  cxi_free_reduction(r);
+  cxi_free_dark_calibration(cal);
+  free(b.batch);
+  free(b.counts);
+  free(b.lower);
+  free(b.inv_width);
+  return NULL;
+}
+
+void cxi_free_dark_calibration(CXI_Dark_Calibration * cal){
+  if(!cal){
+    return;
+  }
+  free(cal->dimensions);
+  free(cal->mean);
+  free(cal->sigma);
+  free(cal->median);
+  free(cal->mask);
+  free(cal);
+}
+
+static CXI_Dataset * frame_dataset(CXI_Dark_Calibration * cal, hid_t data_type){
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  if(!dataset){
+    return NULL;
+  }
+  dataset->dimension_count = cal->dimension_count > 0 ? cal->dimension_count : 1;
+  dataset->dimensions = malloc(sizeof(hsize_t)*dataset->dimension_count);
+  if(!dataset->dimensions){
+    free(dataset);
+    return NULL;
+  }
+  if(cal->dimension_count > 0){
+    memcpy(dataset->dimensions, cal->dimensions, sizeof(hsize_t)*cal->dimension_count);
+  }else{
+    dataset->dimensions[0] = 1;
+  }
+  dataset->data_type = data_type;
+  return dataset;
+}
+
+int cxi_write_dark_calibration(CXI_Detector * detector, CXI_Dark_Calibration * cal){
+  CXI_TRACE();
+  if(!detector || detector->handle < 0 || !cal){
+    return -1;
+  }
+  CXI_Dataset * dark = frame_dataset(cal, H5T_NATIVE_FLOAT);
+  if(!dark){
+    return -1;
+  }
+  detector->data_dark = cxi_create_dataset(detector->handle, dark, CXI_Data_Dark_Type);
+  if(!detector->data_dark || cxi_write_dataset(dark, cal->mean, H5T_NATIVE_DOUBLE)){
+    return -1;
+  }
+  CXI_Dataset * mask = frame_dataset(cal, H5T_NATIVE_UINT32);
+  if(!mask){
+    return -1;
+  }
+  detector->mask = cxi_create_dataset(detector->handle, mask, CXI_Mask_Type);
+  if(!detector->mask || cxi_write_dataset(mask, cal->mask, H5T_NATIVE_UINT32)){
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Rows buffered per column before they are written, and per chunk */
+#define CXI_TABLE_BATCH 4096
+
+static CXI_Frame_Table * new_table(int count){
+  CXI_Frame_Table * t = calloc(sizeof(CXI_Frame_Table),1);
+  if(!t){
+    return NULL;
+  }
+  t->handle = -1;
+  t->names = calloc(sizeof(char *), count ? count : 1);
+  t->types = calloc(sizeof(hid_t), count ? count : 1);
+  t->datasets = calloc(sizeof(hid_t), count ? count : 1);
+  t->pending = calloc(sizeof(void *), count ? count : 1);
+  if(!t->names || !t->types || !t->datasets || !t->pending){
+    free(t->names);
+    free(t->types);
+    free(t->datasets);
+    free(t->pending);
+    free(t);
+    return NULL;
+  }
+  for(int i = 0;i<count;i++){
+    t->types[i] = -1;
+    t->datasets[i] = -1;
+  }
+  return t;
+}
+
+/* The columns keep the order they were created in */
+static hid_t create_group(hid_t loc, const char * name){
+  hid_t plist = H5Pcreate(H5P_GROUP_CREATE);
+  H5Pset_link_creation_order(plist, H5P_CRT_ORDER_TRACKED | H5P_CRT_ORDER_INDEXED);
+  hid_t group = H5Gcreate(loc, name, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Pclose(plist);
+  return group;
+}
+
+static int allocate_pending(CXI_Frame_Table * t){
+  for(int i = 0;i<t->column_count;i++){
+    t->pending[i] = malloc(H5Tget_size(t->types[i])*t->batch_frames);
+    if(!t->pending[i]){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+CXI_Frame_Table * cxi_create_frame_table(hid_t loc, const char * name, const CXI_Column * columns,
+					 int count, hsize_t batch_frames){
+  CXI_TRACE();
+  if(loc < 0 || !name || count < 0 || (count && !columns)){
+    return NULL;
+  }
+  for(int i = 0;i<count;i++){
+    if(!columns[i].name || H5Tget_size(columns[i].type) == 0){
+      return NULL;
+    }
+  }
+  CXI_Frame_Table * t = new_table(count);
+  if(!t){
+    return NULL;
+  }
+  t->batch_frames = batch_frames ? batch_frames : CXI_TABLE_BATCH;
+  t->handle = create_group(loc, name);
+  if(t->handle < 0){
+    cxi_close_frame_table(t);
+    return NULL;
+  }
+  hsize_t dims[1] = {0};
+  hsize_t maxdims[1] = {H5S_UNLIMITED};
+  hid_t space = H5Screate_simple(1, dims, maxdims);
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(plist, 1, &t->batch_frames);
+  for(int i = 0;i<count;i++){
+    t->names[i] = cxi_arena_strdup(NULL, columns[i].name);
+    t->types[i] = H5Tcopy(columns[i].type);
+    t->datasets[i] = H5Dcreate(t->handle, columns[i].name, columns[i].type, space,
+			       H5P_DEFAULT, plist, H5P_DEFAULT);
+    t->column_count++;
+    if(!t->names[i] || t->types[i] < 0 || t->datasets[i] < 0){
+      break;
+    }
+  }
+  H5Pclose(plist);
+  H5Sclose(space);
+  if(t->column_count != count || (count && t->datasets[count-1] < 0) || allocate_pending(t)){
+    cxi_close_frame_table(t);
+    return NULL;
+  }
+  return t;
+}
+
+static herr_t count_column(hid_t group, const char * name, const H5L_info_t * info, void * data){
+  (void)info;
+  H5O_info_t object;
+  if(H5Oget_info_by_name(group, name, &object, H5P_DEFAULT) >= 0 && object.type == H5O_TYPE_DATASET){
+    (*(int *)data)++;
+  }
+  return 0;
+}
+
+static herr_t open_column(hid_t group, const char * name, const H5L_info_t * info, void * data){
+  (void)info;
+  CXI_Frame_Table * t = data;
+  H5O_info_t object;
+  if(H5Oget_info_by_name(group, name, &object, H5P_DEFAULT) < 0 || object.type != H5O_TYPE_DATASET){
+    return 0;
+  }
+  int i = t->column_count++;
+  t->names[i] = cxi_arena_strdup(NULL, name);
+  t->datasets[i] = H5Dopen(group, name, H5P_DEFAULT);
+  if(!t->names[i] || t->datasets[i] < 0){
+    return -1;
+  }
+  t->types[i] = H5Dget_type(t->datasets[i]);
+  hid_t space = H5Dget_space(t->datasets[i]);
+  hsize_t n = 0;
+  if(H5Sget_simple_extent_ndims(space) != 1){
+    H5Sclose(space);
+    return -1;
+  }
+  H5Sget_simple_extent_dims(space, &n, NULL);
+  H5Sclose(space);
+  /* A table cut short while being written has as many rows as its shortest column */
+  if(i == 0 || n < t->frame_count){
+    t->frame_count = n;
+  }
+  return 0;
+}
+
+CXI_Frame_Table * cxi_open_frame_table(hid_t loc, const char * name){
+  CXI_TRACE();
+  if(loc < 0 || !name || H5Lexists(loc, name, H5P_DEFAULT) <= 0){
+    return NULL;
+  }
+  hid_t group = H5Gopen(loc, name, H5P_DEFAULT);
+  if(group < 0){
+    return NULL;
+  }
+  hid_t plist = H5Gget_create_plist(group);
+  unsigned order = 0;
+  H5Pget_link_creation_order(plist, &order);
+  H5Pclose(plist);
+  H5_index_t index_type = (order & H5P_CRT_ORDER_INDEXED) ? H5_INDEX_CRT_ORDER : H5_INDEX_NAME;
+  int count = 0;
+  hsize_t index = 0;
+  H5Literate(group, index_type, H5_ITER_INC, &index, count_column, &count);
+  CXI_Frame_Table * t = new_table(count);
+  if(!t){
+    H5Gclose(group);
+    return NULL;
+  }
+  t->handle = group;
+  t->batch_frames = CXI_TABLE_BATCH;
+  index = 0;
+  if(H5Literate(group, index_type, H5_ITER_INC, &index, open_column, t) < 0 ||
+     t->column_count != count || allocate_pending(t)){
+    cxi_close_frame_table(t);
+    return NULL;
+  }
+  t->written = t->frame_count;
+  return t;
+}
+
+int cxi_frame_table_column(CXI_Frame_Table * table, const char * name){
+  if(!table || !name){
+    return -1;
+  }
+  for(int i = 0;i<table->column_count;i++){
+    if(!strcmp(table->names[i], name)){
+      return i;
+    }
+  }
+  return -1;
+}
+
+int cxi_flush_frame_table(CXI_Frame_Table * table){
+  if(!table){
+    return -1;
+  }
+  hsize_t n = table->pending_frames;
+  if(!n){
+    return 0;
+  }
+  hsize_t size[1] = {table->written+n};
+  hsize_t start[1] = {table->written};
+  hsize_t count[1] = {n};
+  hid_t memspace = H5Screate_simple(1, count, NULL);
+  int ret = 0;
+  /* One write per column for the whole batch */
+  for(int i = 0;i<table->column_count;i++){
+    if(H5Dset_extent(table->datasets[i], size) < 0){
+      ret = -1;
+      continue;
+    }
+    hid_t s = H5Dget_space(table->datasets[i]);
+    H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+    if(H5Dwrite(table->datasets[i], table->types[i], memspace, s, H5P_DEFAULT, table->pending[i]) < 0){
+      ret = -1;
+    }
+    H5Sclose(s);
+  }
+  H5Sclose(memspace);
+  table->written += n;
+  table->pending_frames = 0;
+  return ret;
+}
+
+int cxi_frame_table_append(CXI_Frame_Table * t, const void * const * values, hsize_t skip, hsize_t n){
+  while(n){
+    hsize_t k = t->batch_frames-t->pending_frames;
+    k = k < n ? k : n;
+    for(int i = 0;i<t->column_count;i++){
+      size_t size = H5Tget_size(t->types[i]);
+      char * to = (char *)t->pending[i]+t->pending_frames*size;
+      if(values && values[i]){
+	memcpy(to, (const char *)values[i]+skip*size, k*size);
+      }else{
+	memset(to, 0, k*size);
+      }
+    }
+    t->pending_frames += k;
+    t->frame_count += k;
+    skip += k;
+    n -= k;
+    if(t->pending_frames == t->batch_frames && cxi_flush_frame_table(t)){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int cxi_append_frame_values(CXI_Frame_Table * table, hsize_t n, const void * const * values){
+  CXI_TRACE();
+  if(!table || (n && !values)){
+    return -1;
+  }
+  return cxi_frame_table_append(table, values, 0, n);
+}
+
+int cxi_read_frame_column(CXI_Frame_Table * table, int column, void * values, hid_t mem_type){
+  CXI_TRACE();
+  if(!table || column < 0 || column >= table->column_count || !values){
+    return -1;
+  }
+  /* Rows still in memory are read back from the file like the others */
+  if(cxi_flush_frame_table(table)){
+    return -1;
+  }
+  if(table->frame_count == 0){
+    return 0;
+  }
+  hid_t s = H5Dget_space(table->datasets[column]);
+  hsize_t start[1] = {0};
+  hsize_t count[1] = {table->frame_count};
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  hid_t memspace = H5Screate_simple(1, count, NULL);
+  herr_t status = H5Dread(table->datasets[column], mem_type, memspace, s, H5P_DEFAULT, values);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+int cxi_close_frame_table(CXI_Frame_Table * table){
+  if(!table){
+    return -1;
+  }
+  int ret = 0;
+  if(table->handle >= 0){
+    ret = cxi_flush_frame_table(table);
+  }
+  for(int i = 0;i<table->column_count;i++){
+    if(table->datasets[i] >= 0){
+      H5Dclose(table->datasets[i]);
+    }
+    if(table->types[i] >= 0){
+      H5Tclose(table->types[i]);
+    }
+    free(table->names[i]);
+    free(table->pending[i]);
+  }
+  if(table->handle >= 0){
+    H5Gclose(table->handle);
+  }
+  free(table->names);
+  free(table->types);
+  free(table->datasets);
+  free(table->pending);
+  free(table);
+  return ret;
+}
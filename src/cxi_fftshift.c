@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Aim for tiles of at least this many bytes along the contiguous
+   dimensions so that every copy moves whole cache lines. */
+#define CXI_SHIFT_TILE_BYTES 256
+
+typedef struct{
+  char * data;
+  size_t element_size;
+  /* The array seen as [outer][n][inner] around the shifted axis */
+  hsize_t n;
+  hsize_t inner;
+  hsize_t tile;
+  hsize_t tiles_per_pencil;
+  /* Element j is moved to (j+shift)%n */
+  hsize_t shift;
+  /* Set when a thread could not get its scratch buffer */
+  int failed;
+}Shift_Axis;
+
+/* Rotates the pencils [begin,end) along the axis. A pencil is one tile
+ * of the inner dimensions across the whole length of the axis. It is
+ * gathered into a scratch buffer and scattered back rotated, which
+ * works for odd and even lengths alike and never needs more than n*tile
+ * elements of extra memory per thread.
+ */
+static void shift_pencils(hsize_t begin, hsize_t end, void * arg){
+  Shift_Axis * s = arg;
+  size_t es = s->element_size;
+  char * scratch = malloc(s->n*s->tile*es);
+  if(!scratch){
+    cxi_warning("Could not allocate fftshift scratch buffer");
+    __atomic_store_n(&s->failed, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  for(hsize_t p = begin;p<end;p++){
+    hsize_t outer = p/s->tiles_per_pencil;
+    hsize_t t0 = (p%s->tiles_per_pencil)*s->tile;
+    hsize_t width = s->inner-t0 < s->tile ? s->inner-t0 : s->tile;
+    char * base = s->data + (outer*s->n*s->inner + t0)*es;
+    size_t row_bytes = s->inner*es;
+    size_t bytes = width*es;
+    if(s->inner == 1){
+      /* A contiguous row, rotate it with two copies */
+      hsize_t k = s->n-s->shift;
+      memcpy(scratch, base, s->n*es);
+      memcpy(base + s->shift*es, scratch, k*es);
+      memcpy(base, scratch + k*es, s->shift*es);
+      continue;
+    }
+    if(2*s->shift == s->n){
+      /* Even length, swapping the two halves is enough */
+      for(hsize_t j = 0;j<s->shift;j++){
+	char * a = base + j*row_bytes;
+	char * b = base + (j+s->shift)*row_bytes;
+	memcpy(scratch, a, bytes);
+	memcpy(a, b, bytes);
+	memcpy(b, scratch, bytes);
+      }
+      continue;
+    }
+    for(hsize_t j = 0;j<s->n;j++){
+      memcpy(scratch + j*bytes, base + j*row_bytes, bytes);
+    }
+    for(hsize_t j = 0;j<s->n;j++){
+      hsize_t dest = j+s->shift;
+      if(dest >= s->n){
+	dest -= s->n;
+      }
+      memcpy(base + dest*row_bytes, scratch + j*bytes, bytes);
+    }
+  }
+  free(scratch);
+}
+
+static int shift_array(void * data, int ndims, const hsize_t * dims, size_t element_size,
+		       int inverse, int nthreads){
+  if(!data || ndims <= 0 || !dims || element_size == 0){
+    return -1;
+  }
+  for(int axis = 0;axis<ndims;axis++){
+    Shift_Axis s;
+    s.data = data;
+    s.element_size = element_size;
+    s.n = dims[axis];
+    if(s.n < 2){
+      continue;
+    }
+    hsize_t outer = 1;
+    for(int i = 0;i<axis;i++){
+      outer *= dims[i];
+    }
+    s.inner = 1;
+    for(int i = axis+1;i<ndims;i++){
+      s.inner *= dims[i];
+    }
+    s.shift = inverse ? s.n-s.n/2 : s.n/2;
+    s.failed = 0;
+    if(s.inner == 1){
+      s.tile = 1;
+    }else{
+      s.tile = (CXI_SHIFT_TILE_BYTES+element_size-1)/element_size;
+      if(s.tile > s.inner){
+	s.tile = s.inner;
+      }
+    }
+    s.tiles_per_pencil = (s.inner+s.tile-1)/s.tile;
+    cxi_parallel_for(nthreads, outer*s.tiles_per_pencil, shift_pencils, &s);
+    if(s.failed){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int cxi_fftshift(void * data, int ndims, const hsize_t * dims, size_t element_size, int nthreads){
+  return shift_array(data, ndims, dims, element_size, 0, nthreads);
+}
+
+int cxi_ifftshift(void * data, int ndims, const hsize_t * dims, size_t element_size, int nthreads){
+  return shift_array(data, ndims, dims, element_size, 1, nthreads);
+}
+
+int cxi_read_image_data(CXI_Image * image, void * data, hid_t data_type,
+			CXI_FFT_Shift_State state, int nthreads){
+  CXI_TRACE();
+  if(!image || !image->data || !data){
+    return -1;
+  }
+  CXI_Dataset * dataset = image->data->dataset;
+  if(!dataset){
+    dataset = cxi_open_dataset(image->data);
+  }
+  if(!dataset){
+    return -1;
+  }
+  if(cxi_read_dataset(dataset, data, data_type)){
+    return -1;
+  }
+  int stored_shifted = image->is_fft_shifted_valid && image->is_fft_shifted;
+  if(state == CXI_FFT_As_Stored ||
+     (state == CXI_FFT_Shifted && stored_shifted) ||
+     (state == CXI_FFT_Unshifted && !stored_shifted)){
+    return 0;
+  }
+  /* Only the image dimensions are shifted, any slower ones index a stack of images */
+  int ndims = dataset->dimension_count;
+  if(image->dimensionality_valid && image->dimensionality > 0 && image->dimensionality < ndims){
+    ndims = image->dimensionality;
+  }
+  int lead = dataset->dimension_count-ndims;
+  hsize_t images = 1;
+  for(int i = 0;i<lead;i++){
+    images *= dataset->dimensions[i];
+  }
+  size_t element_size = H5Tget_size(data_type);
+  hsize_t image_length = 1;
+  for(int i = lead;i<dataset->dimension_count;i++){
+    image_length *= dataset->dimensions[i];
+  }
+  for(hsize_t i = 0;i<images;i++){
+    char * p = (char *)data + i*image_length*element_size;
+    /* Going from the corner to the center is a forward shift */
+    if(shift_array(p, ndims, dataset->dimensions+lead, element_size, !stored_shifted, nthreads)){
+      return -1;
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,357 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Indices are kept in this group next to the columns they index */
+#define CXI_INDEX_GROUP "frame_index"
+
+/* Batches below this size are looked up by the calling thread alone */
+#define CXI_INDEX_PARALLEL 65536
+
+typedef struct{
+  uint64_t id;
+  uint64_t frame;
+}Index_Entry;
+
+/* The path of the index of column, "a/b" giving "a/frame_index/b" */
+static char * index_path(const char * column){
+  const char * name = strrchr(column, '/');
+  size_t dir = name ? (size_t)(name-column+1) : 0;
+  name = name ? name+1 : column;
+  size_t size = strlen(column)+strlen(CXI_INDEX_GROUP)+2;
+  char * path = malloc(size);
+  if(path){
+    snprintf(path, size, "%.*s" CXI_INDEX_GROUP "/%s", (int)dir, column, name);
+  }
+  return path;
+}
+
+static int writable(hid_t loc){
+  hid_t file = H5Iget_file_id(loc);
+  unsigned intent = 0;
+  H5Fget_intent(file, &intent);
+  H5Fclose(file);
+  return (intent & H5F_ACC_RDWR) != 0;
+}
+
+static hsize_t column_length(hid_t dataset){
+  hid_t space = H5Dget_space(dataset);
+  hsize_t n = (hsize_t)-1;
+  if(H5Sget_simple_extent_ndims(space) == 1){
+    H5Sget_simple_extent_dims(space, &n, NULL);
+  }
+  H5Sclose(space);
+  return n;
+}
+
+static int read_ids(hid_t dataset, hsize_t n, uint64_t * ids){
+  if(n == 0){
+    return 0;
+  }
+  return H5Dread(dataset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, ids) < 0 ? -1 : 0;
+}
+
+static int compare_entries(const void * a, const void * b){
+  const Index_Entry * x = a;
+  const Index_Entry * y = b;
+  if(x->id != y->id){
+    return x->id < y->id ? -1 : 1;
+  }
+  return x->frame < y->frame ? -1 : x->frame > y->frame;
+}
+
+static CXI_Frame_Index * new_index(hsize_t n){
+  CXI_Frame_Index * index = calloc(sizeof(CXI_Frame_Index),1);
+  if(!index){
+    return NULL;
+  }
+  index->frame_count = n;
+  index->ids = malloc(sizeof(uint64_t)*(n ? n : 1));
+  if(!index->ids){
+    free(index);
+    return NULL;
+  }
+  return index;
+}
+
+/* Sorts the IDs of the column, remembering their frames only when out of order */
+static CXI_Frame_Index * build(hid_t column){
+  hsize_t n = column_length(column);
+  if(n == (hsize_t)-1){
+    return NULL;
+  }
+  CXI_Frame_Index * index = new_index(n);
+  if(!index || read_ids(column, n, index->ids)){
+    cxi_close_frame_index(index);
+    return NULL;
+  }
+  hsize_t i = 1;
+  while(i < n && index->ids[i-1] <= index->ids[i]){
+    i++;
+  }
+  if(i >= n){
+    return index;
+  }
+  Index_Entry * entries = malloc(sizeof(Index_Entry)*n);
+  index->frames = malloc(sizeof(uint64_t)*n);
+  if(!entries || !index->frames){
+    free(entries);
+    cxi_close_frame_index(index);
+    return NULL;
+  }
+  for(i = 0;i<n;i++){
+    entries[i].id = index->ids[i];
+    entries[i].frame = i;
+  }
+  qsort(entries, n, sizeof(Index_Entry), compare_entries);
+  for(i = 0;i<n;i++){
+    index->ids[i] = entries[i].id;
+    index->frames[i] = entries[i].frame;
+  }
+  free(entries);
+  return index;
+}
+
+static int write_array(hid_t group, const char * name, const uint64_t * values, hsize_t n){
+  hid_t space = H5Screate_simple(1, &n, NULL);
+  hid_t dataset = H5Dcreate(group, name, H5T_NATIVE_UINT64, space, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  H5Sclose(space);
+  if(dataset < 0){
+    return -1;
+  }
+  herr_t status = n ? H5Dwrite(dataset, H5T_NATIVE_UINT64, H5S_ALL, H5S_ALL, H5P_DEFAULT, values) : 0;
+  H5Dclose(dataset);
+  return status < 0 ? -1 : 0;
+}
+
+/* IDs already in frame order are not stored again, the column is the index */
+static int store(hid_t loc, const char * path, const CXI_Frame_Index * index){
+  htri_t exists = 0;
+  H5E_BEGIN_TRY{
+    exists = H5Lexists(loc, path, H5P_DEFAULT);
+  }H5E_END_TRY;
+  if(exists > 0 && H5Ldelete(loc, path, H5P_DEFAULT) < 0){
+    return -1;
+  }
+  hid_t lcpl = H5Pcreate(H5P_LINK_CREATE);
+  H5Pset_create_intermediate_group(lcpl, 1);
+  hid_t group = H5Gcreate(loc, path, lcpl, H5P_DEFAULT, H5P_DEFAULT);
+  H5Pclose(lcpl);
+  if(group < 0){
+    return -1;
+  }
+  int ret = 0;
+  if(index->frames){
+    ret = write_array(group, "ids", index->ids, index->frame_count) ||
+      write_array(group, "frames", index->frames, index->frame_count) ? -1 : 0;
+  }
+  hid_t space = H5Screate(H5S_SCALAR);
+  hid_t attr = H5Acreate(group, "frame_count", H5T_NATIVE_UINT64, space, H5P_DEFAULT, H5P_DEFAULT);
+  uint64_t n = index->frame_count;
+  if(attr < 0 || H5Awrite(attr, H5T_NATIVE_UINT64, &n) < 0){
+    ret = -1;
+  }
+  if(attr >= 0){
+    H5Aclose(attr);
+  }
+  H5Sclose(space);
+  H5Gclose(group);
+  /* Half an index would be taken for a whole one */
+  if(ret){
+    H5Ldelete(loc, path, H5P_DEFAULT);
+  }
+  return ret;
+}
+
+/* Returns the stored index, or NULL when there is none for all the frames */
+static CXI_Frame_Index * load(hid_t loc, const char * path, hid_t column){
+  hsize_t n = column_length(column);
+  if(n == (hsize_t)-1){
+    return NULL;
+  }
+  hid_t group = -1;
+  H5E_BEGIN_TRY{
+    group = H5Gopen(loc, path, H5P_DEFAULT);
+  }H5E_END_TRY;
+  if(group < 0){
+    return NULL;
+  }
+  uint64_t stored = (uint64_t)-1;
+  if(H5Aexists(group, "frame_count") > 0){
+    hid_t attr = H5Aopen(group, "frame_count", H5P_DEFAULT);
+    H5Aread(attr, H5T_NATIVE_UINT64, &stored);
+    H5Aclose(attr);
+  }
+  CXI_Frame_Index * index = NULL;
+  /* Frames appended since it was built make it stale */
+  if(stored == n){
+    index = new_index(n);
+  }
+  int ret = index ? 0 : -1;
+  if(!ret && H5Lexists(group, "ids", H5P_DEFAULT) > 0){
+    index->frames = malloc(sizeof(uint64_t)*(n ? n : 1));
+    hid_t ids = H5Dopen(group, "ids", H5P_DEFAULT);
+    hid_t frames = H5Dopen(group, "frames", H5P_DEFAULT);
+    ret = !index->frames || ids < 0 || frames < 0 || column_length(ids) != n || column_length(frames) != n ||
+      read_ids(ids, n, index->ids) || read_ids(frames, n, index->frames) ? -1 : 0;
+    if(ids >= 0){
+      H5Dclose(ids);
+    }
+    if(frames >= 0){
+      H5Dclose(frames);
+    }
+  }else if(!ret){
+    ret = read_ids(column, n, index->ids);
+  }
+  H5Gclose(group);
+  if(ret){
+    cxi_close_frame_index(index);
+    return NULL;
+  }
+  return index;
+}
+
+int cxi_build_frame_index(hid_t loc, const char * column){
+  CXI_TRACE();
+  if(loc < 0 || !column){
+    return -1;
+  }
+  hid_t dataset = H5Dopen(loc, column, H5P_DEFAULT);
+  if(dataset < 0){
+    return -1;
+  }
+  char * path = index_path(column);
+  CXI_Frame_Index * index = build(dataset);
+  int ret = path && index ? store(loc, path, index) : -1;
+  cxi_close_frame_index(index);
+  free(path);
+  H5Dclose(dataset);
+  return ret;
+}
+
+CXI_Frame_Index * cxi_open_frame_index(hid_t loc, const char * column){
+  CXI_TRACE();
+  if(loc < 0 || !column){
+    return NULL;
+  }
+  hid_t dataset = H5Dopen(loc, column, H5P_DEFAULT);
+  if(dataset < 0){
+    return NULL;
+  }
+  char * path = index_path(column);
+  CXI_Frame_Index * index = path ? load(loc, path, dataset) : NULL;
+  if(path && !index){
+    index = build(dataset);
+    /* Read only files get an index that lasts as long as it is open */
+    if(index && writable(loc) && store(loc, path, index)){
+      cxi_warning("Cannot store the index of %s", column);
+    }
+  }
+  free(path);
+  H5Dclose(dataset);
+  return index;
+}
+
+void cxi_close_frame_index(CXI_Frame_Index * index){
+  if(!index){
+    return;
+  }
+  free(index->ids);
+  free(index->frames);
+  free(index);
+}
+
+/* The first position of ids[0..n) not below x, ids being sorted */
+static hsize_t lower_bound(const uint64_t * ids, hsize_t n, uint64_t x, int interpolate){
+  if(n == 0 || x <= ids[0]){
+    return 0;
+  }
+  if(x > ids[n-1]){
+    return n;
+  }
+  /* ids[lo] < x <= ids[hi] */
+  hsize_t lo = 0;
+  hsize_t hi = n-1;
+  int bisect = !interpolate;
+  while(hi-lo > 1){
+    hsize_t mid;
+    if(bisect){
+      mid = lo+(hi-lo)/2;
+    }else{
+      double f = (double)(x-ids[lo])/(double)(ids[hi]-ids[lo]);
+      mid = lo+1+(hsize_t)(f*(hi-lo-1));
+      if(mid >= hi){
+	mid = hi-1;
+      }
+    }
+    hsize_t before = hi-lo;
+    if(ids[mid] < x){
+      lo = mid;
+    }else{
+      hi = mid;
+    }
+    /* Unevenly spaced IDs fall back on bisection until a guess pays off again */
+    bisect = !interpolate || 2*(hi-lo) > before;
+  }
+  return hi;
+}
+
+typedef struct{
+  const CXI_Frame_Index * index;
+  const uint64_t * ids;
+  int64_t * frames;
+  int interpolate;
+  int sorted;
+}Lookup_Job;
+
+static void lookup_range(hsize_t begin, hsize_t end, void * arg){
+  Lookup_Job * job = arg;
+  const CXI_Frame_Index * index = job->index;
+  const uint64_t * sorted = index->ids;
+  hsize_t n = index->frame_count;
+  hsize_t pos = 0;
+  for(hsize_t i = begin;i<end;i++){
+    uint64_t x = job->ids[i];
+    hsize_t k;
+    if(job->sorted && i > begin){
+      /* Sorted IDs are found by galloping on from the previous one */
+      hsize_t step = 1;
+      hsize_t hi = pos;
+      while(hi < n && sorted[hi] < x){
+	pos = hi+1;
+	hi += step;
+	step *= 2;
+      }
+      hi = hi < n ? hi : n;
+      k = pos+lower_bound(sorted+pos, hi-pos, x, job->interpolate);
+    }else{
+      k = lower_bound(sorted, n, x, job->interpolate);
+    }
+    pos = k;
+    if(k < n && sorted[k] == x){
+      job->frames[i] = index->frames ? (int64_t)index->frames[k] : (int64_t)k;
+    }else{
+      job->frames[i] = -1;
+    }
+  }
+}
+
+int cxi_lookup_frames(const CXI_Frame_Index * index, const uint64_t * ids, hsize_t n, int64_t * frames,
+		      int interpolate){
+  CXI_TRACE();
+  if(!index || (n && (!ids || !frames))){
+    return -1;
+  }
+  Lookup_Job job = {index, ids, frames, interpolate, 1};
+  for(hsize_t i = 1;i<n && job.sorted;i++){
+    job.sorted = ids[i-1] <= ids[i];
+  }
+  if(n < CXI_INDEX_PARALLEL){
+    lookup_range(0, n, &job);
+  }else{
+    cxi_parallel_for(cxi_default_thread_count(), n, lookup_range, &job);
+  }
+  return 0;
+}
@@ -0,0 +1,374 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi_private.h"
+
+/* Frames move between datasets as whole stored chunks when the source
+ * and destination cut and filter them the same way and a source chunk
+ * lands exactly on a destination chunk. Everything else, the chunks
+ * shared by two sources or by non consecutive frames, goes through
+ * H5Dread()/H5Dwrite() and so is decoded and encoded again.
+ */
+
+#define MERGE_BATCH_BYTES (16*1024*1024)
+
+typedef struct{
+  CXI_Dataset * dataset;
+  /* The frames per chunk, 0 if chunks cannot be copied */
+  hsize_t chunk_slices;
+  hsize_t chunk[H5S_MAX_RANK];
+  void * buffer;
+  size_t buffer_size;
+}Merge;
+
+static int same_pipeline(hid_t a, hid_t b){
+  int n = H5Pget_nfilters(a);
+  if(n < 0 || n != H5Pget_nfilters(b)){
+    return 0;
+  }
+  for(int i = 0;i<n;i++){
+    unsigned flags[2];
+    size_t count[2] = {16, 16};
+    unsigned values[2][16];
+    H5Z_filter_t id[2];
+    id[0] = H5Pget_filter2(a, i, &flags[0], &count[0], values[0], 0, NULL, NULL);
+    id[1] = H5Pget_filter2(b, i, &flags[1], &count[1], values[1], 0, NULL, NULL);
+    if(id[0] < 0 || id[0] != id[1] || flags[0] != flags[1] || count[0] != count[1] ||
+       memcmp(values[0], values[1], sizeof(unsigned)*(count[0] < 16 ? count[0] : 16))){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* Can the chunks of source be stored as they are in the destination? */
+static int chunks_match(const Merge * m, CXI_Dataset * source){
+  if(!m->chunk_slices || H5Tequal(source->data_type, m->dataset->data_type) <= 0){
+    return 0;
+  }
+  hid_t a = H5Dget_create_plist(m->dataset->handle);
+  hid_t b = H5Dget_create_plist(source->handle);
+  hsize_t chunk[H5S_MAX_RANK];
+  int match = a >= 0 && b >= 0 && H5Pget_layout(b) == H5D_CHUNKED &&
+    H5Pget_chunk(b, source->dimension_count, chunk) == source->dimension_count &&
+    !memcmp(chunk, m->chunk, sizeof(hsize_t)*source->dimension_count) && same_pipeline(a, b);
+  if(a >= 0){
+    H5Pclose(a);
+  }
+  if(b >= 0){
+    H5Pclose(b);
+  }
+  return match;
+}
+
+static int write_frames(CXI_Dataset * dataset, hsize_t first, hsize_t n, const void * data){
+  uint64_t begin = cxi_stats_now();
+  hid_t s = H5Dget_space(dataset->handle);
+  if(s < 0){
+    return -1;
+  }
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
+  for(int i = 0;i<dataset->dimension_count;i++){
+    start[i] = 0;
+    count[i] = dataset->dimensions[i];
+  }
+  start[0] = first;
+  count[0] = n;
+  hid_t memspace = H5Screate_simple(dataset->dimension_count, count, NULL);
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  herr_t status = H5Dwrite(dataset->handle, dataset->data_type, memspace, s,
+			   dataset->transfer_plist, data);
+  cxi_stats_io(dataset, 1, dataset->data_type, 0, first, n, begin);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+/* Decodes frames [from,from+n) of source into the destination at to */
+static int transcode(Merge * m, CXI_Dataset * source, hsize_t from, hsize_t to, hsize_t n){
+  size_t element = H5Tget_size(m->dataset->data_type);
+  hsize_t step = cxi_batch_slices(source, element, MERGE_BATCH_BYTES);
+  if(step == 0){
+    return -1;
+  }
+  size_t bytes = step*cxi_dataset_slice_length(source)*element;
+  if(m->buffer_size < bytes){
+    void * p = realloc(m->buffer, bytes);
+    if(!p){
+      return -1;
+    }
+    m->buffer = p;
+    m->buffer_size = bytes;
+  }
+  for(hsize_t done = 0;done<n;done += step){
+    hsize_t k = n-done < step ? n-done : step;
+    if(cxi_read_dataset_slices(source, from+done, k, m->buffer, m->dataset->data_type) ||
+       write_frames(m->dataset, to+done, k, m->buffer)){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/* Copies every chunk holding frames [from,from+chunk_slices) of source
+ * to the chunks of the destination starting at frame to. Returns -1
+ * without writing anything if some of them were never allocated. */
+static int copy_chunk_row(Merge * m, CXI_Dataset * source, hsize_t from, hsize_t to){
+  int rank = source->dimension_count;
+  hsize_t offset[H5S_MAX_RANK];
+  hsize_t target[H5S_MAX_RANK];
+  hsize_t row_chunks = 1;
+  for(int i = 1;i<rank;i++){
+    row_chunks *= (source->dimensions[i]+m->chunk[i]-1)/m->chunk[i];
+  }
+  for(int pass = 0;pass<2;pass++){
+    for(hsize_t c = 0;c<row_chunks;c++){
+      /* The chunk offsets of the row, last dimension fastest */
+      hsize_t rest = c;
+      for(int i = rank-1;i>0;i--){
+	hsize_t along = (source->dimensions[i]+m->chunk[i]-1)/m->chunk[i];
+	offset[i] = target[i] = rest % along*m->chunk[i];
+	rest /= along;
+      }
+      offset[0] = from;
+      target[0] = to;
+      hsize_t size = 0;
+      herr_t status;
+      H5E_BEGIN_TRY{
+	status = H5Dget_chunk_storage_size(source->handle, offset, &size);
+      }H5E_END_TRY;
+      if(status < 0 || size == 0){
+	return -1;
+      }
+      if(pass == 0){
+	continue;
+      }
+      if(m->buffer_size < size){
+	void * p = realloc(m->buffer, size);
+	if(!p){
+	  return -1;
+	}
+	m->buffer = p;
+	m->buffer_size = size;
+      }
+      uint32_t filters = 0;
+      if(H5Dread_chunk(source->handle, H5P_DEFAULT, offset, &filters, m->buffer) < 0 ||
+	 H5Dwrite_chunk(m->dataset->handle, H5P_DEFAULT, filters, target, size, m->buffer) < 0){
+	return -1;
+      }
+    }
+  }
+  cxi_stats_raw_copy(m->dataset, row_chunks);
+  return 0;
+}
+
+/* Copies frames [from,from+n) of source to the destination at to */
+static int copy_frames(Merge * m, CXI_Dataset * source, hsize_t from, hsize_t to, hsize_t n){
+  hsize_t cs = m->chunk_slices;
+  if(!n){
+    return 0;
+  }
+  if(!chunks_match(m, source) || from % cs != to % cs){
+    return transcode(m, source, from, to, n);
+  }
+  hsize_t end = from+n;
+  hsize_t f = from;
+  /* Up to the first chunk boundary */
+  hsize_t head = (cs-from % cs) % cs;
+  if(head > n){
+    head = n;
+  }
+  if(head && transcode(m, source, f, to, head)){
+    return -1;
+  }
+  f += head;
+  while(f < end){
+    hsize_t k = end-f < cs ? end-f : cs;
+    /* A short last chunk is only whole if it ends both datasets */
+    int whole = k == cs || (f+k == source->dimensions[0] && to+(f-from)+k == m->dataset->dimensions[0]);
+    if(!whole || copy_chunk_row(m, source, f, to+(f-from))){
+      if(transcode(m, source, f, to+(f-from), k)){
+	return -1;
+      }
+    }
+    f += k;
+  }
+  return 0;
+}
+
+static herr_t copy_attribute(hid_t src, const char * name, const H5A_info_t * info, void * data){
+  (void)info;
+  hid_t dst = *(hid_t *)data;
+  hid_t attr = H5Aopen(src, name, H5P_DEFAULT);
+  if(attr < 0){
+    return -1;
+  }
+  hid_t type = H5Aget_type(attr);
+  hid_t space = H5Aget_space(attr);
+  hssize_t n = H5Sget_simple_extent_npoints(space);
+  void * buffer = calloc(H5Tget_size(type), n > 0 ? n : 1);
+  herr_t err = -1;
+  if(buffer && H5Aread(attr, type, buffer) >= 0){
+    hid_t copy = H5Acreate(dst, name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+    if(copy >= 0){
+      err = H5Awrite(copy, type, buffer);
+      H5Aclose(copy);
+    }
+    if(H5Tdetect_class(type, H5T_VLEN) > 0 || H5Tis_variable_str(type) > 0){
+      H5Dvlen_reclaim(type, space, H5P_DEFAULT, buffer);
+    }
+  }
+  free(buffer);
+  H5Sclose(space);
+  H5Tclose(type);
+  H5Aclose(attr);
+  return err < 0 ? -1 : 0;
+}
+
+int cxi_copy_attributes(hid_t src, hid_t dst){
+  hsize_t index = 0;
+  return H5Aiterate(src, H5_INDEX_NAME, H5_ITER_NATIVE, &index, copy_attribute, &dst) < 0 ? -1 : 0;
+}
+
+/* A dataset of frames laid out like model, holding total frames */
+static CXI_Dataset_Reference * create_like(hid_t loc, const char * name, CXI_Dataset * model,
+					   hsize_t total, CXI_Dataset * dataset, Merge * m){
+  memset(m, 0, sizeof(Merge));
+  if(model->dimension_count <= 0 || model->dimension_count > H5S_MAX_RANK){
+    return NULL;
+  }
+  hid_t plist = H5Dget_create_plist(model->handle);
+  if(plist < 0){
+    return NULL;
+  }
+  hsize_t maxdims[H5S_MAX_RANK];
+  dataset->dimension_count = model->dimension_count;
+  dataset->dimensions = malloc(sizeof(hsize_t)*dataset->dimension_count);
+  memcpy(dataset->dimensions, model->dimensions, sizeof(hsize_t)*dataset->dimension_count);
+  memcpy(maxdims, model->dimensions, sizeof(hsize_t)*dataset->dimension_count);
+  dataset->dimensions[0] = maxdims[0] = total;
+  if(H5Pget_layout(plist) == H5D_CHUNKED){
+    /* Chunks taller than the merged stack are allowed if it can grow */
+    maxdims[0] = H5S_UNLIMITED;
+    H5Pget_chunk(plist, dataset->dimension_count, m->chunk);
+    m->chunk_slices = m->chunk[0];
+  }else{
+    /* Whatever else the model does, such as external storage, stays with it */
+    H5Pclose(plist);
+    plist = H5Pcreate(H5P_DATASET_CREATE);
+  }
+  hid_t space = H5Screate_simple(dataset->dimension_count, dataset->dimensions, maxdims);
+  hid_t type = H5Dget_type(model->handle);
+  dataset->handle = H5Dcreate(loc, name, type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Sclose(space);
+  H5Pclose(plist);
+  if(dataset->handle < 0){
+    H5Tclose(type);
+    free(dataset->dimensions);
+    dataset->dimensions = NULL;
+    return NULL;
+  }
+  dataset->data_type = type;
+  dataset->transfer_plist = H5P_DEFAULT;
+  cxi_dataset_init_io(dataset, NULL);
+  cxi_copy_attributes(model->handle, dataset->handle);
+  m->dataset = dataset;
+  CXI_Dataset_Reference * ref = calloc(sizeof(CXI_Dataset_Reference),1);
+  ref->parent_handle = loc;
+  ref->group_name = malloc(sizeof(char)*(strlen(name)+1));
+  strcpy(ref->group_name, name);
+  ref->dataset = dataset;
+  return ref;
+}
+
+/* Removes a dataset that could not be filled */
+static CXI_Dataset_Reference * discard(CXI_Dataset_Reference * ref){
+  CXI_Dataset * dataset = ref->dataset;
+  H5Dclose(dataset->handle);
+  H5Tclose(dataset->data_type);
+  H5Ldelete(ref->parent_handle, ref->group_name, H5P_DEFAULT);
+  free(dataset->dimensions);
+  dataset->dimensions = NULL;
+  dataset->handle = -1;
+  free(ref->group_name);
+  free(ref);
+  return NULL;
+}
+
+static int same_frames(CXI_Dataset * a, CXI_Dataset * b){
+  if(!a || !b || a->dimension_count != b->dimension_count || a->dimension_count <= 0){
+    return 0;
+  }
+  for(int i = 1;i<a->dimension_count;i++){
+    if(a->dimensions[i] != b->dimensions[i]){
+      return 0;
+    }
+  }
+  return 1;
+}
+
+CXI_Dataset_Reference * cxi_merge_datasets(hid_t loc, const char * name, CXI_Dataset ** sources,
+					   int count, CXI_Dataset * merged){
+  CXI_TRACE();
+  if(loc < 0 || !name || !sources || count < 1 || !merged){
+    return NULL;
+  }
+  hsize_t total = 0;
+  for(int i = 0;i<count;i++){
+    if(!same_frames(sources[0], sources[i])){
+      return NULL;
+    }
+    total += sources[i]->dimensions[0];
+  }
+  Merge m;
+  CXI_Dataset_Reference * ref = create_like(loc, name, sources[0], total, merged, &m);
+  if(!ref){
+    return NULL;
+  }
+  hsize_t to = 0;
+  int err = 0;
+  for(int i = 0;!err && i<count;i++){
+    err = copy_frames(&m, sources[i], 0, to, sources[i]->dimensions[0]);
+    to += sources[i]->dimensions[0];
+  }
+  free(m.buffer);
+  if(err){
+    cxi_warning("Could not merge the frames into %s", name);
+    return discard(ref);
+  }
+  return ref;
+}
+
+CXI_Dataset_Reference * cxi_subset_dataset(hid_t loc, const char * name, CXI_Dataset * source,
+					   const hsize_t * frames, hsize_t n, CXI_Dataset * subset){
+  CXI_TRACE();
+  if(loc < 0 || !name || !source || source->dimension_count <= 0 || (n && !frames) || !subset){
+    return NULL;
+  }
+  for(hsize_t i = 0;i<n;i++){
+    if(frames[i] >= source->dimensions[0]){
+      return NULL;
+    }
+  }
+  Merge m;
+  CXI_Dataset_Reference * ref = create_like(loc, name, source, n, subset, &m);
+  if(!ref){
+    return NULL;
+  }
+  int err = 0;
+  /* Runs of consecutive frames are copied together */
+  for(hsize_t i = 0;!err && i<n;){
+    hsize_t j = i+1;
+    while(j < n && frames[j] == frames[j-1]+1){
+      j++;
+    }
+    err = copy_frames(&m, source, frames[i], i, j-i);
+    i = j;
+  }
+  free(m.buffer);
+  if(err){
+    cxi_warning("Could not copy the frames into %s", name);
+    return discard(ref);
+  }
+  return ref;
+}
@@ -0,0 +1,209 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+double cxi_adu_per_photon(CXI_Detector * detector, CXI_Source * source){
+  if(!detector || !source || !detector->counts_per_joule_valid || !source->energy_valid){
+    return 0;
+  }
+  return detector->counts_per_joule*source->energy;
+}
+
+/* Counts beyond 32 bits saturate, before rounding so that the casts are
+   always defined, and NaN counts no photons */
+static int32_t quantize(float adu, double inv_scale, const CXI_Photon_Options * opt){
+  double photons = adu*inv_scale;
+  if(isnan(photons) || photons < opt->threshold){
+    return 0;
+  }
+  if(photons >= INT32_MAX){
+    return INT32_MAX;
+  }
+  if(photons <= INT32_MIN){
+    return INT32_MIN;
+  }
+  switch(opt->rounding){
+  case CXI_Round_Floor:
+    return (int32_t)floor(photons);
+  case CXI_Round_Ceil:
+    return (int32_t)ceil(photons);
+  default:
+    return (int32_t)floor(photons+0.5);
+  }
+}
+
+hid_t cxi_photon_count_type(int64_t min, int64_t max){
+  if(min >= 0){
+    if(max <= UINT8_MAX) return H5T_NATIVE_UINT8;
+    if(max <= UINT16_MAX) return H5T_NATIVE_UINT16;
+    return H5T_NATIVE_UINT32;
+  }
+  if(min >= INT8_MIN && max <= INT8_MAX) return H5T_NATIVE_INT8;
+  if(min >= INT16_MIN && max <= INT16_MAX) return H5T_NATIVE_INT16;
+  return H5T_NATIVE_INT32;
+}
+
+int cxi_quantize_photons(const float * adu, hsize_t n, const CXI_Photon_Options * opt,
+			 int32_t * counts, int64_t * min, int64_t * max){
+  if(!adu || !opt || !counts || opt->adu_per_photon <= 0){
+    return -1;
+  }
+  double inv_scale = 1.0/opt->adu_per_photon;
+  int64_t lo = INT64_MAX;
+  int64_t hi = INT64_MIN;
+  for(hsize_t i = 0;i<n;i++){
+    int32_t c = quantize(adu[i], inv_scale, opt);
+    counts[i] = c;
+    lo = c < lo ? c : lo;
+    hi = c > hi ? c : hi;
+  }
+  if(min){
+    *min = n ? lo : 0;
+  }
+  if(max){
+    *max = n ? hi : 0;
+  }
+  return 0;
+}
+
+static int write_double_attribute(hid_t loc, const char * name, double value){
+  hid_t space = H5Screate(H5S_SCALAR);
+  hid_t attr = H5Acreate(loc, name, H5T_NATIVE_DOUBLE, space, H5P_DEFAULT, H5P_DEFAULT);
+  H5Sclose(space);
+  if(attr < 0){
+    return -1;
+  }
+  herr_t status = H5Awrite(attr, H5T_NATIVE_DOUBLE, &value);
+  H5Aclose(attr);
+  return status < 0 ? -1 : 0;
+}
+
+double cxi_dataset_scale(CXI_Dataset * dataset){
+  if(!dataset || !H5Aexists(dataset->handle, "adu_per_photon")){
+    return 1;
+  }
+  double scale = 1;
+  hid_t attr = H5Aopen(dataset->handle, "adu_per_photon", H5P_DEFAULT);
+  if(attr >= 0){
+    H5Aread(attr, H5T_NATIVE_DOUBLE, &scale);
+    H5Aclose(attr);
+  }
+  return scale;
+}
+
+CXI_Dataset_Reference * cxi_create_photon_dataset(hid_t loc, CXI_Dataset * dataset,
+						  CXI_Dataset_Type type, const float * adu,
+						  const CXI_Photon_Options * opt){
+  CXI_TRACE();
+  if(loc < 0 || !dataset || !opt || opt->adu_per_photon <= 0 || dataset->dimension_count <= 0){
+    return NULL;
+  }
+  hsize_t n = 1;
+  for(int i = 0;i<dataset->dimension_count;i++){
+    n *= dataset->dimensions[i];
+  }
+  int32_t * counts = NULL;
+  hid_t file_type = opt->data_type;
+  if(adu){
+    counts = malloc(sizeof(int32_t)*(n ? n : 1));
+    int64_t min, max;
+    if(!counts || cxi_quantize_photons(adu, n, opt, counts, &min, &max)){
+      free(counts);
+      return NULL;
+    }
+    if(!file_type){
+      file_type = cxi_photon_count_type(min, max);
+    }
+  }
+  if(!file_type){
+    /* Without data there is nothing to size the type on */
+    return NULL;
+  }
+  dataset->data_type = file_type;
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  if(opt->deflate_level > 0){
+    /* One chunk per frame, narrow integers compress well with shuffle */
+    hsize_t * chunk = malloc(sizeof(hsize_t)*dataset->dimension_count);
+    for(int i = 0;i<dataset->dimension_count;i++){
+      chunk[i] = dataset->dimension_count > 2 && i < dataset->dimension_count-2 ? 1 : dataset->dimensions[i];
+      chunk[i] = chunk[i] ? chunk[i] : 1;
+    }
+    H5Pset_chunk(plist, dataset->dimension_count, chunk);
+    H5Pset_shuffle(plist);
+    H5Pset_deflate(plist, opt->deflate_level);
+    free(chunk);
+  }
+  CXI_Dataset_Reference * ref = cxi_create_named_dataset(loc, cxi_dataset_type_name(type),
+							 dataset, plist);
+  H5Pclose(plist);
+  if(!ref ||
+     write_double_attribute(dataset->handle, "adu_per_photon", opt->adu_per_photon) ||
+     write_double_attribute(dataset->handle, "photon_threshold", opt->threshold) ||
+     (counts && cxi_write_dataset(dataset, counts, H5T_NATIVE_INT32))){
+    free(counts);
+    return NULL;
+  }
+  free(counts);
+  return ref;
+}
+
+int cxi_write_photon_slices(CXI_Dataset * dataset, hsize_t first, hsize_t n,
+			    const float * adu, const CXI_Photon_Options * opt){
+  CXI_TRACE();
+  if(!dataset || !adu || !opt || dataset->dimension_count < 2){
+    return -1;
+  }
+  hsize_t frame = 1;
+  for(int i = 1;i<dataset->dimension_count;i++){
+    frame *= dataset->dimensions[i];
+  }
+  hsize_t total = n*frame;
+  int32_t * counts = malloc(sizeof(int32_t)*(total ? total : 1));
+  if(!counts || cxi_quantize_photons(adu, total, opt, counts, NULL, NULL)){
+    free(counts);
+    return -1;
+  }
+  /* Values that do not fit in the file type are clipped by the conversion */
+  hid_t s = H5Dget_space(dataset->handle);
+  hsize_t * start = calloc(sizeof(hsize_t),dataset->dimension_count);
+  hsize_t * count = malloc(sizeof(hsize_t)*dataset->dimension_count);
+  memcpy(count, dataset->dimensions, sizeof(hsize_t)*dataset->dimension_count);
+  start[0] = first;
+  count[0] = n;
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  hid_t memspace = H5Screate_simple(dataset->dimension_count, count, NULL);
+  uint64_t begin = cxi_stats_now();
+  int converts = cxi_dataset_converts(dataset, H5T_NATIVE_INT32);
+  herr_t status = H5Dwrite(dataset->handle, H5T_NATIVE_INT32, memspace, s, dataset->transfer_plist, counts);
+  cxi_stats_io(dataset, 1, H5T_NATIVE_INT32, converts, first, n, begin);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  free(start);
+  free(count);
+  free(counts);
+  return status < 0 ? -1 : 0;
+}
+
+int cxi_read_scaled_dataset(CXI_Dataset * dataset, float * data){
+  CXI_TRACE();
+  if(!dataset || !data){
+    return -1;
+  }
+  if(cxi_read_dataset(dataset, data, H5T_NATIVE_FLOAT)){
+    return -1;
+  }
+  double scale = cxi_dataset_scale(dataset);
+  if(scale != 1){
+    hsize_t n = 1;
+    for(int i = 0;i<dataset->dimension_count;i++){
+      n *= dataset->dimensions[i];
+    }
+    float s = scale;
+    for(hsize_t i = 0;i<n;i++){
+      data[i] *= s;
+    }
+  }
+  return 0;
+}
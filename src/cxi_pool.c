@@ -0,0 +1,161 @@
+/* MADV_HUGEPAGE is not part of POSIX */
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* The free list is a stack of slot numbers. Its head packs the top slot
+ * in the low 32 bits with a counter bumped on every change in the high
+ * ones, so that a pop racing with a pop and push of the same slot fails
+ * its compare and swap instead of linking in a stale next slot.
+ *
+ * Each buffer carries its slot right after the frames, one cache line
+ * past the end of the data, so giving it back needs no lookup.
+ */
+
+#define POOL_CACHE_LINE 64
+#define POOL_HUGE_PAGE (2*1024*1024)
+#define POOL_EMPTY 0xFFFFFFFFu
+
+struct CXI_Frame_Pool{
+  size_t buffer_size;
+  /* Offset of the slot number from the start of a buffer */
+  size_t trailer;
+  size_t alignment;
+  size_t allocation;
+  int flags;
+  uint32_t capacity;
+  /* Slots handed out so far, may exceed capacity */
+  uint32_t created;
+  uint64_t head;
+  uint32_t * next;
+  void ** buffers;
+};
+
+static size_t round_up(size_t n, size_t to){
+  return (n+to-1)/to*to;
+}
+
+CXI_Frame_Pool * cxi_create_frame_pool(CXI_Dataset * dataset, hid_t mem_type, hsize_t frames,
+				       int max_buffers, int flags){
+  CXI_TRACE();
+  if(!dataset || frames == 0 || max_buffers < 0){
+    return NULL;
+  }
+  size_t element = H5Tget_size(mem_type);
+  if(element == 0){
+    return NULL;
+  }
+  CXI_Frame_Pool * pool = calloc(sizeof(CXI_Frame_Pool),1);
+  if(!pool){
+    return NULL;
+  }
+  pool->buffer_size = element*cxi_dataset_slice_length(dataset)*frames;
+  pool->alignment = POOL_CACHE_LINE;
+  if(flags & CXI_Pool_Page_Aligned){
+    long page = sysconf(_SC_PAGESIZE);
+    pool->alignment = page > POOL_CACHE_LINE ? (size_t)page : POOL_CACHE_LINE;
+  }
+  if(flags & CXI_Pool_Huge_Pages){
+    pool->alignment = POOL_HUGE_PAGE;
+  }
+  pool->trailer = round_up(pool->buffer_size, POOL_CACHE_LINE);
+  pool->allocation = round_up(pool->trailer+sizeof(uint32_t), pool->alignment);
+  pool->flags = flags;
+  pool->capacity = max_buffers;
+  pool->head = POOL_EMPTY;
+  pool->next = calloc(sizeof(uint32_t), pool->capacity+1);
+  pool->buffers = calloc(sizeof(void *), pool->capacity+1);
+  if(!pool->next || !pool->buffers){
+    cxi_free_frame_pool(pool);
+    return NULL;
+  }
+  return pool;
+}
+
+size_t cxi_frame_pool_buffer_size(CXI_Frame_Pool * pool){
+  CXI_TRACE();
+  return pool ? pool->buffer_size : 0;
+}
+
+static void * allocate(CXI_Frame_Pool * pool, uint32_t slot){
+  void * p = NULL;
+  if(posix_memalign(&p, pool->alignment, pool->allocation)){
+    return NULL;
+  }
+#ifdef MADV_HUGEPAGE
+  if(pool->flags & CXI_Pool_Huge_Pages){
+    /* Only a hint, the buffer works without it */
+    madvise(p, pool->allocation, MADV_HUGEPAGE);
+  }
+#endif
+  memcpy((char *)p+pool->trailer, &slot, sizeof(slot));
+  return p;
+}
+
+void * cxi_frame_pool_get(CXI_Frame_Pool * pool){
+  CXI_TRACE();
+  if(!pool){
+    return NULL;
+  }
+  uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_ACQUIRE);
+  while((uint32_t)head != POOL_EMPTY){
+    uint32_t slot = (uint32_t)head;
+    uint64_t next = __atomic_load_n(&pool->next[slot], __ATOMIC_RELAXED);
+    uint64_t top = ((head >> 32)+1) << 32 | next;
+    if(__atomic_compare_exchange_n(&pool->head, &head, top, 1, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)){
+      return pool->buffers[slot];
+    }
+  }
+  /* Nothing to reuse, the pool grows until it holds capacity buffers */
+  uint32_t slot = __atomic_fetch_add(&pool->created, 1, __ATOMIC_RELAXED);
+  if(slot >= pool->capacity){
+    __atomic_fetch_sub(&pool->created, 1, __ATOMIC_RELAXED);
+    return allocate(pool, POOL_EMPTY);
+  }
+  void * p = allocate(pool, slot);
+  if(!p){
+    /* The slot stays unused, the next buffers are simply not pooled */
+    return NULL;
+  }
+  pool->buffers[slot] = p;
+  return p;
+}
+
+void cxi_frame_pool_put(CXI_Frame_Pool * pool, void * buffer){
+  CXI_TRACE();
+  if(!pool || !buffer){
+    return;
+  }
+  uint32_t slot;
+  memcpy(&slot, (char *)buffer+pool->trailer, sizeof(slot));
+  if(slot == POOL_EMPTY){
+    free(buffer);
+    return;
+  }
+  uint64_t head = __atomic_load_n(&pool->head, __ATOMIC_RELAXED);
+  uint64_t top;
+  do{
+    __atomic_store_n(&pool->next[slot], (uint32_t)head, __ATOMIC_RELAXED);
+    top = ((head >> 32)+1) << 32 | slot;
+  }while(!__atomic_compare_exchange_n(&pool->head, &head, top, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+void cxi_free_frame_pool(CXI_Frame_Pool * pool){
+  CXI_TRACE();
+  if(!pool){
+    return;
+  }
+  if(pool->buffers){
+    for(uint32_t i = 0;i<pool->capacity;i++){
+      free(pool->buffers[i]);
+    }
+  }
+  free(pool->buffers);
+  free(pool->next);
+  free(pool);
+}
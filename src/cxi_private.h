@@ -0,0 +1,137 @@
+#pragma once
+
+/* Internal helpers shared by the libcxi translation units.
+ * Nothing in here is part of the public API.
+ */
+
+#include "cxi.h"
+
+#if defined CXI_DEBUG
+#define  cxi_debug(...) _cxi_debug(__FILE__,__LINE__,__VA_ARGS__)
+#else
+#define  cxi_debug(...)
+#endif
+
+#define  cxi_warning(...) _cxi_warning(__FILE__,__LINE__,__VA_ARGS__)
+
+void _cxi_debug(char * file, int line, char *format, ...);
+void _cxi_warning(char * file, int line, char *format, ...);
+
+/* Number of threads to use when the caller passes nthreads <= 0 */
+int cxi_default_thread_count(void);
+
+/* Is 1 if HDF5 may be called from several threads at once. Otherwise
+ * every HDF5 call must come from one thread at a time.
+ */
+int cxi_hdf5_threadsafe(void);
+
+/* Splits [0,n) in at most nthreads contiguous ranges and calls
+ * fn(begin, end, arg) for each of them in its own thread.
+ * The calling thread processes the first range.
+ */
+void cxi_parallel_for(int nthreads, hsize_t n,
+		      void (*fn)(hsize_t begin, hsize_t end, void * arg), void * arg);
+
+/* Returns the number of slices along the slowest dimension stored in
+ * each chunk of the dataset, or 0 if the dataset is not chunked.
+ */
+hsize_t cxi_dataset_chunk_slices(CXI_Dataset * dataset);
+
+/* Picks how many slices to process at a time so that a batch of
+ * elements of elem_size bytes stays below max_bytes, rounded down to whole
+ * chunks, or to an even part of a chunk when a single chunk is larger than
+ * max_bytes, unless it covers the whole dataset. Never returns less than one
+ * slice, and returns its own result given that many slices' worth of bytes.
+ */
+hsize_t cxi_batch_slices(CXI_Dataset * dataset, size_t elem_size, size_t max_bytes);
+
+/* Building blocks of cxi_reduce_dataset() for passes that need to
+ * accumulate the same statistics alongside their own.
+ * cxi_reduction_accumulate() merges nframes frames of batch, restricted
+ * to the pixels [begin,end), into r without touching r->frame_count.
+ */
+CXI_Reduction * cxi_reduction_new(CXI_Dataset * dataset);
+void cxi_reduction_accumulate(CXI_Reduction * r, const double * batch, hsize_t nframes,
+			      hsize_t begin, hsize_t end);
+void cxi_reduction_finish(CXI_Reduction * r);
+
+/* cxi_create_dataset() with an arbitrary name and creation property
+ * list, for the auxiliary datasets libcxi keeps next to the standard
+ * ones and for chunked or compressed ones.
+ */
+CXI_Dataset_Reference * cxi_create_named_dataset(hid_t loc, const char * name, CXI_Dataset * dataset,
+						 hid_t create_plist);
+
+/* The name of the dataset of the given type, e.g. "data" */
+char * cxi_dataset_type_name(CXI_Dataset_Type type);
+
+/* Bump allocator owning everything opened from a CXI_File, so that
+ * cxi_close_file() releases the whole tree at once instead of walking it.
+ * All functions accept a NULL arena, in which case they fall back to the
+ * heap and the caller stays responsible for freeing. Handles passed to
+ * cxi_arena_track() belong to the arena and are closed by cxi_arena_free(),
+ * newest first. Use cxi_arena_close() to close one of them earlier.
+ */
+CXI_Arena * cxi_arena_new(void);
+void * cxi_arena_calloc(CXI_Arena * arena, size_t size, size_t n);
+char * cxi_arena_strdup(CXI_Arena * arena, const char * s);
+/* Frees p if it came from the heap, arena memory lives until the arena is freed */
+void cxi_arena_release(CXI_Arena * arena, void * p);
+hid_t cxi_arena_track(CXI_Arena * arena, hid_t id);
+/* Stops tracking id, if it was, and closes it */
+int cxi_arena_close(CXI_Arena * arena, hid_t id);
+void cxi_arena_free(CXI_Arena * arena);
+/* The statistics of the file owning the arena, or NULL */
+CXI_Stats * cxi_arena_stats(CXI_Arena * arena);
+void cxi_arena_set_stats(CXI_Arena * arena, CXI_Stats * stats);
+
+/* I/O statistics. Functions take the cxi_stats_now() timestamp taken
+ * when the operation started and account for the time since then.
+ * cxi_stats_io() records a read or write of n slices starting at first,
+ * in memory type mem_type, converted as told by cxi_dataset_converts().
+ */
+uint64_t cxi_stats_now(void);
+void cxi_stats_call(CXI_Stats * file_stats);
+void cxi_stats_open(CXI_Arena * arena, uint64_t begin);
+void cxi_stats_io(CXI_Dataset * dataset, int write, hid_t mem_type, int converted,
+		  hsize_t first, hsize_t n, uint64_t begin);
+/* Records chunks written to dataset straight from another dataset */
+void cxi_stats_raw_copy(CXI_Dataset * dataset, uint64_t chunks);
+/* Fills in the statistics and layout fields of a freshly opened or created dataset */
+void cxi_dataset_init_io(CXI_Dataset * dataset, CXI_Stats * file_stats);
+
+/* Returns 1 if transfers in mem_type need a conversion, warning about it
+ * if asked to by cxi_set_conversion_warnings().
+ */
+int cxi_dataset_converts(CXI_Dataset * dataset, hid_t mem_type);
+/* Copy the n slices starting at first as raw chunks, which is only possible
+ * for datasets with raw_chunks set, in the file type and for ranges of whole
+ * chunks. Return -1 without side effects when that is not the case, so
+ * that the caller can fall back to H5Dread()/H5Dwrite().
+ */
+int cxi_read_raw_chunks(CXI_Dataset * dataset, hsize_t first, hsize_t n, void * data);
+int cxi_write_raw_chunks(CXI_Dataset * dataset, hsize_t first, hsize_t n, const void * data);
+
+/* cxi_append_frame_values() starting at row skip of each array of values,
+ * which may be NULL to store zeros.
+ */
+int cxi_frame_table_append(CXI_Frame_Table * t, const void * const * values, hsize_t skip, hsize_t n);
+
+/* Copies every attribute of the object src to the object dst, which must
+ * not have any of the same name.
+ */
+int cxi_copy_attributes(hid_t src, hid_t dst);
+
+/* Tracing of public calls, see cxi_start_trace(). CXI_TRACE() at the top
+ * of a function records a begin event and, when the function returns, the
+ * matching end event. Costs a relaxed load and a branch when tracing is off.
+ */
+typedef struct{
+  const char * name;
+}CXI_Trace_Scope;
+
+CXI_Trace_Scope cxi_trace_begin(const char * name);
+void cxi_trace_end(CXI_Trace_Scope * scope);
+
+#define CXI_TRACE() CXI_Trace_Scope cxi_trace_scope __attribute__((cleanup(cxi_trace_end))) = \
+    cxi_trace_begin(__func__)
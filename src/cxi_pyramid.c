@@ -0,0 +1,296 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "cxi.h"
+#include "cxi_private.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define CXI_PYRAMID_BATCH_BYTES (64*1024*1024)
+
+/* Name of the dataset holding the given binning of a dataset */
+static void level_name(char * buffer, const char * name, int binning){
+  sprintf(buffer,"%s_bin%d",name,binning);
+}
+
+/* Averages one output row from two input rows. Odd widths and heights
+ * average only the pixels that exist, r1 is NULL on the last row of an
+ * odd height.
+ */
+static void bin_row(const float * restrict r0, const float * restrict r1,
+		    float * restrict out, hsize_t in_cols){
+  hsize_t pairs = in_cols/2;
+  hsize_t x = 0;
+  if(r1){
+#if defined(__SSE2__)
+    const __m128 quarter = _mm_set1_ps(0.25f);
+    for(;x+4<=pairs;x+=4){
+      __m128 a0 = _mm_loadu_ps(r0+2*x);
+      __m128 a1 = _mm_loadu_ps(r0+2*x+4);
+      __m128 b0 = _mm_loadu_ps(r1+2*x);
+      __m128 b1 = _mm_loadu_ps(r1+2*x+4);
+      __m128 a = _mm_add_ps(a0,b0);
+      __m128 b = _mm_add_ps(a1,b1);
+      /* Add the even and the odd columns together */
+      __m128 even = _mm_shuffle_ps(a,b,_MM_SHUFFLE(2,0,2,0));
+      __m128 odd = _mm_shuffle_ps(a,b,_MM_SHUFFLE(3,1,3,1));
+      _mm_storeu_ps(out+x,_mm_mul_ps(_mm_add_ps(even,odd),quarter));
+    }
+#endif
+    for(;x<pairs;x++){
+      out[x] = 0.25f*(r0[2*x]+r0[2*x+1]+r1[2*x]+r1[2*x+1]);
+    }
+    if(in_cols%2){
+      out[pairs] = 0.5f*(r0[in_cols-1]+r1[in_cols-1]);
+    }
+  }else{
+    for(;x<pairs;x++){
+      out[x] = 0.5f*(r0[2*x]+r0[2*x+1]);
+    }
+    if(in_cols%2){
+      out[pairs] = r0[in_cols-1];
+    }
+  }
+}
+
+typedef struct{
+  const float * in;
+  float * out;
+  hsize_t in_rows;
+  hsize_t in_cols;
+  hsize_t out_rows;
+  hsize_t out_cols;
+}Bin_Job;
+
+static void bin_rows(hsize_t begin, hsize_t end, void * arg){
+  Bin_Job * job = arg;
+  for(hsize_t i = begin;i<end;i++){
+    hsize_t frame = i/job->out_rows;
+    hsize_t y = i%job->out_rows;
+    const float * in = job->in + frame*job->in_rows*job->in_cols;
+    const float * r0 = in + 2*y*job->in_cols;
+    const float * r1 = 2*y+1 < job->in_rows ? r0 + job->in_cols : NULL;
+    bin_row(r0, r1, job->out + frame*job->out_rows*job->out_cols + y*job->out_cols,
+	    job->in_cols);
+  }
+}
+
+CXI_Pyramid * cxi_create_pyramid(CXI_Dataset_Reference * data, int levels){
+  CXI_TRACE();
+  if(!data || !data->dataset || levels <= 0 || levels > CXI_PYRAMID_MAX_LEVELS){
+    return NULL;
+  }
+  CXI_Dataset * dataset = data->dataset;
+  if(dataset->dimension_count != 2 && dataset->dimension_count != 3){
+    cxi_warning("Pyramids need 2D images or 3D stacks of images");
+    return NULL;
+  }
+  CXI_Pyramid * p = calloc(sizeof(CXI_Pyramid),1);
+  if(!p){
+    return NULL;
+  }
+  p->stacked = dataset->dimension_count == 3;
+  p->rows = dataset->dimensions[dataset->dimension_count-2];
+  p->cols = dataset->dimensions[dataset->dimension_count-1];
+  char buffer[1024];
+  hsize_t rows = p->rows;
+  hsize_t cols = p->cols;
+  for(int l = 0;l<levels;l++){
+    rows = (rows+1)/2;
+    cols = (cols+1)/2;
+    CXI_Dataset * level = calloc(sizeof(CXI_Dataset),1);
+    if(!level){
+      cxi_close_pyramid(p);
+      return NULL;
+    }
+    p->levels[l] = level;
+    p->level_count = l+1;
+    level->dimension_count = dataset->dimension_count;
+    level->dimensions = malloc(sizeof(hsize_t)*level->dimension_count);
+    if(p->stacked){
+      level->dimensions[0] = dataset->dimensions[0];
+    }
+    level->dimensions[level->dimension_count-2] = rows;
+    level->dimensions[level->dimension_count-1] = cols;
+    level->data_type = H5T_NATIVE_FLOAT;
+    level_name(buffer, data->group_name, 2<<l);
+    p->references[l] = cxi_create_named_dataset(data->parent_handle, buffer, level, H5P_DEFAULT);
+    if(!p->references[l]){
+      cxi_close_pyramid(p);
+      return NULL;
+    }
+    level->file_stats = dataset->file_stats;
+  }
+  return p;
+}
+
+int cxi_write_pyramid_slices(CXI_Pyramid * pyramid, hsize_t first, hsize_t n,
+			     const float * frames, int nthreads){
+  CXI_TRACE();
+  if(!pyramid || !frames || n == 0){
+    return -1;
+  }
+  if(!pyramid->stacked && (first != 0 || n != 1)){
+    return -1;
+  }
+  /* Each level is binned from the one above, so we only need two buffers */
+  hsize_t rows = (pyramid->rows+1)/2;
+  hsize_t cols = (pyramid->cols+1)/2;
+  float * bufs[2];
+  bufs[0] = malloc(sizeof(float)*n*rows*cols);
+  bufs[1] = malloc(sizeof(float)*n*rows*cols);
+  if(!bufs[0] || !bufs[1]){
+    free(bufs[0]);
+    free(bufs[1]);
+    return -1;
+  }
+  Bin_Job job;
+  job.in = frames;
+  job.in_rows = pyramid->rows;
+  job.in_cols = pyramid->cols;
+  int ret = 0;
+  for(int l = 0;l<pyramid->level_count && !ret;l++){
+    job.out = bufs[l%2];
+    job.out_rows = (job.in_rows+1)/2;
+    job.out_cols = (job.in_cols+1)/2;
+    cxi_parallel_for(nthreads, n*job.out_rows, bin_rows, &job);
+    CXI_Dataset * level = pyramid->levels[l];
+    if(pyramid->stacked){
+      hid_t s = H5Dget_space(level->handle);
+      hsize_t start[3] = {first,0,0};
+      hsize_t count[3] = {n,job.out_rows,job.out_cols};
+      hid_t memspace = H5Screate_simple(3, count, NULL);
+      H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+      uint64_t begin = cxi_stats_now();
+      int converts = cxi_dataset_converts(level, H5T_NATIVE_FLOAT);
+      if(H5Dwrite(level->handle,H5T_NATIVE_FLOAT,memspace,s,level->transfer_plist,job.out) < 0){
+	ret = -1;
+      }
+      cxi_stats_io(level, 1, H5T_NATIVE_FLOAT, converts, first, n, begin);
+      H5Sclose(memspace);
+      H5Sclose(s);
+    }else{
+      ret = cxi_write_dataset(level, job.out, H5T_NATIVE_FLOAT);
+    }
+    job.in = job.out;
+    job.in_rows = job.out_rows;
+    job.in_cols = job.out_cols;
+  }
+  free(bufs[0]);
+  free(bufs[1]);
+  return ret;
+}
+
+void cxi_close_pyramid(CXI_Pyramid * pyramid){
+  if(!pyramid){
+    return;
+  }
+  for(int l = 0;l<pyramid->level_count;l++){
+    if(pyramid->references[l]){
+      free(pyramid->references[l]->group_name);
+      free(pyramid->references[l]);
+    }
+    if(pyramid->levels[l]){
+      if(pyramid->levels[l]->handle > 0){
+	H5Dclose(pyramid->levels[l]->handle);
+      }
+      free(pyramid->levels[l]->dimensions);
+      free(pyramid->levels[l]);
+    }
+  }
+  free(pyramid);
+}
+
+int cxi_build_pyramid(CXI_Dataset_Reference * data, int levels, int nthreads){
+  if(!data){
+    return -1;
+  }
+  CXI_Dataset * dataset = data->dataset;
+  if(!dataset){
+    dataset = cxi_open_dataset(data);
+  }
+  CXI_Pyramid * p = cxi_create_pyramid(data, levels);
+  if(!p){
+    return -1;
+  }
+  hsize_t frames = p->stacked ? dataset->dimensions[0] : 1;
+  hsize_t batch = p->stacked ? cxi_batch_slices(dataset, sizeof(float), CXI_PYRAMID_BATCH_BYTES) : 1;
+  float * buffer = malloc(sizeof(float)*batch*p->rows*p->cols);
+  int ret = buffer ? 0 : -1;
+  for(hsize_t first = 0;first<frames && !ret;first += batch){
+    hsize_t n = frames-first < batch ? frames-first : batch;
+    if(p->stacked){
+      ret = cxi_read_dataset_slices(dataset, first, n, buffer, H5T_NATIVE_FLOAT);
+    }else{
+      ret = cxi_read_dataset(dataset, buffer, H5T_NATIVE_FLOAT);
+    }
+    if(!ret){
+      ret = cxi_write_pyramid_slices(p, first, n, buffer, nthreads);
+    }
+  }
+  free(buffer);
+  cxi_close_pyramid(p);
+  return ret;
+}
+
+CXI_Dataset * cxi_open_pyramid_level(CXI_Dataset_Reference * data, hsize_t rows, hsize_t cols,
+				     int * binning){
+  CXI_TRACE();
+  if(!data){
+    return NULL;
+  }
+  char buffer[1024];
+  int chosen = 1;
+  /* Find the coarsest level that still covers the viewport */
+  for(int b = 2;b <= (1<<CXI_PYRAMID_MAX_LEVELS);b *= 2){
+    level_name(buffer, data->group_name, b);
+    if(!H5Lexists(data->parent_handle, buffer, H5P_DEFAULT)){
+      break;
+    }
+    hid_t ds = H5Dopen(data->parent_handle, buffer, H5P_DEFAULT);
+    if(ds < 0){
+      break;
+    }
+    hid_t s = H5Dget_space(ds);
+    int ndims = H5Sget_simple_extent_ndims(s);
+    hsize_t dims[3] = {0,0,0};
+    if(ndims >= 2 && ndims <= 3){
+      H5Sget_simple_extent_dims(s, dims, NULL);
+    }
+    H5Sclose(s);
+    H5Dclose(ds);
+    if(ndims < 2 || ndims > 3 || dims[ndims-2] < rows || dims[ndims-1] < cols){
+      break;
+    }
+    chosen = b;
+  }
+  CXI_Dataset_Reference ref;
+  memset(&ref, 0, sizeof(ref));
+  ref.parent_handle = data->parent_handle;
+  ref.group_name = buffer;
+  if(chosen == 1){
+    strcpy(buffer, data->group_name);
+  }else{
+    level_name(buffer, data->group_name, chosen);
+  }
+  CXI_Dataset * dataset = cxi_open_dataset(&ref);
+  if(dataset){
+    /* Heap allocated, but its I/O still counts towards the file */
+    dataset->file_stats = cxi_arena_stats(data->arena);
+  }
+  if(dataset && binning){
+    *binning = chosen;
+  }
+  return dataset;
+}
+
+void cxi_close_pyramid_level(CXI_Dataset * dataset){
+  if(!dataset){
+    return;
+  }
+  H5Dclose(dataset->handle);
+  H5Tclose(dataset->data_type);
+  free(dataset->dimensions);
+  free(dataset);
+}
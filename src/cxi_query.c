@@ -0,0 +1,342 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi.h"
+#include "cxi_private.h"
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* Frames evaluated at a time, a multiple of the 64 frames of a bitmap word */
+#define CXI_QUERY_BLOCK 65536
+
+typedef struct{
+  int column;
+  int term;
+  CXI_Compare op;
+  double value;
+  double upper;
+}Condition;
+
+struct CXI_Query{
+  hid_t loc;
+  char ** columns;
+  int column_count;
+  Condition * conditions;
+  int condition_count;
+  /* The term new conditions are added to */
+  int term;
+};
+
+CXI_Query * cxi_create_query(hid_t loc){
+  CXI_TRACE();
+  if(loc < 0){
+    return NULL;
+  }
+  CXI_Query * q = calloc(sizeof(CXI_Query),1);
+  if(!q){
+    return NULL;
+  }
+  q->loc = loc;
+  return q;
+}
+
+static int find_column(CXI_Query * q, const char * column){
+  for(int i = 0;i<q->column_count;i++){
+    if(!strcmp(q->columns[i], column)){
+      return i;
+    }
+  }
+  char ** columns = realloc(q->columns, sizeof(char *)*(q->column_count+1));
+  if(!columns){
+    return -1;
+  }
+  q->columns = columns;
+  q->columns[q->column_count] = cxi_arena_strdup(NULL, column);
+  if(!q->columns[q->column_count]){
+    return -1;
+  }
+  return q->column_count++;
+}
+
+int cxi_query_where(CXI_Query * query, const char * column, CXI_Compare op, double value, double upper){
+  if(!query || !column || op < CXI_Less || op > CXI_Between){
+    return -1;
+  }
+  Condition * conditions = realloc(query->conditions, sizeof(Condition)*(query->condition_count+1));
+  if(!conditions){
+    return -1;
+  }
+  query->conditions = conditions;
+  Condition * c = &query->conditions[query->condition_count];
+  c->column = find_column(query, column);
+  if(c->column < 0){
+    return -1;
+  }
+  c->term = query->term;
+  c->op = op;
+  c->value = value;
+  c->upper = upper;
+  query->condition_count++;
+  return 0;
+}
+
+int cxi_query_or(CXI_Query * query){
+  if(!query){
+    return -1;
+  }
+  /* An empty term would match everything */
+  if(query->condition_count && query->conditions[query->condition_count-1].term == query->term){
+    query->term++;
+  }
+  return 0;
+}
+
+void cxi_free_query(CXI_Query * query){
+  if(!query){
+    return;
+  }
+  for(int i = 0;i<query->column_count;i++){
+    free(query->columns[i]);
+  }
+  free(query->columns);
+  free(query->conditions);
+  free(query);
+}
+
+static int matches(double x, const Condition * c){
+  switch(c->op){
+  case CXI_Less: return x < c->value;
+  case CXI_Less_Equal: return x <= c->value;
+  case CXI_Greater: return x > c->value;
+  case CXI_Greater_Equal: return x >= c->value;
+  case CXI_Equal: return x == c->value;
+  case CXI_Not_Equal: return x != c->value;
+  case CXI_Between: return x >= c->value && x <= c->upper;
+  }
+  return 0;
+}
+
+static uint64_t scalar_bits(const double * x, int n, const Condition * c){
+  uint64_t bits = 0;
+  for(int j = 0;j<n;j++){
+    bits |= (uint64_t)matches(x[j], c) << j;
+  }
+  return bits;
+}
+
+#if defined(__SSE2__)
+/* Two frames per comparison, their two sign bits going straight into the word */
+#define COMPARE_WORD(expr) for(int j = 0;j<64;j += 2){			\
+    __m128d p = _mm_loadu_pd(v+j);					\
+    bits |= (uint64_t)_mm_movemask_pd(expr) << j;			\
+  }
+#endif
+
+/* Sets bit f of words when frame f of x satisfies the condition */
+static void compare_block(const double * restrict x, hsize_t n, const Condition * c,
+			  uint64_t * restrict words){
+  hsize_t full = n/64;
+#if defined(__SSE2__)
+  const __m128d a = _mm_set1_pd(c->value);
+  const __m128d b = _mm_set1_pd(c->upper);
+  for(hsize_t w = 0;w<full;w++){
+    const double * v = x+64*w;
+    uint64_t bits = 0;
+    switch(c->op){
+    case CXI_Less: COMPARE_WORD(_mm_cmplt_pd(p, a)); break;
+    case CXI_Less_Equal: COMPARE_WORD(_mm_cmple_pd(p, a)); break;
+    case CXI_Greater: COMPARE_WORD(_mm_cmpgt_pd(p, a)); break;
+    case CXI_Greater_Equal: COMPARE_WORD(_mm_cmpge_pd(p, a)); break;
+    case CXI_Equal: COMPARE_WORD(_mm_cmpeq_pd(p, a)); break;
+    case CXI_Not_Equal: COMPARE_WORD(_mm_cmpneq_pd(p, a)); break;
+    case CXI_Between: COMPARE_WORD(_mm_and_pd(_mm_cmpge_pd(p, a), _mm_cmple_pd(p, b))); break;
+    }
+    words[w] = bits;
+  }
+#else
+  for(hsize_t w = 0;w<full;w++){
+    words[w] = scalar_bits(x+64*w, 64, c);
+  }
+#endif
+  if(n % 64){
+    words[full] = scalar_bits(x+64*full, n % 64, c);
+  }
+}
+
+static hsize_t column_length(hid_t dataset){
+  hid_t space = H5Dget_space(dataset);
+  hsize_t n = 0;
+  if(H5Sget_simple_extent_ndims(space) == 1){
+    H5Sget_simple_extent_dims(space, &n, NULL);
+  }else{
+    n = (hsize_t)-1;
+  }
+  H5Sclose(space);
+  return n;
+}
+
+static int read_block(hid_t dataset, hsize_t first, hsize_t n, double * values){
+  hid_t s = H5Dget_space(dataset);
+  hsize_t start[1] = {first};
+  hsize_t count[1] = {n};
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  hid_t memspace = H5Screate_simple(1, count, NULL);
+  herr_t status = H5Dread(dataset, H5T_NATIVE_DOUBLE, memspace, s, H5P_DEFAULT, values);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+static int evaluate(CXI_Query * q, hid_t * datasets, double ** values, CXI_Selection * sel){
+  const hsize_t block_words = CXI_QUERY_BLOCK/64;
+  uint64_t * term = malloc(sizeof(uint64_t)*block_words);
+  uint64_t * condition = malloc(sizeof(uint64_t)*block_words);
+  if(!term || !condition){
+    free(term);
+    free(condition);
+    return -1;
+  }
+  int ret = 0;
+  for(hsize_t first = 0;!ret && first<sel->frame_count;first += CXI_QUERY_BLOCK){
+    hsize_t n = sel->frame_count-first < CXI_QUERY_BLOCK ? sel->frame_count-first : CXI_QUERY_BLOCK;
+    hsize_t words = (n+63)/64;
+    /* Each column is read once per block, however many conditions use it */
+    for(int i = 0;!ret && i<q->column_count;i++){
+      ret = read_block(datasets[i], first, n, values[i]);
+    }
+    uint64_t * out = sel->bitmap+first/64;
+    for(int c = 0;!ret && c<q->condition_count;c++){
+      const Condition * cond = &q->conditions[c];
+      compare_block(values[cond->column], n, cond, condition);
+      int starts = c == 0 || q->conditions[c-1].term != cond->term;
+      int ends = c == q->condition_count-1 || q->conditions[c+1].term != cond->term;
+      for(hsize_t w = 0;w<words;w++){
+	term[w] = starts ? condition[w] : term[w] & condition[w];
+      }
+      if(ends){
+	for(hsize_t w = 0;w<words;w++){
+	  out[w] |= term[w];
+	}
+      }
+    }
+  }
+  free(term);
+  free(condition);
+  return ret;
+}
+
+CXI_Selection * cxi_run_query(CXI_Query * query){
+  CXI_TRACE();
+  if(!query || !query->condition_count){
+    return NULL;
+  }
+  CXI_Selection * sel = calloc(sizeof(CXI_Selection),1);
+  hid_t * datasets = calloc(sizeof(hid_t), query->column_count);
+  double ** values = calloc(sizeof(double *), query->column_count);
+  int ret = sel && datasets && values ? 0 : -1;
+  for(int i = 0;!ret && i<query->column_count;i++){
+    datasets[i] = H5Dopen(query->loc, query->columns[i], H5P_DEFAULT);
+    values[i] = malloc(sizeof(double)*CXI_QUERY_BLOCK);
+    if(datasets[i] < 0 || !values[i]){
+      cxi_warning("Cannot read the column %s", query->columns[i]);
+      ret = -1;
+      break;
+    }
+    hsize_t n = column_length(datasets[i]);
+    if(i == 0){
+      sel->frame_count = n;
+    }
+    if(n == (hsize_t)-1 || n != sel->frame_count){
+      cxi_warning("The column %s does not have one value per frame", query->columns[i]);
+      ret = -1;
+    }
+  }
+  if(!ret){
+    sel->bitmap = calloc(sizeof(uint64_t), (sel->frame_count+63)/64+1);
+    ret = sel->bitmap ? evaluate(query, datasets, values, sel) : -1;
+  }
+  if(!ret){
+    hsize_t words = (sel->frame_count+63)/64;
+    for(hsize_t w = 0;w<words;w++){
+      sel->selected_count += __builtin_popcountll(sel->bitmap[w]);
+    }
+    sel->frames = malloc(sizeof(hsize_t)*(sel->selected_count ? sel->selected_count : 1));
+    ret = sel->frames ? 0 : -1;
+    hsize_t k = 0;
+    for(hsize_t w = 0;!ret && w<words;w++){
+      for(uint64_t bits = sel->bitmap[w];bits;bits &= bits-1){
+	sel->frames[k++] = 64*w+__builtin_ctzll(bits);
+      }
+    }
+  }
+  for(int i = 0;datasets && values && i<query->column_count;i++){
+    if(datasets[i] > 0){
+      H5Dclose(datasets[i]);
+    }
+    free(values[i]);
+  }
+  free(datasets);
+  free(values);
+  if(ret){
+    cxi_free_selection(sel);
+    return NULL;
+  }
+  return sel;
+}
+
+void cxi_free_selection(CXI_Selection * selection){
+  if(!selection){
+    return;
+  }
+  free(selection->bitmap);
+  free(selection->frames);
+  free(selection);
+}
+
+int cxi_read_selected_frames(CXI_Dataset * dataset, const CXI_Selection * selection, hsize_t first,
+			     hsize_t n, void * data, hid_t mem_type){
+  CXI_TRACE();
+  if(!dataset || !selection || !data || dataset->dimension_count <= 0 ||
+     first+n > selection->selected_count){
+    return -1;
+  }
+  if(n == 0){
+    return 0;
+  }
+  const hsize_t * frames = selection->frames+first;
+  for(hsize_t i = 0;i<n;i++){
+    if(frames[i] >= dataset->dimensions[0]){
+      return -1;
+    }
+  }
+  uint64_t begin = cxi_stats_now();
+  int converts = cxi_dataset_converts(dataset, mem_type);
+  hid_t s = H5Dget_space(dataset->handle);
+  if(s < 0){
+    return -1;
+  }
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
+  for(int i = 0;i<dataset->dimension_count;i++){
+    start[i] = 0;
+    count[i] = dataset->dimensions[i];
+  }
+  /* One hyperslab per run of consecutive frames, all read in one call */
+  for(hsize_t i = 0;i<n;){
+    hsize_t j = i+1;
+    while(j < n && frames[j] == frames[j-1]+1){
+      j++;
+    }
+    start[0] = frames[i];
+    count[0] = j-i;
+    H5Sselect_hyperslab(s, i ? H5S_SELECT_OR : H5S_SELECT_SET, start, NULL, count, NULL);
+    i = j;
+  }
+  count[0] = n;
+  hid_t memspace = H5Screate_simple(dataset->dimension_count, count, NULL);
+  herr_t status = H5Dread(dataset->handle, mem_type, memspace, s, dataset->transfer_plist, data);
+  cxi_stats_io(dataset, 0, mem_type, converts, frames[0], n, begin);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
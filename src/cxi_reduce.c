@@ -0,0 +1,236 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Default upper bound on the memory used to hold a batch of frames */
+#define CXI_REDUCE_BATCH_BYTES (64*1024*1024)
+
+typedef struct{
+  CXI_Reduction * r;
+  /* The current batch, frame major */
+  double * batch;
+  hsize_t batch_frames;
+}Reduce_Batch;
+
+/* Reduces the pixels [begin,end) of a batch and merges the result into
+ * the running accumulators, without updating frame_count. The batch
+ * statistics are computed with two passes, which is exact since the
+ * batch is resident, and then combined with the running ones using the
+ * pairwise update of Chan et al. Until cxi_reduction_finish() is called
+ * the variance array holds the sum of squared deviations.
+ */
+void cxi_reduction_accumulate(CXI_Reduction * r, const double * batch, hsize_t nb,
+			      hsize_t begin, hsize_t end){
+  hsize_t len = r->frame_length;
+  double na = r->frame_count;
+  double * mean = r->mean;
+  double * m2 = r->variance;
+  double * sum = r->sum;
+  double * max = r->max;
+  /* Work on blocks of pixels small enough for the batch
+     accumulators to live on the stack. */
+  enum {block = 256};
+  double bsum[block];
+  double bm2[block];
+  double bmax[block];
+  for(hsize_t p0 = begin; p0 < end; p0 += block){
+    hsize_t pn = end-p0 < block ? end-p0 : block;
+    for(hsize_t p = 0;p<pn;p++){
+      bsum[p] = 0;
+      bm2[p] = 0;
+      bmax[p] = -DBL_MAX;
+    }
+    for(hsize_t f = 0;f<nb;f++){
+      const double * frame = batch + f*len + p0;
+      for(hsize_t p = 0;p<pn;p++){
+	bsum[p] += frame[p];
+	bmax[p] = frame[p] > bmax[p] ? frame[p] : bmax[p];
+      }
+    }
+    for(hsize_t f = 0;f<nb;f++){
+      const double * frame = batch + f*len + p0;
+      for(hsize_t p = 0;p<pn;p++){
+	double d = frame[p] - bsum[p]/nb;
+	bm2[p] += d*d;
+      }
+    }
+    double n = na + nb;
+    for(hsize_t p = 0;p<pn;p++){
+      hsize_t i = p0+p;
+      double bmean = bsum[p]/nb;
+      double delta = bmean - mean[i];
+      mean[i] += delta*nb/n;
+      m2[i] += bm2[p] + delta*delta*na*nb/n;
+      sum[i] += bsum[p];
+      if(na == 0 || bmax[p] > max[i]){
+	max[i] = bmax[p];
+      }
+    }
+  }
+}
+
+static void reduce_pixels(hsize_t begin, hsize_t end, void * arg){
+  Reduce_Batch * b = arg;
+  cxi_reduction_accumulate(b->r, b->batch, b->batch_frames, begin, end);
+}
+
+CXI_Reduction * cxi_reduction_new(CXI_Dataset * dataset){
+  if(!dataset || dataset->dimension_count <= 0 || dataset->handle < 0){
+    return NULL;
+  }
+  if(dataset->dimensions[0] == 0){
+    return NULL;
+  }
+  CXI_Reduction * r = calloc(sizeof(CXI_Reduction),1);
+  if(!r){
+    return NULL;
+  }
+  r->frame_length = cxi_dataset_slice_length(dataset);
+  r->dimension_count = dataset->dimension_count-1;
+  r->dimensions = malloc(sizeof(hsize_t)*(r->dimension_count+1));
+  r->mean = calloc(sizeof(double),r->frame_length);
+  r->variance = calloc(sizeof(double),r->frame_length);
+  r->sum = calloc(sizeof(double),r->frame_length);
+  r->max = calloc(sizeof(double),r->frame_length);
+  if(!r->dimensions || !r->mean || !r->variance || !r->sum || !r->max){
+    cxi_free_reduction(r);
+    return NULL;
+  }
+  for(int i = 0;i<r->dimension_count;i++){
+    r->dimensions[i] = dataset->dimensions[i+1];
+  }
+  return r;
+}
+
+void cxi_reduction_finish(CXI_Reduction * r){
+  /* Turn the sum of squared deviations into the sample variance */
+  for(hsize_t i = 0;i<r->frame_length;i++){
+    r->variance[i] = r->frame_count > 1 ? r->variance[i]/(r->frame_count-1) : 0;
+  }
+}
+
+CXI_Reduction * cxi_reduce_dataset(CXI_Dataset * dataset, hsize_t batch_frames, int nthreads){
+  CXI_Reduction * r = cxi_reduction_new(dataset);
+  if(!r){
+    return NULL;
+  }
+  hsize_t frames = dataset->dimensions[0];
+  if(batch_frames == 0){
+    batch_frames = cxi_batch_slices(dataset, sizeof(double), CXI_REDUCE_BATCH_BYTES);
+  }
+  if(batch_frames > frames){
+    batch_frames = frames;
+  }
+  Reduce_Batch b;
+  b.r = r;
+  b.batch = malloc(sizeof(double)*r->frame_length*batch_frames);
+  if(!b.batch){
+    cxi_free_reduction(r);
+    return NULL;
+  }
+  cxi_debug("reducing %llu frames in batches of %llu",(unsigned long long)frames,
+	    (unsigned long long)batch_frames);
+  for(hsize_t first = 0; first < frames; first += batch_frames){
+    b.batch_frames = frames-first < batch_frames ? frames-first : batch_frames;
+    if(cxi_read_dataset_slices(dataset, first, b.batch_frames, b.batch, H5T_NATIVE_DOUBLE)){
+      free(b.batch);
+      cxi_free_reduction(r);
+      return NULL;
+    }
+    cxi_parallel_for(nthreads, r->frame_length, reduce_pixels, &b);
+    r->frame_count += b.batch_frames;
+  }
+  free(b.batch);
+  cxi_reduction_finish(r);
+  return r;
+}
+
+void cxi_free_reduction(CXI_Reduction * reduction){
+  if(!reduction){
+    return;
+  }
+  free(reduction->dimensions);
+  free(reduction->mean);
+  free(reduction->variance);
+  free(reduction->sum);
+  free(reduction->max);
+  free(reduction);
+}
+
+CXI_Dataset_Reference * cxi_create_reduction_dataset(hid_t loc, CXI_Reduction * reduction,
+						     CXI_Reduction_Quantity quantity,
+						     CXI_Dataset_Type type){
+  CXI_TRACE();
+  if(loc < 0 || !reduction){
+    return NULL;
+  }
+  double * values = NULL;
+  switch(quantity){
+  case CXI_Reduction_Mean:
+    values = reduction->mean;
+    break;
+  case CXI_Reduction_Variance:
+    values = reduction->variance;
+    break;
+  case CXI_Reduction_Sum:
+    values = reduction->sum;
+    break;
+  case CXI_Reduction_Max:
+    values = reduction->max;
+    break;
+  case CXI_Reduction_Standard_Deviation:
+    values = malloc(sizeof(double)*reduction->frame_length);
+    if(!values){
+      return NULL;
+    }
+    for(hsize_t i = 0;i<reduction->frame_length;i++){
+      values[i] = sqrt(reduction->variance[i]);
+    }
+    break;
+  default:
+    return NULL;
+  }
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  if(!dataset){
+    if(quantity == CXI_Reduction_Standard_Deviation){
+      free(values);
+    }
+    return NULL;
+  }
+  /* A 1D dataset reduces to a single value */
+  dataset->dimension_count = reduction->dimension_count > 0 ? reduction->dimension_count : 1;
+  dataset->dimensions = malloc(sizeof(hsize_t)*dataset->dimension_count);
+  if(!dataset->dimensions){
+    free(dataset);
+    if(quantity == CXI_Reduction_Standard_Deviation){
+      free(values);
+    }
+    return NULL;
+  }
+  if(reduction->dimension_count > 0){
+    memcpy(dataset->dimensions, reduction->dimensions, sizeof(hsize_t)*reduction->dimension_count);
+  }else{
+    dataset->dimensions[0] = 1;
+  }
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  CXI_Dataset_Reference * ref = cxi_create_dataset(loc, dataset, type);
+  if(ref && cxi_write_dataset(dataset, values, H5T_NATIVE_DOUBLE)){
+    /* Leave nothing half written behind */
+    H5Dclose(dataset->handle);
+    H5Ldelete(loc, ref->group_name, H5P_DEFAULT);
+    free(ref->group_name);
+    free(ref);
+    ref = NULL;
+  }
+  if(!ref){
+    free(dataset->dimensions);
+    free(dataset);
+  }
+  if(quantity == CXI_Reduction_Standard_Deviation){
+    free(values);
+  }
+  return ref;
+}
@@ -0,0 +1,356 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Frames read at a time from datasets that are not chunked */
+#define CXI_SAMPLER_UNIT_BYTES (1<<20)
+#define CXI_SAMPLER_WINDOW 8
+#define CXI_SAMPLER_PREFETCH 2
+
+typedef struct{
+  void * data;
+  hsize_t * frames;
+  hsize_t frame_count;
+  uint64_t epoch;
+  /* -1 when the producer failed */
+  int status;
+}Batch;
+
+struct CXI_Batch_Sampler{
+  CXI_Dataset * dataset;
+  hid_t mem_type;
+  CXI_Sampler_Options options;
+  size_t frame_bytes;
+  /* Frames read at a time, a chunk when the dataset is chunked */
+  hsize_t unit_frames;
+  hsize_t unit_count;
+  CXI_Frame_Pool * pool;
+  /* The frames of the resident units and their shuffled order */
+  char * window;
+  hsize_t * window_frames;
+  hsize_t * order;
+  hsize_t * units;
+
+  Batch * batches;
+  int batch_count;
+  /* Batches waiting for the consumer, in order, and free ones */
+  Batch ** ready;
+  int ready_first;
+  int ready_count;
+  Batch ** free_batches;
+  int free_count;
+  int stop;
+  /* Without a thread-safe HDF5 the producer only reads while the
+     consumer waits in cxi_next_batch(), which lets it read */
+  int serial;
+  int may_read;
+  int reading;
+  /* The producer gave up, every batch from now on fails */
+  int failed;
+  pthread_mutex_t lock;
+  pthread_cond_t changed;
+  pthread_t thread;
+  int started;
+};
+
+/* splitmix64, good enough to shuffle and cheap to reseed per epoch */
+static uint64_t next_random(uint64_t * state){
+  uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static void shuffle(hsize_t * v, hsize_t n, uint64_t * rng){
+  for(hsize_t i = n;i>1;i--){
+    hsize_t j = next_random(rng) % i;
+    hsize_t t = v[i-1];
+    v[i-1] = v[j];
+    v[j] = t;
+  }
+}
+
+static Batch * take_free(CXI_Batch_Sampler * s){
+  pthread_mutex_lock(&s->lock);
+  while(!s->free_count && !s->stop){
+    pthread_cond_wait(&s->changed, &s->lock);
+  }
+  Batch * b = s->stop ? NULL : s->free_batches[--s->free_count];
+  pthread_mutex_unlock(&s->lock);
+  return b;
+}
+
+static void push_ready(CXI_Batch_Sampler * s, Batch * b){
+  pthread_mutex_lock(&s->lock);
+  s->ready[(s->ready_first+s->ready_count) % s->batch_count] = b;
+  s->ready_count++;
+  pthread_cond_broadcast(&s->changed);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* Waits for the consumer to let the producer read, returns 0 if it stopped instead */
+static int start_reading(CXI_Batch_Sampler * s){
+  pthread_mutex_lock(&s->lock);
+  while(s->serial && !s->may_read && !s->stop){
+    pthread_cond_wait(&s->changed, &s->lock);
+  }
+  int go = !s->stop;
+  s->reading = go;
+  pthread_mutex_unlock(&s->lock);
+  return go;
+}
+
+static void stop_reading(CXI_Batch_Sampler * s){
+  pthread_mutex_lock(&s->lock);
+  s->reading = 0;
+  pthread_cond_broadcast(&s->changed);
+  pthread_mutex_unlock(&s->lock);
+}
+
+/* Reads whole units into the window, each frame of the dataset once per epoch */
+static int load_window(CXI_Batch_Sampler * s, const hsize_t * units, int count, hsize_t * n){
+  *n = 0;
+  if(!start_reading(s)){
+    return 0;
+  }
+  for(int u = 0;u<count;u++){
+    hsize_t first = units[u]*s->unit_frames;
+    hsize_t k = s->dataset->dimensions[0]-first;
+    k = k < s->unit_frames ? k : s->unit_frames;
+    if(cxi_read_dataset_slices(s->dataset, first, k, s->window+*n*s->frame_bytes, s->mem_type)){
+      stop_reading(s);
+      return -1;
+    }
+    for(hsize_t i = 0;i<k;i++){
+      s->window_frames[*n+i] = first+i;
+    }
+    *n += k;
+  }
+  stop_reading(s);
+  return 0;
+}
+
+static int run_epoch(CXI_Batch_Sampler * s, uint64_t epoch){
+  uint64_t rng = s->options.seed+epoch*0x632BE59BD9B4E019ULL;
+  for(hsize_t u = 0;u<s->unit_count;u++){
+    s->units[u] = u;
+  }
+  shuffle(s->units, s->unit_count, &rng);
+  Batch * b = NULL;
+  int window = s->options.window_chunks;
+  for(hsize_t u = 0;u<s->unit_count;u += window){
+    int count = s->unit_count-u < (hsize_t)window ? (int)(s->unit_count-u) : window;
+    hsize_t n;
+    if(load_window(s, s->units+u, count, &n)){
+      return -1;
+    }
+    for(hsize_t i = 0;i<n;i++){
+      s->order[i] = i;
+    }
+    shuffle(s->order, n, &rng);
+    /* Batches run on from one window to the next */
+    for(hsize_t i = 0;i<n;i++){
+      if(!b){
+	b = take_free(s);
+	if(!b){
+	  return 0;
+	}
+	b->frame_count = 0;
+	b->epoch = epoch;
+	b->status = 0;
+      }
+      memcpy((char *)b->data+b->frame_count*s->frame_bytes, s->window+s->order[i]*s->frame_bytes,
+	     s->frame_bytes);
+      b->frames[b->frame_count++] = s->window_frames[s->order[i]];
+      if(b->frame_count == s->options.batch_frames){
+	push_ready(s, b);
+	b = NULL;
+      }
+    }
+  }
+  if(b && b->frame_count && !s->options.drop_last){
+    push_ready(s, b);
+    b = take_free(s);
+  }
+  /* An empty batch marks the end of the epoch */
+  if(!b){
+    b = take_free(s);
+  }
+  if(b){
+    b->frame_count = 0;
+    b->epoch = epoch;
+    b->status = 0;
+    push_ready(s, b);
+  }
+  return 0;
+}
+
+static void * produce(void * arg){
+  CXI_Batch_Sampler * s = arg;
+  for(uint64_t epoch = 0;;epoch++){
+    pthread_mutex_lock(&s->lock);
+    int stop = s->stop;
+    pthread_mutex_unlock(&s->lock);
+    if(stop){
+      break;
+    }
+    if(run_epoch(s, epoch)){
+      Batch * b = take_free(s);
+      if(b){
+	b->frame_count = 0;
+	b->status = -1;
+	push_ready(s, b);
+      }
+      break;
+    }
+  }
+  return NULL;
+}
+
+CXI_Batch_Sampler * cxi_create_batch_sampler(CXI_Dataset * dataset, hid_t mem_type,
+					     const CXI_Sampler_Options * options){
+  CXI_TRACE();
+  if(!dataset || !options || options->batch_frames == 0 || dataset->dimension_count <= 0 ||
+     dataset->dimensions[0] == 0){
+    return NULL;
+  }
+  CXI_Batch_Sampler * s = calloc(sizeof(CXI_Batch_Sampler),1);
+  if(!s){
+    return NULL;
+  }
+  s->dataset = dataset;
+  s->mem_type = mem_type;
+  s->options = *options;
+  if(s->options.window_chunks <= 0){
+    s->options.window_chunks = CXI_SAMPLER_WINDOW;
+  }
+  if(s->options.prefetch_batches <= 0){
+    s->options.prefetch_batches = CXI_SAMPLER_PREFETCH;
+  }
+  s->frame_bytes = cxi_dataset_slice_length(dataset)*H5Tget_size(mem_type);
+  s->unit_frames = cxi_dataset_chunk_slices(dataset);
+  if(!s->unit_frames){
+    s->unit_frames = cxi_batch_slices(dataset, H5Tget_size(mem_type), CXI_SAMPLER_UNIT_BYTES);
+  }
+  s->unit_count = (dataset->dimensions[0]+s->unit_frames-1)/s->unit_frames;
+  if((hsize_t)s->options.window_chunks > s->unit_count){
+    s->options.window_chunks = s->unit_count;
+  }
+  hsize_t window_frames = s->unit_frames*s->options.window_chunks;
+  s->window = malloc(s->frame_bytes*window_frames);
+  s->window_frames = malloc(sizeof(hsize_t)*window_frames);
+  s->order = malloc(sizeof(hsize_t)*window_frames);
+  s->units = malloc(sizeof(hsize_t)*s->unit_count);
+  /* The ones being filled and handed out besides those waiting */
+  s->batch_count = s->options.prefetch_batches+2;
+  s->batches = calloc(sizeof(Batch), s->batch_count);
+  s->ready = calloc(sizeof(Batch *), s->batch_count);
+  s->free_batches = calloc(sizeof(Batch *), s->batch_count);
+  s->pool = cxi_create_frame_pool(dataset, mem_type, s->options.batch_frames, s->batch_count,
+				  s->options.pool_flags);
+  int ret = s->window && s->window_frames && s->order && s->units && s->batches && s->ready &&
+    s->free_batches && s->pool && s->frame_bytes ? 0 : -1;
+  for(int i = 0;!ret && i<s->batch_count;i++){
+    s->batches[i].data = cxi_frame_pool_get(s->pool);
+    s->batches[i].frames = malloc(sizeof(hsize_t)*s->options.batch_frames);
+    if(!s->batches[i].data || !s->batches[i].frames){
+      ret = -1;
+    }
+    s->free_batches[s->free_count++] = &s->batches[i];
+  }
+  if(!ret){
+    s->serial = !cxi_hdf5_threadsafe();
+    pthread_mutex_init(&s->lock, NULL);
+    pthread_cond_init(&s->changed, NULL);
+    s->started = pthread_create(&s->thread, NULL, produce, s) == 0;
+    ret = s->started ? 0 : -1;
+  }
+  if(ret){
+    cxi_free_batch_sampler(s);
+    return NULL;
+  }
+  return s;
+}
+
+int cxi_next_batch(CXI_Batch_Sampler * sampler, CXI_Batch * batch){
+  CXI_TRACE();
+  if(!sampler || !batch){
+    return -1;
+  }
+  pthread_mutex_lock(&sampler->lock);
+  sampler->may_read = 1;
+  pthread_cond_broadcast(&sampler->changed);
+  while((!sampler->ready_count && !sampler->failed) || (sampler->serial && sampler->reading)){
+    pthread_cond_wait(&sampler->changed, &sampler->lock);
+  }
+  sampler->may_read = 0;
+  if(sampler->failed){
+    pthread_mutex_unlock(&sampler->lock);
+    return -1;
+  }
+  Batch * b = sampler->ready[sampler->ready_first];
+  sampler->failed = b->status != 0;
+  sampler->ready_first = (sampler->ready_first+1) % sampler->batch_count;
+  sampler->ready_count--;
+  pthread_mutex_unlock(&sampler->lock);
+  int status = b->status ? -1 : b->frame_count ? 1 : 0;
+  batch->data = b->data;
+  batch->frames = b->frames;
+  batch->frame_count = b->frame_count;
+  batch->epoch = b->epoch;
+  /* Nothing to hand out with the end of an epoch or an error */
+  if(status <= 0){
+    cxi_release_batch(sampler, batch);
+    batch->data = NULL;
+    batch->frames = NULL;
+  }
+  return status;
+}
+
+void cxi_release_batch(CXI_Batch_Sampler * sampler, CXI_Batch * batch){
+  if(!sampler || !batch || !batch->data){
+    return;
+  }
+  pthread_mutex_lock(&sampler->lock);
+  for(int i = 0;i<sampler->batch_count;i++){
+    if(sampler->batches[i].data == batch->data){
+      sampler->free_batches[sampler->free_count++] = &sampler->batches[i];
+      pthread_cond_broadcast(&sampler->changed);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&sampler->lock);
+  batch->data = NULL;
+}
+
+void cxi_free_batch_sampler(CXI_Batch_Sampler * sampler){
+  if(!sampler){
+    return;
+  }
+  if(sampler->started){
+    pthread_mutex_lock(&sampler->lock);
+    sampler->stop = 1;
+    pthread_cond_broadcast(&sampler->changed);
+    pthread_mutex_unlock(&sampler->lock);
+    pthread_join(sampler->thread, NULL);
+    pthread_mutex_destroy(&sampler->lock);
+    pthread_cond_destroy(&sampler->changed);
+  }
+  for(int i = 0;sampler->batches && i<sampler->batch_count;i++){
+    if(sampler->batches[i].data){
+      cxi_frame_pool_put(sampler->pool, sampler->batches[i].data);
+    }
+    free(sampler->batches[i].frames);
+  }
+  cxi_free_frame_pool(sampler->pool);
+  free(sampler->batches);
+  free(sampler->ready);
+  free(sampler->free_batches);
+  free(sampler->window);
+  free(sampler->window_frames);
+  free(sampler->order);
+  free(sampler->units);
+  free(sampler);
+}
@@ -0,0 +1,255 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Pixels per chunk of the index and value arrays */
+#define CXI_SPARSE_CHUNK 65536
+
+/* Creates an empty one dimensional dataset that can grow without limit */
+static hid_t create_growing_dataset(hid_t loc, const char * name, hid_t type, hsize_t chunk){
+  hsize_t dims[1] = {0};
+  hsize_t maxdims[1] = {H5S_UNLIMITED};
+  hid_t space = H5Screate_simple(1, dims, maxdims);
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(plist, 1, &chunk);
+  hid_t ds = H5Dcreate(loc, name, type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Pclose(plist);
+  H5Sclose(space);
+  return ds;
+}
+
+/* Appends n elements at position start of a growing dataset */
+static int append_to_dataset(hid_t ds, hsize_t start, hsize_t n, hid_t type, const void * data){
+  if(n == 0){
+    return 0;
+  }
+  hsize_t size[1] = {start+n};
+  if(H5Dset_extent(ds, size) < 0){
+    return -1;
+  }
+  hid_t s = H5Dget_space(ds);
+  hsize_t offset[1] = {start};
+  hsize_t count[1] = {n};
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, offset, NULL, count, NULL);
+  hid_t memspace = H5Screate_simple(1, count, NULL);
+  herr_t status = H5Dwrite(ds, type, memspace, s, H5P_DEFAULT, data);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+static int read_from_dataset(hid_t ds, hsize_t start, hsize_t n, hid_t type, void * data){
+  if(n == 0){
+    return 0;
+  }
+  hid_t s = H5Dget_space(ds);
+  hsize_t offset[1] = {start};
+  hsize_t count[1] = {n};
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, offset, NULL, count, NULL);
+  hid_t memspace = H5Screate_simple(1, count, NULL);
+  herr_t status = H5Dread(ds, type, memspace, s, H5P_DEFAULT, data);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+CXI_Sparse_Frames * cxi_create_sparse_frames(hid_t loc, const char * name,
+					     hsize_t rows, hsize_t cols){
+  CXI_TRACE();
+  if(loc < 0 || !name || rows == 0 || cols == 0 || rows*cols > UINT32_MAX){
+    return NULL;
+  }
+  CXI_Sparse_Frames * s = calloc(sizeof(CXI_Sparse_Frames),1);
+  if(!s){
+    return NULL;
+  }
+  s->frame_dimensions[0] = rows;
+  s->frame_dimensions[1] = cols;
+  s->handle = H5Gcreate(loc, name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  if(s->handle < 0){
+    free(s);
+    return NULL;
+  }
+  hsize_t dims[1] = {2};
+  hid_t space = H5Screate_simple(1, dims, NULL);
+  hid_t ds = H5Dcreate(s->handle, "frame_dimensions", H5T_NATIVE_HSIZE, space,
+		       H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+  H5Dwrite(ds, H5T_NATIVE_HSIZE, H5S_ALL, H5S_ALL, H5P_DEFAULT, s->frame_dimensions);
+  H5Dclose(ds);
+  H5Sclose(space);
+  s->offsets = create_growing_dataset(s->handle, "frame_offsets", H5T_NATIVE_HSIZE, 1024);
+  s->indices = create_growing_dataset(s->handle, "pixel_index", H5T_NATIVE_UINT32, CXI_SPARSE_CHUNK);
+  s->values = create_growing_dataset(s->handle, "pixel_value", H5T_NATIVE_FLOAT, CXI_SPARSE_CHUNK);
+  s->frame_offsets = calloc(sizeof(hsize_t),1);
+  s->offsets_capacity = 1;
+  if(s->offsets < 0 || s->indices < 0 || s->values < 0 || !s->frame_offsets ||
+     append_to_dataset(s->offsets, 0, 1, H5T_NATIVE_HSIZE, s->frame_offsets)){
+    cxi_close_sparse_frames(s);
+    return NULL;
+  }
+  return s;
+}
+
+int cxi_append_sparse_pixels(CXI_Sparse_Frames * s, const uint32_t * index,
+			     const float * value, hsize_t n){
+  if(!s || (n && (!index || !value))){
+    return -1;
+  }
+  if(s->frame_count+2 > s->offsets_capacity){
+    hsize_t capacity = 2*s->offsets_capacity;
+    hsize_t * offsets = realloc(s->frame_offsets, sizeof(hsize_t)*capacity);
+    if(!offsets){
+      return -1;
+    }
+    s->frame_offsets = offsets;
+    s->offsets_capacity = capacity;
+  }
+  hsize_t start = s->frame_offsets[s->frame_count];
+  if(append_to_dataset(s->indices, start, n, H5T_NATIVE_UINT32, index) ||
+     append_to_dataset(s->values, start, n, H5T_NATIVE_FLOAT, value)){
+    return -1;
+  }
+  s->frame_offsets[s->frame_count+1] = start+n;
+  /* The offsets go last so readers never see a frame with missing pixels */
+  if(append_to_dataset(s->offsets, s->frame_count+1, 1, H5T_NATIVE_HSIZE,
+		       &s->frame_offsets[s->frame_count+1])){
+    return -1;
+  }
+  s->frame_count++;
+  return 0;
+}
+
+int cxi_append_sparse_frame(CXI_Sparse_Frames * s, const float * frame, float threshold){
+  if(!s || !frame){
+    return -1;
+  }
+  hsize_t npixels = s->frame_dimensions[0]*s->frame_dimensions[1];
+  hsize_t n = 0;
+  for(hsize_t i = 0;i<npixels;i++){
+    n += frame[i] > threshold;
+  }
+  uint32_t * index = malloc(sizeof(uint32_t)*(n ? n : 1));
+  float * value = malloc(sizeof(float)*(n ? n : 1));
+  if(!index || !value){
+    free(index);
+    free(value);
+    return -1;
+  }
+  n = 0;
+  for(hsize_t i = 0;i<npixels;i++){
+    if(frame[i] > threshold){
+      index[n] = i;
+      value[n] = frame[i];
+      n++;
+    }
+  }
+  int ret = cxi_append_sparse_pixels(s, index, value, n);
+  free(index);
+  free(value);
+  return ret;
+}
+
+CXI_Sparse_Frames * cxi_open_sparse_frames(hid_t loc, const char * name){
+  CXI_TRACE();
+  if(loc < 0 || !name || !H5Lexists(loc, name, H5P_DEFAULT)){
+    return NULL;
+  }
+  CXI_Sparse_Frames * s = calloc(sizeof(CXI_Sparse_Frames),1);
+  if(!s){
+    return NULL;
+  }
+  s->handle = H5Gopen(loc, name, H5P_DEFAULT);
+  if(s->handle < 0){
+    free(s);
+    return NULL;
+  }
+  s->offsets = H5Dopen(s->handle, "frame_offsets", H5P_DEFAULT);
+  s->indices = H5Dopen(s->handle, "pixel_index", H5P_DEFAULT);
+  s->values = H5Dopen(s->handle, "pixel_value", H5P_DEFAULT);
+  hid_t ds = H5Dopen(s->handle, "frame_dimensions", H5P_DEFAULT);
+  if(s->offsets < 0 || s->indices < 0 || s->values < 0 || ds < 0 ||
+     H5Dread(ds, H5T_NATIVE_HSIZE, H5S_ALL, H5S_ALL, H5P_DEFAULT, s->frame_dimensions) < 0){
+    if(ds >= 0){
+      H5Dclose(ds);
+    }
+    cxi_close_sparse_frames(s);
+    return NULL;
+  }
+  H5Dclose(ds);
+  /* Keep the whole offsets table in memory, it is small and every read needs it */
+  hid_t space = H5Dget_space(s->offsets);
+  hsize_t n = 0;
+  H5Sget_simple_extent_dims(space, &n, NULL);
+  H5Sclose(space);
+  s->frame_offsets = malloc(sizeof(hsize_t)*(n ? n : 1));
+  s->offsets_capacity = n ? n : 1;
+  if(!s->frame_offsets || n == 0 ||
+     H5Dread(s->offsets, H5T_NATIVE_HSIZE, H5S_ALL, H5S_ALL, H5P_DEFAULT, s->frame_offsets) < 0){
+    cxi_close_sparse_frames(s);
+    return NULL;
+  }
+  s->frame_count = n-1;
+  return s;
+}
+
+int cxi_read_sparse_frames(CXI_Sparse_Frames * s, hsize_t first, hsize_t n,
+			   float * dense, float fill){
+  CXI_TRACE();
+  if(!s || !dense || first+n > s->frame_count){
+    return -1;
+  }
+  hsize_t npixels = s->frame_dimensions[0]*s->frame_dimensions[1];
+  hsize_t start = s->frame_offsets[first];
+  hsize_t count = s->frame_offsets[first+n]-start;
+  uint32_t * index = malloc(sizeof(uint32_t)*(count ? count : 1));
+  float * value = malloc(sizeof(float)*(count ? count : 1));
+  /* All the frames are fetched with a single read of each array */
+  if(!index || !value ||
+     read_from_dataset(s->indices, start, count, H5T_NATIVE_UINT32, index) ||
+     read_from_dataset(s->values, start, count, H5T_NATIVE_FLOAT, value)){
+    free(index);
+    free(value);
+    return -1;
+  }
+  for(hsize_t i = 0;i<n*npixels;i++){
+    dense[i] = fill;
+  }
+  for(hsize_t f = 0;f<n;f++){
+    float * out = dense + f*npixels;
+    hsize_t end = s->frame_offsets[first+f+1]-start;
+    for(hsize_t k = s->frame_offsets[first+f]-start;k<end;k++){
+      if(index[k] < npixels){
+	out[index[k]] = value[k];
+      }
+    }
+  }
+  free(index);
+  free(value);
+  return 0;
+}
+
+int cxi_read_sparse_frame(CXI_Sparse_Frames * s, hsize_t frame, float * dense, float fill){
+  CXI_TRACE();
+  return cxi_read_sparse_frames(s, frame, 1, dense, fill);
+}
+
+void cxi_close_sparse_frames(CXI_Sparse_Frames * s){
+  if(!s){
+    return;
+  }
+  if(s->offsets > 0){
+    H5Dclose(s->offsets);
+  }
+  if(s->indices > 0){
+    H5Dclose(s->indices);
+  }
+  if(s->values > 0){
+    H5Dclose(s->values);
+  }
+  if(s->handle > 0){
+    H5Gclose(s->handle);
+  }
+  free(s->frame_offsets);
+  free(s);
+}
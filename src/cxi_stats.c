@@ -0,0 +1,150 @@
+#include <string.h>
+#include <time.h>
+#include "cxi_private.h"
+
+/* Counters are bumped from whatever thread does the I/O, relaxed atomics
+   are enough as nobody orders anything on them */
+#define STATS_ADD(field, v) __atomic_fetch_add(&(field), (v), __ATOMIC_RELAXED)
+#define STATS_FIELDS (sizeof(CXI_Stats)/sizeof(uint64_t))
+
+static CXI_Stats process_stats;
+
+uint64_t cxi_stats_now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000u + ts.tv_nsec;
+}
+
+void cxi_stats_call(CXI_Stats * file_stats){
+  STATS_ADD(process_stats.hdf5_calls, 1);
+  if(file_stats){
+    STATS_ADD(file_stats->hdf5_calls, 1);
+  }
+}
+
+void cxi_stats_open(CXI_Arena * arena, uint64_t begin){
+  uint64_t ns = cxi_stats_now()-begin;
+  CXI_Stats * file_stats = cxi_arena_stats(arena);
+  STATS_ADD(process_stats.opens, 1);
+  STATS_ADD(process_stats.open_ns, ns);
+  if(file_stats){
+    STATS_ADD(file_stats->opens, 1);
+    STATS_ADD(file_stats->open_ns, ns);
+  }
+}
+
+void cxi_dataset_init_io(CXI_Dataset * dataset, CXI_Stats * file_stats){
+  memset(&dataset->stats, 0, sizeof(CXI_Stats));
+  dataset->file_stats = file_stats;
+  dataset->chunk_slices = cxi_dataset_chunk_slices(dataset);
+  dataset->filtered = 0;
+  dataset->last_chunk = 0;
+  dataset->raw_chunks = 0;
+  if(dataset->chunk_slices){
+    hid_t plist = H5Dget_create_plist(dataset->handle);
+    if(plist >= 0){
+      dataset->filtered = H5Pget_nfilters(plist) > 0;
+      hsize_t chunk[H5S_MAX_RANK];
+      if(!dataset->filtered && dataset->dimension_count <= H5S_MAX_RANK &&
+	 H5Pget_chunk(plist, dataset->dimension_count, chunk) == dataset->dimension_count){
+	dataset->raw_chunks = 1;
+	for(int i = 1;i<dataset->dimension_count;i++){
+	  dataset->raw_chunks = dataset->raw_chunks && chunk[i] == dataset->dimensions[i];
+	}
+      }
+      H5Pclose(plist);
+    }
+  }
+}
+
+static void add_io(CXI_Stats * s, int write, uint64_t bytes, uint64_t ns,
+		   int converted, int filtered, uint64_t hits, uint64_t misses){
+  STATS_ADD(s->hdf5_calls, 1);
+  if(write){
+    STATS_ADD(s->writes, 1);
+    STATS_ADD(s->bytes_written, bytes);
+    STATS_ADD(s->write_ns, ns);
+  }else{
+    STATS_ADD(s->reads, 1);
+    STATS_ADD(s->bytes_read, bytes);
+    STATS_ADD(s->read_ns, ns);
+  }
+  if(converted){
+    STATS_ADD(s->conversions, 1);
+    STATS_ADD(s->convert_ns, ns);
+  }
+  if(filtered){
+    STATS_ADD(s->decompress_ns, ns);
+  }
+  if(hits){
+    STATS_ADD(s->chunk_cache_hits, hits);
+  }
+  if(misses){
+    STATS_ADD(s->chunk_cache_misses, misses);
+  }
+}
+
+void cxi_stats_io(CXI_Dataset * dataset, int write, hid_t mem_type, int converted,
+		  hsize_t first, hsize_t n, uint64_t begin){
+  uint64_t ns = cxi_stats_now()-begin;
+  uint64_t bytes = H5Tget_size(mem_type)*n;
+  for(int i = 1;i<dataset->dimension_count;i++){
+    bytes *= dataset->dimensions[i];
+  }
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  if(dataset->chunk_slices && n){
+    /* HDF5 keeps the most recently used chunks around, so a chunk is
+       only expected to be cached if the previous access touched it */
+    hsize_t begin_chunk = first/dataset->chunk_slices;
+    hsize_t end_chunk = (first+n-1)/dataset->chunk_slices;
+    hsize_t last = __atomic_exchange_n(&dataset->last_chunk, end_chunk+1, __ATOMIC_RELAXED);
+    misses = end_chunk-begin_chunk+1;
+    if(last == begin_chunk+1){
+      hits = 1;
+      misses--;
+    }
+  }
+  add_io(&process_stats, write, bytes, ns, converted, dataset->filtered, hits, misses);
+  add_io(&dataset->stats, write, bytes, ns, converted, dataset->filtered, hits, misses);
+  if(dataset->file_stats){
+    add_io(dataset->file_stats, write, bytes, ns, converted, dataset->filtered, hits, misses);
+  }
+}
+
+void cxi_stats_raw_copy(CXI_Dataset * dataset, uint64_t chunks){
+  STATS_ADD(process_stats.raw_chunk_copies, chunks);
+  STATS_ADD(dataset->stats.raw_chunk_copies, chunks);
+  if(dataset->file_stats){
+    STATS_ADD(dataset->file_stats->raw_chunk_copies, chunks);
+  }
+}
+
+static CXI_Stats * select_stats(CXI_File * file, CXI_Dataset * dataset){
+  if(dataset){
+    return &dataset->stats;
+  }
+  if(file){
+    return &file->stats;
+  }
+  return &process_stats;
+}
+
+int cxi_get_stats(CXI_File * file, CXI_Dataset * dataset, CXI_Stats * stats){
+  if(!stats){
+    return -1;
+  }
+  uint64_t * from = (uint64_t *)select_stats(file, dataset);
+  uint64_t * to = (uint64_t *)stats;
+  for(size_t i = 0;i<STATS_FIELDS;i++){
+    to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+  }
+  return 0;
+}
+
+void cxi_reset_stats(CXI_File * file, CXI_Dataset * dataset){
+  uint64_t * s = (uint64_t *)select_stats(file, dataset);
+  for(size_t i = 0;i<STATS_FIELDS;i++){
+    __atomic_store_n(&s[i], 0, __ATOMIC_RELAXED);
+  }
+}
@@ -0,0 +1,517 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Default chunk size, big enough for HDF5's per chunk costs not to matter */
+#define CXI_STREAM_CHUNK_BYTES (4*1024*1024)
+
+/* Closes what open_next_file() managed to create, leaving the stream without a file */
+static int abandon_next_file(CXI_Frame_Stream * s){
+  if(s->table){
+    cxi_close_frame_table(s->table);
+    s->table = NULL;
+  }
+  cxi_close_file(s->file);
+  s->file = NULL;
+  s->dataset = NULL;
+  return -1;
+}
+
+/* Creates the groups and the growing data of the next file, all of them
+   tracked by the file so that closing it closes everything */
+static int open_next_file(CXI_Frame_Stream * s){
+  s->file_count++;
+  sprintf(s->filename,"%s_%04d.cxi",s->prefix,s->file_count);
+  s->file = cxi_open_file(s->filename,"w");
+  if(!s->file){
+    return -1;
+  }
+  CXI_Arena * arena = s->file->arena;
+  CXI_Entry * entry = cxi_arena_calloc(arena, sizeof(CXI_Entry), 1);
+  CXI_Data * data = cxi_arena_calloc(arena, sizeof(CXI_Data), 1);
+  CXI_Dataset * dataset = cxi_arena_calloc(arena, sizeof(CXI_Dataset), 1);
+  int rank = s->frame_rank+1;
+  hsize_t * dims = cxi_arena_calloc(arena, sizeof(hsize_t), rank);
+  if(!entry || !data || !dataset || !dims){
+    return abandon_next_file(s);
+  }
+  CXI_Entry_Reference * entry_ref = cxi_create_entry(s->file->handle, entry);
+  if(!entry_ref){
+    return abandon_next_file(s);
+  }
+  cxi_arena_track(arena, entry->handle);
+  free(entry_ref->group_name);
+  free(entry_ref);
+  CXI_Data_Reference * data_ref = cxi_create_data(entry->handle, data);
+  if(!data_ref){
+    return abandon_next_file(s);
+  }
+  cxi_arena_track(arena, data->handle);
+  free(data_ref->group_name);
+  free(data_ref);
+
+  hsize_t maxdims[H5S_MAX_RANK];
+  hsize_t chunk[H5S_MAX_RANK];
+  dims[0] = 0;
+  maxdims[0] = H5S_UNLIMITED;
+  chunk[0] = s->options.chunk_frames;
+  for(int i = 1;i<rank;i++){
+    dims[i] = maxdims[i] = chunk[i] = s->frame_dimensions[i-1];
+  }
+  hid_t space = H5Screate_simple(rank, dims, maxdims);
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(plist, rank, chunk);
+  if(s->options.deflate_level > 0){
+    H5Pset_shuffle(plist);
+    H5Pset_deflate(plist, s->options.deflate_level);
+  }
+  dataset->handle = cxi_arena_track(arena, H5Dcreate(data->handle, "data", s->data_type, space,
+						     H5P_DEFAULT, plist, H5P_DEFAULT));
+  H5Pclose(plist);
+  H5Sclose(space);
+  if(dataset->handle < 0){
+    return abandon_next_file(s);
+  }
+  if(s->options.column_count){
+    s->table = cxi_create_frame_table(data->handle, "events", s->options.columns,
+				      s->options.column_count, 0);
+    if(!s->table){
+      return abandon_next_file(s);
+    }
+  }
+  dataset->dimension_count = rank;
+  dataset->dimensions = dims;
+  dataset->data_type = s->data_type;
+  dataset->arena = arena;
+  cxi_dataset_init_io(dataset, &s->file->stats);
+  s->dataset = dataset;
+  s->file_frames = 0;
+  /* HDF5 only writes out the end of the file when it flushes, so the
+     size is followed here, counting chunks before compression */
+  s->file_bytes = 0;
+  H5Fget_filesize(s->file->handle, &s->file_bytes);
+  return 0;
+}
+
+/* Grows the data of the current file by n frames and writes them */
+static int store(CXI_Frame_Stream * s, const void * frames, hsize_t n, hid_t mem_type){
+  CXI_Dataset * dataset = s->dataset;
+  hsize_t first = dataset->dimensions[0];
+  hsize_t size[H5S_MAX_RANK];
+  memcpy(size, dataset->dimensions, sizeof(hsize_t)*dataset->dimension_count);
+  size[0] = first+n;
+  if(H5Dset_extent(dataset->handle, size) < 0){
+    return -1;
+  }
+  dataset->dimensions[0] = first+n;
+  s->file_bytes += n*s->frame_bytes;
+  uint64_t begin = cxi_stats_now();
+  int converts = cxi_dataset_converts(dataset, mem_type);
+  if(!converts && cxi_write_raw_chunks(dataset, first, n, frames) == 0){
+    cxi_stats_io(dataset, 1, mem_type, converts, first, n, begin);
+    return 0;
+  }
+  hsize_t start[H5S_MAX_RANK];
+  memset(start, 0, sizeof(start));
+  start[0] = first;
+  size[0] = n;
+  hid_t s_file = H5Dget_space(dataset->handle);
+  H5Sselect_hyperslab(s_file, H5S_SELECT_SET, start, NULL, size, NULL);
+  hid_t memspace = H5Screate_simple(dataset->dimension_count, size, NULL);
+  herr_t status = H5Dwrite(dataset->handle, mem_type, memspace, s_file, dataset->transfer_plist, frames);
+  cxi_stats_io(dataset, 1, mem_type, converts, first, n, begin);
+  H5Sclose(memspace);
+  H5Sclose(s_file);
+  return status < 0 ? -1 : 0;
+}
+
+static int flush_pending(CXI_Frame_Stream * s){
+  if(!s->pending_frames){
+    return 0;
+  }
+  int ret = store(s, s->pending, s->pending_frames, s->data_type);
+  s->pending_frames = 0;
+  return ret;
+}
+
+/* The parts are referred to by their name alone, which HDF5 looks up
+   next to the master file */
+static const char * part_name(CXI_Frame_Stream * s, int part, char * buffer){
+  sprintf(buffer,"%s_%04d.cxi",s->prefix,part+1);
+  const char * slash = strrchr(buffer,'/');
+  return slash ? slash+1 : buffer;
+}
+
+static int create_master(CXI_Frame_Stream * s){
+  CXI_File * file = cxi_open_file(s->master_filename,"w");
+  if(!file){
+    return -1;
+  }
+  CXI_Entry entry;
+  CXI_Data data;
+  memset(&entry, 0, sizeof(entry));
+  memset(&data, 0, sizeof(data));
+  CXI_Entry_Reference * entry_ref = cxi_create_entry(file->handle, &entry);
+  CXI_Data_Reference * data_ref = entry_ref ? cxi_create_data(entry.handle, &data) : NULL;
+  int ret = data_ref ? 0 : -1;
+  if(data_ref){
+    /* The links the virtual dataset follows, named by the part's index from 0 */
+    hid_t parts = H5Gcreate(data.handle, "parts", H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    if(parts < 0){
+      ret = -1;
+    }else{
+      H5Gclose(parts);
+    }
+    H5Gclose(data.handle);
+    free(data_ref->group_name);
+    free(data_ref);
+  }
+  if(entry_ref){
+    H5Gclose(entry.handle);
+    free(entry_ref->group_name);
+    free(entry_ref);
+  }
+  if(cxi_close_file(file)){
+    ret = -1;
+  }
+  return ret;
+}
+
+/* The virtual dataset of the master over every finished part, one after the
+   other. With block frames per part it maps the links parts/0, parts/1... by
+   pattern instead, so that HDF5 picks up the parts linked later. */
+static hid_t create_master_data(CXI_Frame_Stream * s, hid_t group, hsize_t block){
+  int rank = s->frame_rank+1;
+  hsize_t dims[H5S_MAX_RANK];
+  hsize_t maxdims[H5S_MAX_RANK];
+  hsize_t start[H5S_MAX_RANK];
+  memset(start, 0, sizeof(start));
+  dims[0] = 0;
+  for(int p = 0;!block && p<s->part_count;p++){
+    dims[0] += s->part_frames[p];
+  }
+  maxdims[0] = block ? H5S_UNLIMITED : dims[0];
+  for(int i = 1;i<rank;i++){
+    dims[i] = maxdims[i] = s->frame_dimensions[i-1];
+  }
+  hid_t space = H5Screate_simple(rank, dims, maxdims);
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  int ret = 0;
+  if(block){
+    hsize_t stride[H5S_MAX_RANK];
+    hsize_t count[H5S_MAX_RANK];
+    for(int i = 0;i<rank;i++){
+      stride[i] = 1;
+      count[i] = 1;
+    }
+    stride[0] = block;
+    count[0] = H5S_UNLIMITED;
+    dims[0] = block;
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, start, stride, count, dims);
+    hid_t source = H5Screate_simple(rank, dims, NULL);
+    if(H5Pset_virtual(plist, space, ".", "/entry_1/data_1/parts/%b", source) < 0){
+      ret = -1;
+    }
+    H5Sclose(source);
+  }
+  char * buffer = malloc(strlen(s->prefix)+32);
+  for(int p = 0;!block && p<s->part_count;p++){
+    if(!s->part_frames[p]){
+      continue;
+    }
+    dims[0] = s->part_frames[p];
+    hid_t source = H5Screate_simple(rank, dims, NULL);
+    H5Sselect_hyperslab(space, H5S_SELECT_SET, start, NULL, dims, NULL);
+    if(H5Pset_virtual(plist, space, part_name(s, p, buffer), "/entry_1/data_1/data", source) < 0){
+      ret = -1;
+    }
+    H5Sclose(source);
+    start[0] += dims[0];
+  }
+  free(buffer);
+  H5Sselect_all(space);
+  hid_t ds = ret ? -1 : H5Dcreate(group, "data", s->data_type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Pclose(plist);
+  H5Sclose(space);
+  return ds;
+}
+
+/* Links the parts finished since the last update from the master. While they
+   all have as many frames its virtual dataset is created once and follows the
+   links by itself, otherwise, as for a shorter last part, it is replaced with
+   one listing every part. The master is opened without file locks, which
+   readers holding it open would otherwise make fail. */
+static int update_master(CXI_Frame_Stream * s){
+  hid_t fapl = H5Pcreate(H5P_FILE_ACCESS);
+#if H5_VERSION_GE(1,10,7)
+  H5Pset_file_locking(fapl, 0, 1);
+#endif
+  hid_t file = H5Fopen(s->master_filename, H5F_ACC_RDWR, fapl);
+  H5Pclose(fapl);
+  if(file < 0){
+    return -1;
+  }
+  hid_t group = H5Gopen(file, "entry_1/data_1", H5P_DEFAULT);
+  if(group < 0){
+    H5Fclose(file);
+    return -1;
+  }
+  char * buffer = malloc(strlen(s->prefix)+32);
+  char link[32];
+  int ret = buffer ? 0 : -1;
+  for(int p = s->master_parts;!ret && p<s->part_count;p++){
+    const char * name = part_name(s, p, buffer);
+    sprintf(link,"part_%04d",p+1);
+    if(H5Lexists(group, link, H5P_DEFAULT) <= 0 &&
+       H5Lcreate_external(name, "/entry_1/data_1/data", group, link, H5P_DEFAULT, H5P_DEFAULT) < 0){
+      ret = -1;
+    }
+    sprintf(link,"parts/%d",p);
+    if(!ret && H5Lexists(group, link, H5P_DEFAULT) <= 0 &&
+       H5Lcreate_external(name, "/entry_1/data_1/data", group, link, H5P_DEFAULT, H5P_DEFAULT) < 0){
+      ret = -1;
+    }
+    if(!ret){
+      s->master_parts = p+1;
+    }
+  }
+  free(buffer);
+  hsize_t block = s->part_frames[0];
+  for(int p = 1;p<s->part_count;p++){
+    if(s->part_frames[p] != block){
+      block = 0;
+    }
+  }
+  if(!ret && (!block || block != s->master_block)){
+    if(H5Lexists(group, "data", H5P_DEFAULT) > 0){
+      H5Ldelete(group, "data", H5P_DEFAULT);
+    }
+    hid_t ds = create_master_data(s, group, block);
+    if(ds < 0){
+      ret = -1;
+    }else{
+      H5Dclose(ds);
+      s->master_block = block;
+    }
+  }
+  H5Gclose(group);
+  if(H5Fclose(file) < 0){
+    ret = -1;
+  }
+  return ret;
+}
+
+/* Finishes the file being written. Unless it is the last one a master that
+   cannot be updated is left for the next file to catch up. */
+static int close_current_file(CXI_Frame_Stream * s, int last){
+  if(!s->file){
+    return 0;
+  }
+  int ret = flush_pending(s);
+  hsize_t frames = s->dataset ? s->dataset->dimensions[0] : 0;
+  if(s->table && s->options.index_column &&
+     (cxi_flush_frame_table(s->table) || cxi_build_frame_index(s->table->handle, s->options.index_column))){
+    ret = -1;
+  }
+  if(s->table && cxi_close_frame_table(s->table)){
+    ret = -1;
+  }
+  s->table = NULL;
+  if(cxi_close_file(s->file)){
+    ret = -1;
+  }
+  s->file = NULL;
+  s->dataset = NULL;
+  if(s->master_filename){
+    hsize_t * part_frames = realloc(s->part_frames, sizeof(hsize_t)*(s->part_count+1));
+    if(!part_frames){
+      return -1;
+    }
+    s->part_frames = part_frames;
+    s->part_frames[s->part_count++] = frames;
+    if(update_master(s)){
+      if(last){
+	ret = -1;
+      }else{
+	cxi_warning("Could not update %s, trying again after the next file", s->master_filename);
+      }
+    }
+  }
+  return ret;
+}
+
+/* Only asked between chunks, so that files never split one */
+static int file_is_full(CXI_Frame_Stream * s){
+  if(s->file_frames == 0){
+    return 0;
+  }
+  if(s->options.max_file_frames && s->file_frames >= s->options.max_file_frames){
+    return 1;
+  }
+  if(s->options.max_file_bytes){
+    return s->file_bytes + s->options.chunk_frames*s->frame_bytes > s->options.max_file_bytes;
+  }
+  return 0;
+}
+
+/* How many more frames the current file takes. A size limit is rounded down
+   to whole chunks, but always leaves room to finish the current chunk or,
+   in an empty file, for one chunk. */
+static hsize_t file_room(CXI_Frame_Stream * s){
+  hsize_t room = (hsize_t)-1;
+  if(s->options.max_file_frames){
+    room = s->options.max_file_frames-s->file_frames;
+  }
+  if(s->options.max_file_bytes && s->frame_bytes){
+    hsize_t chunk = s->options.chunk_frames;
+    hsize_t stored = s->file_frames-s->pending_frames;
+    hsize_t fit = s->options.max_file_bytes > s->file_bytes ?
+      (s->options.max_file_bytes-s->file_bytes)/s->frame_bytes : 0;
+    hsize_t limit = (stored+fit)/chunk*chunk;
+    hsize_t least = (s->file_frames/chunk+1)*chunk;
+    limit = limit > least ? limit : least;
+    room = room < limit-s->file_frames ? room : limit-s->file_frames;
+  }
+  return room;
+}
+
+CXI_Frame_Stream * cxi_create_frame_stream(const char * prefix, int frame_rank,
+					   const hsize_t * frame_dimensions, hid_t data_type,
+					   const CXI_Stream_Options * options){
+  CXI_TRACE();
+  if(!prefix || frame_rank < 0 || frame_rank >= H5S_MAX_RANK || (frame_rank && !frame_dimensions) ||
+     H5Tget_size(data_type) == 0){
+    return NULL;
+  }
+  CXI_Frame_Stream * s = calloc(sizeof(CXI_Frame_Stream),1);
+  if(!s){
+    return NULL;
+  }
+  if(options){
+    s->options = *options;
+  }
+  s->frame_rank = frame_rank;
+  s->frame_bytes = H5Tget_size(data_type);
+  for(int i = 0;i<frame_rank;i++){
+    s->frame_dimensions[i] = frame_dimensions[i];
+    s->frame_bytes *= frame_dimensions[i];
+  }
+  if(!s->options.chunk_frames){
+    s->options.chunk_frames = s->frame_bytes && s->frame_bytes < CXI_STREAM_CHUNK_BYTES ?
+      CXI_STREAM_CHUNK_BYTES/s->frame_bytes : 1;
+  }
+  if(s->options.max_file_frames && s->options.max_file_frames < s->options.chunk_frames){
+    s->options.chunk_frames = s->options.max_file_frames;
+  }
+  s->data_type = data_type;
+  s->prefix = cxi_arena_strdup(NULL, prefix);
+  s->filename = malloc(strlen(prefix)+32);
+  if(s->options.master && s->filename){
+    s->master_filename = malloc(strlen(prefix)+5);
+    if(s->master_filename){
+      sprintf(s->master_filename,"%s.cxi",prefix);
+    }
+    if(!s->master_filename || create_master(s)){
+      cxi_close_frame_stream(s);
+      return NULL;
+    }
+  }
+  if(!s->prefix || !s->filename || open_next_file(s)){
+    cxi_close_frame_stream(s);
+    return NULL;
+  }
+  s->pool = cxi_create_frame_pool(s->dataset, data_type, s->options.chunk_frames, 1, CXI_Pool_Page_Aligned);
+  s->pending = cxi_frame_pool_get(s->pool);
+  if(!s->pending){
+    cxi_close_frame_stream(s);
+    return NULL;
+  }
+  return s;
+}
+
+static int append(CXI_Frame_Stream * s, const void * frames, hsize_t n, hid_t mem_type,
+		  const void * const * values){
+  hsize_t done = 0;
+  int same = H5Tequal(mem_type, s->data_type) > 0;
+  size_t mem_frame_bytes = s->frame_bytes/H5Tget_size(s->data_type)*H5Tget_size(mem_type);
+  hsize_t chunk = s->options.chunk_frames;
+  const char * src = frames;
+  while(n){
+    if(s->pending_frames == 0 && file_is_full(s)){
+      /* The next file is opened even if this one did not close cleanly */
+      int ret = close_current_file(s, 0);
+      if(open_next_file(s) || ret){
+	return -1;
+      }
+    }
+    hsize_t room = file_room(s);
+    room = room < n ? room : n;
+    hsize_t k;
+    if(!same){
+      /* HDF5 converts into its own buffer, ours would only add a copy */
+      k = n < room ? n : room;
+      if(flush_pending(s) || store(s, src, k, mem_type)){
+	return -1;
+      }
+    }else if(s->pending_frames == 0 && n >= chunk && room >= chunk){
+      /* Whole chunks go straight from the caller's buffer */
+      k = (n < room ? n : room)/chunk*chunk;
+      if(store(s, src, k, mem_type)){
+	return -1;
+      }
+    }else{
+      k = chunk-s->pending_frames;
+      k = k < n ? k : n;
+      k = k < room ? k : room;
+      memcpy((char *)s->pending+s->pending_frames*s->frame_bytes, src, k*s->frame_bytes);
+      s->pending_frames += k;
+      if((s->pending_frames == chunk || k == room) && flush_pending(s)){
+	return -1;
+      }
+    }
+    /* The rows follow the frames into the same file */
+    if(s->table && cxi_frame_table_append(s->table, values, done, k)){
+      return -1;
+    }
+    src += k*mem_frame_bytes;
+    n -= k;
+    done += k;
+    s->file_frames += k;
+    s->frame_count += k;
+  }
+  return 0;
+}
+
+int cxi_append_frames(CXI_Frame_Stream * stream, const void * frames, hsize_t n, hid_t mem_type){
+  CXI_TRACE();
+  if(!stream || !stream->file || (n && !frames)){
+    return -1;
+  }
+  return append(stream, frames, n, mem_type, NULL);
+}
+
+int cxi_append_frames_with_values(CXI_Frame_Stream * stream, const void * frames, hsize_t n,
+				  hid_t mem_type, const void * const * values){
+  CXI_TRACE();
+  if(!stream || !stream->file || (n && (!frames || !values))){
+    return -1;
+  }
+  return append(stream, frames, n, mem_type, values);
+}
+
+int cxi_close_frame_stream(CXI_Frame_Stream * stream){
+  if(!stream){
+    return -1;
+  }
+  int ret = close_current_file(stream, 1);
+  cxi_frame_pool_put(stream->pool, stream->pending);
+  cxi_free_frame_pool(stream->pool);
+  free(stream->prefix);
+  free(stream->filename);
+  free(stream->master_filename);
+  free(stream->part_frames);
+  free(stream);
+  return ret;
+}
@@ -0,0 +1,79 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "cxi_private.h"
+
+typedef struct{
+  void (*fn)(hsize_t begin, hsize_t end, void * arg);
+  void * arg;
+  hsize_t begin;
+  hsize_t end;
+}Parallel_Range;
+
+static void * run_range(void * p){
+  Parallel_Range * r = p;
+  r->fn(r->begin, r->end, r->arg);
+  return NULL;
+}
+
+int cxi_default_thread_count(void){
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if(n < 1){
+    return 1;
+  }
+  return (int)n;
+}
+
+int cxi_hdf5_threadsafe(void){
+  hbool_t threadsafe = 0;
+  return H5is_library_threadsafe(&threadsafe) >= 0 && threadsafe;
+}
+
+void cxi_parallel_for(int nthreads, hsize_t n,
+		      void (*fn)(hsize_t begin, hsize_t end, void * arg), void * arg){
+  if(n == 0){
+    return;
+  }
+  if(nthreads <= 0){
+    nthreads = cxi_default_thread_count();
+  }
+  if((hsize_t)nthreads > n){
+    nthreads = n;
+  }
+  if(nthreads == 1){
+    fn(0, n, arg);
+    return;
+  }
+  Parallel_Range * ranges = malloc(sizeof(Parallel_Range)*nthreads);
+  pthread_t * threads = malloc(sizeof(pthread_t)*nthreads);
+  int * started = calloc(sizeof(int),nthreads);
+  if(!ranges || !threads || !started){
+    free(ranges);
+    free(threads);
+    free(started);
+    fn(0, n, arg);
+    return;
+  }
+  for(int i = 0;i<nthreads;i++){
+    ranges[i].fn = fn;
+    ranges[i].arg = arg;
+    ranges[i].begin = (n*i)/nthreads;
+    ranges[i].end = (n*(i+1))/nthreads;
+  }
+  for(int i = 1;i<nthreads;i++){
+    started[i] = (pthread_create(&threads[i], NULL, run_range, &ranges[i]) == 0);
+    if(!started[i]){
+      /* Couldn't get a thread, do the work ourselves */
+      run_range(&ranges[i]);
+    }
+  }
+  run_range(&ranges[0]);
+  for(int i = 1;i<nthreads;i++){
+    if(started[i]){
+      pthread_join(threads[i], NULL);
+    }
+  }
+  free(ranges);
+  free(threads);
+  free(started);
+}
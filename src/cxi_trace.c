@@ -0,0 +1,172 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "cxi_private.h"
+
+/* Each thread appends to its own list of chunks, so recording never
+ * takes a lock. The chunk lists are pushed once on a global stack when
+ * a thread records its first event, and the flush walks that stack,
+ * reading only the events whose count has been published.
+ */
+
+#define TRACE_CHUNK_EVENTS 4096
+
+typedef struct{
+  const char * name;
+  uint64_t ts;
+  char phase;
+}Trace_Event;
+
+typedef struct Trace_Chunk{
+  Trace_Event events[TRACE_CHUNK_EVENTS];
+  /* Published with release semantics once the event is complete */
+  size_t count;
+  struct Trace_Chunk * next;
+}Trace_Chunk;
+
+typedef struct Trace_Buffer{
+  Trace_Chunk * first;
+  /* Only touched by the owning thread */
+  Trace_Chunk * last;
+  int tid;
+  /* The events already written by a previous cxi_stop_trace() */
+  Trace_Chunk * flushed_chunk;
+  size_t flushed_count;
+  struct Trace_Buffer * next;
+}Trace_Buffer;
+
+static int trace_enabled = 0;
+static char * trace_filename = NULL;
+static uint64_t trace_origin = 0;
+static Trace_Buffer * trace_buffers = NULL;
+static int trace_thread_count = 0;
+static __thread Trace_Buffer * thread_buffer = NULL;
+
+static Trace_Buffer * new_buffer(void){
+  Trace_Buffer * b = calloc(sizeof(Trace_Buffer),1);
+  Trace_Chunk * c = calloc(sizeof(Trace_Chunk),1);
+  if(!b || !c){
+    free(b);
+    free(c);
+    return NULL;
+  }
+  b->first = c;
+  b->last = c;
+  b->flushed_chunk = c;
+  b->tid = __atomic_add_fetch(&trace_thread_count, 1, __ATOMIC_RELAXED);
+  b->next = __atomic_load_n(&trace_buffers, __ATOMIC_RELAXED);
+  while(!__atomic_compare_exchange_n(&trace_buffers, &b->next, b, 1,
+				     __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+  return b;
+}
+
+static void record(const char * name, char phase){
+  Trace_Buffer * b = thread_buffer;
+  if(!b){
+    b = thread_buffer = new_buffer();
+    if(!b){
+      return;
+    }
+  }
+  Trace_Chunk * c = b->last;
+  size_t n = c->count;
+  if(n == TRACE_CHUNK_EVENTS){
+    Trace_Chunk * next = calloc(sizeof(Trace_Chunk),1);
+    if(!next){
+      return;
+    }
+    __atomic_store_n(&c->next, next, __ATOMIC_RELEASE);
+    b->last = c = next;
+    n = 0;
+  }
+  c->events[n].name = name;
+  c->events[n].ts = cxi_stats_now();
+  c->events[n].phase = phase;
+  __atomic_store_n(&c->count, n+1, __ATOMIC_RELEASE);
+}
+
+CXI_Trace_Scope cxi_trace_begin(const char * name){
+  CXI_Trace_Scope scope = {NULL};
+  if(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)){
+    scope.name = name;
+    record(name, 'B');
+  }
+  return scope;
+}
+
+void cxi_trace_end(CXI_Trace_Scope * scope){
+  /* Calls that started while tracing was on are always closed */
+  if(scope->name){
+    record(scope->name, 'E');
+  }
+}
+
+int cxi_start_trace(const char * filename){
+  if(!filename || !filename[0]){
+    return -1;
+  }
+  if(__atomic_load_n(&trace_enabled, __ATOMIC_RELAXED)){
+    cxi_stop_trace();
+  }
+  char * copy = cxi_arena_strdup(NULL, filename);
+  if(!copy){
+    return -1;
+  }
+  free(trace_filename);
+  trace_filename = copy;
+  if(!trace_origin){
+    trace_origin = cxi_stats_now();
+  }
+  __atomic_store_n(&trace_enabled, 1, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int cxi_stop_trace(void){
+  if(!__atomic_exchange_n(&trace_enabled, 0, __ATOMIC_ACQ_REL) || !trace_filename){
+    return -1;
+  }
+  FILE * fp = fopen(trace_filename,"w");
+  if(!fp){
+    cxi_warning("Could not write trace to %s", trace_filename);
+    return -1;
+  }
+  int pid = getpid();
+  int first = 1;
+  fprintf(fp,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  for(Trace_Buffer * b = __atomic_load_n(&trace_buffers, __ATOMIC_ACQUIRE);b;b = b->next){
+    Trace_Chunk * c = b->flushed_chunk;
+    size_t i = b->flushed_count;
+    while(c){
+      size_t n = __atomic_load_n(&c->count, __ATOMIC_ACQUIRE);
+      for(;i<n;i++){
+	Trace_Event * e = &c->events[i];
+	fprintf(fp,"%s{\"name\":\"%s\",\"cat\":\"cxi\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d}",
+		first ? "" : ",\n", e->name, e->phase, (e->ts-trace_origin)*1e-3, pid, b->tid);
+	first = 0;
+      }
+      b->flushed_chunk = c;
+      b->flushed_count = n;
+      Trace_Chunk * next = __atomic_load_n(&c->next, __ATOMIC_ACQUIRE);
+      if(!next || n < TRACE_CHUNK_EVENTS){
+	break;
+      }
+      c = next;
+      i = 0;
+    }
+  }
+  fprintf(fp,"\n]}\n");
+  return fclose(fp) ? -1 : 0;
+}
+
+static void stop_trace_at_exit(void){
+  cxi_stop_trace();
+}
+
+/* Tracing can be turned on without touching the program */
+__attribute__((constructor)) static void trace_from_environment(void){
+  const char * filename = getenv("CXI_TRACE");
+  if(filename && filename[0] && cxi_start_trace(filename) == 0){
+    atexit(stop_trace_at_exit);
+  }
+}
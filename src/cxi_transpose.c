@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <string.h>
+#include "cxi.h"
+#include "cxi_private.h"
+
+/* Frames by pixels copied at a time, small enough for both sides to stay in L1 */
+#define CXI_TRANSPOSE_TILE 32
+/* The target size of the chunks of pixel-major datasets */
+#define CXI_TRANSPOSE_CHUNK_BYTES (1024*1024)
+/* Frames of the source transposed at a time */
+#define CXI_TRANSPOSE_BLOCK_BYTES (16*1024*1024)
+#define CXI_SERIES_BYTES (256*1024*1024)
+
+#define TRANSPOSE_TILES(T) {						\
+    const T * s = (const T *)src;					\
+    T * d = (T *)dst;							\
+    for(hsize_t f0 = 0;f0<frames;f0 += CXI_TRANSPOSE_TILE){		\
+      hsize_t f1 = f0+CXI_TRANSPOSE_TILE < frames ? f0+CXI_TRANSPOSE_TILE : frames; \
+      for(hsize_t p0 = 0;p0<pixels;p0 += CXI_TRANSPOSE_TILE){		\
+	hsize_t p1 = p0+CXI_TRANSPOSE_TILE < pixels ? p0+CXI_TRANSPOSE_TILE : pixels; \
+	for(hsize_t p = p0;p<p1;p++){					\
+	  for(hsize_t f = f0;f<f1;f++){					\
+	    d[p*dst_stride+f] = s[f*src_stride+p];			\
+	  }								\
+	}								\
+      }									\
+    }									\
+  }
+
+/* dst[p*dst_stride+f] = src[f*src_stride+p], strides counted in elements */
+static void transpose(const void * src, hsize_t src_stride, void * dst, hsize_t dst_stride,
+		      hsize_t frames, hsize_t pixels, size_t size){
+  switch(size){
+  case 1: TRANSPOSE_TILES(uint8_t); break;
+  case 2: TRANSPOSE_TILES(uint16_t); break;
+  case 4: TRANSPOSE_TILES(uint32_t); break;
+  case 8: TRANSPOSE_TILES(uint64_t); break;
+  default:
+    for(hsize_t p = 0;p<pixels;p++){
+      for(hsize_t f = 0;f<frames;f++){
+	memcpy((char *)dst+(p*dst_stride+f)*size, (const char *)src+(f*src_stride+p)*size, size);
+      }
+    }
+  }
+}
+
+typedef struct{
+  CXI_Dataset * transposed;
+  hsize_t pixels;
+  void * buffer;
+  hsize_t buffer_frames;
+}Transpose_Job;
+
+/* Writes a block of frames as the same frames of every pixel */
+static int write_block(const void * data, hsize_t first, hsize_t n, hid_t mem_type, void * user){
+  Transpose_Job * job = user;
+  size_t size = H5Tget_size(mem_type);
+  if(n > job->buffer_frames){
+    free(job->buffer);
+    job->buffer = malloc(size*job->pixels*n);
+    job->buffer_frames = job->buffer ? n : 0;
+    if(!job->buffer){
+      return -1;
+    }
+  }
+  transpose(data, job->pixels, job->buffer, n, n, job->pixels, size);
+  CXI_Dataset * t = job->transposed;
+  int rank = t->dimension_count;
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
+  for(int i = 0;i<rank-1;i++){
+    start[i] = 0;
+    count[i] = t->dimensions[i];
+  }
+  start[rank-1] = first;
+  count[rank-1] = n;
+  hid_t s = H5Dget_space(t->handle);
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  hid_t memspace = H5Screate_simple(rank, count, NULL);
+  herr_t status = H5Dwrite(t->handle, mem_type, memspace, s, H5P_DEFAULT, job->buffer);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+CXI_Dataset_Reference * cxi_create_pixel_major_dataset(hid_t loc, const char * name, CXI_Dataset * source,
+						       CXI_Dataset * transposed){
+  CXI_TRACE();
+  if(loc < 0 || !name || !source || !transposed || source->dimension_count < 2 ||
+     source->dimension_count > H5S_MAX_RANK || source->dimensions[0] == 0){
+    return NULL;
+  }
+  int rank = source->dimension_count;
+  hsize_t frames = source->dimensions[0];
+  size_t size = H5Tget_size(source->data_type);
+  /* The source is read in blocks of whole chunks and each block fills whole
+     chunks, which span the block's frames, or an even part of them, and
+     enough rows to make about a MB */
+  hsize_t block = cxi_batch_slices(source, size, CXI_TRANSPOSE_BLOCK_BYTES);
+  size_t frame_row_bytes = size;
+  hsize_t chunk[H5S_MAX_RANK];
+  for(int i = 2;i<rank;i++){
+    chunk[i-1] = source->dimensions[i];
+    frame_row_bytes *= source->dimensions[i];
+  }
+  chunk[rank-1] = frame_row_bytes < CXI_TRANSPOSE_CHUNK_BYTES ? CXI_TRANSPOSE_CHUNK_BYTES/frame_row_bytes : 1;
+  chunk[rank-1] = chunk[rank-1] < block ? chunk[rank-1] : block;
+  while(block % chunk[rank-1]){
+    chunk[rank-1]--;
+  }
+  size_t row_bytes = frame_row_bytes*chunk[rank-1];
+  chunk[0] = row_bytes < CXI_TRANSPOSE_CHUNK_BYTES ? CXI_TRANSPOSE_CHUNK_BYTES/row_bytes : 1;
+  chunk[0] = chunk[0] < source->dimensions[1] ? chunk[0] : source->dimensions[1];
+
+  hid_t plist = H5Dget_create_plist(source->handle);
+  if(plist >= 0 && H5Pget_layout(plist) != H5D_CHUNKED){
+    H5Pclose(plist);
+    plist = H5Pcreate(H5P_DATASET_CREATE);
+  }
+  if(plist < 0){
+    return NULL;
+  }
+  /* The filters of the source, if any, go with its chunks */
+  H5Pset_chunk(plist, rank, chunk);
+  transposed->dimension_count = rank;
+  transposed->dimensions = malloc(sizeof(hsize_t)*rank);
+  if(!transposed->dimensions){
+    H5Pclose(plist);
+    return NULL;
+  }
+  for(int i = 1;i<rank;i++){
+    transposed->dimensions[i-1] = source->dimensions[i];
+  }
+  transposed->dimensions[rank-1] = frames;
+  hid_t space = H5Screate_simple(rank, transposed->dimensions, NULL);
+  hid_t type = H5Dget_type(source->handle);
+  transposed->handle = H5Dcreate(loc, name, type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Sclose(space);
+  H5Pclose(plist);
+  if(transposed->handle < 0){
+    H5Tclose(type);
+    free(transposed->dimensions);
+    transposed->dimensions = NULL;
+    return NULL;
+  }
+  transposed->data_type = type;
+  transposed->transfer_plist = H5P_DEFAULT;
+  cxi_dataset_init_io(transposed, NULL);
+
+  /* One pass, every chunk of the source read once and every chunk written once */
+  Transpose_Job job;
+  memset(&job, 0, sizeof(job));
+  job.transposed = transposed;
+  job.pixels = cxi_dataset_slice_length(source);
+  int ret = cxi_dataset_foreach_block(source, block, write_block, &job);
+  free(job.buffer);
+  if(ret){
+    H5Dclose(transposed->handle);
+    H5Tclose(transposed->data_type);
+    H5Ldelete(loc, name, H5P_DEFAULT);
+    free(transposed->dimensions);
+    transposed->dimensions = NULL;
+    transposed->handle = -1;
+    return NULL;
+  }
+  CXI_Dataset_Reference * ref = calloc(sizeof(CXI_Dataset_Reference),1);
+  ref->parent_handle = loc;
+  ref->group_name = malloc(sizeof(char)*(strlen(name)+1));
+  strcpy(ref->group_name, name);
+  ref->dataset = transposed;
+  return ref;
+}
+
+typedef struct{
+  void * series;
+  hsize_t frames;
+  hsize_t pixels;
+  hsize_t first_pixel;
+  hsize_t block_pixels;
+}Series_Job;
+
+/* Copies the pixels of this pass out of a block of frames */
+static int gather_block(const void * data, hsize_t first, hsize_t n, hid_t mem_type, void * user){
+  Series_Job * job = user;
+  size_t size = H5Tget_size(mem_type);
+  transpose((const char *)data+job->first_pixel*size, job->pixels,
+	    (char *)job->series+first*size, job->frames, n, job->block_pixels, size);
+  return 0;
+}
+
+int cxi_foreach_pixel_series(CXI_Dataset * dataset, size_t max_bytes, CXI_Series_Callback callback, void * user){
+  CXI_TRACE();
+  if(!dataset || !callback || dataset->dimension_count < 2){
+    return -1;
+  }
+  hsize_t frames = dataset->dimensions[0];
+  hsize_t pixels = cxi_dataset_slice_length(dataset);
+  if(frames == 0 || pixels == 0){
+    return 0;
+  }
+  hid_t mem_type = H5Tget_native_type(dataset->data_type, H5T_DIR_ASCEND);
+  if(mem_type < 0){
+    return -1;
+  }
+  size_t size = H5Tget_size(mem_type);
+  /* Passes take whole rows of pixels, as many as fit */
+  hsize_t row = pixels/dataset->dimensions[1];
+  size_t row_bytes = size*row*frames;
+  max_bytes = max_bytes ? max_bytes : CXI_SERIES_BYTES;
+  hsize_t rows = max_bytes > row_bytes ? max_bytes/row_bytes : 1;
+  rows = rows < dataset->dimensions[1] ? rows : dataset->dimensions[1];
+  Series_Job job;
+  memset(&job, 0, sizeof(job));
+  job.frames = frames;
+  job.pixels = pixels;
+  job.series = malloc(row_bytes*rows);
+  int ret = job.series ? 0 : -1;
+  for(hsize_t r = 0;!ret && r<dataset->dimensions[1];r += rows){
+    hsize_t n = dataset->dimensions[1]-r < rows ? dataset->dimensions[1]-r : rows;
+    job.first_pixel = r*row;
+    job.block_pixels = n*row;
+    ret = cxi_dataset_foreach_block(dataset, 0, gather_block, &job);
+    if(!ret){
+      ret = callback(job.series, job.first_pixel, job.block_pixels, frames, mem_type, user);
+    }
+  }
+  free(job.series);
+  H5Tclose(mem_type);
+  return ret;
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cxi.h>
+
+#define SLOW 4
+#define FAST 6
+#define PANELS 3
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: assemble <cxi file>\n");
+    return 0;
+  }
+
+  /* Two panels one above the other, with a gap, and a third one rotated by 90 degrees */
+  double pix = 1e-4;
+  double corners[PANELS][3] = {{0,0,0},{0,-6*pix,0},{-7*pix,0,0}};
+  double basis[PANELS][2][3] = {{{0,-pix,0},{-pix,0,0}},
+				{{0,-pix,0},{-pix,0,0}},
+				{{-pix,0,0},{0,-pix,0}}};
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Instrument * instrument = calloc(sizeof(CXI_Instrument),1);
+  if(!cxi_create_instrument(entry->handle,instrument)) return -1;
+  for(int p = 0;p<PANELS;p++){
+    CXI_Detector * det = calloc(sizeof(CXI_Detector),1);
+    memcpy(det->corner_position, corners[p], sizeof(det->corner_position));
+    det->corner_position_valid = 1;
+    memcpy(det->basis_vectors, basis[p], sizeof(det->basis_vectors));
+    det->basis_vectors_valid = 1;
+    if(!cxi_create_detector(instrument->handle,det)) return -1;
+  }
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  instrument = cxi_open_instrument(entry->instruments[0]);
+  if(instrument->detector_count != PANELS) return -1;
+  CXI_Panel panels[PANELS];
+  for(int p = 0;p<PANELS;p++){
+    CXI_Detector * det = cxi_open_detector(instrument->detectors[p]);
+    if(cxi_panel_from_detector(det, SLOW, FAST, &panels[p])) return -1;
+  }
+  cxi_close_file(file);
+
+  CXI_Assembler * a = cxi_create_assembler(panels, PANELS, 0);
+  if(!a || a->input_length != PANELS*SLOW*FAST) return -1;
+  /* Rows from y=0 down to the bottom of the second panel,
+     columns from x=0 to the end of the rotated one */
+  if(a->dimensions[0] != 10 || a->dimensions[1] != 11){
+    printf("Unexpected output size %llux%llu\n",(unsigned long long)a->dimensions[0],
+	   (unsigned long long)a->dimensions[1]);
+    return -1;
+  }
+  a->fill_value = -1;
+
+  const int frames = 5;
+  hsize_t nout = a->dimensions[0]*a->dimensions[1];
+  float * input = malloc(sizeof(float)*frames*a->input_length);
+  float * output = malloc(sizeof(float)*frames*nout);
+  for(hsize_t i = 0;i<frames*a->input_length;i++){
+    input[i] = i;
+  }
+  for(int nthreads = 1;nthreads<=8;nthreads*=8){
+    memset(output, 0, sizeof(float)*frames*nout);
+    if(cxi_assemble_frames(a, input, frames, output, nthreads)) return -1;
+    for(int f = 0;f<frames;f++){
+      float * out = output+f*nout;
+      int covered = 0;
+      for(hsize_t i = 0;i<a->input_length;i++){
+	if(out[a->pixel_to_output[i]] != input[f*a->input_length+i]){
+	  printf("Pixel %llu of frame %d misplaced\n",(unsigned long long)i,f);
+	  return -1;
+	}
+      }
+      for(hsize_t o = 0;o<nout;o++){
+	covered += out[o] >= 0;
+      }
+      if(covered != PANELS*SLOW*FAST){
+	printf("%d pixels covered\n",covered);
+	return -1;
+      }
+    }
+  }
+  /* The rotated panel runs down the columns */
+  if(a->pixel_to_output[2*SLOW*FAST+1]-a->pixel_to_output[2*SLOW*FAST] != (int64_t)a->dimensions[1]){
+    return -1;
+  }
+  cxi_free_assembler(a);
+  free(input);
+  free(output);
+  return 0;
+}
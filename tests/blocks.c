@@ -0,0 +1,91 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <cxi.h>
+#include "stream_files.h"
+
+#define ROWS 5
+#define COLS 7
+#define FRAMES 103
+
+typedef struct{
+  hsize_t next;
+  hsize_t block_frames;
+  double sum;
+  hsize_t stop_at;
+}Visit;
+
+/* Blocks come in order, in whole chunks, and hold their frames */
+static int visit(const void * data, hsize_t first, hsize_t n, hid_t mem_type, void * user){
+  Visit * v = user;
+  if(first != v->next || !H5Tequal(mem_type, H5T_NATIVE_SHORT)) return -2;
+  if(n != v->block_frames && first+n != FRAMES) return -2;
+  const short * frames = data;
+  for(hsize_t f = 0;f<n;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      if(frames[f*ROWS*COLS+i] != (short)(first+f-i)) return -2;
+      v->sum += frames[f*ROWS*COLS+i];
+    }
+  }
+  v->next += n;
+  return v->next >= v->stop_at ? 5 : 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: blocks <prefix>\n");
+    return 0;
+  }
+  char filename[1100];
+  hsize_t dims[2] = {ROWS,COLS};
+  short * frames = malloc(sizeof(short)*FRAMES*ROWS*COLS);
+  double sum = 0;
+  for(int f = 0;f<FRAMES;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      frames[f*ROWS*COLS+i] = (short)(f-i);
+      sum += (short)(f-i);
+    }
+  }
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 8;
+  opt.deflate_level = 1;
+  CXI_Frame_Stream * s = cxi_create_frame_stream(argv[1], 2, dims, H5T_NATIVE_SHORT, &opt);
+  if(!s || cxi_append_frames(s, frames, FRAMES, H5T_NATIVE_SHORT) || cxi_close_frame_stream(s)) return -1;
+  sprintf(filename,"%s_%04d.cxi",argv[1],1);
+  CXI_File * file = cxi_open_file(filename,"r");
+  CXI_Dataset * dataset = open_frames(file);
+  if(!dataset) return -1;
+
+  /* Twenty frames are rounded to two chunks, each read once */
+  Visit v;
+  memset(&v, 0, sizeof(v));
+  v.block_frames = 16;
+  v.stop_at = FRAMES+1;
+  cxi_reset_stats(NULL, dataset);
+  if(cxi_dataset_foreach_block(dataset, 20, visit, &v) || v.next != FRAMES || v.sum != sum) return -1;
+  CXI_Stats stats;
+  cxi_get_stats(NULL, dataset, &stats);
+  if(stats.reads != (FRAMES+15)/16 || stats.bytes_read != sizeof(short)*FRAMES*ROWS*COLS) return -1;
+
+  /* Fewer frames than a chunk split it evenly, the default makes one block */
+  memset(&v, 0, sizeof(v));
+  v.block_frames = 2;
+  v.stop_at = FRAMES+1;
+  if(cxi_dataset_foreach_block(dataset, 3, visit, &v) || v.next != FRAMES) return -1;
+  memset(&v, 0, sizeof(v));
+  v.block_frames = FRAMES;
+  v.stop_at = FRAMES+1;
+  if(cxi_dataset_foreach_block(dataset, 0, visit, &v) || v.next != FRAMES) return -1;
+
+  /* The callback stops it */
+  memset(&v, 0, sizeof(v));
+  v.block_frames = 16;
+  v.stop_at = 40;
+  if(cxi_dataset_foreach_block(dataset, 16, visit, &v) != 5 || v.next != 48) return -1;
+  if(cxi_dataset_foreach_block(dataset, 16, NULL, &v) != -1) return -1;
+
+  cxi_close_file(file);
+  free(frames);
+  return 0;
+}
@@ -0,0 +1,120 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cxi.h>
+
+static int write_file(const char * filename, double distance, double energy, int frames){
+  CXI_File * file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  entry->title = "catalogue";
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Instrument * instrument = calloc(sizeof(CXI_Instrument),1);
+  if(!cxi_create_instrument(entry->handle,instrument)) return -1;
+  CXI_Source * source = calloc(sizeof(CXI_Source),1);
+  source->energy = energy;
+  source->energy_valid = 1;
+  if(!cxi_create_source(instrument->handle,source)) return -1;
+  CXI_Detector * detector = calloc(sizeof(CXI_Detector),1);
+  detector->distance = distance;
+  detector->distance_valid = 1;
+  if(!cxi_create_detector(instrument->handle,detector)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 3;
+  dataset->dimensions = malloc(sizeof(hsize_t)*3);
+  dataset->dimensions[0] = frames;
+  dataset->dimensions[1] = 4;
+  dataset->dimensions[2] = 6;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(detector->handle,dataset,CXI_Data_Type)) return -1;
+  /* Created objects are ours to close, the file stays open until they are */
+  H5Dclose(dataset->handle);
+  H5Gclose(detector->handle);
+  H5Gclose(source->handle);
+  H5Gclose(instrument->handle);
+  H5Gclose(entry->handle);
+  return cxi_close_file(file);
+}
+
+static hsize_t count(CXI_Catalogue * catalogue, CXI_Catalogue_Column column, double min, double max){
+  CXI_Catalogue_Range range = {column, min, max};
+  return cxi_query_catalogue(catalogue, &range, 1, NULL);
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: catalogue <catalogue file>\n");
+    return 0;
+  }
+  char dir[1024];
+  char sub[1100];
+  char files[3][1200];
+  sprintf(dir,"%s_files",argv[1]);
+  sprintf(sub,"%s/run2",dir);
+  sprintf(files[0],"%s/a.cxi",dir);
+  sprintf(files[1],"%s/b.cxi",dir);
+  sprintf(files[2],"%s/run2/c.cxi",dir);
+  mkdir(dir,0755);
+  mkdir(sub,0755);
+  /* A link back up must not be followed forever */
+  char loop[1200];
+  sprintf(loop,"%s/loop",sub);
+  remove(loop);
+  if(symlink("..", loop)) return -1;
+  remove(argv[1]);
+  for(int i = 0;i<3;i++){
+    if(write_file(files[i], 0.1*(i+1), 0.25*(i+1), 2)) return -1;
+  }
+  /* Not a CXI file, must be skipped */
+  char notes[1100];
+  sprintf(notes,"%s/notes.txt",dir);
+  FILE * fp = fopen(notes,"w");
+  if(!fp) return -1;
+  fprintf(fp,"calibration run\n");
+  fclose(fp);
+
+  CXI_Catalogue * catalogue = cxi_open_catalogue(argv[1]);
+  if(!catalogue || catalogue->file_count != 0) return -1;
+  const char * roots[1] = {dir};
+  if(cxi_update_catalogue(catalogue, roots, 1, 2) != 3) return -1;
+  if(catalogue->file_count != 3 || catalogue->row_count != 3) return -1;
+  if(count(catalogue, CXI_Catalogue_Distance, 0.15, 0.35) != 2) return -1;
+  if(count(catalogue, CXI_Catalogue_Photon_Energy, 0.7, 1) != 1) return -1;
+  if(count(catalogue, CXI_Catalogue_Frames, 2, 2) != 3) return -1;
+  if(count(catalogue, CXI_Catalogue_Columns, 6, 6) != 3) return -1;
+  /* Pulse energy was never written */
+  if(count(catalogue, CXI_Catalogue_Pulse_Energy, -INFINITY, INFINITY) != 0) return -1;
+  for(hsize_t r = 0;r<catalogue->row_count;r++){
+    if(!catalogue->titles[r] || strcmp(catalogue->titles[r],"catalogue")) return -1;
+  }
+
+  /* Nothing changed */
+  if(cxi_update_catalogue(catalogue, roots, 1, 2) != 0) return -1;
+  if(catalogue->row_count != 3) return -1;
+
+  /* One file grows, another one goes away */
+  if(write_file(files[1], 0.2, 0.5, 5)) return -1;
+  remove(files[2]);
+  if(cxi_update_catalogue(catalogue, roots, 1, 2) != 1) return -1;
+  if(catalogue->file_count != 2 || catalogue->row_count != 2) return -1;
+  if(count(catalogue, CXI_Catalogue_Frames, 5, 5) != 1) return -1;
+  if(count(catalogue, CXI_Catalogue_Distance, 0.25, 0.35) != 0) return -1;
+
+  if(cxi_save_catalogue(catalogue, argv[1])) return -1;
+  cxi_close_catalogue(catalogue);
+  catalogue = cxi_open_catalogue(argv[1]);
+  if(!catalogue || catalogue->file_count != 2 || catalogue->row_count != 2) return -1;
+  if(count(catalogue, CXI_Catalogue_Frames, 5, 5) != 1) return -1;
+  CXI_Catalogue_Range ranges[2] = {{CXI_Catalogue_Distance, 0, 1},{CXI_Catalogue_Photon_Energy, 0.2, 0.3}};
+  hsize_t row;
+  if(cxi_query_catalogue(catalogue, ranges, 2, &row) != 1) return -1;
+  if(strcmp(catalogue->paths[catalogue->row_file[row]], files[0])) return -1;
+  if(!catalogue->titles[row] || strcmp(catalogue->titles[row],"catalogue")) return -1;
+  /* The reloaded catalogue is up to date */
+  if(cxi_update_catalogue(catalogue, roots, 1, 2) != 0) return -1;
+  cxi_close_catalogue(catalogue);
+  return 0;
+}
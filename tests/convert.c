@@ -0,0 +1,144 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cxi.h>
+
+#define FRAMES 6
+#define ROWS 12
+#define COLS 10
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: convert <cxi file>\n");
+    return 0;
+  }
+  int n = FRAMES*ROWS*COLS;
+  int frame = ROWS*COLS;
+  short * frames = malloc(sizeof(short)*n);
+  short * shorts = malloc(sizeof(short)*n);
+  float * floats = malloc(sizeof(float)*n);
+  for(int i = 0;i<n;i++){
+    frames[i] = i%1000-500;
+  }
+
+  /* One frame per unfiltered chunk, the layout raw chunks are copied for */
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  hsize_t dims[3] = {FRAMES,ROWS,COLS};
+  hsize_t chunk[3] = {1,ROWS,COLS};
+  hid_t space = H5Screate_simple(3, dims, NULL);
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5Pset_chunk(plist, 3, chunk);
+  hid_t handle = H5Dcreate(data->handle, "data", H5T_NATIVE_SHORT, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  if(handle < 0) return -1;
+  H5Dclose(handle);
+  handle = H5Dcreate(data->handle, "full", H5T_NATIVE_SHORT, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  if(handle < 0) return -1;
+  H5Dclose(handle);
+  H5Pclose(plist);
+  H5Sclose(space);
+  /* Opened through references so that writes can copy chunks as they are */
+  CXI_Dataset_Reference ref;
+  memset(&ref, 0, sizeof(ref));
+  ref.parent_handle = data->handle;
+  ref.group_name = "data";
+  ref.arena = file->arena;
+  CXI_Dataset * out = cxi_open_dataset(&ref);
+  ref.group_name = "full";
+  CXI_Dataset * full = cxi_open_dataset(&ref);
+  if(!out || !full || !out->raw_chunks || !full->raw_chunks) return -1;
+  /* The last frame is left unwritten */
+  for(int f = 0;f<FRAMES-1;f++){
+    if(cxi_write_dataset_slice(out, f, frames+f*frame, H5T_NATIVE_SHORT)) return -1;
+  }
+  if(cxi_write_dataset(full, frames, H5T_NATIVE_SHORT)) return -1;
+  CXI_Stats stats;
+  cxi_get_stats(NULL, out, &stats);
+  if(stats.writes != FRAMES-1 || stats.raw_chunk_copies != FRAMES-1 || stats.conversions != 0) return -1;
+  cxi_get_stats(NULL, full, &stats);
+  if(stats.writes != 1 || stats.raw_chunk_copies != FRAMES) return -1;
+  /* Converted writes go through H5Dwrite(), and its failures are reported */
+  for(int i = 0;i<frame;i++){
+    floats[i] = frames[(FRAMES-2)*frame+i];
+  }
+  if(cxi_write_dataset_slice(full, FRAMES-2, floats, H5T_NATIVE_FLOAT)) return -1;
+  cxi_get_stats(NULL, full, &stats);
+  if(stats.raw_chunk_copies != FRAMES || stats.conversions != 1) return -1;
+  int failed;
+  H5E_BEGIN_TRY{
+    failed = cxi_write_dataset(full, frames, H5T_C_S1) != 0 ||
+      cxi_write_dataset_slice(full, 0, frames, H5T_C_S1) != 0;
+  }H5E_END_TRY;
+  if(!failed) return -1;
+  H5E_BEGIN_TRY{
+    failed = cxi_read_dataset(full, frames, H5T_C_S1) != 0 &&
+      cxi_read_dataset_slice(full, 0, frames, H5T_C_S1) != 0;
+  }H5E_END_TRY;
+  if(!failed) return -1;
+  H5Gclose(data->handle);
+  H5Gclose(entry->handle);
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  if(!entry) return -1;
+  data = cxi_open_data(entry->data[0]);
+  if(!data) return -1;
+  CXI_Dataset * dataset = cxi_open_dataset(data->data);
+  if(!dataset || !dataset->raw_chunks || dataset->chunk_slices != 1) return -1;
+
+  for(int f = 0;f<FRAMES-1;f++){
+    if(cxi_read_dataset_slice(dataset, f, shorts+f*frame, H5T_NATIVE_SHORT)) return -1;
+  }
+  if(memcmp(shorts, frames, sizeof(short)*frame*(FRAMES-1))) return -1;
+  memset(shorts, 0, sizeof(short)*n);
+  if(cxi_read_dataset_slices(dataset, 0, FRAMES-1, shorts, H5T_NATIVE_SHORT)) return -1;
+  if(memcmp(shorts, frames, sizeof(short)*frame*(FRAMES-1))) return -1;
+  /* Reading the unwritten chunk must give the fill value */
+  shorts[n-1] = 1;
+  if(cxi_read_dataset(dataset, shorts, H5T_NATIVE_SHORT)) return -1;
+  if(memcmp(shorts, frames, sizeof(short)*frame*(FRAMES-1)) || shorts[n-1] != 0) return -1;
+  cxi_get_stats(NULL, dataset, &stats);
+  if(stats.reads != FRAMES+1 || stats.conversions != 0 || stats.raw_chunk_copies != 2*(FRAMES-1)) return -1;
+  /* Every chunk of the other dataset was written, all of it is copied as stored */
+  ref.parent_handle = data->handle;
+  ref.arena = file->arena;
+  full = cxi_open_dataset(&ref);
+  if(!full || cxi_read_dataset(full, shorts, H5T_NATIVE_SHORT) || memcmp(shorts, frames, sizeof(short)*n)) return -1;
+  cxi_get_stats(NULL, full, &stats);
+  if(stats.raw_chunk_copies != FRAMES) return -1;
+
+  /* Converted reads are counted, with and without a buffer of our own */
+  if(cxi_read_dataset_slice(dataset, 1, floats, H5T_NATIVE_FLOAT)) return -1;
+  for(int i = 0;i<frame;i++){
+    if(floats[i] != frames[frame+i]) return -1;
+  }
+  if(cxi_set_conversion_buffer(dataset, 100)) return -1;
+  if(dataset->transfer_plist == H5P_DEFAULT || !dataset->conversion_buffer) return -1;
+  memset(floats, 0, sizeof(float)*n);
+  if(cxi_read_dataset(dataset, floats, H5T_NATIVE_FLOAT)) return -1;
+  for(int i = 0;i<frame*(FRAMES-1);i++){
+    if(floats[i] != frames[i]) return -1;
+  }
+  if(floats[n-1] != 0) return -1;
+  if(cxi_set_conversion_buffer(dataset, 0)) return -1;
+  if(dataset->transfer_plist != H5P_DEFAULT || dataset->conversion_buffer) return -1;
+  if(cxi_read_dataset_slices(dataset, 2, 2, floats, H5T_NATIVE_FLOAT)) return -1;
+  for(int i = 0;i<2*frame;i++){
+    if(floats[i] != frames[2*frame+i]) return -1;
+  }
+  cxi_get_stats(NULL, dataset, &stats);
+  if(stats.conversions != 3 || stats.reads != FRAMES+4) return -1;
+
+  /* Closing the file also closes the transfer property list */
+  if(cxi_set_conversion_buffer(dataset, 1<<16)) return -1;
+  if(cxi_close_file(file)) return -1;
+  free(frames);
+  free(shorts);
+  free(floats);
+  return 0;
+}
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <math.h>
+#include <cxi.h>
+
+/* Deterministic normally distributed noise */
+static double gaussian(void){
+  double u = (rand()+1.0)/(RAND_MAX+2.0);
+  double v = (rand()+1.0)/(RAND_MAX+2.0);
+  return sqrt(-2*log(u))*cos(2*M_PI*v);
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: dark <cxi file>\n");
+    return 0;
+  }
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Instrument * instrument = calloc(sizeof(CXI_Instrument),1);
+  if(!cxi_create_instrument(entry->handle,instrument)) return -1;
+  CXI_Detector * det = calloc(sizeof(CXI_Detector),1);
+  if(!cxi_create_detector(instrument->handle,det)) return -1;
+
+  const int frames = 500;
+  const int npix = 64;
+  const int hot = 5;
+  const int noisy = 17;
+  const int dead = 40;
+  CXI_Dataset * darks = calloc(sizeof(CXI_Dataset),1);
+  darks->dimension_count = 3;
+  darks->dimensions = malloc(sizeof(hsize_t)*3);
+  darks->dimensions[0] = frames;
+  darks->dimensions[1] = 8;
+  darks->dimensions[2] = 8;
+  darks->data_type = H5T_NATIVE_FLOAT;
+  /* Written as data as the calibration will create data_dark */
+  if(!cxi_create_dataset(det->handle, darks, CXI_Data_Type)) return -1;
+
+  srand(1);
+  float * stack = malloc(sizeof(float)*frames*npix);
+  for(int f = 0;f<frames;f++){
+    for(int p = 0;p<npix;p++){
+      double pedestal = 100 + p%3;
+      double sigma = 2;
+      if(p == hot) pedestal = 400;
+      if(p == noisy) sigma = 30;
+      stack[f*npix+p] = p == dead ? 7 : pedestal + sigma*gaussian();
+    }
+  }
+  if(cxi_write_dataset(darks, stack, H5T_NATIVE_FLOAT)) return -1;
+
+  CXI_Dark_Options options = {0};
+  options.batch_frames = 64;
+  options.nthreads = 2;
+  CXI_Dark_Calibration * cal = cxi_calibrate_dark(darks, &options);
+  if(!cal || cal->frame_count != (hsize_t)frames || cal->frame_length != (hsize_t)npix){
+    printf("Calibration failed\n");
+    return -1;
+  }
+  for(int p = 0;p<npix;p++){
+    uint32_t expected = 0;
+    if(p == hot || p == noisy) expected = CXI_PIXEL_IS_HOT;
+    if(p == dead) expected = CXI_PIXEL_IS_DEAD;
+    if(cal->mask[p] != expected){
+      printf("Pixel %d has mask %x instead of %x\n",p,cal->mask[p],expected);
+      return -1;
+    }
+    if(p == hot || p == noisy || p == dead) continue;
+    double pedestal = 100 + p%3;
+    if(fabs(cal->mean[p]-pedestal) > 0.5 || fabs(cal->sigma[p]-2) > 0.3 ||
+       fabs(cal->median[p]-pedestal) > 0.5){
+      printf("Pixel %d: mean %g sigma %g median %g\n",p,cal->mean[p],cal->sigma[p],cal->median[p]);
+      return -1;
+    }
+  }
+  if(cal->hot_count != 1 || cal->noisy_count != 1 || cal->dead_count != 1){
+    return -1;
+  }
+
+  if(cxi_write_dark_calibration(det, cal)) return -1;
+  if(!det->data_dark || !det->mask) return -1;
+  cxi_free_dark_calibration(cal);
+
+  /* Identical pixels, a third of them a hair higher, have a MAD of 0, and the
+     pedestal jumps after the first batch */
+  CXI_Detector * det2 = calloc(sizeof(CXI_Detector),1);
+  if(!cxi_create_detector(instrument->handle,det2)) return -1;
+  CXI_Dataset * steps = calloc(sizeof(CXI_Dataset),1);
+  *steps = *darks;
+  steps->dimensions = malloc(sizeof(hsize_t)*3);
+  for(int i = 0;i<3;i++) steps->dimensions[i] = darks->dimensions[i];
+  if(!cxi_create_dataset(det2->handle, steps, CXI_Data_Type)) return -1;
+  for(int f = 0;f<frames;f++){
+    for(int p = 0;p<npix;p++){
+      stack[f*npix+p] = (f < 64 ? 100 : 112) + (f%2)*2 + (p%3 == 0)*1e-3 + (p == hot)*300;
+    }
+  }
+  if(cxi_write_dataset(steps, stack, H5T_NATIVE_FLOAT)) return -1;
+  cal = cxi_calibrate_dark(steps, &options);
+  if(!cal || cal->hot_count != 1 || cal->noisy_count != 0 || cal->dead_count != 0 ||
+     cal->mask[hot] != CXI_PIXEL_IS_HOT){
+    printf("Flat calibration flagged %d hot and %d noisy pixels\n",
+	   cal ? (int)cal->hot_count : -1, cal ? (int)cal->noisy_count : -1);
+    return -1;
+  }
+  for(int p = 0;p<npix;p++){
+    if(p != hot && fabs(cal->median[p]-113) > 1.5){
+      printf("Pixel %d: median %g after the step\n",p,cal->median[p]);
+      return -1;
+    }
+  }
+  cxi_free_dark_calibration(cal);
+  free(stack);
+  return 0;
+}
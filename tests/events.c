@@ -0,0 +1,107 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <cxi.h>
+#include "stream_files.h"
+
+#define ROWS 4
+#define COLS 3
+#define SHOTS 1000
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: events <prefix>\n");
+    return 0;
+  }
+  char filename[1100];
+  double energy[SHOTS];
+  uint64_t pulse_id[SHOTS];
+  float hit[SHOTS];
+  for(int i = 0;i<SHOTS;i++){
+    energy[i] = 1.5+0.001*i;
+    pulse_id[i] = 1000000+3*i;
+    hit[i] = i % 7;
+  }
+  CXI_Column columns[3] = {{"pulse_energy", H5T_NATIVE_DOUBLE},
+			   {"pulse_id", H5T_NATIVE_UINT64},
+			   {"hit_score", H5T_NATIVE_FLOAT}};
+
+  /* Rows added in uneven batches, partly still in memory when read */
+  sprintf(filename,"%s.cxi",argv[1]);
+  CXI_File * file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Frame_Table * t = cxi_create_frame_table(data->handle, "events", columns, 3, 64);
+  if(!t || t->column_count != 3) return -1;
+  for(int i = 0;i<SHOTS;){
+    int n = 1+i % 97;
+    if(n > SHOTS-i) n = SHOTS-i;
+    const void * values[3] = {energy+i, pulse_id+i, hit+i};
+    if(cxi_append_frame_values(t, n, values)) return -1;
+    i += n;
+  }
+  if(t->frame_count != SHOTS || t->written == SHOTS) return -1;
+  double read_energy[SHOTS];
+  if(cxi_read_frame_column(t, cxi_frame_table_column(t, "pulse_energy"), read_energy, H5T_NATIVE_DOUBLE)) return -1;
+  if(memcmp(read_energy, energy, sizeof(energy)) || t->written != SHOTS) return -1;
+  if(cxi_frame_table_column(t, "nothing") != -1) return -1;
+  if(cxi_close_frame_table(t)) return -1;
+  cxi_close_file(file);
+
+  /* Columns come back in their order and can be read in another type */
+  file = cxi_open_file(filename,"r");
+  t = open_table(file);
+  if(!t || t->column_count != 3 || t->frame_count != SHOTS) return -1;
+  if(strcmp(t->names[0],"pulse_energy") || strcmp(t->names[1],"pulse_id") || strcmp(t->names[2],"hit_score")) return -1;
+  uint64_t read_id[SHOTS];
+  double read_hit[SHOTS];
+  if(cxi_read_frame_column(t, 1, read_id, H5T_NATIVE_UINT64) ||
+     cxi_read_frame_column(t, 2, read_hit, H5T_NATIVE_DOUBLE)) return -1;
+  for(int i = 0;i<SHOTS;i++){
+    if(read_id[i] != pulse_id[i] || read_hit[i] != hit[i]) return -1;
+  }
+  if(cxi_read_frame_column(t, 3, read_hit, H5T_NATIVE_DOUBLE) == 0) return -1;
+  cxi_close_frame_table(t);
+  cxi_close_file(file);
+
+  /* In a stream the rows follow their frames from file to file */
+  char prefix[1024];
+  snprintf(prefix, sizeof(prefix), "%s_stream", argv[1]);
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 4;
+  opt.max_file_frames = 10;
+  opt.columns = columns;
+  opt.column_count = 3;
+  hsize_t dims[2] = {ROWS,COLS};
+  unsigned short frames[25*ROWS*COLS];
+  memset(frames, 0, sizeof(frames));
+  CXI_Frame_Stream * s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_USHORT, &opt);
+  if(!s) return -1;
+  const void * values[3] = {energy, pulse_id, hit};
+  if(cxi_append_frames_with_values(s, frames, 13, H5T_NATIVE_USHORT, values)) return -1;
+  if(cxi_append_frames(s, frames, 2, H5T_NATIVE_USHORT)) return -1;
+  const void * more[3] = {energy+13, pulse_id+13, hit+13};
+  if(cxi_append_frames_with_values(s, frames, 10, H5T_NATIVE_USHORT, more)) return -1;
+  if(cxi_close_frame_stream(s)) return -1;
+  int row = 0;
+  for(int f = 0;f<3;f++){
+    sprintf(filename,"%s_%04d.cxi",prefix,f+1);
+    file = cxi_open_file(filename,"r");
+    t = open_table(file);
+    hsize_t n = f < 2 ? 10 : 5;
+    if(!t || t->frame_count != n) return -1;
+    if(cxi_read_frame_column(t, 1, read_id, H5T_NATIVE_UINT64)) return -1;
+    for(hsize_t i = 0;i<n;i++, row++){
+      uint64_t expected = row < 13 ? pulse_id[row] : row < 15 ? 0 : pulse_id[row-2];
+      if(read_id[i] != expected) return -1;
+    }
+    cxi_close_frame_table(t);
+    cxi_close_file(file);
+  }
+  return 0;
+}
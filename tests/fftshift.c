@@ -0,0 +1,111 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cxi.h>
+
+/* Out of place reference, with arrays padded to 3 dimensions */
+static void reference_shift(const double * in, double * out, const hsize_t * d, int inverse){
+  hsize_t s[3];
+  for(int i = 0;i<3;i++){
+    s[i] = inverse ? d[i]-d[i]/2 : d[i]/2;
+  }
+  for(hsize_t i = 0;i<d[0];i++){
+    for(hsize_t j = 0;j<d[1];j++){
+      for(hsize_t k = 0;k<d[2];k++){
+	hsize_t o = (((i+s[0])%d[0])*d[1] + (j+s[1])%d[1])*d[2] + (k+s[2])%d[2];
+	out[2*o] = in[2*((i*d[1]+j)*d[2]+k)];
+	out[2*o+1] = in[2*((i*d[1]+j)*d[2]+k)+1];
+      }
+    }
+  }
+}
+
+static int check_shape(int ndims, hsize_t d0, hsize_t d1, hsize_t d2){
+  hsize_t dims[3] = {d0,d1,d2};
+  hsize_t padded[3] = {1,1,1};
+  for(int i = 0;i<ndims;i++){
+    padded[3-ndims+i] = dims[i];
+  }
+  hsize_t n = padded[0]*padded[1]*padded[2];
+  /* Complex doubles, 16 bytes per element */
+  double * a = malloc(sizeof(double)*2*n);
+  double * b = malloc(sizeof(double)*2*n);
+  double * orig = malloc(sizeof(double)*2*n);
+  for(hsize_t i = 0;i<2*n;i++){
+    orig[i] = a[i] = i;
+  }
+  for(int inverse = 0;inverse<2;inverse++){
+    for(int nthreads = 1;nthreads<=3;nthreads+=2){
+      memcpy(a, orig, sizeof(double)*2*n);
+      reference_shift(orig, b, padded, inverse);
+      int ret = inverse ? cxi_ifftshift(a, ndims, dims, 2*sizeof(double), nthreads) :
+	cxi_fftshift(a, ndims, dims, 2*sizeof(double), nthreads);
+      if(ret || memcmp(a, b, sizeof(double)*2*n)){
+	printf("Shift %d of %dD %llux%llux%llu failed\n",inverse,ndims,(unsigned long long)d0,
+	       (unsigned long long)d1,(unsigned long long)d2);
+	return -1;
+      }
+      /* And undo it */
+      int ret2 = inverse ? cxi_fftshift(a, ndims, dims, 2*sizeof(double), nthreads) :
+	cxi_ifftshift(a, ndims, dims, 2*sizeof(double), nthreads);
+      if(ret2 || memcmp(a, orig, sizeof(double)*2*n)){
+	printf("Round trip %d of %dD failed\n",inverse,ndims);
+	return -1;
+      }
+    }
+  }
+  free(a);
+  free(b);
+  free(orig);
+  return 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: fftshift <cxi file>\n");
+    return 0;
+  }
+  if(check_shape(1,7,1,1) || check_shape(1,8,1,1) ||
+     check_shape(2,5,6,1) || check_shape(2,9,33,1) ||
+     check_shape(3,4,6,8) || check_shape(3,5,7,3) || check_shape(3,1,40,17)){
+    return -1;
+  }
+
+  /* Read a stored shifted image back centred */
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Image * image = calloc(sizeof(CXI_Image),1);
+  image->is_fft_shifted = 1;
+  image->is_fft_shifted_valid = 1;
+  image->dimensionality = 2;
+  image->dimensionality_valid = 1;
+  if(!cxi_create_image(entry->handle,image)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 2;
+  dataset->dimensions = malloc(sizeof(hsize_t)*2);
+  dataset->dimensions[0] = 3;
+  dataset->dimensions[1] = 5;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(image->handle, dataset, CXI_Data_Type)) return -1;
+  float shifted[15];
+  for(int i = 0;i<15;i++){
+    shifted[i] = i;
+  }
+  if(cxi_write_dataset(dataset, shifted, H5T_NATIVE_FLOAT)) return -1;
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  entry = cxi_open_entry(file->entries[0]);
+  image = cxi_open_image(entry->images[0]);
+  if(!image || !image->is_fft_shifted_valid || image->is_fft_shifted != 1) return -1;
+  float centred[15];
+  if(cxi_read_image_data(image, centred, H5T_NATIVE_FLOAT, CXI_FFT_Unshifted, 0)) return -1;
+  /* The zero frequency, stored first, ends up at the center */
+  if(centred[1*5+2] != 0) return -1;
+  hsize_t dims[2] = {3,5};
+  cxi_ifftshift(centred, 2, dims, sizeof(float), 1);
+  if(memcmp(centred, shifted, sizeof(shifted))) return -1;
+  cxi_close_file(file);
+  return 0;
+}
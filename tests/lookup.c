@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <cxi.h>
+#include "stream_files.h"
+
+#define ROWS 2
+#define COLS 3
+/* Enough IDs for batches to be split between threads */
+#define SHOTS (1<<18)
+#define MASK 0xFFFFF
+
+/* Pulse IDs increase with a gap now and then */
+static uint64_t pulse_id(uint64_t i){
+  return 5000+7*i+(i/1000)*100;
+}
+
+/* Timestamps are scrambled, two frames sharing each */
+static uint64_t stamp(uint64_t i){
+  return ((i/2)*2654435761ULL) & MASK;
+}
+
+/* Looks up every ID with and without interpolation, expecting frames */
+static int check(CXI_Frame_Index * index, const uint64_t * ids, hsize_t n, const int64_t * expected){
+  int64_t * frames = malloc(sizeof(int64_t)*n);
+  for(int interpolate = 0;interpolate<2;interpolate++){
+    memset(frames, 0, sizeof(int64_t)*n);
+    if(cxi_lookup_frames(index, ids, n, frames, interpolate)) return -1;
+    if(memcmp(frames, expected, sizeof(int64_t)*n)) return -1;
+  }
+  free(frames);
+  return 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: lookup <prefix>\n");
+    return 0;
+  }
+  char filename[1100];
+  char prefix[1024];
+  uint64_t * ids = malloc(sizeof(uint64_t)*2*SHOTS);
+  int64_t * expected = malloc(sizeof(int64_t)*2*SHOTS);
+  uint64_t * pulses = malloc(sizeof(uint64_t)*SHOTS);
+  uint64_t * stamps = malloc(sizeof(uint64_t)*SHOTS);
+  for(uint64_t i = 0;i<SHOTS;i++){
+    pulses[i] = pulse_id(i);
+    stamps[i] = stamp(i);
+  }
+  CXI_Column columns[2] = {{"pulse_id", H5T_NATIVE_UINT64}, {"timestamp", H5T_NATIVE_UINT64}};
+
+  /* Streams index the pulse IDs of each file as it is finished */
+  snprintf(prefix, sizeof(prefix), "%s_stream", argv[1]);
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 4;
+  opt.max_file_frames = 10;
+  opt.columns = columns;
+  opt.column_count = 2;
+  opt.index_column = "pulse_id";
+  hsize_t dims[2] = {ROWS,COLS};
+  unsigned short frames[25*ROWS*COLS];
+  memset(frames, 0, sizeof(frames));
+  CXI_Frame_Stream * s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_USHORT, &opt);
+  const void * values[2] = {pulses, stamps};
+  if(!s || cxi_append_frames_with_values(s, frames, 25, H5T_NATIVE_USHORT, values)) return -1;
+  if(cxi_close_frame_stream(s)) return -1;
+  sprintf(filename,"%s_%04d.cxi",prefix,2);
+  CXI_File * file = cxi_open_file(filename,"r");
+  CXI_Frame_Table * t = open_table(file);
+  if(!t || t->column_count != 2 || H5Lexists(t->handle, "frame_index", H5P_DEFAULT) <= 0) return -1;
+  CXI_Frame_Index * index = cxi_open_frame_index(t->handle, "pulse_id");
+  if(!index || index->frame_count != 10 || index->frames) return -1;
+  hsize_t n = 0;
+  for(int i = 0;i<40;i++){
+    ids[n] = pulse_id(i);
+    expected[n++] = i >= 10 && i < 20 ? i-10 : -1;
+  }
+  if(check(index, ids, n, expected)) return -1;
+  cxi_close_frame_index(index);
+  cxi_close_frame_table(t);
+  cxi_close_file(file);
+
+  /* A table indexed on first use */
+  sprintf(filename,"%s.cxi",argv[1]);
+  file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  t = cxi_create_frame_table(data->handle, "events", columns, 2, 0);
+  if(!t || cxi_append_frame_values(t, SHOTS, values) || cxi_flush_frame_table(t)) return -1;
+
+  /* Sorted pulse IDs, every other one missing, found in one batch */
+  index = cxi_open_frame_index(entry->handle, "data_1/events/pulse_id");
+  if(!index || index->frame_count != SHOTS || index->frames) return -1;
+  if(H5Lexists(t->handle, "frame_index", H5P_DEFAULT) <= 0) return -1;
+  n = 0;
+  for(uint64_t i = 0;i<SHOTS;i++){
+    ids[n] = pulse_id(i)-1;
+    expected[n++] = -1;
+    ids[n] = pulse_id(i);
+    expected[n++] = i;
+  }
+  if(check(index, ids, n, expected)) return -1;
+  cxi_close_frame_index(index);
+
+  /* Scrambled timestamps, looked up in no particular order */
+  int64_t * first = malloc(sizeof(int64_t)*(MASK+1));
+  for(int i = 0;i<=MASK;i++){
+    first[i] = -1;
+  }
+  for(int64_t i = SHOTS-1;i>=0;i--){
+    first[stamp(i)] = i;
+  }
+  index = cxi_open_frame_index(t->handle, "timestamp");
+  if(!index || index->frame_count != SHOTS || !index->frames) return -1;
+  n = 0;
+  for(uint64_t i = 0;i<SHOTS;i++){
+    ids[n] = (i*40503) & MASK;
+    expected[n] = first[ids[n]];
+    n++;
+  }
+  ids[n] = UINT64_MAX;
+  expected[n++] = -1;
+  if(check(index, ids, n, expected)) return -1;
+  cxi_close_frame_index(index);
+
+  /* Frames appended since make it stale */
+  uint64_t more_pulses[3] = {1, pulse_id(SHOTS), 2};
+  uint64_t more_stamps[3] = {MASK+1, MASK+1, 0};
+  const void * more[2] = {more_pulses, more_stamps};
+  if(cxi_append_frame_values(t, 3, more) || cxi_flush_frame_table(t)) return -1;
+  index = cxi_open_frame_index(t->handle, "pulse_id");
+  if(!index || index->frame_count != SHOTS+3 || !index->frames) return -1;
+  ids[0] = 1; ids[1] = 2; ids[2] = pulse_id(SHOTS); ids[3] = pulse_id(0);
+  int64_t found[4] = {SHOTS, SHOTS+2, SHOTS+1, 0};
+  if(check(index, ids, 4, found)) return -1;
+  cxi_close_frame_index(index);
+  if(cxi_build_frame_index(t->handle, "timestamp")) return -1;
+  if(cxi_close_frame_table(t)) return -1;
+  cxi_close_file(file);
+
+  /* Indices stored before are used as they are */
+  file = cxi_open_file(filename,"r");
+  t = open_table(file);
+  if(!t || t->column_count != 2 || t->frame_count != SHOTS+3) return -1;
+  index = cxi_open_frame_index(t->handle, "timestamp");
+  if(!index || index->frame_count != SHOTS+3) return -1;
+  ids[0] = MASK+1; ids[1] = 0; ids[2] = stamp(SHOTS-1);
+  int64_t stamped[3] = {SHOTS, 0, SHOTS-2};
+  if(check(index, ids, 3, stamped)) return -1;
+  cxi_close_frame_index(index);
+  if(H5Lexists(t->handle, "frame_index/timestamp", H5P_DEFAULT) <= 0) return -1;
+  if(cxi_open_frame_index(t->handle, "nothing")) return -1;
+  cxi_close_frame_table(t);
+  cxi_close_file(file);
+
+  free(first);
+  free(ids);
+  free(expected);
+  free(pulses);
+  free(stamps);
+  return 0;
+}
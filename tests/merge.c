@@ -0,0 +1,146 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <cxi.h>
+#include "stream_files.h"
+
+#define ROWS 6
+#define COLS 5
+#define FRAMES 27
+
+/* The value of pixel i of frame f */
+static unsigned short pixel(hsize_t f, int i){
+  return (unsigned short)(f*ROWS*COLS+i);
+}
+
+/* Checks frame i of the dataset is frame frames[i] of the original stack */
+static int check(CXI_Dataset * dataset, const hsize_t * frames, hsize_t n){
+  if(dataset->dimensions[0] != n || dataset->dimensions[1] != ROWS || dataset->dimensions[2] != COLS) return -1;
+  unsigned short * out = malloc(sizeof(unsigned short)*n*ROWS*COLS);
+  if(cxi_read_dataset(dataset, out, H5T_NATIVE_USHORT)) return -1;
+  for(hsize_t f = 0;f<n;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      if(out[f*ROWS*COLS+i] != pixel(frames[f],i)) return -1;
+    }
+  }
+  free(out);
+  return 0;
+}
+
+static uint64_t raw_copies(CXI_Dataset * dataset){
+  CXI_Stats stats;
+  cxi_get_stats(NULL, dataset, &stats);
+  return stats.raw_chunk_copies;
+}
+
+static void close_dataset(CXI_Dataset_Reference * ref, CXI_Dataset * dataset){
+  H5Dclose(dataset->handle);
+  H5Tclose(dataset->data_type);
+  free(dataset->dimensions);
+  free(ref->group_name);
+  free(ref);
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: merge <prefix>\n");
+    return 0;
+  }
+  char prefix[1024];
+  char filename[1100];
+  hsize_t dims[2] = {ROWS,COLS};
+  unsigned short frames[FRAMES*ROWS*COLS];
+  for(int f = 0;f<FRAMES;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      frames[f*ROWS*COLS+i] = pixel(f,i);
+    }
+  }
+
+  /* Three compressed runs of 12, 12 and 3 frames in chunks of 4 */
+  snprintf(prefix, sizeof(prefix), "%s_run", argv[1]);
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 4;
+  opt.deflate_level = 1;
+  opt.max_file_frames = 12;
+  CXI_Frame_Stream * s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_USHORT, &opt);
+  if(!s || cxi_append_frames(s, frames, FRAMES, H5T_NATIVE_USHORT) || s->file_count != 3) return -1;
+  if(cxi_close_frame_stream(s)) return -1;
+  CXI_File * runs[3];
+  CXI_Dataset * sources[4];
+  for(int i = 0;i<3;i++){
+    sprintf(filename,"%s_%04d.cxi",prefix,i+1);
+    runs[i] = cxi_open_file(filename,"r");
+    sources[i] = open_frames(runs[i]);
+    if(!sources[i]) return -1;
+  }
+
+  /* Five more frames, uncompressed and in another type */
+  sprintf(filename,"%s_float.cxi",argv[1]);
+  CXI_File * file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Dataset * floats = calloc(sizeof(CXI_Dataset),1);
+  floats->dimension_count = 3;
+  floats->dimensions = malloc(sizeof(hsize_t)*3);
+  floats->dimensions[0] = 5;
+  floats->dimensions[1] = ROWS;
+  floats->dimensions[2] = COLS;
+  floats->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(data->handle, floats, CXI_Data_Type)) return -1;
+  if(cxi_write_dataset(floats, frames, H5T_NATIVE_USHORT)) return -1;
+  sources[3] = floats;
+
+  sprintf(filename,"%s.cxi",argv[1]);
+  CXI_File * out = cxi_open_file(filename,"w");
+  if(!out) return -1;
+  CXI_Entry * out_entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(out->handle,out_entry)) return -1;
+  CXI_Data * out_data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(out_entry->handle,out_data)) return -1;
+  hsize_t expected[FRAMES+5];
+  for(int f = 0;f<FRAMES+5;f++){
+    expected[f] = f < FRAMES ? f : f-FRAMES;
+  }
+
+  /* Every chunk is copied as stored, the short last one included */
+  CXI_Dataset merged;
+  memset(&merged, 0, sizeof(merged));
+  CXI_Dataset_Reference * ref = cxi_merge_datasets(out_data->handle, "data", sources, 3, &merged);
+  if(!ref || check(&merged, expected, FRAMES) || raw_copies(&merged) != 7) return -1;
+
+  /* Only the aligned run of four frames is copied as stored */
+  hsize_t hits[] = {4, 5, 6, 7, 0, 1, 13, 14, 15, 16, 20};
+  hsize_t n = sizeof(hits)/sizeof(hits[0]);
+  CXI_Dataset subset;
+  memset(&subset, 0, sizeof(subset));
+  CXI_Dataset_Reference * subset_ref = cxi_subset_dataset(out_data->handle, "hits", &merged, hits, n, &subset);
+  if(!subset_ref || check(&subset, hits, n) || raw_copies(&subset) != 1) return -1;
+  close_dataset(subset_ref, &subset);
+  hsize_t beyond[] = {3, FRAMES};
+  if(cxi_subset_dataset(out_data->handle, "beyond", &merged, beyond, 2, &subset)) return -1;
+  close_dataset(ref, &merged);
+
+  /* With a run laid out otherwise after them, the short chunk is no longer whole */
+  ref = cxi_merge_datasets(out_data->handle, "all", sources, 4, &merged);
+  if(!ref || check(&merged, expected, FRAMES+5) || raw_copies(&merged) != 6) return -1;
+  close_dataset(ref, &merged);
+
+  /* Sources must hold the same frames */
+  CXI_Dataset other = *floats;
+  hsize_t other_dims[3] = {5, ROWS, COLS+1};
+  other.dimensions = other_dims;
+  sources[1] = &other;
+  if(cxi_merge_datasets(out_data->handle, "bad", sources, 2, &merged)) return -1;
+
+  for(int i = 0;i<3;i++){
+    cxi_close_file(runs[i]);
+  }
+  H5Dclose(floats->handle);
+  cxi_close_file(file);
+  cxi_close_file(out);
+  return 0;
+}
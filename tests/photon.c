@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cxi.h>
+
+#define FRAMES 4
+#define ROWS 16
+#define COLS 24
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: photon <cxi file>\n");
+    return 0;
+  }
+  /* 9.5 keV photons on a detector giving one count per 3.6 eV */
+  CXI_Detector detector;
+  CXI_Source source;
+  memset(&detector, 0, sizeof(detector));
+  memset(&source, 0, sizeof(source));
+  if(cxi_adu_per_photon(&detector, &source) != 0) return -1;
+  source.energy = 9500*1.602176634e-19;
+  source.energy_valid = 1;
+  detector.counts_per_joule = 1/(3.6*1.602176634e-19);
+  detector.counts_per_joule_valid = 1;
+  double adu_per_photon = cxi_adu_per_photon(&detector, &source);
+  if(fabs(adu_per_photon-9500/3.6) > 1e-6*adu_per_photon) return -1;
+
+  int n = FRAMES*ROWS*COLS;
+  float * adu = malloc(sizeof(float)*n);
+  int32_t * photons = malloc(sizeof(int32_t)*n);
+  srand(3);
+  for(int i = 0;i<n;i++){
+    photons[i] = rand()%4 == 0 ? rand()%20 : 0;
+    /* Up to a third of a photon of noise, possibly negative */
+    adu[i] = (photons[i] + ((rand()%200)-100)/300.0)*adu_per_photon;
+  }
+
+  CXI_Photon_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.adu_per_photon = adu_per_photon;
+  opt.threshold = 0.5;
+  opt.deflate_level = 4;
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 3;
+  dataset->dimensions = malloc(sizeof(hsize_t)*3);
+  dataset->dimensions[0] = FRAMES;
+  dataset->dimensions[1] = ROWS;
+  dataset->dimensions[2] = COLS;
+  if(!cxi_create_photon_dataset(data->handle, dataset, CXI_Data_Type, adu, &opt)) return -1;
+  if(!H5Tequal(dataset->data_type, H5T_NATIVE_UINT8)) return -1;
+
+  /* The same frames written one at a time, into a type chosen upfront */
+  CXI_Image * image = calloc(sizeof(CXI_Image),1);
+  if(!cxi_create_image(entry->handle,image)) return -1;
+  CXI_Dataset * streamed = calloc(sizeof(CXI_Dataset),1);
+  streamed->dimension_count = 3;
+  streamed->dimensions = malloc(sizeof(hsize_t)*3);
+  memcpy(streamed->dimensions, dataset->dimensions, sizeof(hsize_t)*3);
+  opt.data_type = H5T_NATIVE_UINT16;
+  opt.deflate_level = 0;
+  if(!cxi_create_photon_dataset(image->handle, streamed, CXI_Data_Type, NULL, &opt)) return -1;
+  for(int f = 0;f<FRAMES;f++){
+    if(cxi_write_photon_slices(streamed, f, 1, adu+f*ROWS*COLS, &opt)) return -1;
+  }
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  data = cxi_open_data(entry->data[0]);
+  image = cxi_open_image(entry->images[0]);
+  if(!data || !data->data || !image || !image->data) return -1;
+  CXI_Dataset * sets[2] = {cxi_open_dataset(data->data), cxi_open_dataset(image->data)};
+  int32_t * counts = malloc(sizeof(int32_t)*n);
+  float * scaled = malloc(sizeof(float)*n);
+  for(int d = 0;d<2;d++){
+    if(cxi_read_dataset(sets[d], counts, H5T_NATIVE_INT32)) return -1;
+    for(int i = 0;i<n;i++){
+      if(counts[i] != photons[i]){
+	printf("Pixel %d of dataset %d has %d photons instead of %d\n",i,d,counts[i],photons[i]);
+	return -1;
+      }
+    }
+    if(fabs(cxi_dataset_scale(sets[d])-adu_per_photon) > 1e-9*adu_per_photon) return -1;
+    if(cxi_read_scaled_dataset(sets[d], scaled)) return -1;
+    for(int i = 0;i<n;i++){
+      if(fabs(scaled[i]-photons[i]*adu_per_photon) > 1e-3*adu_per_photon) return -1;
+    }
+  }
+  cxi_close_file(file);
+
+  /* Non-finite and huge counts saturate, NaN counts nothing */
+  float odd[5] = {NAN, INFINITY, -INFINITY, 1e30, -1e30};
+  int32_t odd_counts[5];
+  int64_t lo, hi;
+  opt.threshold = -INFINITY;
+  for(int r = 0;r<3;r++){
+    opt.rounding = r == 0 ? CXI_Round_Floor : r == 1 ? CXI_Round_Ceil : CXI_Round_Nearest;
+    if(cxi_quantize_photons(odd, 5, &opt, odd_counts, &lo, &hi)) return -1;
+    if(odd_counts[0] != 0 || odd_counts[1] != INT32_MAX || odd_counts[2] != INT32_MIN ||
+       odd_counts[3] != INT32_MAX || odd_counts[4] != INT32_MIN || lo != INT32_MIN || hi != INT32_MAX) return -1;
+  }
+  free(adu);
+  free(photons);
+  free(counts);
+  free(scaled);
+  return 0;
+}
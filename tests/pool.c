@@ -0,0 +1,133 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cxi.h>
+
+#define THREADS 4
+#define BUFFERS 3
+#define ROUNDS 2000
+#define FRAMES 8
+#define ROWS 20
+#define COLS 30
+
+static CXI_Frame_Pool * shared;
+
+/* Each thread holds at most one buffer at a time and checks nobody else
+   writes to it while it does */
+static void * churn(void * arg){
+  unsigned char mark = (unsigned char)(size_t)arg;
+  size_t size = cxi_frame_pool_buffer_size(shared);
+  for(int r = 0;r<ROUNDS;r++){
+    unsigned char * b = cxi_frame_pool_get(shared);
+    if(!b) return arg;
+    memset(b, mark, size);
+    for(size_t i = 0;i<size;i += 97){
+      if(b[i] != mark) return arg;
+    }
+    cxi_frame_pool_put(shared, b);
+  }
+  return NULL;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: pool <cxi file>\n");
+    return 0;
+  }
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 3;
+  dataset->dimensions = malloc(sizeof(hsize_t)*3);
+  dataset->dimensions[0] = FRAMES;
+  dataset->dimensions[1] = ROWS;
+  dataset->dimensions[2] = COLS;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(data->handle, dataset, CXI_Data_Type)) return -1;
+
+  /* Writing and reading back frames through pooled buffers */
+  CXI_Frame_Pool * pool = cxi_create_frame_pool(dataset, H5T_NATIVE_FLOAT, 2, BUFFERS, CXI_Pool_Cache_Line);
+  if(!pool || cxi_frame_pool_buffer_size(pool) != sizeof(float)*2*ROWS*COLS) return -1;
+  float * out = cxi_frame_pool_get(pool);
+  if(!out || (uintptr_t)out % 64) return -1;
+  for(int i = 0;i<2*ROWS*COLS;i++){
+    out[i] = i;
+  }
+  for(int f = 0;f<FRAMES;f += 2){
+    if(cxi_write_dataset_slice(dataset, f, out, H5T_NATIVE_FLOAT)) return -1;
+    if(cxi_write_dataset_slice(dataset, f+1, out+ROWS*COLS, H5T_NATIVE_FLOAT)) return -1;
+  }
+  cxi_frame_pool_put(pool, out);
+  float * in = cxi_frame_pool_get(pool);
+  /* The buffer just given back is the one reused */
+  if(in != out) return -1;
+  memset(in, 0, cxi_frame_pool_buffer_size(pool));
+  if(cxi_read_dataset_slices(dataset, 4, 2, in, H5T_NATIVE_FLOAT)) return -1;
+  for(int i = 0;i<2*ROWS*COLS;i++){
+    if(in[i] != i) return -1;
+  }
+
+  /* Beyond the capacity buffers still work but are not kept */
+  void * held[BUFFERS+2];
+  held[0] = in;
+  for(int i = 1;i<BUFFERS+2;i++){
+    held[i] = cxi_frame_pool_get(pool);
+    if(!held[i]) return -1;
+    for(int j = 0;j<i;j++){
+      if(held[j] == held[i]) return -1;
+    }
+  }
+  for(int i = 0;i<BUFFERS+2;i++){
+    cxi_frame_pool_put(pool, held[i]);
+  }
+  void * again[BUFFERS];
+  for(int i = 0;i<BUFFERS;i++){
+    again[i] = cxi_frame_pool_get(pool);
+    int pooled = 0;
+    for(int j = 0;j<BUFFERS;j++){
+      pooled |= again[i] == held[j];
+    }
+    if(!pooled) return -1;
+  }
+  for(int i = 0;i<BUFFERS;i++){
+    cxi_frame_pool_put(pool, again[i]);
+  }
+  cxi_free_frame_pool(pool);
+
+  /* More threads than buffers */
+  long page = sysconf(_SC_PAGESIZE);
+  shared = cxi_create_frame_pool(dataset, H5T_NATIVE_DOUBLE, 1, BUFFERS, CXI_Pool_Page_Aligned);
+  if(!shared) return -1;
+  void * b = cxi_frame_pool_get(shared);
+  if(!b || (uintptr_t)b % page) return -1;
+  cxi_frame_pool_put(shared, b);
+  pthread_t threads[THREADS];
+  for(int t = 0;t<THREADS;t++){
+    if(pthread_create(&threads[t], NULL, churn, (void *)(size_t)(t+1))) return -1;
+  }
+  int failed = 0;
+  for(int t = 0;t<THREADS;t++){
+    void * ret;
+    pthread_join(threads[t], &ret);
+    failed |= ret != NULL;
+  }
+  if(failed) return -1;
+  cxi_free_frame_pool(shared);
+
+  pool = cxi_create_frame_pool(dataset, H5T_NATIVE_SHORT, 1, 1, CXI_Pool_Huge_Pages);
+  b = cxi_frame_pool_get(pool);
+  if(!b || (uintptr_t)b % (2*1024*1024)) return -1;
+  cxi_frame_pool_put(pool, b);
+  cxi_free_frame_pool(pool);
+  if(cxi_create_frame_pool(dataset, H5T_NATIVE_FLOAT, 0, 1, 0)) return -1;
+
+  H5Dclose(dataset->handle);
+  cxi_close_file(file);
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <cxi.h>
+
+#define FRAMES 3
+#define ROWS 21
+#define COLS 37
+
+/* Naive 2x2 binning of one level into the next, averaging only the
+   pixels that exist at odd edges */
+static float * reference_bin(const float * in, hsize_t rows, hsize_t cols){
+  hsize_t orows = (rows+1)/2;
+  hsize_t ocols = (cols+1)/2;
+  float * out = malloc(sizeof(float)*FRAMES*orows*ocols);
+  for(int f = 0;f<FRAMES;f++){
+    for(hsize_t y = 0;y<orows;y++){
+      for(hsize_t x = 0;x<ocols;x++){
+	double sum = 0;
+	int n = 0;
+	for(hsize_t i = 2*y;i<2*y+2 && i<rows;i++){
+	  for(hsize_t j = 2*x;j<2*x+2 && j<cols;j++){
+	    sum += in[(f*rows+i)*cols+j];
+	    n++;
+	  }
+	}
+	out[(f*orows+y)*ocols+x] = sum/n;
+      }
+    }
+  }
+  return out;
+}
+
+static int check_level(CXI_Dataset * level, int b, const float * expected,
+		       hsize_t rows, hsize_t cols){
+  if(level->dimension_count != 3 || level->dimensions[0] != FRAMES ||
+     level->dimensions[1] != rows || level->dimensions[2] != cols){
+    printf("Level %d has the wrong size\n",b);
+    return -1;
+  }
+  float * binned = malloc(sizeof(float)*FRAMES*rows*cols);
+  if(cxi_read_dataset(level, binned, H5T_NATIVE_FLOAT)) return -1;
+  for(int f = 0;f<FRAMES;f++){
+    for(hsize_t y = 0;y<rows;y++){
+      for(hsize_t x = 0;x<cols;x++){
+	float ref = expected[(f*rows+y)*cols+x];
+	float v = binned[(f*rows+y)*cols+x];
+	if(fabs(v-ref) > 1e-3*fabs(ref)+1e-3){
+	  printf("Level %d frame %d pixel %llu,%llu is %g instead of %g\n",b,f,
+		 (unsigned long long)y,(unsigned long long)x,v,ref);
+	  return -1;
+	}
+      }
+    }
+  }
+  free(binned);
+  return 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: pyramid <cxi file>\n");
+    return 0;
+  }
+  /* An odd width and height so every level has partial edge bins */
+  float * frames = malloc(sizeof(float)*FRAMES*ROWS*COLS);
+  for(int i = 0;i<FRAMES*ROWS*COLS;i++){
+    frames[i] = (i*7919)%1000;
+  }
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 3;
+  dataset->dimensions = malloc(sizeof(hsize_t)*3);
+  dataset->dimensions[0] = FRAMES;
+  dataset->dimensions[1] = ROWS;
+  dataset->dimensions[2] = COLS;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  CXI_Dataset_Reference * ref = cxi_create_dataset(data->handle, dataset, CXI_Data_Type);
+  if(!ref) return -1;
+  /* Bin while writing, one frame at a time */
+  CXI_Pyramid * pyramid = cxi_create_pyramid(ref, 3);
+  if(!pyramid) return -1;
+  for(int f = 0;f<FRAMES;f++){
+    if(cxi_write_dataset_slice(dataset, f, frames+f*ROWS*COLS, H5T_NATIVE_FLOAT)) return -1;
+    if(cxi_write_pyramid_slices(pyramid, f, 1, frames+f*ROWS*COLS, 2)) return -1;
+  }
+  cxi_close_pyramid(pyramid);
+
+  /* Build a pyramid after the fact, this time for a single image */
+  CXI_Image * image = calloc(sizeof(CXI_Image),1);
+  if(!cxi_create_image(entry->handle,image)) return -1;
+  CXI_Dataset * single = calloc(sizeof(CXI_Dataset),1);
+  single->dimension_count = 2;
+  single->dimensions = malloc(sizeof(hsize_t)*2);
+  single->dimensions[0] = ROWS;
+  single->dimensions[1] = COLS;
+  single->data_type = H5T_NATIVE_FLOAT;
+  CXI_Dataset_Reference * single_ref = cxi_create_dataset(image->handle, single, CXI_Data_Type);
+  if(!single_ref) return -1;
+  if(cxi_write_dataset(single, frames, H5T_NATIVE_FLOAT)) return -1;
+  if(cxi_build_pyramid(single_ref, 2, 0)) return -1;
+  int binning = 0;
+  CXI_Dataset * level = cxi_open_pyramid_level(single_ref, 1, 1, &binning);
+  if(!level || binning != 4 || level->dimension_count != 2 ||
+     level->dimensions[0] != (ROWS+3)/4 || level->dimensions[1] != (COLS+3)/4) return -1;
+  cxi_close_pyramid_level(level);
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  data = cxi_open_data(entry->data[0]);
+  if(!data || !data->data) return -1;
+  float * expected = frames;
+  hsize_t rows = ROWS;
+  hsize_t cols = COLS;
+  for(int b = 2;b<=8;b*=2){
+    float * next = reference_bin(expected, rows, cols);
+    if(expected != frames){
+      free(expected);
+    }
+    expected = next;
+    rows = (rows+1)/2;
+    cols = (cols+1)/2;
+    binning = 0;
+    /* A viewport just small enough for this level */
+    level = cxi_open_pyramid_level(data->data, rows, cols, &binning);
+    if(!level || binning != b){
+      printf("Picked binning %d instead of %d\n",binning,b);
+      return -1;
+    }
+    if(check_level(level, b, expected, rows, cols)) return -1;
+    cxi_close_pyramid_level(level);
+  }
+  free(expected);
+  /* Larger than the original falls back to it */
+  binning = 0;
+  level = cxi_open_pyramid_level(data->data, 2*ROWS, COLS, &binning);
+  if(!level || binning != 1 || level->dimensions[1] != ROWS) return -1;
+  cxi_close_pyramid_level(level);
+  cxi_close_file(file);
+
+  free(frames);
+  return 0;
+}
@@ -0,0 +1,136 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <cxi.h>
+
+#define ROWS 2
+#define COLS 2
+/* More than a block of frames, and not a whole number of bitmap words */
+#define FRAMES 70001
+
+static double energy(int f){
+  return 1.0+(f % 1000)*0.001;
+}
+
+static float score(int f){
+  return (float)(f % 13);
+}
+
+/* Checks the selection against the frames for which match() holds */
+static int check(const CXI_Selection * sel, int (*match)(int)){
+  if(!sel || sel->frame_count != FRAMES) return -1;
+  hsize_t k = 0;
+  for(int f = 0;f<FRAMES;f++){
+    int bit = (sel->bitmap[f/64] >> (f % 64)) & 1;
+    if(bit != match(f)) return -1;
+    if(bit && (k >= sel->selected_count || sel->frames[k++] != (hsize_t)f)) return -1;
+  }
+  return k == sel->selected_count ? 0 : -1;
+}
+
+static int bright_hits(int f){
+  return (energy(f) > 1.5 && score(f) >= 10) || energy(f) == 1.0;
+}
+
+static int band(int f){
+  return energy(f) >= 1.25 && energy(f) <= 1.26 && score(f) != 3;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: query <prefix>\n");
+    return 0;
+  }
+  char filename[1100];
+  sprintf(filename,"%s.cxi",argv[1]);
+  CXI_File * file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+
+  /* Frame f is filled with f */
+  unsigned int * frames = malloc(sizeof(unsigned int)*FRAMES*ROWS*COLS);
+  for(int f = 0;f<FRAMES;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      frames[f*ROWS*COLS+i] = f;
+    }
+  }
+  CXI_Dataset * stack = calloc(sizeof(CXI_Dataset),1);
+  stack->dimension_count = 3;
+  stack->dimensions = malloc(sizeof(hsize_t)*3);
+  stack->dimensions[0] = FRAMES;
+  stack->dimensions[1] = ROWS;
+  stack->dimensions[2] = COLS;
+  stack->data_type = H5T_NATIVE_UINT;
+  if(!cxi_create_dataset(data->handle, stack, CXI_Data_Type)) return -1;
+  if(cxi_write_dataset(stack, frames, H5T_NATIVE_UINT)) return -1;
+
+  CXI_Column columns[2] = {{"pulse_energy", H5T_NATIVE_DOUBLE}, {"hit_score", H5T_NATIVE_FLOAT}};
+  CXI_Frame_Table * t = cxi_create_frame_table(data->handle, "events", columns, 2, 0);
+  if(!t) return -1;
+  double * e = malloc(sizeof(double)*FRAMES);
+  float * s = malloc(sizeof(float)*FRAMES);
+  for(int f = 0;f<FRAMES;f++){
+    e[f] = energy(f);
+    s[f] = score(f);
+  }
+  const void * values[2] = {e, s};
+  if(cxi_append_frame_values(t, FRAMES, values) || cxi_close_frame_table(t)) return -1;
+
+  /* Paths relative to the entry, a term of two conditions or one of one */
+  CXI_Query * q = cxi_create_query(entry->handle);
+  if(!q) return -1;
+  if(cxi_query_where(q, "data_1/events/pulse_energy", CXI_Greater, 1.5, 0) ||
+     cxi_query_where(q, "data_1/events/hit_score", CXI_Greater_Equal, 10, 0) ||
+     cxi_query_or(q) || cxi_query_or(q) ||
+     cxi_query_where(q, "data_1/events/pulse_energy", CXI_Equal, 1.0, 0)) return -1;
+  CXI_Selection * sel = cxi_run_query(q);
+  if(check(sel, bright_hits)) return -1;
+
+  /* The selected frames are read back in one call */
+  hsize_t n = 100;
+  unsigned int * out = malloc(sizeof(unsigned int)*n*ROWS*COLS);
+  hsize_t first = sel->selected_count-n;
+  if(cxi_read_selected_frames(stack, sel, first, n, out, H5T_NATIVE_UINT)) return -1;
+  for(hsize_t k = 0;k<n;k++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      if(out[k*ROWS*COLS+i] != sel->frames[first+k]) return -1;
+    }
+  }
+  if(cxi_read_selected_frames(stack, sel, first, n+1, out, H5T_NATIVE_UINT) == 0) return -1;
+  cxi_free_selection(sel);
+  cxi_free_query(q);
+
+  /* Within the table itself */
+  hid_t events = H5Gopen(data->handle, "events", H5P_DEFAULT);
+  q = cxi_create_query(events);
+  if(cxi_query_where(q, "pulse_energy", CXI_Between, 1.25, 1.26) ||
+     cxi_query_where(q, "hit_score", CXI_Not_Equal, 3, 0)) return -1;
+  sel = cxi_run_query(q);
+  if(check(sel, band)) return -1;
+  cxi_free_selection(sel);
+  cxi_free_query(q);
+
+  /* Columns must exist and have as many values */
+  q = cxi_create_query(events);
+  if(cxi_run_query(q)) return -1;
+  if(cxi_query_where(q, "pulse_energy", CXI_Less, 2, 0) ||
+     cxi_query_where(q, "nothing", CXI_Less, 2, 0)) return -1;
+  if(cxi_run_query(q)) return -1;
+  cxi_free_query(q);
+  q = cxi_create_query(data->handle);
+  if(cxi_query_where(q, "events/pulse_energy", CXI_Less, 2, 0) ||
+     cxi_query_where(q, "data", CXI_Less, 2, 0)) return -1;
+  if(cxi_run_query(q)) return -1;
+  cxi_free_query(q);
+  H5Gclose(events);
+
+  free(frames);
+  free(e);
+  free(s);
+  cxi_close_file(file);
+  return 0;
+}
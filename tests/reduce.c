@@ -0,0 +1,72 @@
+#include <stdlib.h>
+#include <math.h>
+#include <cxi.h>
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: reduce <cxi file>\n");
+    return 0;
+  }
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Instrument * instrument = calloc(sizeof(CXI_Instrument),1);
+  if(!cxi_create_instrument(entry->handle,instrument)) return -1;
+  CXI_Detector * det = calloc(sizeof(CXI_Detector),1);
+  if(!cxi_create_detector(instrument->handle,det)) return -1;
+
+  const int frames = 37;
+  const int ny = 5;
+  const int nx = 7;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 3;
+  dataset->dimensions = malloc(sizeof(hsize_t)*3);
+  dataset->dimensions[0] = frames;
+  dataset->dimensions[1] = ny;
+  dataset->dimensions[2] = nx;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(det->handle, dataset, CXI_Data_Type)) return -1;
+
+  float * stack = malloc(sizeof(float)*frames*ny*nx);
+  for(int i = 0;i<frames*ny*nx;i++){
+    /* Large offset to check the accumulators don't lose precision */
+    stack[i] = 1000 + (i*7919)%101 - 0.25*(i%13);
+  }
+  if(cxi_write_dataset(dataset, stack, H5T_NATIVE_FLOAT)) return -1;
+
+  /* Uneven batches and more threads than needed on purpose */
+  CXI_Reduction * r = cxi_reduce_dataset(dataset, 4, 3);
+  if(!r || r->frame_count != (hsize_t)frames || r->frame_length != (hsize_t)(ny*nx)){
+    printf("Reduction failed\n");
+    return -1;
+  }
+  for(int p = 0;p<ny*nx;p++){
+    double sum = 0;
+    double max = stack[p];
+    for(int f = 0;f<frames;f++){
+      sum += stack[f*ny*nx+p];
+      if(stack[f*ny*nx+p] > max) max = stack[f*ny*nx+p];
+    }
+    double mean = sum/frames;
+    double var = 0;
+    for(int f = 0;f<frames;f++){
+      var += (stack[f*ny*nx+p]-mean)*(stack[f*ny*nx+p]-mean);
+    }
+    var /= frames-1;
+    if(fabs(r->mean[p]-mean) > 1e-9*fabs(mean) || fabs(r->sum[p]-sum) > 1e-9*fabs(sum) ||
+       fabs(r->variance[p]-var) > 1e-9*(var+1) || r->max[p] != max){
+      printf("Mismatch at pixel %d: mean %g/%g var %g/%g\n",p,r->mean[p],mean,r->variance[p],var);
+      return -1;
+    }
+  }
+
+  if(!cxi_create_reduction_dataset(det->handle, r, CXI_Reduction_Standard_Deviation,
+				   CXI_Data_Error_Type)){
+    return -1;
+  }
+  cxi_free_reduction(r);
+  free(stack);
+  return 0;
+}
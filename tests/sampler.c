@@ -0,0 +1,112 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <cxi.h>
+#include "stream_files.h"
+
+#define ROWS 3
+#define COLS 4
+#define FRAMES 203
+#define BATCH 16
+
+/* Runs an epoch, checking every frame comes once and holds its index */
+static int epoch(CXI_Batch_Sampler * sampler, uint64_t e, hsize_t * order, int drop_last){
+  int seen[FRAMES];
+  memset(seen, 0, sizeof(seen));
+  hsize_t n = 0;
+  CXI_Batch batch;
+  int status;
+  while((status = cxi_next_batch(sampler, &batch)) == 1){
+    if(batch.epoch != e || batch.frame_count > BATCH) return -1;
+    /* Only the last batch is short */
+    if(batch.frame_count != BATCH && n+batch.frame_count != FRAMES) return -1;
+    unsigned int * frames = batch.data;
+    for(hsize_t i = 0;i<batch.frame_count;i++){
+      hsize_t f = batch.frames[i];
+      if(f >= FRAMES || seen[f]++) return -1;
+      for(int j = 0;j<ROWS*COLS;j++){
+	if(frames[i*ROWS*COLS+j] != f) return -1;
+      }
+      order[n++] = f;
+    }
+    cxi_release_batch(sampler, &batch);
+  }
+  if(status != 0) return -1;
+  return n == (drop_last ? FRAMES/BATCH*BATCH : FRAMES) ? 0 : -1;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: sampler <prefix>\n");
+    return 0;
+  }
+  char prefix[1024];
+  char filename[1100];
+  hsize_t dims[2] = {ROWS,COLS};
+  unsigned int * frames = malloc(sizeof(unsigned int)*FRAMES*ROWS*COLS);
+  for(int f = 0;f<FRAMES;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      frames[f*ROWS*COLS+i] = f;
+    }
+  }
+  snprintf(prefix, sizeof(prefix), "%s", argv[1]);
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 8;
+  opt.deflate_level = 1;
+  CXI_Frame_Stream * s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_UINT, &opt);
+  if(!s || cxi_append_frames(s, frames, FRAMES, H5T_NATIVE_UINT) || cxi_close_frame_stream(s)) return -1;
+  sprintf(filename,"%s_%04d.cxi",prefix,1);
+  CXI_File * file = cxi_open_file(filename,"r");
+  CXI_Dataset * dataset = open_frames(file);
+  if(!dataset) return -1;
+
+  CXI_Sampler_Options so;
+  memset(&so, 0, sizeof(so));
+  so.batch_frames = BATCH;
+  so.window_chunks = 4;
+  so.seed = 7;
+  so.pool_flags = CXI_Pool_Page_Aligned;
+  cxi_reset_stats(NULL, dataset);
+  CXI_Batch_Sampler * sampler = cxi_create_batch_sampler(dataset, H5T_NATIVE_UINT, &so);
+  if(!sampler) return -1;
+  hsize_t first[FRAMES];
+  hsize_t second[FRAMES];
+  if(epoch(sampler, 0, first, 0) || epoch(sampler, 1, second, 0)) return -1;
+  cxi_free_batch_sampler(sampler);
+  int in_order = 1;
+  for(int f = 0;f<FRAMES;f++){
+    in_order &= first[f] == (hsize_t)f;
+  }
+  if(in_order || !memcmp(first, second, sizeof(first))) return -1;
+
+  /* Each chunk was read once per epoch, besides the few read ahead for the next one */
+  CXI_Stats stats;
+  cxi_get_stats(NULL, dataset, &stats);
+  uint64_t epoch_bytes = (uint64_t)FRAMES*ROWS*COLS*sizeof(unsigned int);
+  if(stats.bytes_read < 2*epoch_bytes || stats.bytes_read > 4*epoch_bytes) return -1;
+
+  /* The same seed shuffles the same way */
+  sampler = cxi_create_batch_sampler(dataset, H5T_NATIVE_UINT, &so);
+  if(!sampler || epoch(sampler, 0, second, 0)) return -1;
+  cxi_free_batch_sampler(sampler);
+  if(memcmp(first, second, sizeof(first))) return -1;
+
+  /* Without the short last batch, and with the frames of every chunk together */
+  so.drop_last = 1;
+  so.window_chunks = 1000;
+  so.seed = 8;
+  sampler = cxi_create_batch_sampler(dataset, H5T_NATIVE_UINT, &so);
+  if(!sampler || epoch(sampler, 0, second, 1)) return -1;
+  CXI_Batch batch;
+  if(cxi_next_batch(sampler, &batch) != 1 || batch.epoch != 1) return -1;
+  cxi_release_batch(sampler, &batch);
+  cxi_free_batch_sampler(sampler);
+
+  so.batch_frames = 0;
+  if(cxi_create_batch_sampler(dataset, H5T_NATIVE_UINT, &so)) return -1;
+  cxi_close_file(file);
+  free(frames);
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cxi.h>
+
+#define FRAMES 6
+#define ROWS 32
+#define COLS 48
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: sparse <cxi file>\n");
+    return 0;
+  }
+  /* A few photons per frame on a noisy background, and one empty frame */
+  float * frames = malloc(sizeof(float)*FRAMES*ROWS*COLS);
+  float * expected = malloc(sizeof(float)*FRAMES*ROWS*COLS);
+  hsize_t stored = 0;
+  srand(7);
+  for(int i = 0;i<FRAMES*ROWS*COLS;i++){
+    frames[i] = (rand()%100)/1000.0f;
+    if(i/(ROWS*COLS) != 2 && rand()%50 == 0){
+      frames[i] += 1+rand()%5;
+    }
+    expected[i] = frames[i] > 0.5f ? frames[i] : -1;
+    stored += frames[i] > 0.5f;
+  }
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Sparse_Frames * s = cxi_create_sparse_frames(data->handle, "data_sparse", ROWS, COLS);
+  if(!s) return -1;
+  for(int f = 0;f<FRAMES-1;f++){
+    if(cxi_append_sparse_frame(s, frames+f*ROWS*COLS, 0.5f)) return -1;
+  }
+  /* The last one as an explicit list of pixels */
+  uint32_t index[ROWS*COLS];
+  float value[ROWS*COLS];
+  hsize_t n = 0;
+  for(uint32_t i = 0;i<ROWS*COLS;i++){
+    if(expected[(FRAMES-1)*ROWS*COLS+i] >= 0){
+      index[n] = i;
+      value[n++] = expected[(FRAMES-1)*ROWS*COLS+i];
+    }
+  }
+  if(cxi_append_sparse_pixels(s, index, value, n)) return -1;
+  cxi_close_sparse_frames(s);
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  data = cxi_open_data(entry->data[0]);
+  if(!data) return -1;
+  s = cxi_open_sparse_frames(data->handle, "data_sparse");
+  if(!s || s->frame_count != FRAMES || s->frame_dimensions[0] != ROWS ||
+     s->frame_dimensions[1] != COLS) return -1;
+  if(s->frame_offsets[FRAMES] != stored || s->frame_offsets[3] != s->frame_offsets[2]){
+    printf("Stored %llu pixels instead of %llu\n",(unsigned long long)s->frame_offsets[FRAMES],
+	   (unsigned long long)stored);
+    return -1;
+  }
+  float * dense = malloc(sizeof(float)*FRAMES*ROWS*COLS);
+  for(int f = 0;f<FRAMES;f++){
+    if(cxi_read_sparse_frame(s, f, dense, -1)) return -1;
+    if(memcmp(dense, expected+f*ROWS*COLS, sizeof(float)*ROWS*COLS)){
+      printf("Frame %d differs\n",f);
+      return -1;
+    }
+  }
+  if(cxi_read_sparse_frames(s, 1, FRAMES-1, dense, -1)) return -1;
+  if(memcmp(dense, expected+ROWS*COLS, sizeof(float)*(FRAMES-1)*ROWS*COLS)) return -1;
+  if(cxi_read_sparse_frames(s, FRAMES-1, 2, dense, -1) == 0) return -1;
+  cxi_close_sparse_frames(s);
+  cxi_close_file(file);
+  free(frames);
+  free(expected);
+  free(dense);
+  return 0;
+}
@@ -0,0 +1,117 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cxi.h>
+
+#define FRAMES 8
+#define ROWS 16
+#define COLS 16
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: stats <cxi file>\n");
+    return 0;
+  }
+  int n = FRAMES*ROWS*COLS;
+  float * frames = malloc(sizeof(float)*n);
+  double * doubles = malloc(sizeof(double)*n);
+  for(int i = 0;i<n;i++){
+    frames[i] = i%7;
+  }
+  CXI_Stats before;
+  CXI_Stats stats;
+  if(cxi_get_stats(NULL, NULL, &before)) return -1;
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 3;
+  dataset->dimensions = malloc(sizeof(hsize_t)*3);
+  dataset->dimensions[0] = FRAMES;
+  dataset->dimensions[1] = ROWS;
+  dataset->dimensions[2] = COLS;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(data->handle, dataset, CXI_Data_Type)) return -1;
+  for(int f = 0;f<FRAMES;f++){
+    if(cxi_write_dataset_slice(dataset, f, frames+f*ROWS*COLS, H5T_NATIVE_FLOAT)) return -1;
+  }
+  if(cxi_get_stats(NULL, dataset, &stats)) return -1;
+  if(stats.writes != FRAMES || stats.bytes_written != sizeof(float)*n || stats.reads != 0) return -1;
+  if(stats.convert_ns != 0 || stats.decompress_ns != 0) return -1;
+
+  /* Compressed with one chunk per frame */
+  CXI_Image * image = calloc(sizeof(CXI_Image),1);
+  if(!cxi_create_image(entry->handle,image)) return -1;
+  CXI_Dataset * photons = calloc(sizeof(CXI_Dataset),1);
+  photons->dimension_count = 3;
+  photons->dimensions = malloc(sizeof(hsize_t)*3);
+  memcpy(photons->dimensions, dataset->dimensions, sizeof(hsize_t)*3);
+  CXI_Photon_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.adu_per_photon = 1;
+  opt.threshold = 0.5;
+  opt.deflate_level = 4;
+  if(!cxi_create_photon_dataset(image->handle, photons, CXI_Data_Type, frames, &opt)) return -1;
+  H5Dclose(dataset->handle);
+  H5Dclose(photons->handle);
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  data = cxi_open_data(entry->data[0]);
+  image = cxi_open_image(entry->images[0]);
+  if(!data || !image) return -1;
+  dataset = cxi_open_dataset(data->data);
+  photons = cxi_open_dataset(image->data);
+  if(!dataset || !photons) return -1;
+  if(cxi_get_stats(file, NULL, &stats)) return -1;
+  /* file, entry, data, image and the two datasets */
+  if(stats.opens != 6 || stats.open_ns == 0 || stats.hdf5_calls < 6) return -1;
+
+  for(int f = 0;f<FRAMES;f++){
+    if(cxi_read_dataset_slice(dataset, f, frames+f*ROWS*COLS, H5T_NATIVE_FLOAT)) return -1;
+  }
+  if(cxi_read_dataset(dataset, doubles, H5T_NATIVE_DOUBLE)) return -1;
+  if(cxi_get_stats(NULL, dataset, &stats)) return -1;
+  if(stats.reads != FRAMES+1 || stats.bytes_read != (sizeof(float)+sizeof(double))*n) return -1;
+  if(stats.convert_ns == 0 || stats.convert_ns >= stats.read_ns) return -1;
+  if(stats.chunk_cache_hits || stats.chunk_cache_misses || stats.decompress_ns) return -1;
+
+  /* Reading every frame twice only decompresses each chunk once */
+  for(int f = 0;f<FRAMES;f++){
+    for(int r = 0;r<2;r++){
+      if(cxi_read_dataset_slice(photons, f, frames, H5T_NATIVE_FLOAT)) return -1;
+    }
+  }
+  if(cxi_get_stats(NULL, photons, &stats)) return -1;
+  if(stats.reads != 2*FRAMES || stats.chunk_cache_hits != FRAMES || stats.chunk_cache_misses != FRAMES) return -1;
+  if(stats.decompress_ns == 0) return -1;
+
+  /* The file adds up its datasets */
+  CXI_Stats file_stats;
+  CXI_Stats dataset_stats;
+  cxi_get_stats(file, NULL, &file_stats);
+  cxi_get_stats(NULL, dataset, &dataset_stats);
+  if(file_stats.reads != 3*FRAMES+1) return -1;
+  if(file_stats.bytes_read != dataset_stats.bytes_read + stats.bytes_read) return -1;
+
+  cxi_reset_stats(NULL, dataset);
+  cxi_get_stats(NULL, dataset, &stats);
+  if(stats.reads || stats.bytes_read || stats.read_ns) return -1;
+  cxi_get_stats(file, NULL, &stats);
+  if(stats.reads != file_stats.reads) return -1;
+  cxi_reset_stats(file, NULL);
+  cxi_get_stats(file, NULL, &stats);
+  if(stats.reads || stats.opens) return -1;
+
+  cxi_get_stats(NULL, NULL, &stats);
+  if(stats.reads - before.reads != 3*FRAMES+1 || stats.writes - before.writes < FRAMES+1) return -1;
+  cxi_close_file(file);
+  free(frames);
+  free(doubles);
+  return 0;
+}
@@ -0,0 +1,162 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <cxi.h>
+
+#define ROWS 6
+#define COLS 5
+
+/* The value of pixel i of frame f */
+static unsigned short pixel(hsize_t f, int i){
+  return (unsigned short)(f*ROWS*COLS+i);
+}
+
+/* Reads back one file of the stream and checks it holds frames [first,first+n) */
+static int check_file(const char * filename, hsize_t first, hsize_t n, hsize_t rows, hsize_t cols){
+  CXI_File * file = cxi_open_file(filename,"r");
+  if(!file || file->entry_count != 1) return -1;
+  CXI_Entry * entry = cxi_open_entry(file->entries[0]);
+  if(!entry || entry->data_count != 1) return -1;
+  CXI_Data * data = cxi_open_data(entry->data[0]);
+  if(!data || !data->data) return -1;
+  CXI_Dataset * dataset = cxi_open_dataset(data->data);
+  if(!dataset || dataset->dimension_count != 3) return -1;
+  if(dataset->dimensions[0] != n || dataset->dimensions[1] != rows || dataset->dimensions[2] != cols) return -1;
+  unsigned short * frames = malloc(sizeof(unsigned short)*n*rows*cols);
+  if(cxi_read_dataset(dataset, frames, H5T_NATIVE_USHORT)) return -1;
+  for(hsize_t f = 0;f<n;f++){
+    for(hsize_t i = 0;i<rows*cols;i++){
+      if(frames[f*rows*cols+i] != (unsigned short)((first+f)*rows*cols+i)) return -1;
+    }
+  }
+  free(frames);
+  cxi_close_file(file);
+  return 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: stream <prefix>\n");
+    return 0;
+  }
+  char prefix[1024];
+  char filename[1100];
+  hsize_t dims[2] = {ROWS,COLS};
+  unsigned short frames[30*ROWS*COLS];
+  float floats[4*ROWS*COLS];
+  for(int f = 0;f<30;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      frames[f*ROWS*COLS+i] = pixel(f,i);
+    }
+  }
+  for(int f = 0;f<4;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      floats[f*ROWS*COLS+i] = pixel(23+f,i);
+    }
+  }
+
+  /* Split by frame count, with a chunk size that does not divide it */
+  snprintf(prefix, sizeof(prefix), "%s_frames", argv[1]);
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 4;
+  opt.max_file_frames = 10;
+  CXI_Frame_Stream * s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_USHORT, &opt);
+  if(!s || s->file_count != 1) return -1;
+  if(cxi_append_frames(s, frames, 3, H5T_NATIVE_USHORT)) return -1;
+  if(cxi_append_frames(s, frames+3*ROWS*COLS, 20, H5T_NATIVE_USHORT)) return -1;
+  if(cxi_append_frames(s, floats, 4, H5T_NATIVE_FLOAT)) return -1;
+  if(s->frame_count != 27 || s->file_count != 3 || s->file_frames != 7) return -1;
+  if(cxi_close_frame_stream(s)) return -1;
+  for(int i = 0;i<3;i++){
+    sprintf(filename,"%s_%04d.cxi",prefix,i+1);
+    if(check_file(filename, 10*i, i < 2 ? 10 : 7, ROWS, COLS)) return -1;
+  }
+
+  /* Split by size, the bound holding even uncompressed, whether frames
+     come one at a time or all at once */
+  hsize_t big[2] = {64,64};
+  int total = 64;
+  unsigned short * large = malloc(sizeof(unsigned short)*total*64*64);
+  for(int i = 0;i<total*64*64;i++){
+    large[i] = i;
+  }
+  for(int bulk = 0;bulk<2;bulk++){
+    snprintf(prefix, sizeof(prefix), "%s_bytes%d", argv[1], bulk);
+    memset(&opt, 0, sizeof(opt));
+    opt.chunk_frames = 2;
+    opt.max_file_bytes = 100*1024;
+    s = cxi_create_frame_stream(prefix, 2, big, H5T_NATIVE_USHORT, &opt);
+    if(!s) return -1;
+    if(bulk && cxi_append_frames(s, large, total, H5T_NATIVE_USHORT)) return -1;
+    for(int f = 0;!bulk && f<total;f++){
+      if(cxi_append_frames(s, large+f*64*64, 1, H5T_NATIVE_USHORT)) return -1;
+    }
+    int files = s->file_count;
+    if(files < 2 || cxi_close_frame_stream(s)) return -1;
+    hsize_t first = 0;
+    for(int i = 0;i<files;i++){
+      sprintf(filename,"%s_%04d.cxi",prefix,i+1);
+      struct stat st;
+      if(stat(filename, &st) || (hsize_t)st.st_size > opt.max_file_bytes) return -1;
+      CXI_File * file = cxi_open_file(filename,"r");
+      if(!file) return -1;
+      CXI_Dataset * dataset = cxi_open_dataset(cxi_open_data(cxi_open_entry(file->entries[0])->data[0])->data);
+      hsize_t n = dataset->dimensions[0];
+      cxi_close_file(file);
+      /* Files only end between chunks */
+      if(check_file(filename, first, n, 64, 64) || (i+1 < files && n % opt.chunk_frames)) return -1;
+      first += n;
+    }
+    if(first != (hsize_t)total) return -1;
+  }
+  free(large);
+
+  /* The master stacks the finished files */
+  snprintf(prefix, sizeof(prefix), "%s_master", argv[1]);
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 4;
+  opt.max_file_frames = 10;
+  opt.master = 1;
+  s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_USHORT, &opt);
+  if(!s) return -1;
+  if(cxi_append_frames(s, frames, 25, H5T_NATIVE_USHORT)) return -1;
+  sprintf(filename,"%s.cxi",prefix);
+  if(check_file(filename, 0, 20, ROWS, COLS)) return -1;
+  if(cxi_close_frame_stream(s)) return -1;
+  if(check_file(filename, 0, 25, ROWS, COLS)) return -1;
+  hid_t master = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if(master < 0) return -1;
+  for(int i = 0;i<3;i++){
+    sprintf(filename,"/entry_1/data_1/part_%04d",i+1);
+    if(H5Lexists(master, filename, H5P_DEFAULT) <= 0) return -1;
+  }
+  hid_t part = H5Dopen(master, "/entry_1/data_1/part_0003", H5P_DEFAULT);
+  hsize_t part_dims[3];
+  hid_t space = H5Dget_space(part);
+  H5Sget_simple_extent_dims(space, part_dims, NULL);
+  if(part_dims[0] != 5) return -1;
+  H5Sclose(space);
+  H5Dclose(part);
+  H5Fclose(master);
+
+  /* A reader holding the master does not stop the stream, which catches up later */
+  snprintf(prefix, sizeof(prefix), "%s_held", argv[1]);
+  s = cxi_create_frame_stream(prefix, 2, dims, H5T_NATIVE_USHORT, &opt);
+  sprintf(filename,"%s.cxi",prefix);
+  master = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if(!s || master < 0) return -1;
+  herr_t status;
+  H5E_BEGIN_TRY{
+    status = cxi_append_frames(s, frames, 15, H5T_NATIVE_USHORT);
+  }H5E_END_TRY;
+  if(status || s->file_count != 2 || s->master_parts != 0) return -1;
+  H5Fclose(master);
+  if(cxi_append_frames(s, frames+15*ROWS*COLS, 10, H5T_NATIVE_USHORT)) return -1;
+  if(s->master_parts != 2 || s->master_block != 10) return -1;
+  if(check_file(filename, 0, 20, ROWS, COLS)) return -1;
+  if(cxi_close_frame_stream(s)) return -1;
+  if(check_file(filename, 0, 25, ROWS, COLS)) return -1;
+  return 0;
+}
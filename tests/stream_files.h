@@ -0,0 +1,25 @@
+#pragma once
+
+/* Opening the files written by a CXI_Frame_Stream, shared by the tests */
+
+#include <cxi.h>
+
+/* The frames of a file with one entry holding one data group */
+static inline CXI_Dataset * open_frames(CXI_File * file){
+  if(!file || file->entry_count != 1) return NULL;
+  CXI_Entry * entry = cxi_open_entry(file->entries[0]);
+  if(!entry || entry->data_count != 1) return NULL;
+  CXI_Data * data = cxi_open_data(entry->data[0]);
+  if(!data || !data->data) return NULL;
+  return cxi_open_dataset(data->data);
+}
+
+/* The table next to the frames of the first entry of a file */
+static inline CXI_Frame_Table * open_table(CXI_File * file){
+  if(!file || file->entry_count != 1) return NULL;
+  CXI_Entry * entry = cxi_open_entry(file->entries[0]);
+  if(!entry || entry->data_count != 1) return NULL;
+  CXI_Data * data = cxi_open_data(entry->data[0]);
+  if(!data) return NULL;
+  return cxi_open_frame_table(data->handle, "events");
+}
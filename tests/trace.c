@@ -0,0 +1,99 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <cxi.h>
+
+#define THREADS 4
+#define FRAMES 16
+#define PIXELS 64
+
+static CXI_Dataset * shared;
+
+static void * read_frames(void * arg){
+  float frame[PIXELS];
+  for(int f = (int)(size_t)arg;f<FRAMES;f += THREADS){
+    if(cxi_read_dataset_slice(shared, f, frame, H5T_NATIVE_FLOAT)) return arg;
+  }
+  return NULL;
+}
+
+static int count(const char * text, const char * pattern){
+  int n = 0;
+  for(const char * p = strstr(text,pattern);p;p = strstr(p+1,pattern)){
+    n++;
+  }
+  return n;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: trace <cxi file>\n");
+    return 0;
+  }
+  char trace[1100];
+  sprintf(trace,"%s.json",argv[1]);
+  if(cxi_start_trace(trace)) return -1;
+
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  CXI_Data * data = calloc(sizeof(CXI_Data),1);
+  if(!cxi_create_data(entry->handle,data)) return -1;
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 2;
+  dataset->dimensions = malloc(sizeof(hsize_t)*2);
+  dataset->dimensions[0] = FRAMES;
+  dataset->dimensions[1] = PIXELS;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  if(!cxi_create_dataset(data->handle, dataset, CXI_Data_Type)) return -1;
+  float * frames = calloc(sizeof(float),FRAMES*PIXELS);
+  if(cxi_write_dataset(dataset, frames, H5T_NATIVE_FLOAT)) return -1;
+  H5Dclose(dataset->handle);
+  cxi_close_file(file);
+
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  entry = cxi_open_entry(file->entries[0]);
+  data = entry ? cxi_open_data(entry->data[0]) : NULL;
+  shared = data ? cxi_open_dataset(data->data) : NULL;
+  if(!shared) return -1;
+  pthread_t threads[THREADS];
+  for(size_t t = 0;t<THREADS;t++){
+    pthread_create(&threads[t], NULL, read_frames, (void *)t);
+  }
+  for(int t = 0;t<THREADS;t++){
+    void * ret;
+    pthread_join(threads[t], &ret);
+    if(ret) return -1;
+  }
+  cxi_close_file(file);
+  if(cxi_stop_trace()) return -1;
+  /* Nothing is recorded once stopped */
+  if(cxi_stop_trace() == 0) return -1;
+  file = cxi_open_file(argv[1],"r");
+  if(!file) return -1;
+  cxi_close_file(file);
+
+  FILE * fp = fopen(trace,"r");
+  if(!fp) return -1;
+  char * text = calloc(1,1<<20);
+  fread(text, 1, (1<<20)-1, fp);
+  fclose(fp);
+  if(strncmp(text,"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[",39)) return -1;
+  int begins = count(text,"\"ph\":\"B\"");
+  if(begins != count(text,"\"ph\":\"E\"")) return -1;
+  if(count(text,"\"name\":\"cxi_open_file\"") != 4) return -1;
+  if(count(text,"\"name\":\"cxi_read_dataset_slice\"") != 2*FRAMES) return -1;
+  if(count(text,"\"name\":\"cxi_create_dataset\"") != 2) return -1;
+  if(count(text,"\"name\":\"cxi_write_dataset\"") != 2) return -1;
+  /* The main thread and the readers */
+  for(int t = 1;t<=THREADS+1;t++){
+    char tid[64];
+    sprintf(tid,"\"tid\":%d}",t);
+    if(!strstr(text,tid)) return -1;
+  }
+  free(text);
+  free(frames);
+  return 0;
+}
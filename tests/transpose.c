@@ -0,0 +1,108 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <cxi.h>
+#include "stream_files.h"
+
+#define ROWS 6
+#define COLS 5
+#define FRAMES 37
+
+typedef struct{
+  hsize_t next_pixel;
+  int calls;
+}Visit;
+
+/* The value of pixel i of frame f */
+static int pixel(hsize_t f, hsize_t i){
+  return (int)(f*1000+i);
+}
+
+/* Pixels come in order, in whole rows, with all their frames */
+static int visit(const void * series, hsize_t first_pixel, hsize_t pixels, hsize_t frames, hid_t mem_type,
+		 void * user){
+  Visit * v = user;
+  if(first_pixel != v->next_pixel || pixels % COLS || frames != FRAMES || !H5Tequal(mem_type, H5T_NATIVE_INT)) return -2;
+  const int * s = series;
+  for(hsize_t p = 0;p<pixels;p++){
+    for(hsize_t f = 0;f<frames;f++){
+      if(s[p*frames+f] != pixel(f, first_pixel+p)) return -2;
+    }
+  }
+  v->next_pixel += pixels;
+  v->calls++;
+  return 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: transpose <prefix>\n");
+    return 0;
+  }
+  char filename[1100];
+  hsize_t dims[2] = {ROWS,COLS};
+  int * frames = malloc(sizeof(int)*FRAMES*ROWS*COLS);
+  for(int f = 0;f<FRAMES;f++){
+    for(int i = 0;i<ROWS*COLS;i++){
+      frames[f*ROWS*COLS+i] = pixel(f,i);
+    }
+  }
+  CXI_Stream_Options opt;
+  memset(&opt, 0, sizeof(opt));
+  opt.chunk_frames = 1;
+  opt.deflate_level = 1;
+  CXI_Frame_Stream * s = cxi_create_frame_stream(argv[1], 2, dims, H5T_NATIVE_INT, &opt);
+  if(!s || cxi_append_frames(s, frames, FRAMES, H5T_NATIVE_INT) || cxi_close_frame_stream(s)) return -1;
+  sprintf(filename,"%s_%04d.cxi",argv[1],1);
+  CXI_File * file = cxi_open_file(filename,"r");
+  CXI_Dataset * dataset = open_frames(file);
+  if(!dataset) return -1;
+
+  /* Two rows of series at a time, or all of them */
+  Visit v;
+  memset(&v, 0, sizeof(v));
+  if(cxi_foreach_pixel_series(dataset, 2*COLS*FRAMES*sizeof(int), visit, &v) ||
+     v.next_pixel != ROWS*COLS || v.calls != ROWS/2) return -1;
+  memset(&v, 0, sizeof(v));
+  if(cxi_foreach_pixel_series(dataset, 0, visit, &v) || v.calls != 1) return -1;
+  memset(&v, 0, sizeof(v));
+  if(cxi_foreach_pixel_series(dataset, 1, visit, &v) || v.calls != ROWS) return -1;
+
+  /* A pixel-major copy, compressed like the stack, in chunks of all the frames
+     however few the stack's chunks hold */
+  sprintf(filename,"%s.cxi",argv[1]);
+  CXI_File * out = cxi_open_file(filename,"w");
+  if(!out) return -1;
+  CXI_Dataset t;
+  memset(&t, 0, sizeof(t));
+  CXI_Dataset_Reference * ref = cxi_create_pixel_major_dataset(out->handle, "series", dataset, &t);
+  if(!ref || t.dimension_count != 3 || t.dimensions[0] != ROWS || t.dimensions[1] != COLS ||
+     t.dimensions[2] != FRAMES) return -1;
+  hid_t plist = H5Dget_create_plist(t.handle);
+  hsize_t chunk[3];
+  if(H5Pget_chunk(plist, 3, chunk) != 3 || chunk[0] != ROWS || chunk[1] != COLS || chunk[2] != FRAMES) return -1;
+  if(H5Pget_nfilters(plist) != 2) return -1;
+  H5Pclose(plist);
+  int * series = malloc(sizeof(int)*FRAMES*ROWS*COLS);
+  if(cxi_read_dataset(&t, series, H5T_NATIVE_INT)) return -1;
+  for(int i = 0;i<ROWS*COLS;i++){
+    for(int f = 0;f<FRAMES;f++){
+      if(series[i*FRAMES+f] != pixel(f,i)) return -1;
+    }
+  }
+  H5Dclose(t.handle);
+  H5Tclose(t.data_type);
+  free(t.dimensions);
+  free(ref->group_name);
+  free(ref);
+
+  /* Frames alone have no pixels to transpose */
+  CXI_Dataset flat = *dataset;
+  flat.dimension_count = 1;
+  if(cxi_create_pixel_major_dataset(out->handle, "flat", &flat, &t) || cxi_foreach_pixel_series(&flat, 0, visit, &v) != -1) return -1;
+  cxi_close_file(out);
+  cxi_close_file(file);
+  free(series);
+  free(frames);
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include <cxi.h>
+
+/* Opens everything in the file, down to the datasets */
+static int open_tree(const char * filename){
+  /* The writer leaves its own handles open, only count ours */
+  ssize_t before = H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_ALL);
+  CXI_File * file = cxi_open_file(filename,"r");
+  if(!file || file->entry_count != 1) return -1;
+  CXI_Entry * entry = cxi_open_entry(file->entries[0]);
+  if(!entry || !entry->title || strcmp(entry->title,"tree")) return -1;
+  for(int i = 0;i<entry->data_count;i++){
+    CXI_Data * data = cxi_open_data(entry->data[i]);
+    if(!data || !cxi_open_dataset(data->data)) return -1;
+  }
+  for(int i = 0;i<entry->image_count;i++){
+    CXI_Image * image = cxi_open_image(entry->images[i]);
+    if(!image || !cxi_open_dataset(image->data)) return -1;
+  }
+  for(int i = 0;i<entry->sample_count;i++){
+    if(!cxi_open_sample(entry->samples[i])) return -1;
+  }
+  if(entry->instrument_count != 1) return -1;
+  CXI_Instrument * instrument = cxi_open_instrument(entry->instruments[0]);
+  if(!instrument || instrument->detector_count != 2 || instrument->source_count != 1) return -1;
+  for(int i = 0;i<instrument->detector_count;i++){
+    CXI_Detector * detector = cxi_open_detector(instrument->detectors[i]);
+    if(!detector || !detector->description || !detector->geometry) return -1;
+    if(!cxi_open_geometry(detector->geometry)) return -1;
+  }
+  CXI_Source * source = cxi_open_source(instrument->sources[0]);
+  if(!source || !source->energy_valid || source->energy != 0.5) return -1;
+  if(cxi_close_file(file)) return -1;
+  /* Nothing may be left open */
+  ssize_t after = H5Fget_obj_count(H5F_OBJ_ALL, H5F_OBJ_ALL);
+  if(after != before){
+    printf("%lld HDF5 objects left open\n",(long long)(after-before));
+    return -1;
+  }
+  return 0;
+}
+
+static CXI_Dataset * small_dataset(void){
+  CXI_Dataset * dataset = calloc(sizeof(CXI_Dataset),1);
+  dataset->dimension_count = 2;
+  dataset->dimensions = malloc(sizeof(hsize_t)*2);
+  dataset->dimensions[0] = 4;
+  dataset->dimensions[1] = 5;
+  dataset->data_type = H5T_NATIVE_FLOAT;
+  return dataset;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 2){
+    printf("Usage: tree <cxi file>\n");
+    return 0;
+  }
+  CXI_File * file = cxi_open_file(argv[1],"w");
+  if(!file) return -1;
+  CXI_Entry * entry = calloc(sizeof(CXI_Entry),1);
+  entry->title = "tree";
+  if(!cxi_create_entry(file->handle,entry)) return -1;
+  for(int i = 0;i<3;i++){
+    CXI_Data * data = calloc(sizeof(CXI_Data),1);
+    if(!cxi_create_data(entry->handle,data)) return -1;
+    if(!cxi_create_dataset(data->handle, small_dataset(), CXI_Data_Type)) return -1;
+  }
+  CXI_Image * image = calloc(sizeof(CXI_Image),1);
+  if(!cxi_create_image(entry->handle,image)) return -1;
+  if(!cxi_create_dataset(image->handle, small_dataset(), CXI_Data_Type)) return -1;
+  CXI_Sample * sample = calloc(sizeof(CXI_Sample),1);
+  if(!cxi_create_sample(entry->handle,sample)) return -1;
+  CXI_Instrument * instrument = calloc(sizeof(CXI_Instrument),1);
+  if(!cxi_create_instrument(entry->handle,instrument)) return -1;
+  for(int i = 0;i<2;i++){
+    CXI_Detector * detector = calloc(sizeof(CXI_Detector),1);
+    detector->description = "panel";
+    if(!cxi_create_detector(instrument->handle,detector)) return -1;
+    CXI_Geometry * geometry = calloc(sizeof(CXI_Geometry),1);
+    if(!cxi_create_geometry(detector->handle,geometry)) return -1;
+  }
+  CXI_Source * source = calloc(sizeof(CXI_Source),1);
+  source->energy = 0.5;
+  source->energy_valid = 1;
+  if(!cxi_create_source(instrument->handle,source)) return -1;
+  cxi_close_file(file);
+
+  /* Crawlers open the same kind of tree over and over */
+  for(int i = 0;i<200;i++){
+    if(open_tree(argv[1])){
+      printf("Failed on iteration %d\n",i);
+      return -1;
+    }
+  }
+  return 0;
+}
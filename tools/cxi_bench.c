@@ -0,0 +1,456 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <math.h>
+#include <cxi.h>
+
+/* Measures write and read throughput of synthetic detector stacks under
+ * several storage layouts.
+ *
+ *   cxi_bench [-f frames] [-r rows] [-c cols] [-t u8|u16|i32|f32|f64]
+ *             [-k chunk frames] [-z deflate level] [-b range frames]
+ *             [-n repeats] [-o output prefix] [-j results.json]
+ *             [-B baseline.json] [-T tolerance]
+ *
+ * Results are written as JSON, one result per line. With -B every
+ * result is compared with the one of the same case and operation in the
+ * baseline, after scaling the baseline by how much faster or slower this
+ * machine is overall. The program fails if any is slower than
+ * (1-tolerance) times the scaled baseline.
+ *
+ * Files are read back right after being written, so reads are usually
+ * served from the page cache.
+ */
+
+#define MAX_RESULTS 256
+
+typedef struct{
+  int frames;
+  int rows;
+  int cols;
+  const char * dtype;
+  int chunk_frames;
+  int deflate;
+  int range_frames;
+  int repeats;
+  const char * prefix;
+  const char * json;
+  const char * baseline;
+  double tolerance;
+}Options;
+
+typedef struct{
+  char name[64];
+  /* 0 for contiguous storage */
+  int chunk_frames;
+  int shuffle;
+  int deflate;
+}Layout;
+
+typedef struct{
+  char layout[64];
+  char op[32];
+  double bytes;
+  double seconds;
+}Result;
+
+static Result results[MAX_RESULTS];
+static int result_count = 0;
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static hid_t dtype_type(const char * name){
+  if(strcmp(name,"u8") == 0) return H5T_NATIVE_UINT8;
+  if(strcmp(name,"u16") == 0) return H5T_NATIVE_UINT16;
+  if(strcmp(name,"i32") == 0) return H5T_NATIVE_INT32;
+  if(strcmp(name,"f32") == 0) return H5T_NATIVE_FLOAT;
+  if(strcmp(name,"f64") == 0) return H5T_NATIVE_DOUBLE;
+  return -1;
+}
+
+/* Mostly dark frames with a few bright pixels, roughly what photon
+   counting detectors produce */
+static void fill_frames(void * data, hid_t type, size_t n){
+  srand(7);
+  for(size_t i = 0;i<n;i++){
+    int v = rand()%16 == 0 ? rand()%200 : rand()%3;
+    if(H5Tequal(type, H5T_NATIVE_UINT8) > 0) ((uint8_t *)data)[i] = v;
+    else if(H5Tequal(type, H5T_NATIVE_UINT16) > 0) ((uint16_t *)data)[i] = v;
+    else if(H5Tequal(type, H5T_NATIVE_INT32) > 0) ((int32_t *)data)[i] = v;
+    else if(H5Tequal(type, H5T_NATIVE_FLOAT) > 0) ((float *)data)[i] = v;
+    else ((double *)data)[i] = v;
+  }
+}
+
+static void add_result(const Layout * layout, const char * op, double bytes, double seconds){
+  if(result_count == MAX_RESULTS){
+    return;
+  }
+  Result * r = &results[result_count++];
+  snprintf(r->layout, sizeof(r->layout), "%s", layout->name);
+  snprintf(r->op, sizeof(r->op), "%s", op);
+  r->bytes = bytes;
+  r->seconds = seconds;
+}
+
+static double mb_per_s(const Result * r){
+  return r->seconds > 0 ? r->bytes/r->seconds/1e6 : 0;
+}
+
+/* Keeps the best of the repeats */
+static void record(const Layout * layout, const char * op, double bytes, double seconds, int repeat){
+  if(repeat == 0){
+    add_result(layout, op, bytes, seconds);
+    return;
+  }
+  for(int i = 0;i<result_count;i++){
+    Result * r = &results[i];
+    if(strcmp(r->layout, layout->name) == 0 && strcmp(r->op, op) == 0 && seconds < r->seconds){
+      r->seconds = seconds;
+    }
+  }
+}
+
+static int write_range(CXI_Dataset * dataset, hsize_t first, hsize_t n, const void * data, hid_t type){
+  hsize_t start[3] = {first,0,0};
+  hsize_t count[3] = {n,dataset->dimensions[1],dataset->dimensions[2]};
+  hid_t s = H5Dget_space(dataset->handle);
+  hid_t memspace = H5Screate_simple(3, count, NULL);
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  herr_t status = H5Dwrite(dataset->handle, type, memspace, s, H5P_DEFAULT, data);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+static int read_roi(CXI_Dataset * dataset, void * data, hid_t type){
+  hsize_t start[3] = {0,dataset->dimensions[1]/4,dataset->dimensions[2]/4};
+  hsize_t count[3] = {dataset->dimensions[0],dataset->dimensions[1]/2,dataset->dimensions[2]/2};
+  hid_t s = H5Dget_space(dataset->handle);
+  hid_t memspace = H5Screate_simple(3, count, NULL);
+  H5Sselect_hyperslab(s, H5S_SELECT_SET, start, NULL, count, NULL);
+  herr_t status = H5Dread(dataset->handle, type, memspace, s, H5P_DEFAULT, data);
+  H5Sclose(memspace);
+  H5Sclose(s);
+  return status < 0 ? -1 : 0;
+}
+
+static int write_layout(const Options * opt, const Layout * layout, const char * filename,
+			const void * data, hid_t type, int repeat){
+  size_t frame_bytes = (size_t)opt->rows*opt->cols*H5Tget_size(type);
+  CXI_File * file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  CXI_Entry entry;
+  CXI_Data cxi_data;
+  memset(&entry, 0, sizeof(entry));
+  memset(&cxi_data, 0, sizeof(cxi_data));
+  CXI_Entry_Reference * entry_ref = cxi_create_entry(file->handle, &entry);
+  CXI_Data_Reference * data_ref = entry_ref ? cxi_create_data(entry.handle, &cxi_data) : NULL;
+  CXI_Dataset * dataset = NULL;
+  if(data_ref){
+    hsize_t dims[3] = {opt->frames,opt->rows,opt->cols};
+    hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+    if(layout->chunk_frames){
+      hsize_t chunk[3] = {layout->chunk_frames,opt->rows,opt->cols};
+      H5Pset_chunk(plist, 3, chunk);
+      if(layout->shuffle){
+	H5Pset_shuffle(plist);
+      }
+      if(layout->deflate){
+	H5Pset_deflate(plist, layout->deflate);
+      }
+    }
+    hid_t space = H5Screate_simple(3, dims, NULL);
+    hid_t handle = H5Dcreate(cxi_data.handle, "data", type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+    H5Sclose(space);
+    H5Pclose(plist);
+    if(handle >= 0){
+      H5Dclose(handle);
+      /* Opened like any dataset of the file, so writes take the same paths,
+	 raw chunk copies included, and are closed with it */
+      CXI_Dataset_Reference ref;
+      memset(&ref, 0, sizeof(ref));
+      ref.parent_handle = cxi_data.handle;
+      ref.group_name = "data";
+      ref.arena = file->arena;
+      dataset = cxi_open_dataset(&ref);
+    }
+  }
+  int ret = dataset ? 0 : -1;
+
+  double t = now();
+  if(!ret){
+    ret = cxi_write_dataset(dataset, (void *)data, type);
+    H5Fflush(file->handle, H5F_SCOPE_GLOBAL);
+    record(layout, "write_full", frame_bytes*opt->frames, now()-t, repeat);
+  }
+
+  t = now();
+  for(int f = 0;!ret && f<opt->frames;f++){
+    ret = cxi_write_dataset_slice(dataset, f, (char *)data+f*frame_bytes, type);
+  }
+  if(!ret){
+    H5Fflush(file->handle, H5F_SCOPE_GLOBAL);
+    record(layout, "write_slice", frame_bytes*opt->frames, now()-t, repeat);
+  }
+
+  t = now();
+  for(int f = 0;!ret && f<opt->frames;f += opt->range_frames){
+    int n = f+opt->range_frames > opt->frames ? opt->frames-f : opt->range_frames;
+    ret = write_range(dataset, f, n, (char *)data+f*frame_bytes, type);
+  }
+  if(!ret){
+    H5Fflush(file->handle, H5F_SCOPE_GLOBAL);
+    record(layout, "write_range", frame_bytes*opt->frames, now()-t, repeat);
+  }
+
+  if(data_ref){
+    H5Gclose(cxi_data.handle);
+    free(data_ref->group_name);
+    free(data_ref);
+  }
+  if(entry_ref){
+    H5Gclose(entry.handle);
+    free(entry_ref->group_name);
+    free(entry_ref);
+  }
+  if(cxi_close_file(file)) ret = -1;
+  return ret;
+}
+
+static int read_layout(const Options * opt, const Layout * layout, const char * filename,
+		       const void * expected, void * data, hid_t type, int repeat){
+  size_t frame_bytes = (size_t)opt->rows*opt->cols*H5Tget_size(type);
+  CXI_File * file = cxi_open_file(filename,"r");
+  if(!file) return -1;
+  CXI_Entry * entry = file->entry_count ? cxi_open_entry(file->entries[0]) : NULL;
+  CXI_Data * cxi_data = entry && entry->data_count ? cxi_open_data(entry->data[0]) : NULL;
+  CXI_Dataset * dataset = cxi_data ? cxi_open_dataset(cxi_data->data) : NULL;
+  int ret = dataset ? 0 : -1;
+
+  double t = now();
+  if(!ret){
+    ret = cxi_read_dataset(dataset, data, type);
+    record(layout, "read_full", frame_bytes*opt->frames, now()-t, repeat);
+  }
+  if(!ret && memcmp(data, expected, frame_bytes*opt->frames)){
+    fprintf(stderr,"%s does not read back what was written\n",filename);
+    ret = -1;
+  }
+
+  t = now();
+  for(int f = 0;!ret && f<opt->frames;f++){
+    ret = cxi_read_dataset_slice(dataset, f, (char *)data+f*frame_bytes, type);
+  }
+  if(!ret){
+    record(layout, "read_slice", frame_bytes*opt->frames, now()-t, repeat);
+  }
+
+  t = now();
+  for(int f = 0;!ret && f<opt->frames;f += opt->range_frames){
+    int n = f+opt->range_frames > opt->frames ? opt->frames-f : opt->range_frames;
+    ret = cxi_read_dataset_slices(dataset, f, n, (char *)data+f*frame_bytes, type);
+  }
+  if(!ret){
+    record(layout, "read_range", frame_bytes*opt->frames, now()-t, repeat);
+  }
+
+  t = now();
+  if(!ret){
+    ret = read_roi(dataset, data, type);
+    record(layout, "read_roi", frame_bytes*opt->frames/4, now()-t, repeat);
+  }
+
+  int * order = malloc(sizeof(int)*opt->frames);
+  if(!order){
+    ret = -1;
+  }
+  for(int f = 0;!ret && f<opt->frames;f++){
+    order[f] = f;
+  }
+  srand(11);
+  for(int f = opt->frames-1;!ret && f>0;f--){
+    int j = rand()%(f+1);
+    int tmp = order[f];
+    order[f] = order[j];
+    order[j] = tmp;
+  }
+  t = now();
+  for(int f = 0;!ret && f<opt->frames;f++){
+    ret = cxi_read_dataset_slice(dataset, order[f], data, type);
+  }
+  if(!ret){
+    record(layout, "read_random", frame_bytes*opt->frames, now()-t, repeat);
+  }
+  free(order);
+  if(cxi_close_file(file)) ret = -1;
+  return ret;
+}
+
+static int write_json(const Options * opt, FILE * fp){
+  fprintf(fp,"{\"frames\":%d,\"rows\":%d,\"cols\":%d,\"dtype\":\"%s\",\"results\":[\n",
+	  opt->frames, opt->rows, opt->cols, opt->dtype);
+  for(int i = 0;i<result_count;i++){
+    Result * r = &results[i];
+    fprintf(fp,"{\"case\":\"%s\",\"op\":\"%s\",\"bytes\":%.0f,\"seconds\":%.6f,\"mb_per_s\":%.3f}%s\n",
+	    r->layout, r->op, r->bytes, r->seconds, mb_per_s(r), i+1 < result_count ? "," : "");
+  }
+  fprintf(fp,"]}\n");
+  return 0;
+}
+
+/* Reads back the result lines written by write_json(). Absolute rates
+   depend on the machine and its load, so each rate is taken relative to the
+   geometric mean of the rates compared in the same run: only the relative
+   speed of layouts and operations has to match the baseline. */
+static int compare_baseline(const Options * opt){
+  FILE * fp = fopen(opt->baseline,"r");
+  if(!fp){
+    fprintf(stderr,"Could not read baseline %s\n",opt->baseline);
+    return -1;
+  }
+  char line[1024];
+  int matched[MAX_RESULTS];
+  double expected[MAX_RESULTS];
+  int compared = 0;
+  while(compared < MAX_RESULTS && fgets(line, sizeof(line), fp)){
+    char layout[64];
+    char op[32];
+    const char * rate = strstr(line,"\"mb_per_s\":");
+    double baseline;
+    if(sscanf(line,"{\"case\":\"%63[^\"]\",\"op\":\"%31[^\"]\"",layout,op) != 2 ||
+       !rate || sscanf(rate+11,"%lf",&baseline) != 1 || baseline <= 0){
+      continue;
+    }
+    for(int i = 0;i<result_count;i++){
+      if(strcmp(results[i].layout, layout) || strcmp(results[i].op, op) || mb_per_s(&results[i]) <= 0){
+	continue;
+      }
+      matched[compared] = i;
+      expected[compared++] = baseline;
+      break;
+    }
+  }
+  fclose(fp);
+  double log_measured = 0;
+  double log_expected = 0;
+  for(int k = 0;k<compared;k++){
+    log_measured += log(mb_per_s(&results[matched[k]]));
+    log_expected += log(expected[k]);
+  }
+  double scale = compared ? exp((log_measured-log_expected)/compared) : 1;
+  int regressions = 0;
+  for(int k = 0;k<compared;k++){
+    Result * r = &results[matched[k]];
+    double measured = mb_per_s(r);
+    if(measured < (1-opt->tolerance)*scale*expected[k]){
+      fprintf(stderr,"%s %s: %.1f MB/s, baseline %.1f MB/s scaled to %.1f MB/s\n",
+	      r->layout,r->op,measured,expected[k],scale*expected[k]);
+      regressions++;
+    }
+  }
+  printf("Compared %d results with %s scaled by %.2f, %d regressions\n",compared,opt->baseline,scale,regressions);
+  return regressions || !compared ? -1 : 0;
+}
+
+static void usage(void){
+  printf("Usage: cxi_bench [-f frames] [-r rows] [-c cols] [-t u8|u16|i32|f32|f64]\n");
+  printf("                 [-k chunk frames] [-z deflate level] [-b range frames]\n");
+  printf("                 [-n repeats] [-o output prefix] [-j results.json]\n");
+  printf("                 [-B baseline.json] [-T tolerance]\n");
+}
+
+int main(int argc, char ** argv){
+  Options opt = {100, 512, 512, "u16", 8, 4, 8, 1, "cxi_bench", NULL, NULL, 0.5};
+  for(int i = 1;i<argc;i++){
+    if(argv[i][0] != '-' || !argv[i][1] || argv[i][2] || i+1 == argc){
+      usage();
+      return 1;
+    }
+    const char * v = argv[++i];
+    switch(argv[i-1][1]){
+    case 'f': opt.frames = atoi(v); break;
+    case 'r': opt.rows = atoi(v); break;
+    case 'c': opt.cols = atoi(v); break;
+    case 't': opt.dtype = v; break;
+    case 'k': opt.chunk_frames = atoi(v); break;
+    case 'z': opt.deflate = atoi(v); break;
+    case 'b': opt.range_frames = atoi(v); break;
+    case 'n': opt.repeats = atoi(v); break;
+    case 'o': opt.prefix = v; break;
+    case 'j': opt.json = v; break;
+    case 'B': opt.baseline = v; break;
+    case 'T': opt.tolerance = atof(v); break;
+    default: usage(); return 1;
+    }
+  }
+  hid_t type = dtype_type(opt.dtype);
+  if(type < 0 || opt.frames < 1 || opt.rows < 2 || opt.cols < 2 ||
+     opt.chunk_frames < 1 || opt.range_frames < 1 || opt.repeats < 1){
+    usage();
+    return 1;
+  }
+  Layout layouts[5];
+  memset(layouts, 0, sizeof(layouts));
+  int layout_count = 0;
+  sprintf(layouts[layout_count++].name,"contiguous");
+  layouts[layout_count].chunk_frames = 1;
+  sprintf(layouts[layout_count++].name,"chunk1");
+  if(opt.chunk_frames > 1){
+    layouts[layout_count].chunk_frames = opt.chunk_frames;
+    sprintf(layouts[layout_count++].name,"chunk%d",opt.chunk_frames);
+  }
+  if(opt.deflate > 0){
+    layouts[layout_count].chunk_frames = 1;
+    layouts[layout_count].deflate = opt.deflate;
+    sprintf(layouts[layout_count++].name,"chunk1_deflate%d",opt.deflate);
+    layouts[layout_count].chunk_frames = 1;
+    layouts[layout_count].shuffle = 1;
+    layouts[layout_count].deflate = opt.deflate;
+    sprintf(layouts[layout_count++].name,"chunk1_shuffle_deflate%d",opt.deflate);
+  }
+
+  size_t n = (size_t)opt.frames*opt.rows*opt.cols;
+  void * data = malloc(n*H5Tget_size(type));
+  void * readback = malloc(n*H5Tget_size(type));
+  if(!data || !readback){
+    fprintf(stderr,"Could not allocate %zu bytes\n",2*n*H5Tget_size(type));
+    return 1;
+  }
+  fill_frames(data, type, n);
+  char * filename = malloc(strlen(opt.prefix)+80);
+  for(int l = 0;l<layout_count;l++){
+    sprintf(filename,"%s_%s.cxi",opt.prefix,layouts[l].name);
+    for(int r = 0;r<opt.repeats;r++){
+      if(write_layout(&opt, &layouts[l], filename, data, type, r) ||
+	 read_layout(&opt, &layouts[l], filename, data, readback, type, r)){
+	fprintf(stderr,"Benchmark of %s failed\n",layouts[l].name);
+	return 1;
+      }
+    }
+    remove(filename);
+  }
+
+  for(int i = 0;i<result_count;i++){
+    printf("%-28s %-12s %10.1f MB/s\n",results[i].layout,results[i].op,mb_per_s(&results[i]));
+  }
+  if(opt.json){
+    FILE * fp = fopen(opt.json,"w");
+    if(!fp){
+      fprintf(stderr,"Could not write %s\n",opt.json);
+      return 1;
+    }
+    write_json(&opt, fp);
+    fclose(fp);
+  }
+  int ret = opt.baseline ? compare_baseline(&opt) : 0;
+  free(filename);
+  free(data);
+  free(readback);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <cxi.h>
+
+/* Measures how the cost of creating, opening, traversing and closing
+ * CXI files grows with the number of entries.
+ *
+ *   cxi_bench_metadata [-e max entries] [-d detectors] [-i images]
+ *                      [-n repeats] [-o output prefix] [-j results.json]
+ *
+ * Files with 1, 10, 100... up to max entries are built through the
+ * cxi_create_* functions, each entry with an instrument holding the given
+ * number of detectors, a source and the given number of images. For each
+ * size the program reports the time to create the file, to open it, to
+ * open every group of the tree and to close it, plus how much the heap
+ * grew while the tree was open, HDF5's own caches included. The growth
+ * exponent of each phase between consecutive sizes is printed, 1 meaning
+ * linear in the entry count.
+ */
+
+#define MAX_SIZES 16
+
+typedef struct{
+  int entries;
+  double create;
+  double open;
+  double traverse;
+  double close;
+  double heap_bytes;
+  long groups;
+}Size_Result;
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static double heap_in_use(void){
+#if defined __GLIBC__ && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  return mallinfo2().uordblks;
+#else
+  return -1;
+#endif
+}
+
+/* Created objects belong to us, close and free them as we go */
+static void release(hid_t handle, void * ref, char * group_name){
+  H5Gclose(handle);
+  free(group_name);
+  free(ref);
+}
+
+static int build(const char * filename, int entries, int detectors, int images){
+  CXI_File * file = cxi_open_file(filename,"w");
+  if(!file) return -1;
+  for(int e = 0;e<entries;e++){
+    CXI_Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.title = "metadata benchmark";
+    CXI_Entry_Reference * entry_ref = cxi_create_entry(file->handle, &entry);
+    if(!entry_ref) return -1;
+    CXI_Instrument instrument;
+    memset(&instrument, 0, sizeof(instrument));
+    instrument.name = "instrument";
+    CXI_Instrument_Reference * instrument_ref = cxi_create_instrument(entry.handle, &instrument);
+    if(!instrument_ref) return -1;
+    CXI_Source source;
+    memset(&source, 0, sizeof(source));
+    source.energy = 1.6e-15;
+    source.energy_valid = 1;
+    CXI_Source_Reference * source_ref = cxi_create_source(instrument.handle, &source);
+    if(!source_ref) return -1;
+    release(source.handle, source_ref, source_ref->group_name);
+    for(int d = 0;d<detectors;d++){
+      CXI_Detector detector;
+      memset(&detector, 0, sizeof(detector));
+      detector.distance = 0.1;
+      detector.distance_valid = 1;
+      detector.x_pixel_size = detector.y_pixel_size = 75e-6;
+      detector.x_pixel_size_valid = detector.y_pixel_size_valid = 1;
+      detector.description = "panel";
+      CXI_Detector_Reference * detector_ref = cxi_create_detector(instrument.handle, &detector);
+      if(!detector_ref) return -1;
+      release(detector.handle, detector_ref, detector_ref->group_name);
+    }
+    for(int i = 0;i<images;i++){
+      CXI_Image image;
+      memset(&image, 0, sizeof(image));
+      CXI_Image_Reference * image_ref = cxi_create_image(entry.handle, &image);
+      if(!image_ref) return -1;
+      release(image.handle, image_ref, image_ref->group_name);
+    }
+    release(instrument.handle, instrument_ref, instrument_ref->group_name);
+    release(entry.handle, entry_ref, entry_ref->group_name);
+  }
+  return cxi_close_file(file);
+}
+
+static long traverse(CXI_File * file){
+  long groups = 0;
+  for(int e = 0;e<file->entry_count;e++){
+    CXI_Entry * entry = cxi_open_entry(file->entries[e]);
+    if(!entry) return -1;
+    groups++;
+    for(int i = 0;i<entry->instrument_count;i++){
+      CXI_Instrument * instrument = cxi_open_instrument(entry->instruments[i]);
+      if(!instrument) return -1;
+      groups++;
+      for(int d = 0;d<instrument->detector_count;d++){
+	if(!cxi_open_detector(instrument->detectors[d])) return -1;
+	groups++;
+      }
+      for(int s = 0;s<instrument->source_count;s++){
+	if(!cxi_open_source(instrument->sources[s])) return -1;
+	groups++;
+      }
+    }
+    for(int i = 0;i<entry->image_count;i++){
+      if(!cxi_open_image(entry->images[i])) return -1;
+      groups++;
+    }
+  }
+  return groups;
+}
+
+static int measure(const char * filename, int repeats, Size_Result * r){
+  for(int k = 0;k<repeats;k++){
+    double heap = heap_in_use();
+    double t0 = now();
+    CXI_File * file = cxi_open_file(filename,"r");
+    if(!file) return -1;
+    double t1 = now();
+    long groups = traverse(file);
+    if(groups < 0) return -1;
+    double t2 = now();
+    double used = heap >= 0 ? heap_in_use()-heap : -1;
+    if(cxi_close_file(file)) return -1;
+    double t3 = now();
+    if(k == 0 || t1-t0 < r->open) r->open = t1-t0;
+    if(k == 0 || t2-t1 < r->traverse) r->traverse = t2-t1;
+    if(k == 0 || t3-t2 < r->close) r->close = t3-t2;
+    r->heap_bytes = used;
+    r->groups = groups;
+  }
+  return 0;
+}
+
+/* d log(t) / d log(entries) */
+static double exponent(double t0, double t1, int n0, int n1){
+  if(t0 <= 0 || t1 <= 0 || n1 == n0){
+    return NAN;
+  }
+  return log(t1/t0)/log((double)n1/n0);
+}
+
+int main(int argc, char ** argv){
+  int max_entries = 1000;
+  int detectors = 2;
+  int images = 1;
+  int repeats = 3;
+  const char * prefix = "cxi_bench_metadata";
+  const char * json = NULL;
+  for(int i = 1;i+1<argc;i += 2){
+    if(strcmp(argv[i],"-e") == 0) max_entries = atoi(argv[i+1]);
+    else if(strcmp(argv[i],"-d") == 0) detectors = atoi(argv[i+1]);
+    else if(strcmp(argv[i],"-i") == 0) images = atoi(argv[i+1]);
+    else if(strcmp(argv[i],"-n") == 0) repeats = atoi(argv[i+1]);
+    else if(strcmp(argv[i],"-o") == 0) prefix = argv[i+1];
+    else if(strcmp(argv[i],"-j") == 0) json = argv[i+1];
+    else argc = 0;
+  }
+  if(argc % 2 == 0 || max_entries < 1 || detectors < 0 || images < 0 || repeats < 1){
+    printf("Usage: cxi_bench_metadata [-e max entries] [-d detectors] [-i images]\n");
+    printf("                          [-n repeats] [-o output prefix] [-j results.json]\n");
+    return 1;
+  }
+  Size_Result results[MAX_SIZES];
+  int size_count = 0;
+  char * filename = malloc(strlen(prefix)+32);
+  for(int n = 1;n <= max_entries && size_count < MAX_SIZES;n *= 10){
+    Size_Result * r = &results[size_count++];
+    memset(r, 0, sizeof(Size_Result));
+    r->entries = n;
+    sprintf(filename,"%s_%d.cxi",prefix,n);
+    double t = now();
+    if(build(filename, n, detectors, images)){
+      fprintf(stderr,"Could not build %s\n",filename);
+      return 1;
+    }
+    r->create = now()-t;
+    if(measure(filename, repeats, r)){
+      fprintf(stderr,"Could not traverse %s\n",filename);
+      return 1;
+    }
+    remove(filename);
+  }
+  free(filename);
+
+  printf("%8s %8s %12s %12s %12s %12s %12s\n","entries","groups","create(s)","open(s)","traverse(s)","close(s)","heap(bytes)");
+  for(int i = 0;i<size_count;i++){
+    Size_Result * r = &results[i];
+    printf("%8d %8ld %12.6f %12.6f %12.6f %12.6f %12.0f\n",r->entries,r->groups,r->create,
+	   r->open,r->traverse,r->close,r->heap_bytes);
+  }
+  printf("Growth exponents between sizes:\n");
+  for(int i = 1;i<size_count;i++){
+    Size_Result * a = &results[i-1];
+    Size_Result * b = &results[i];
+    printf("%8d->%-8d create %5.2f  open %5.2f  traverse %5.2f  close %5.2f\n",a->entries,b->entries,
+	   exponent(a->create,b->create,a->entries,b->entries),
+	   exponent(a->open,b->open,a->entries,b->entries),
+	   exponent(a->traverse,b->traverse,a->entries,b->entries),
+	   exponent(a->close,b->close,a->entries,b->entries));
+  }
+  if(json){
+    FILE * fp = fopen(json,"w");
+    if(!fp){
+      fprintf(stderr,"Could not write %s\n",json);
+      return 1;
+    }
+    fprintf(fp,"{\"detectors\":%d,\"images\":%d,\"results\":[\n",detectors,images);
+    for(int i = 0;i<size_count;i++){
+      Size_Result * r = &results[i];
+      fprintf(fp,"{\"entries\":%d,\"groups\":%ld,\"create_s\":%.6f,\"open_s\":%.6f,"
+	      "\"traverse_s\":%.6f,\"close_s\":%.6f,\"heap_bytes\":%.0f}%s\n",
+	      r->entries,r->groups,r->create,r->open,r->traverse,r->close,r->heap_bytes,
+	      i+1 < size_count ? "," : "");
+    }
+    fprintf(fp,"]}\n");
+    fclose(fp);
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <cxi.h>
+
+/* Maintains and queries a catalogue of CXI files.
+ *
+ *   cxi_index <catalogue> update [-j threads] <dir or file>...
+ *   cxi_index <catalogue> query [column=min:max]...
+ *
+ * Query bounds are in SI units, either of them may be left out,
+ * e.g. distance=0.1:0.5 or photon_energy=:1.6e-15.
+ */
+
+static void usage(void){
+  printf("Usage: cxi_index <catalogue> update [-j threads] <dir or file>...\n");
+  printf("       cxi_index <catalogue> query [column=min:max]...\n");
+  printf("Columns:");
+  for(int c = 0;c<CXI_Catalogue_Column_Count;c++){
+    printf(" %s",cxi_catalogue_column_name(c));
+  }
+  printf("\n");
+}
+
+static int parse_range(const char * arg, CXI_Catalogue_Range * range){
+  const char * eq = strchr(arg,'=');
+  if(!eq){
+    return -1;
+  }
+  range->column = CXI_Catalogue_Column_Count;
+  for(int c = 0;c<CXI_Catalogue_Column_Count;c++){
+    const char * name = cxi_catalogue_column_name(c);
+    if(strlen(name) == (size_t)(eq-arg) && strncmp(arg,name,eq-arg) == 0){
+      range->column = c;
+    }
+  }
+  if(range->column == CXI_Catalogue_Column_Count){
+    return -1;
+  }
+  range->min = -INFINITY;
+  range->max = INFINITY;
+  const char * colon = strchr(eq,':');
+  char * end;
+  if(colon != eq+1){
+    range->min = strtod(eq+1,&end);
+    if(end == eq+1){
+      return -1;
+    }
+  }
+  if(!colon){
+    /* A single value */
+    range->max = range->min;
+  }else if(colon[1]){
+    range->max = strtod(colon+1,&end);
+    if(end == colon+1){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static int update(CXI_Catalogue * catalogue, const char * filename, int argc, char ** argv){
+  int nthreads = 0;
+  const char ** roots = malloc(sizeof(char *)*(argc+1));
+  int root_count = 0;
+  for(int i = 0;i<argc;i++){
+    if(strcmp(argv[i],"-j") == 0 && i+1 < argc){
+      nthreads = atoi(argv[++i]);
+    }else{
+      roots[root_count++] = argv[i];
+    }
+  }
+  int read = cxi_update_catalogue(catalogue, roots, root_count, nthreads);
+  free(roots);
+  if(read < 0){
+    fprintf(stderr,"Could not update catalogue\n");
+    return -1;
+  }
+  if(cxi_save_catalogue(catalogue, filename)){
+    fprintf(stderr,"Could not write %s\n",filename);
+    return -1;
+  }
+  printf("Read %d files, %llu files and %llu rows in the catalogue\n",read,
+	 (unsigned long long)catalogue->file_count,(unsigned long long)catalogue->row_count);
+  return 0;
+}
+
+static int query(CXI_Catalogue * catalogue, int argc, char ** argv){
+  CXI_Catalogue_Range * ranges = malloc(sizeof(CXI_Catalogue_Range)*(argc+1));
+  for(int i = 0;i<argc;i++){
+    if(parse_range(argv[i],&ranges[i])){
+      fprintf(stderr,"Invalid range %s\n",argv[i]);
+      free(ranges);
+      return -1;
+    }
+  }
+  hsize_t * rows = malloc(sizeof(hsize_t)*(catalogue->row_count+1));
+  hsize_t n = cxi_query_catalogue(catalogue, ranges, argc, rows);
+  printf("path\ttitle\tsample");
+  for(int c = 0;c<CXI_Catalogue_Column_Count;c++){
+    printf("\t%s",cxi_catalogue_column_name(c));
+  }
+  printf("\n");
+  for(hsize_t i = 0;i<n;i++){
+    hsize_t r = rows[i];
+    printf("%s\t%s\t%s",catalogue->paths[catalogue->row_file[r]],
+	   catalogue->titles[r] ? catalogue->titles[r] : "",
+	   catalogue->samples[r] ? catalogue->samples[r] : "");
+    for(int c = 0;c<CXI_Catalogue_Column_Count;c++){
+      printf("\t%g",catalogue->columns[c][r]);
+    }
+    printf("\n");
+  }
+  free(rows);
+  free(ranges);
+  return 0;
+}
+
+int main(int argc, char ** argv){
+  if(argc < 3){
+    usage();
+    return 0;
+  }
+  CXI_Catalogue * catalogue = cxi_open_catalogue(argv[1]);
+  if(!catalogue){
+    fprintf(stderr,"Could not read %s\n",argv[1]);
+    return 1;
+  }
+  int ret;
+  if(strcmp(argv[2],"update") == 0){
+    ret = update(catalogue, argv[1], argc-3, argv+3);
+  }else if(strcmp(argv[2],"query") == 0){
+    ret = query(catalogue, argc-3, argv+3);
+  }else{
+    usage();
+    ret = -1;
+  }
+  cxi_close_catalogue(catalogue);
+  return ret ? 1 : 0;
+}
@@ -0,0 +1,626 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cxi.h>
+
+/* Receives detector frames over a socket and appends them to rotating
+ * CXI files.
+ *
+ *   cxi_ingestd -l tcp:<port>|unix:<path> -r rows -c cols [-t u8|u16|i32|f32|f64]
+ *               [-o output prefix] [-k chunk frames] [-z deflate level]
+ *               [-F frames per file] [-M MB per file] [-q queued batches]
+ *               [-n connections] [-i report interval] [-L loopback frames]
+ *               [-m 1]
+ *
+ * Every message starts with a 16 byte header: the bytes "CXIF", the
+ * number of frames as a little endian 32 bit integer and the size of the
+ * frames that follow in bytes as a little endian 64 bit integer. A
+ * message without frames ends the connection. Several senders can be
+ * connected at once, their frames are interleaved in arrival order.
+ *
+ * Each connection has a thread receiving frames straight into buffers of
+ * whole chunks taken from a frame pool, and a single thread appends the
+ * full buffers to the files, so chunks are copied from the socket to the
+ * files without conversion. When the writer falls behind the queue
+ * fills up, the receivers stop reading and TCP slows the senders down.
+ * The ingest rate and the backlog of frames waiting to be written are
+ * reported every interval. With -m 1 a master file "<prefix>.cxi" stacks
+ * the files already finished into one dataset.
+ *
+ * The program exits after -n connections ended, or on SIGINT or SIGTERM.
+ * -L starts a sender in the program itself that sends the given number
+ * of synthetic frames through the socket, after which the files are read
+ * back and checked; it stands in for a detector when testing.
+ */
+
+#define HEADER_BYTES 16
+#define MAX_CONNECTIONS 64
+
+typedef struct{
+  char * listen;
+  int rows;
+  int cols;
+  const char * dtype;
+  const char * prefix;
+  int chunk_frames;
+  int deflate;
+  int file_frames;
+  double file_mb;
+  int queue;
+  int connections;
+  double interval;
+  long loopback;
+  int master;
+}Options;
+
+typedef struct{
+  void * buffer;
+  hsize_t frames;
+}Batch;
+
+/* Full batches from the receivers to the writer */
+typedef struct{
+  Batch * batches;
+  int capacity;
+  int head;
+  int count;
+  hsize_t frames;
+  int done;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty;
+  pthread_cond_t not_full;
+}Queue;
+
+static Options opt = {NULL, 0, 0, "u16", "cxi_ingestd", 0, 0, 0, 0, 8, 0, 1, 0, 0};
+static volatile sig_atomic_t stopping = 0;
+static Queue queue;
+static CXI_Frame_Pool * pool;
+static size_t frame_bytes;
+static hsize_t batch_frames;
+static struct sockaddr_storage address;
+static socklen_t address_length;
+static int finished_connections = 0;
+static pthread_mutex_t connections_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+static hid_t dtype_type(const char * name){
+  if(strcmp(name,"u8") == 0) return H5T_NATIVE_UINT8;
+  if(strcmp(name,"u16") == 0) return H5T_NATIVE_UINT16;
+  if(strcmp(name,"i32") == 0) return H5T_NATIVE_INT32;
+  if(strcmp(name,"f32") == 0) return H5T_NATIVE_FLOAT;
+  if(strcmp(name,"f64") == 0) return H5T_NATIVE_DOUBLE;
+  return -1;
+}
+
+static void on_signal(int sig){
+  (void)sig;
+  stopping = 1;
+}
+
+static void push_batch(void * buffer, hsize_t frames){
+  pthread_mutex_lock(&queue.lock);
+  while(queue.count == queue.capacity){
+    pthread_cond_wait(&queue.not_full, &queue.lock);
+  }
+  Batch * b = &queue.batches[(queue.head+queue.count)%queue.capacity];
+  b->buffer = buffer;
+  b->frames = frames;
+  queue.count++;
+  queue.frames += frames;
+  pthread_cond_signal(&queue.not_empty);
+  pthread_mutex_unlock(&queue.lock);
+}
+
+/* Waits at most timeout seconds, returns 0 if there was nothing and -1
+   once the queue is drained and closed */
+static int pop_batch(Batch * b, double timeout){
+  pthread_mutex_lock(&queue.lock);
+  if(queue.count == 0 && !queue.done){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    double t = ts.tv_sec + 1e-9*ts.tv_nsec + timeout;
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t-ts.tv_sec)*1e9);
+    pthread_cond_timedwait(&queue.not_empty, &queue.lock, &ts);
+  }
+  int ret = 0;
+  if(queue.count){
+    *b = queue.batches[queue.head];
+    queue.head = (queue.head+1)%queue.capacity;
+    queue.count--;
+    queue.frames -= b->frames;
+    pthread_cond_signal(&queue.not_full);
+    ret = 1;
+  }else if(queue.done){
+    ret = -1;
+  }
+  pthread_mutex_unlock(&queue.lock);
+  return ret;
+}
+
+static hsize_t backlog(void){
+  pthread_mutex_lock(&queue.lock);
+  hsize_t frames = queue.frames;
+  pthread_mutex_unlock(&queue.lock);
+  return frames;
+}
+
+/* Returns the bytes read, less than n only at the end of the connection */
+static size_t read_all(int fd, void * buffer, size_t n){
+  size_t done = 0;
+  while(done < n){
+    ssize_t r = read(fd, (char *)buffer+done, n-done);
+    if(r < 0 && errno == EINTR){
+      continue;
+    }
+    if(r <= 0){
+      break;
+    }
+    done += r;
+  }
+  return done;
+}
+
+static int write_all(int fd, const void * buffer, size_t n){
+  size_t done = 0;
+  while(done < n){
+    ssize_t w = write(fd, (const char *)buffer+done, n-done);
+    if(w < 0 && errno == EINTR){
+      continue;
+    }
+    if(w <= 0){
+      return -1;
+    }
+    done += w;
+  }
+  return 0;
+}
+
+static void encode_header(unsigned char * h, uint32_t frames, uint64_t bytes){
+  memcpy(h, "CXIF", 4);
+  for(int i = 0;i<4;i++){
+    h[4+i] = frames >> (8*i);
+  }
+  for(int i = 0;i<8;i++){
+    h[8+i] = bytes >> (8*i);
+  }
+}
+
+static int decode_header(const unsigned char * h, uint32_t * frames, uint64_t * bytes){
+  if(memcmp(h, "CXIF", 4)){
+    return -1;
+  }
+  *frames = 0;
+  *bytes = 0;
+  for(int i = 0;i<4;i++){
+    *frames |= (uint32_t)h[4+i] << (8*i);
+  }
+  for(int i = 0;i<8;i++){
+    *bytes |= (uint64_t)h[8+i] << (8*i);
+  }
+  return 0;
+}
+
+/* Is more data already waiting on the socket? */
+static int readable(int fd){
+  struct pollfd p = {fd, POLLIN, 0};
+  return poll(&p, 1, 0) > 0;
+}
+
+static void * receive(void * arg){
+  int fd = (int)(intptr_t)arg;
+  unsigned char * buffer = NULL;
+  hsize_t filled = 0;
+  for(;;){
+    unsigned char h[HEADER_BYTES];
+    uint32_t frames;
+    uint64_t bytes;
+    if(read_all(fd, h, HEADER_BYTES) != HEADER_BYTES || decode_header(h, &frames, &bytes)){
+      fprintf(stderr,"cxi_ingestd: connection lost or bad header\n");
+      break;
+    }
+    if(frames == 0){
+      break;
+    }
+    if(bytes != frames*frame_bytes){
+      fprintf(stderr,"cxi_ingestd: %u frames of %llu bytes do not match the frame size\n",
+	      frames,(unsigned long long)bytes);
+      break;
+    }
+    int lost = 0;
+    while(frames && !lost){
+      if(!buffer){
+	buffer = cxi_frame_pool_get(pool);
+	filled = 0;
+	if(!buffer){
+	  fprintf(stderr,"cxi_ingestd: out of memory\n");
+	  lost = 1;
+	  break;
+	}
+      }
+      hsize_t n = batch_frames-filled < frames ? batch_frames-filled : frames;
+      if(read_all(fd, buffer+filled*frame_bytes, n*frame_bytes) != n*frame_bytes){
+	lost = 1;
+	break;
+      }
+      filled += n;
+      frames -= n;
+      if(filled == batch_frames){
+	push_batch(buffer, filled);
+	buffer = NULL;
+      }
+    }
+    if(lost){
+      fprintf(stderr,"cxi_ingestd: connection lost in the middle of a message\n");
+      break;
+    }
+    /* Waiting for a full batch only pays when frames keep coming */
+    if(buffer && filled && !readable(fd)){
+      push_batch(buffer, filled);
+      buffer = NULL;
+    }
+  }
+  if(buffer && filled){
+    push_batch(buffer, filled);
+  }else if(buffer){
+    cxi_frame_pool_put(pool, buffer);
+  }
+  /* The socket is closed once the thread is joined, so that a signal can
+     still shut it down to wake up a blocked read */
+  pthread_mutex_lock(&connections_lock);
+  finished_connections++;
+  pthread_mutex_unlock(&connections_lock);
+  return NULL;
+}
+
+/* The synthetic frames of the loopback sender, byte j of frame f is
+   (31f+j) mod 256, copied out of a ramp so that the sender keeps up */
+static unsigned char * ramp;
+
+static void fill_pattern(unsigned char * frames, hsize_t first, hsize_t n){
+  for(hsize_t f = 0;f<n;f++){
+    memcpy(frames+f*frame_bytes, ramp+(first+f)*31%256, frame_bytes);
+  }
+}
+
+static void * loopback_sender(void * arg){
+  (void)arg;
+  int fd = socket(address.ss_family, SOCK_STREAM, 0);
+  if(fd < 0 || connect(fd, (struct sockaddr *)&address, address_length)){
+    fprintf(stderr,"cxi_ingestd: loopback sender could not connect\n");
+    if(fd >= 0) close(fd);
+    return (void *)1;
+  }
+  /* Messages of an odd size so that they straddle batches */
+  hsize_t per_message = batch_frames/3+1;
+  unsigned char * frames = malloc(per_message*frame_bytes);
+  unsigned char h[HEADER_BYTES];
+  int ret = 0;
+  for(hsize_t sent = 0;sent<(hsize_t)opt.loopback && !ret;){
+    hsize_t n = opt.loopback-sent < per_message ? opt.loopback-sent : per_message;
+    fill_pattern(frames, sent, n);
+    encode_header(h, n, n*frame_bytes);
+    ret = write_all(fd, h, HEADER_BYTES) || write_all(fd, frames, n*frame_bytes);
+    sent += n;
+  }
+  encode_header(h, 0, 0);
+  ret = ret || write_all(fd, h, HEADER_BYTES);
+  free(frames);
+  close(fd);
+  return (void *)(intptr_t)ret;
+}
+
+/* Checks that a file holds the loopback frames from first on and
+   returns how many it holds, or -1 */
+static long check_file(const char * filename, hsize_t first, hid_t type){
+  CXI_File * file = cxi_open_file(filename,"r");
+  CXI_Entry * entry = file && file->entry_count ? cxi_open_entry(file->entries[0]) : NULL;
+  CXI_Data * data = entry && entry->data_count ? cxi_open_data(entry->data[0]) : NULL;
+  CXI_Dataset * dataset = data && data->data ? cxi_open_dataset(data->data) : NULL;
+  if(!dataset){
+    fprintf(stderr,"cxi_ingestd: could not read back %s\n",filename);
+    if(file) cxi_close_file(file);
+    return -1;
+  }
+  hsize_t n = dataset->dimensions[0];
+  unsigned char * got = malloc(n*frame_bytes+1);
+  unsigned char * expected = malloc(n*frame_bytes+1);
+  fill_pattern(expected, first, n);
+  int differ = n && (cxi_read_dataset(dataset, got, type) || memcmp(got, expected, n*frame_bytes));
+  free(got);
+  free(expected);
+  cxi_close_file(file);
+  if(differ){
+    fprintf(stderr,"cxi_ingestd: frames of %s differ from the ones sent\n",filename);
+    return -1;
+  }
+  return n;
+}
+
+/* Reads back the files written from the loopback sender */
+static int check_loopback(int file_count, hid_t type){
+  hsize_t first = 0;
+  char * filename = malloc(strlen(opt.prefix)+32);
+  for(int i = 0;i<file_count;i++){
+    sprintf(filename,"%s_%04d.cxi",opt.prefix,i+1);
+    long n = check_file(filename, first, type);
+    if(n < 0){
+      return -1;
+    }
+    first += n;
+  }
+  if(opt.master){
+    sprintf(filename,"%s.cxi",opt.prefix);
+    if(check_file(filename, 0, type) != (long)first){
+      fprintf(stderr,"cxi_ingestd: %s does not stack all the frames\n",filename);
+      return -1;
+    }
+  }
+  free(filename);
+  if(first != (hsize_t)opt.loopback){
+    fprintf(stderr,"cxi_ingestd: %llu frames written, %ld sent\n",(unsigned long long)first,opt.loopback);
+    return -1;
+  }
+  printf("Loopback: %llu frames in %d files match\n",(unsigned long long)first,file_count);
+  return 0;
+}
+
+static int open_listener(const char * spec){
+  memset(&address, 0, sizeof(address));
+  int fd = -1;
+  if(strncmp(spec,"tcp:",4) == 0){
+    struct sockaddr_in * in = (struct sockaddr_in *)&address;
+    in->sin_family = AF_INET;
+    in->sin_port = htons(atoi(spec+4));
+    in->sin_addr.s_addr = htonl(INADDR_ANY);
+    address_length = sizeof(struct sockaddr_in);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  }else if(strncmp(spec,"unix:",5) == 0 && strlen(spec+5) < sizeof(((struct sockaddr_un *)0)->sun_path)){
+    struct sockaddr_un * un = (struct sockaddr_un *)&address;
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, spec+5);
+    address_length = sizeof(struct sockaddr_un);
+    unlink(spec+5);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  }else{
+    return -1;
+  }
+  if(fd < 0 || bind(fd, (struct sockaddr *)&address, address_length) || listen(fd, MAX_CONNECTIONS)){
+    perror("cxi_ingestd");
+    if(fd >= 0) close(fd);
+    return -1;
+  }
+  /* Port 0 picks a free port, the loopback sender needs to know which */
+  getsockname(fd, (struct sockaddr *)&address, &address_length);
+  if(address.ss_family == AF_INET){
+    struct sockaddr_in * in = (struct sockaddr_in *)&address;
+    in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    printf("Listening on TCP port %d\n",ntohs(in->sin_port));
+  }else{
+    printf("Listening on %s\n",spec+5);
+  }
+  fflush(stdout);
+  return fd;
+}
+
+typedef struct{
+  CXI_Frame_Stream * stream;
+  hid_t type;
+  int failed;
+}Writer;
+
+static void report(CXI_Frame_Stream * stream, double elapsed, hsize_t frames, double seconds, int final){
+  double mb = frames*(double)frame_bytes/1e6;
+  printf("%s%.1f s: %llu frames in %d files, %.1f MB/s, %.0f frames/s, backlog %llu frames\n",
+	 final ? "Total " : "", elapsed, (unsigned long long)stream->frame_count, stream->file_count,
+	 seconds > 0 ? mb/seconds : 0, seconds > 0 ? frames/seconds : 0,
+	 (unsigned long long)backlog());
+  fflush(stdout);
+}
+
+static void * write_batches(void * arg){
+  Writer * w = arg;
+  double start = now();
+  double last = start;
+  hsize_t last_frames = 0;
+  for(;;){
+    Batch b;
+    int got = pop_batch(&b, opt.interval);
+    if(got < 0){
+      break;
+    }
+    if(got){
+      if(!w->failed && cxi_append_frames(w->stream, b.buffer, b.frames, w->type)){
+	fprintf(stderr,"cxi_ingestd: could not write to %s\n",w->stream->filename);
+	w->failed = 1;
+      }
+      cxi_frame_pool_put(pool, b.buffer);
+    }
+    double t = now();
+    if(t-last >= opt.interval){
+      report(w->stream, t-start, w->stream->frame_count-last_frames, t-last, 0);
+      last = t;
+      last_frames = w->stream->frame_count;
+    }
+  }
+  double t = now();
+  report(w->stream, t-start, w->stream->frame_count, t-start, 1);
+  return NULL;
+}
+
+static void usage(void){
+  printf("Usage: cxi_ingestd -l tcp:<port>|unix:<path> -r rows -c cols [-t u8|u16|i32|f32|f64]\n");
+  printf("                   [-o output prefix] [-k chunk frames] [-z deflate level]\n");
+  printf("                   [-F frames per file] [-M MB per file] [-q queued batches]\n");
+  printf("                   [-n connections] [-i report interval] [-L loopback frames]\n");
+  printf("                   [-m 1]\n");
+}
+
+int main(int argc, char ** argv){
+  for(int i = 1;i<argc;i++){
+    if(argv[i][0] != '-' || !argv[i][1] || argv[i][2] || i+1 == argc){
+      usage();
+      return 1;
+    }
+    char * v = argv[++i];
+    switch(argv[i-1][1]){
+    case 'l': opt.listen = v; break;
+    case 'r': opt.rows = atoi(v); break;
+    case 'c': opt.cols = atoi(v); break;
+    case 't': opt.dtype = v; break;
+    case 'o': opt.prefix = v; break;
+    case 'k': opt.chunk_frames = atoi(v); break;
+    case 'z': opt.deflate = atoi(v); break;
+    case 'F': opt.file_frames = atoi(v); break;
+    case 'M': opt.file_mb = atof(v); break;
+    case 'q': opt.queue = atoi(v); break;
+    case 'n': opt.connections = atoi(v); break;
+    case 'i': opt.interval = atof(v); break;
+    case 'L': opt.loopback = atol(v); break;
+    case 'm': opt.master = atoi(v); break;
+    default: usage(); return 1;
+    }
+  }
+  hid_t type = dtype_type(opt.dtype);
+  if(!opt.listen || type < 0 || opt.rows < 1 || opt.cols < 1 || opt.chunk_frames < 0 ||
+     opt.file_frames < 0 || opt.file_mb < 0 || opt.queue < 1 || opt.connections < 0 ||
+     opt.interval <= 0 || opt.loopback < 0){
+    usage();
+    return 1;
+  }
+  if(opt.loopback && !opt.connections){
+    opt.connections = 1;
+  }
+
+  hsize_t dims[2] = {opt.rows, opt.cols};
+  CXI_Stream_Options so;
+  memset(&so, 0, sizeof(so));
+  so.chunk_frames = opt.chunk_frames;
+  so.deflate_level = opt.deflate;
+  so.max_file_frames = opt.file_frames;
+  so.max_file_bytes = opt.file_mb*1e6;
+  so.master = opt.master;
+  Writer writer = {NULL, type, 0};
+  writer.stream = cxi_create_frame_stream(opt.prefix, 2, dims, type, &so);
+  if(!writer.stream){
+    fprintf(stderr,"cxi_ingestd: could not create %s_0001.cxi\n",opt.prefix);
+    return 1;
+  }
+  frame_bytes = writer.stream->frame_bytes;
+  /* Whole chunks, which go to the files without being copied again */
+  batch_frames = writer.stream->options.chunk_frames;
+  pool = cxi_create_frame_pool(writer.stream->dataset, type, batch_frames,
+			       opt.queue+MAX_CONNECTIONS, CXI_Pool_Page_Aligned);
+  queue.capacity = opt.queue;
+  queue.batches = calloc(sizeof(Batch), opt.queue);
+  pthread_mutex_init(&queue.lock, NULL);
+  pthread_cond_init(&queue.not_empty, NULL);
+  pthread_cond_init(&queue.not_full, NULL);
+
+  int listener = open_listener(opt.listen);
+  if(listener < 0 || !pool || !queue.batches){
+    usage();
+    return 1;
+  }
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  pthread_t writer_thread;
+  pthread_create(&writer_thread, NULL, write_batches, &writer);
+  pthread_t sender;
+  if(opt.loopback){
+    ramp = malloc(frame_bytes+256);
+    for(size_t j = 0;j<frame_bytes+256;j++){
+      ramp[j] = (unsigned char)j;
+    }
+    pthread_create(&sender, NULL, loopback_sender, NULL);
+  }
+  pthread_t receivers[MAX_CONNECTIONS];
+  int sockets[MAX_CONNECTIONS];
+  int receiver_count = 0;
+  int accepted = 0;
+  while(!stopping){
+    pthread_mutex_lock(&connections_lock);
+    int done = opt.connections && finished_connections >= opt.connections;
+    pthread_mutex_unlock(&connections_lock);
+    if(done){
+      break;
+    }
+    struct pollfd p = {listener, POLLIN, 0};
+    if(poll(&p, 1, 200) <= 0 || (opt.connections && accepted == opt.connections)){
+      continue;
+    }
+    int fd = accept(listener, NULL, NULL);
+    if(fd < 0){
+      continue;
+    }
+    if(receiver_count == MAX_CONNECTIONS){
+      fprintf(stderr,"cxi_ingestd: too many connections\n");
+      close(fd);
+      continue;
+    }
+    int size = 8*1024*1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    sockets[receiver_count] = fd;
+    pthread_create(&receivers[receiver_count++], NULL, receive, (void *)(intptr_t)fd);
+    accepted++;
+  }
+  close(listener);
+  if(address.ss_family == AF_UNIX){
+    unlink(((struct sockaddr_un *)&address)->sun_path);
+  }
+  /* Receivers stop when their senders hang up, or now if asked to stop */
+  for(int i = 0;i<receiver_count;i++){
+    if(stopping){
+      shutdown(sockets[i], SHUT_RDWR);
+    }
+    pthread_join(receivers[i], NULL);
+    close(sockets[i]);
+  }
+  int ret = writer.failed;
+  if(opt.loopback){
+    void * sent;
+    pthread_join(sender, &sent);
+    ret |= sent != NULL;
+  }
+  pthread_mutex_lock(&queue.lock);
+  queue.done = 1;
+  pthread_cond_signal(&queue.not_empty);
+  pthread_mutex_unlock(&queue.lock);
+  pthread_join(writer_thread, NULL);
+  ret |= writer.failed;
+  int file_count = writer.stream->file_count;
+  if(cxi_close_frame_stream(writer.stream)){
+    fprintf(stderr,"cxi_ingestd: could not write the last frames\n");
+    ret = 1;
+  }
+  cxi_free_frame_pool(pool);
+  if(!ret && opt.loopback && check_loopback(file_count, type)){
+    ret = 1;
+  }
+  free(queue.batches);
+  free(ramp);
+  return ret ? 1 : 0;
+}
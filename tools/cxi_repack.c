@@ -0,0 +1,919 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <cxi.h>
+#include "cxi_private.h"
+
+/* Rewrites CXI files with chunk shapes and compression chosen per dataset.
+ *
+ *   cxi_repack [-j threads] [-z deflate level] [-c chunk bytes]
+ *              [-t min dataset bytes] [-f] [-v] <input> <output>
+ *
+ * The input is a file, rewritten to the output file, or a directory
+ * whose HDF5 files are rewritten to the same relative paths under the
+ * output directory. Groups, attributes, soft and external links, such as
+ * the ones left by cxi_create_data_link, and objects reachable through
+ * several hard links are recreated as they are, so the entry, instrument
+ * and detector hierarchy reads the same afterwards.
+ *
+ * Numeric datasets of at least -t bytes are rechunked in whole frames of
+ * about -c bytes, splitting the rows of frames larger than that, and
+ * compressed with shuffle and deflate at the given level, 0 storing the
+ * chunks without filters. Everything else is copied as it is. Chunks are
+ * gathered, shuffled and deflated by -j threads while the next frames are
+ * read, and go to the file with H5Dwrite_chunk, so the encoding does not
+ * wait on HDF5.
+ *
+ * Each file is written under "<output>.partial" and renamed once
+ * complete; outputs that already exist are skipped unless -f is given,
+ * so an interrupted run is resumed by running it again. -v reads back
+ * every rewritten file and compares it to its input. Sizes, compression
+ * ratio and throughput are reported per file and for the whole run.
+ */
+
+#define BLOCK_BYTES (64*1024*1024)
+
+typedef struct{
+  int threads;
+  int level;
+  size_t chunk_bytes;
+  hsize_t min_bytes;
+  int force;
+  int verify;
+}Options;
+
+static Options opt = {0, 4, 1024*1024, 64*1024, 0, 0};
+
+static double now(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
+
+/* How a rechunked dataset is cut. Chunks span whole frames along the
+ * first dimension, or part of the rows of a single frame. */
+typedef struct{
+  hid_t type;
+  size_t element;
+  int rank;
+  hsize_t dims[H5S_MAX_RANK];
+  hsize_t chunk[H5S_MAX_RANK];
+  hsize_t rows;
+  size_t row_bytes;
+  size_t chunk_bytes;
+  hsize_t chunks_per_row;
+  int shuffle;
+}Layout;
+
+/* Frames read at once and their encoded chunks */
+typedef struct{
+  const Layout * layout;
+  unsigned char * frames;
+  hsize_t first;
+  hsize_t n;
+  hsize_t chunks;
+  size_t packed_capacity;
+  unsigned char ** packed;
+  size_t * packed_size;
+  int failed;
+}Batch;
+
+/* Threads encoding the chunks of one batch at a time */
+typedef struct{
+  pthread_mutex_t lock;
+  pthread_cond_t work;
+  pthread_cond_t done;
+  Batch * batch;
+  hsize_t next;
+  hsize_t finished;
+  int quit;
+  int count;
+  pthread_t * threads;
+}Encoders;
+
+static void encode_chunk(Batch * b, hsize_t c, unsigned char ** scratch, size_t * scratch_size){
+  const Layout * l = b->layout;
+  hsize_t r = c / l->chunks_per_row;
+  hsize_t row0 = (c % l->chunks_per_row)*l->chunk[1];
+  if(l->rank < 2){
+    row0 = 0;
+  }
+  if(*scratch_size < 2*l->chunk_bytes){
+    free(*scratch);
+    *scratch = malloc(2*l->chunk_bytes);
+    *scratch_size = *scratch ? 2*l->chunk_bytes : 0;
+    if(!*scratch){
+      b->failed = 1;
+      return;
+    }
+  }
+  unsigned char * raw = *scratch;
+  unsigned char * shuffled = raw+l->chunk_bytes;
+  /* Edge chunks are stored full size, padded with zeros */
+  memset(raw, 0, l->chunk_bytes);
+  hsize_t chunk_rows = l->rank < 2 ? 1 : l->chunk[1];
+  hsize_t present = chunk_rows;
+  if(row0+present > l->rows){
+    present = l->rows-row0;
+  }
+  hsize_t frames = l->chunk[0];
+  if(r*l->chunk[0]+frames > b->n){
+    frames = b->n-r*l->chunk[0];
+  }
+  if(present == l->rows){
+    /* Whole frames are contiguous in the batch already */
+    memcpy(raw, b->frames+r*l->chunk[0]*l->rows*l->row_bytes, frames*l->rows*l->row_bytes);
+  }else{
+    for(hsize_t f = 0;f<frames;f++){
+      hsize_t frame = r*l->chunk[0]+f;
+      memcpy(raw+f*chunk_rows*l->row_bytes, b->frames+(frame*l->rows+row0)*l->row_bytes,
+	     present*l->row_bytes);
+    }
+  }
+  if(opt.level == 0){
+    memcpy(b->packed[c], raw, l->chunk_bytes);
+    b->packed_size[c] = l->chunk_bytes;
+    return;
+  }
+  const unsigned char * in = raw;
+  if(l->shuffle){
+    /* Byte j of element i goes to j*n+i, as the shuffle filter does */
+    size_t n = l->chunk_bytes/l->element;
+    for(size_t i = 0;i<n;i++){
+      for(size_t j = 0;j<l->element;j++){
+	shuffled[j*n+i] = raw[i*l->element+j];
+      }
+    }
+    in = shuffled;
+  }
+  uLongf size = b->packed_capacity;
+  if(compress2(b->packed[c], &size, in, l->chunk_bytes, opt.level) != Z_OK){
+    b->failed = 1;
+    return;
+  }
+  b->packed_size[c] = size;
+}
+
+static void * encode(void * arg){
+  Encoders * e = arg;
+  unsigned char * scratch = NULL;
+  size_t scratch_size = 0;
+  pthread_mutex_lock(&e->lock);
+  while(1){
+    while(!e->quit && (!e->batch || e->next == e->batch->chunks)){
+      pthread_cond_wait(&e->work, &e->lock);
+    }
+    if(e->quit){
+      break;
+    }
+    Batch * b = e->batch;
+    hsize_t c = e->next++;
+    pthread_mutex_unlock(&e->lock);
+    encode_chunk(b, c, &scratch, &scratch_size);
+    pthread_mutex_lock(&e->lock);
+    if(++e->finished == b->chunks){
+      pthread_cond_broadcast(&e->done);
+    }
+  }
+  pthread_mutex_unlock(&e->lock);
+  free(scratch);
+  return NULL;
+}
+
+static void submit(Encoders * e, Batch * b){
+  pthread_mutex_lock(&e->lock);
+  e->batch = b;
+  e->next = 0;
+  e->finished = 0;
+  pthread_cond_broadcast(&e->work);
+  pthread_mutex_unlock(&e->lock);
+}
+
+static void wait_batch(Encoders * e){
+  pthread_mutex_lock(&e->lock);
+  while(e->batch && e->finished < e->batch->chunks){
+    pthread_cond_wait(&e->done, &e->lock);
+  }
+  e->batch = NULL;
+  pthread_mutex_unlock(&e->lock);
+}
+
+static int start_encoders(Encoders * e, int count){
+  memset(e, 0, sizeof(Encoders));
+  pthread_mutex_init(&e->lock, NULL);
+  pthread_cond_init(&e->work, NULL);
+  pthread_cond_init(&e->done, NULL);
+  e->threads = calloc(sizeof(pthread_t), count);
+  if(!e->threads){
+    return -1;
+  }
+  for(;e->count<count;e->count++){
+    if(pthread_create(&e->threads[e->count], NULL, encode, e)){
+      break;
+    }
+  }
+  return e->count ? 0 : -1;
+}
+
+static void stop_encoders(Encoders * e){
+  pthread_mutex_lock(&e->lock);
+  e->quit = 1;
+  pthread_cond_broadcast(&e->work);
+  pthread_mutex_unlock(&e->lock);
+  for(int i = 0;i<e->count;i++){
+    pthread_join(e->threads[i], NULL);
+  }
+  free(e->threads);
+  pthread_mutex_destroy(&e->lock);
+  pthread_cond_destroy(&e->work);
+  pthread_cond_destroy(&e->done);
+}
+
+static int read_frames(hid_t dataset, hid_t mem_type, int rank, const hsize_t * dims,
+		       hsize_t first, hsize_t n, void * buffer){
+  if(rank == 0){
+    return H5Dread(dataset, mem_type, H5S_ALL, H5S_ALL, H5P_DEFAULT, buffer) < 0 ? -1 : 0;
+  }
+  hsize_t start[H5S_MAX_RANK];
+  hsize_t count[H5S_MAX_RANK];
+  memset(start, 0, sizeof(start));
+  memcpy(count, dims, sizeof(hsize_t)*rank);
+  start[0] = first;
+  count[0] = n;
+  hid_t file_space = H5Dget_space(dataset);
+  hid_t mem_space = H5Screate_simple(rank, count, NULL);
+  herr_t err = H5Sselect_hyperslab(file_space, H5S_SELECT_SET, start, NULL, count, NULL);
+  if(err >= 0){
+    err = H5Dread(dataset, mem_type, mem_space, file_space, H5P_DEFAULT, buffer);
+  }
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  return err < 0 ? -1 : 0;
+}
+
+/* Whole frames up to the target chunk size, or rows of one frame */
+static void choose_chunks(Layout * l){
+  size_t frame = l->element;
+  for(int i = 1;i<l->rank;i++){
+    frame *= l->dims[i];
+    l->chunk[i] = l->dims[i] ? l->dims[i] : 1;
+  }
+  l->rows = l->rank < 2 ? 1 : l->chunk[1];
+  l->row_bytes = frame/l->rows;
+  if(frame <= opt.chunk_bytes || l->rank < 2){
+    l->chunk[0] = frame ? opt.chunk_bytes/frame : 1;
+    if(l->chunk[0] > l->dims[0]){
+      l->chunk[0] = l->dims[0];
+    }
+    if(l->chunk[0] < 1){
+      l->chunk[0] = 1;
+    }
+  }else{
+    l->chunk[0] = 1;
+    l->chunk[1] = opt.chunk_bytes/l->row_bytes;
+    if(l->chunk[1] < 1){
+      l->chunk[1] = 1;
+    }
+  }
+  l->chunks_per_row = l->rank < 2 ? 1 : (l->rows+l->chunk[1]-1)/l->chunk[1];
+  l->chunk_bytes = l->element;
+  for(int i = 0;i<l->rank;i++){
+    l->chunk_bytes *= l->chunk[i];
+  }
+  l->shuffle = l->element > 1;
+}
+
+static int write_batch(hid_t dataset, const Batch * b){
+  if(b->failed){
+    return -1;
+  }
+  const Layout * l = b->layout;
+  hsize_t offset[H5S_MAX_RANK];
+  memset(offset, 0, sizeof(offset));
+  for(hsize_t c = 0;c<b->chunks;c++){
+    offset[0] = b->first+(c/l->chunks_per_row)*l->chunk[0];
+    if(l->rank > 1){
+      offset[1] = (c % l->chunks_per_row)*l->chunk[1];
+    }
+    if(H5Dwrite_chunk(dataset, H5P_DEFAULT, 0, offset, b->packed_size[c], b->packed[c]) < 0){
+      return -1;
+    }
+  }
+  return 0;
+}
+
+static void free_batch(Batch * b){
+  for(hsize_t c = 0;b->packed && c<b->chunks;c++){
+    free(b->packed[c]);
+  }
+  free(b->packed);
+  free(b->packed_size);
+  free(b->frames);
+}
+
+typedef struct{
+  int rechunked;
+  int copied;
+  hsize_t data_bytes;
+  Encoders encoders;
+}Report;
+
+/* Returns 1 for datasets better copied as they are */
+static int repack_dataset(hid_t src_group, const char * name, hid_t dst_group, Report * report){
+  Layout l;
+  memset(&l, 0, sizeof(l));
+  /* A source chunked along other lines must not be decoded again for
+     every batch that touches its chunks */
+  hid_t access = H5Pcreate(H5P_DATASET_ACCESS);
+  H5Pset_chunk_cache(access, 12421, BLOCK_BYTES, 1.0);
+  hid_t src = H5Dopen(src_group, name, access);
+  H5Pclose(access);
+  if(src < 0){
+    return -1;
+  }
+  hid_t src_plist = H5Dget_create_plist(src);
+  hid_t space = H5Dget_space(src);
+  l.type = H5Dget_type(src);
+  l.element = H5Tget_size(l.type);
+  l.rank = H5Sget_simple_extent_ndims(space);
+  H5Sget_simple_extent_dims(space, l.dims, NULL);
+  H5T_class_t type_class = H5Tget_class(l.type);
+  hsize_t bytes = l.element*H5Sget_simple_extent_npoints(space);
+  if(l.rank < 1 || (type_class != H5T_INTEGER && type_class != H5T_FLOAT) ||
+     H5Pget_layout(src_plist) == H5D_VIRTUAL || bytes < opt.min_bytes || bytes == 0){
+    H5Sclose(space);
+    H5Tclose(l.type);
+    H5Pclose(src_plist);
+    H5Dclose(src);
+    return 1;
+  }
+  choose_chunks(&l);
+  int ret = -1;
+  hid_t plist = H5Pcreate(H5P_DATASET_CREATE);
+  H5D_fill_value_t fill;
+  if(H5Pfill_value_defined(src_plist, &fill) >= 0 && fill == H5D_FILL_VALUE_USER_DEFINED){
+    void * value = calloc(l.element,1);
+    H5Pget_fill_value(src_plist, l.type, value);
+    H5Pset_fill_value(plist, l.type, value);
+    free(value);
+  }
+  H5Pset_chunk(plist, l.rank, l.chunk);
+  if(opt.level){
+    if(l.shuffle){
+      H5Pset_shuffle(plist);
+    }
+    H5Pset_deflate(plist, opt.level);
+  }
+  hid_t dst = H5Dcreate(dst_group, name, l.type, space, H5P_DEFAULT, plist, H5P_DEFAULT);
+  H5Pclose(plist);
+  /* Enough chunks per batch to keep every thread busy */
+  hsize_t batch_rows = (2*report->encoders.count+l.chunks_per_row-1)/l.chunks_per_row;
+  hsize_t frames_per_batch = batch_rows*l.chunk[0];
+  Batch batches[2];
+  memset(batches, 0, sizeof(batches));
+  for(int i = 0;i<2;i++){
+    Batch * b = &batches[i];
+    b->layout = &l;
+    b->chunks = batch_rows*l.chunks_per_row;
+    b->packed_capacity = compressBound(l.chunk_bytes);
+    b->frames = malloc(frames_per_batch*l.rows*l.row_bytes);
+    b->packed = calloc(sizeof(unsigned char *), b->chunks);
+    b->packed_size = calloc(sizeof(size_t), b->chunks);
+    for(hsize_t c = 0;b->frames && b->packed && c<b->chunks;c++){
+      b->packed[c] = malloc(b->packed_capacity);
+      if(!b->packed[c]){
+	b->failed = 1;
+      }
+    }
+    if(!b->frames || !b->packed || !b->packed_size){
+      b->failed = 1;
+    }
+  }
+  if(dst < 0 || batches[0].failed || batches[1].failed || cxi_copy_attributes(src, dst)){
+    goto done;
+  }
+  /* Reads the next frames while the threads encode the previous ones,
+     then writes those out while the threads move on */
+  Batch * previous = NULL;
+  for(hsize_t first = 0;first<l.dims[0];first += frames_per_batch){
+    Batch * b = previous == &batches[0] ? &batches[1] : &batches[0];
+    b->first = first;
+    b->n = l.dims[0]-first < frames_per_batch ? l.dims[0]-first : frames_per_batch;
+    b->chunks = (b->n+l.chunk[0]-1)/l.chunk[0]*l.chunks_per_row;
+    if(read_frames(src, l.type, l.rank, l.dims, first, b->n, b->frames)){
+      wait_batch(&report->encoders);
+      goto done;
+    }
+    wait_batch(&report->encoders);
+    submit(&report->encoders, b);
+    if(previous && write_batch(dst, previous)){
+      wait_batch(&report->encoders);
+      goto done;
+    }
+    previous = b;
+  }
+  wait_batch(&report->encoders);
+  if(previous && write_batch(dst, previous)){
+    goto done;
+  }
+  report->rechunked++;
+  report->data_bytes += bytes;
+  ret = 0;
+ done:
+  batches[0].chunks = batches[1].chunks = batch_rows*l.chunks_per_row;
+  free_batch(&batches[0]);
+  free_batch(&batches[1]);
+  if(dst >= 0){
+    H5Dclose(dst);
+  }
+  H5Sclose(space);
+  H5Tclose(l.type);
+  H5Pclose(src_plist);
+  H5Dclose(src);
+  return ret;
+}
+
+/* Objects with several hard links, copied once and linked afterwards */
+typedef struct{
+  haddr_t address;
+  char * path;
+}Shared;
+
+typedef struct{
+  hid_t dst_file;
+  Shared * shared;
+  int shared_count;
+  Report * report;
+}Walk;
+
+typedef struct{
+  Walk * walk;
+  hid_t dst;
+  const char * path;
+}Level;
+
+static H5_index_t link_order(hid_t group){
+  hid_t plist = H5Gget_create_plist(group);
+  unsigned flags = 0;
+  H5Pget_link_creation_order(plist, &flags);
+  H5Pclose(plist);
+  return (flags & H5P_CRT_ORDER_INDEXED) ? H5_INDEX_CRT_ORDER : H5_INDEX_NAME;
+}
+
+static char * join(const char * path, const char * name){
+  char * s = malloc(strlen(path)+strlen(name)+2);
+  if(s){
+    sprintf(s, "%s/%s", strcmp(path,"/") ? path : "", name);
+  }
+  return s;
+}
+
+static int remember(Walk * walk, const H5O_info_t * object, const char * path){
+  if(object->rc < 2){
+    return 0;
+  }
+  Shared * s = realloc(walk->shared, sizeof(Shared)*(walk->shared_count+1));
+  if(!s){
+    return -1;
+  }
+  walk->shared = s;
+  walk->shared[walk->shared_count].address = object->addr;
+  walk->shared[walk->shared_count].path = strdup(path);
+  return walk->shared[walk->shared_count++].path ? 0 : -1;
+}
+
+static int copy_group(hid_t src, hid_t dst, const char * path, Walk * walk);
+
+static herr_t copy_link(hid_t src, const char * name, const H5L_info_t * info, void * data){
+  Level * level = data;
+  Walk * walk = level->walk;
+  if(info->type == H5L_TYPE_SOFT || info->type == H5L_TYPE_EXTERNAL){
+    char * value = malloc(info->u.val_size);
+    herr_t err = -1;
+    if(value && H5Lget_val(src, name, value, info->u.val_size, H5P_DEFAULT) >= 0){
+      if(info->type == H5L_TYPE_SOFT){
+	err = H5Lcreate_soft(value, level->dst, name, H5P_DEFAULT, H5P_DEFAULT);
+      }else{
+	const char * file;
+	const char * object;
+	unsigned flags;
+	if(H5Lunpack_elink_val(value, info->u.val_size, &flags, &file, &object) >= 0){
+	  err = H5Lcreate_external(file, object, level->dst, name, H5P_DEFAULT, H5P_DEFAULT);
+	}
+      }
+    }
+    free(value);
+    return err;
+  }
+  if(info->type != H5L_TYPE_HARD){
+    return -1;
+  }
+  H5O_info_t object;
+  if(H5Oget_info_by_name(src, name, &object, H5P_DEFAULT) < 0){
+    return -1;
+  }
+  for(int i = 0;object.rc > 1 && i<walk->shared_count;i++){
+    if(walk->shared[i].address == object.addr){
+      return H5Lcreate_hard(walk->dst_file, walk->shared[i].path, level->dst, name,
+			    H5P_DEFAULT, H5P_DEFAULT);
+    }
+  }
+  char * path = join(level->path, name);
+  if(!path){
+    return -1;
+  }
+  int err = -1;
+  if(object.type == H5O_TYPE_GROUP){
+    hid_t group = H5Gopen(src, name, H5P_DEFAULT);
+    hid_t plist = H5Gget_create_plist(group);
+    hid_t copy = H5Gcreate(level->dst, name, H5P_DEFAULT, plist, H5P_DEFAULT);
+    /* Known before descending, in case a subgroup links back to it */
+    if(copy >= 0 && !remember(walk, &object, path)){
+      err = copy_group(group, copy, path, walk);
+    }
+    if(copy >= 0){
+      H5Gclose(copy);
+    }
+    H5Pclose(plist);
+    H5Gclose(group);
+  }else{
+    err = 1;
+    if(object.type == H5O_TYPE_DATASET){
+      err = repack_dataset(src, name, level->dst, walk->report);
+    }
+    if(err == 1){
+      walk->report->copied += object.type == H5O_TYPE_DATASET;
+      err = H5Ocopy(src, name, level->dst, name, H5P_DEFAULT, H5P_DEFAULT) < 0 ? -1 : 0;
+    }
+    if(!err){
+      err = remember(walk, &object, path);
+    }
+  }
+  free(path);
+  return err ? -1 : 0;
+}
+
+static int copy_group(hid_t src, hid_t dst, const char * path, Walk * walk){
+  if(cxi_copy_attributes(src, dst)){
+    return -1;
+  }
+  Level level = {walk, dst, path};
+  hsize_t index = 0;
+  return H5Literate(src, link_order(src), H5_ITER_INC, &index, copy_link, &level) < 0 ? -1 : 0;
+}
+
+/* Reading back */
+
+static int same_contents(hid_t a, hid_t b){
+  hid_t type = H5Dget_type(a);
+  hid_t space = H5Dget_space(a);
+  hid_t other_type = H5Dget_type(b);
+  hid_t other_space = H5Dget_space(b);
+  int ret = -1;
+  int rank = H5Sget_simple_extent_ndims(space);
+  hsize_t dims[H5S_MAX_RANK];
+  H5Sget_simple_extent_dims(space, dims, NULL);
+  if(H5Tequal(type, other_type) <= 0 || H5Sextent_equal(space, other_space) <= 0){
+    goto done;
+  }
+  H5T_class_t type_class = H5Tget_class(type);
+  if(type_class != H5T_INTEGER && type_class != H5T_FLOAT){
+    /* Copied by HDF5 itself */
+    ret = 0;
+    goto done;
+  }
+  size_t frame = H5Tget_size(type);
+  for(int i = 1;i<rank;i++){
+    frame *= dims[i];
+  }
+  hsize_t total = rank ? dims[0] : 1;
+  hsize_t step = frame ? BLOCK_BYTES/frame : 1;
+  if(step < 1){
+    step = 1;
+  }
+  if(step > total){
+    step = total;
+  }
+  unsigned char * x = malloc(step*frame+1);
+  unsigned char * y = malloc(step*frame+1);
+  ret = x && y ? 0 : -1;
+  for(hsize_t first = 0;!ret && first<total;first += step){
+    hsize_t n = total-first < step ? total-first : step;
+    if(read_frames(a, type, rank, dims, first, n, x) || read_frames(b, type, rank, dims, first, n, y) ||
+       memcmp(x, y, n*frame)){
+      ret = -1;
+    }
+  }
+  free(x);
+  free(y);
+ done:
+  H5Tclose(type);
+  H5Tclose(other_type);
+  H5Sclose(space);
+  H5Sclose(other_space);
+  return ret;
+}
+
+static int compare_group(hid_t src, hid_t dst);
+
+static herr_t compare_link(hid_t src, const char * name, const H5L_info_t * info, void * data){
+  hid_t dst = *(hid_t *)data;
+  H5L_info_t other;
+  if(H5Lget_info(dst, name, &other, H5P_DEFAULT) < 0 || other.type != info->type){
+    return -1;
+  }
+  if(info->type != H5L_TYPE_HARD){
+    if(other.u.val_size != info->u.val_size){
+      return -1;
+    }
+    char * a = malloc(info->u.val_size);
+    char * b = malloc(info->u.val_size);
+    int differ = !a || !b || H5Lget_val(src, name, a, info->u.val_size, H5P_DEFAULT) < 0 ||
+      H5Lget_val(dst, name, b, info->u.val_size, H5P_DEFAULT) < 0 || memcmp(a, b, info->u.val_size);
+    free(a);
+    free(b);
+    return differ ? -1 : 0;
+  }
+  H5O_info_t object;
+  H5O_info_t copy;
+  if(H5Oget_info_by_name(src, name, &object, H5P_DEFAULT) < 0 ||
+     H5Oget_info_by_name(dst, name, &copy, H5P_DEFAULT) < 0 ||
+     object.type != copy.type || object.rc != copy.rc || object.num_attrs != copy.num_attrs){
+    return -1;
+  }
+  hid_t a = H5Oopen(src, name, H5P_DEFAULT);
+  hid_t b = H5Oopen(dst, name, H5P_DEFAULT);
+  int err = 0;
+  if(object.type == H5O_TYPE_GROUP){
+    err = compare_group(a, b);
+  }else if(object.type == H5O_TYPE_DATASET){
+    err = same_contents(a, b);
+  }
+  H5Oclose(a);
+  H5Oclose(b);
+  return err ? -1 : 0;
+}
+
+static int compare_group(hid_t src, hid_t dst){
+  H5G_info_t a;
+  H5G_info_t b;
+  if(H5Gget_info(src, &a) < 0 || H5Gget_info(dst, &b) < 0 || a.nlinks != b.nlinks){
+    return -1;
+  }
+  hsize_t index = 0;
+  return H5Literate(src, H5_INDEX_NAME, H5_ITER_INC, &index, compare_link, &dst) < 0 ? -1 : 0;
+}
+
+static int verify(const char * input, const char * output){
+  hid_t src = H5Fopen(input, H5F_ACC_RDONLY, H5P_DEFAULT);
+  hid_t dst = H5Fopen(output, H5F_ACC_RDONLY, H5P_DEFAULT);
+  int err = src < 0 || dst < 0 ? -1 : compare_group(src, dst);
+  if(src >= 0){
+    H5Fclose(src);
+  }
+  if(dst >= 0){
+    H5Fclose(dst);
+  }
+  if(err){
+    return -1;
+  }
+  /* And the library still finds the same tree */
+  CXI_File * a = cxi_open_file(input, "r");
+  CXI_File * b = cxi_open_file(output, "r");
+  err = !a || !b || a->entry_count != b->entry_count;
+  if(a){
+    cxi_close_file(a);
+  }
+  if(b){
+    cxi_close_file(b);
+  }
+  return err ? -1 : 0;
+}
+
+/* Files to rewrite */
+
+static char ** inputs;
+static int input_count;
+
+static int collect(const char * path, const struct stat * st, int flag, struct FTW * ftw){
+  (void)st;
+  (void)ftw;
+  if(flag != FTW_F){
+    return 0;
+  }
+  htri_t is_hdf5;
+  H5E_BEGIN_TRY{
+    is_hdf5 = H5Fis_hdf5(path);
+  }H5E_END_TRY;
+  if(is_hdf5 <= 0){
+    return 0;
+  }
+  char ** p = realloc(inputs, sizeof(char *)*(input_count+1));
+  if(!p){
+    return -1;
+  }
+  inputs = p;
+  inputs[input_count++] = strdup(path);
+  return 0;
+}
+
+static int by_name(const void * a, const void * b){
+  return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int make_parents(const char * path){
+  char * dir = strdup(path);
+  for(char * p = dir+1;p && *p;p++){
+    if(*p == '/'){
+      *p = 0;
+      if(mkdir(dir, 0777) && errno != EEXIST){
+	free(dir);
+	return -1;
+      }
+      *p = '/';
+    }
+  }
+  free(dir);
+  return 0;
+}
+
+static double file_size(const char * path){
+  struct stat st;
+  return stat(path, &st) ? 0 : st.st_size;
+}
+
+typedef struct{
+  int files;
+  int skipped;
+  int failed;
+  double in_bytes;
+  double out_bytes;
+  double data_bytes;
+  double seconds;
+}Totals;
+
+static int repack_file(const char * input, const char * output, Report * report, Totals * totals){
+  if(!opt.force && access(output, F_OK) == 0){
+    printf("%s: %s exists, skipped\n", input, output);
+    totals->skipped++;
+    return 0;
+  }
+  char * partial = malloc(strlen(output)+16);
+  sprintf(partial, "%s.partial", output);
+  double start = now();
+  report->rechunked = report->copied = 0;
+  report->data_bytes = 0;
+  int err = -1;
+  Walk walk = {-1, NULL, 0, report};
+  hid_t src = H5Fopen(input, H5F_ACC_RDONLY, H5P_DEFAULT);
+  if(src >= 0 && !make_parents(output)){
+    hid_t plist = H5Fget_create_plist(src);
+    walk.dst_file = H5Fcreate(partial, H5F_ACC_TRUNC, plist, H5P_DEFAULT);
+    H5Pclose(plist);
+    if(walk.dst_file >= 0){
+      hid_t src_root = H5Gopen(src, "/", H5P_DEFAULT);
+      hid_t dst_root = H5Gopen(walk.dst_file, "/", H5P_DEFAULT);
+      err = copy_group(src_root, dst_root, "/", &walk);
+      H5Gclose(dst_root);
+      H5Gclose(src_root);
+      if(H5Fclose(walk.dst_file) < 0){
+	err = -1;
+      }
+    }
+  }
+  if(src >= 0){
+    H5Fclose(src);
+  }
+  for(int i = 0;i<walk.shared_count;i++){
+    free(walk.shared[i].path);
+  }
+  free(walk.shared);
+  if(!err && opt.verify && verify(input, partial)){
+    fprintf(stderr, "cxi_repack: %s differs from %s\n", partial, input);
+    err = -1;
+  }
+  if(!err && rename(partial, output)){
+    err = -1;
+  }
+  if(err){
+    fprintf(stderr, "cxi_repack: could not rewrite %s\n", input);
+    remove(partial);
+    free(partial);
+    totals->failed++;
+    return -1;
+  }
+  free(partial);
+  double seconds = now()-start;
+  double in = file_size(input);
+  double out = file_size(output);
+  printf("%s: %d datasets rechunked, %d copied, %.1f MB -> %.1f MB, ratio %.2f, %.2f s, %.1f MB/s\n",
+	 input, report->rechunked, report->copied, in/1e6, out/1e6, out ? in/out : 0,
+	 seconds, seconds > 0 ? in/1e6/seconds : 0);
+  totals->files++;
+  totals->in_bytes += in;
+  totals->out_bytes += out;
+  totals->data_bytes += report->data_bytes;
+  totals->seconds += seconds;
+  return 0;
+}
+
+static void usage(void){
+  printf("Usage: cxi_repack [-j threads] [-z deflate level] [-c chunk bytes]\n");
+  printf("                  [-t min dataset bytes] [-f] [-v] <input> <output>\n");
+}
+
+int main(int argc, char ** argv){
+  int i = 1;
+  for(;i<argc && argv[i][0] == '-';i++){
+    if(!argv[i][1] || argv[i][2]){
+      usage();
+      return 1;
+    }
+    if(argv[i][1] == 'f'){
+      opt.force = 1;
+      continue;
+    }
+    if(argv[i][1] == 'v'){
+      opt.verify = 1;
+      continue;
+    }
+    if(i+1 == argc){
+      usage();
+      return 1;
+    }
+    char * v = argv[++i];
+    switch(argv[i-1][1]){
+    case 'j': opt.threads = atoi(v); break;
+    case 'z': opt.level = atoi(v); break;
+    case 'c': opt.chunk_bytes = atol(v); break;
+    case 't': opt.min_bytes = atol(v); break;
+    default: usage(); return 1;
+    }
+  }
+  if(argc-i != 2 || opt.threads < 0 || opt.level < 0 || opt.level > 9 || opt.chunk_bytes < 1){
+    usage();
+    return 1;
+  }
+  const char * input = argv[i];
+  const char * output = argv[i+1];
+  if(!opt.threads){
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    opt.threads = n > 0 ? n : 1;
+  }
+  struct stat st;
+  if(stat(input, &st)){
+    fprintf(stderr, "cxi_repack: cannot read %s\n", input);
+    return 1;
+  }
+  int tree = S_ISDIR(st.st_mode);
+  if(tree){
+    if(nftw(input, collect, 32, FTW_PHYS)){
+      fprintf(stderr, "cxi_repack: cannot walk %s\n", input);
+      return 1;
+    }
+    qsort(inputs, input_count, sizeof(char *), by_name);
+  }else{
+    collect(input, &st, FTW_F, NULL);
+  }
+  if(!input_count){
+    fprintf(stderr, "cxi_repack: no HDF5 files in %s\n", input);
+    return 1;
+  }
+
+  Report report;
+  memset(&report, 0, sizeof(report));
+  if(start_encoders(&report.encoders, opt.threads)){
+    fprintf(stderr, "cxi_repack: cannot start threads\n");
+    return 1;
+  }
+  Totals totals;
+  memset(&totals, 0, sizeof(totals));
+  size_t skip = strlen(input);
+  for(int f = 0;f<input_count;f++){
+    char * target;
+    if(tree){
+      target = malloc(strlen(output)+strlen(inputs[f]+skip)+2);
+      sprintf(target, "%s/%s", output, inputs[f]+skip+(inputs[f][skip] == '/'));
+    }else{
+      target = strdup(output);
+    }
+    repack_file(inputs[f], target, &report, &totals);
+    free(target);
+    free(inputs[f]);
+  }
+  free(inputs);
+  stop_encoders(&report.encoders);
+  printf("%d files rewritten, %d skipped, %d failed: %.1f MB -> %.1f MB, ratio %.2f, %.2f s, %.1f MB/s\n",
+	 totals.files, totals.skipped, totals.failed, totals.in_bytes/1e6, totals.out_bytes/1e6,
+	 totals.out_bytes ? totals.in_bytes/totals.out_bytes : 0, totals.seconds,
+	 totals.seconds > 0 ? totals.in_bytes/1e6/totals.seconds : 0);
+  return totals.failed ? 1 : 0;
+}